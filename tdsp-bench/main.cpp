@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "capture_log.h"
+#include "receiver_service.h"
+#include "reliable_upload.h"
+#include "replay.h"
+#include "sample_image.h"
+#include "send_pipeline.h"
+#include "upload.h"
+#include "word_lz.h"
+
+using boost::asio::ip::udp;
+
+struct Options {
+    size_t count = 200000;
+    size_t words = 1 << 22;
+    size_t window_size = 64;
+    double loss_rate = 0.0;
+    // Raw image of little-endian words for the program upload rows; generated if empty.
+    std::string image;
+    // Pacing for the program upload rows, to emulate a slower device; zero is unpaced.
+    double rate = 0;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t packets = 0;
+    size_t words = 0;
+    size_t lost = 0;
+    double seconds = 0;
+    std::vector<double> latencies_us;
+    bool ok = true;
+};
+
+static std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            options.count = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--words") == 0 && i + 1 < argc) {
+            options.words = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            options.window_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            options.loss_rate = std::strtod(argv[++i], nullptr) / 100.0;
+        } else if (std::strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            options.image = argv[++i];
+        } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            options.rate = std::strtod(argv[++i], nullptr);
+        } else {
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+static double Percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static udp::endpoint Loopback() {
+    return udp::endpoint(boost::asio::ip::address_v4::loopback(), 0);
+}
+
+// Sends `count` two-word instructions through the interactive pipeline. Each instruction is
+// tagged with its index so the receiver side can compute send-to-receive latency.
+static BenchResult RunPipeline(const Options& options, bool batch) {
+    BenchResult result;
+    result.name = batch ? "batch" : "single";
+
+    ReceiverService receiver{Loopback(), 0.0, 1, true};
+    boost::asio::io_service io_service;
+    udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+
+    std::vector<TransferClock::time_point> sent_at(options.count);
+    const auto start = TransferClock::now();
+    {
+        SendPipeline pipeline{io_service, socket, receiver.Endpoint(), batch, std::chrono::milliseconds{1}};
+        for (size_t i = 0; i < options.count; i++) {
+            sent_at[i] = TransferClock::now();
+            pipeline.Send({static_cast<std::uint16_t>(i), static_cast<std::uint16_t>(i >> 16)});
+        }
+        pipeline.Finish();
+    }
+
+    // Loopback can still drop datagrams if the receiver falls behind; stop waiting once
+    // nothing has arrived for a while.
+    size_t instructions = 0;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        const size_t now_received = receiver.GetCounters().instructions;
+        if (now_received >= options.count || now_received == instructions)
+            break;
+        instructions = now_received;
+    }
+
+    const DspReceiver snapshot = receiver.Snapshot();
+    for (const auto& packet : snapshot.Log()) {
+        if (packet.tag < sent_at.size()) {
+            const std::chrono::duration<double, std::micro> latency = packet.arrival - sent_at[packet.tag];
+            result.latencies_us.push_back(latency.count());
+        }
+    }
+
+    result.packets = snapshot.PacketCount();
+    result.words = snapshot.PayloadWordCount();
+    result.lost = options.count - snapshot.InstructionCount();
+    if (!snapshot.Log().empty()) {
+        result.seconds = std::chrono::duration<double>(snapshot.Log().back().arrival - start).count();
+    }
+    return result;
+}
+
+static BenchResult RunUpload(const Options& options, bool reliable) {
+    BenchResult result;
+    result.name = reliable ? "reliable" : "upload";
+
+    const std::vector<std::uint16_t> image = MakeNoiseImage(options.words);
+
+    ReceiverService receiver{Loopback(), reliable ? options.loss_rate : 0.0, 1, true};
+    boost::asio::io_service io_service;
+    udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+
+    const auto start = TransferClock::now();
+    UploadStats stats;
+    if (reliable) {
+        stats = ReliableUpload(io_service, socket, receiver.Endpoint(), image.data(), image.size(),
+                               ReliableUploadOptions{options.window_size});
+    } else {
+        stats = StreamImage(socket, receiver.Endpoint(), image.data(), image.size());
+    }
+
+    const auto received = receiver.WaitForImage(std::chrono::milliseconds{200});
+    const DspReceiver snapshot = receiver.Snapshot();
+
+    result.packets = snapshot.PacketCount();
+    result.words = snapshot.PayloadWordCount();
+    result.lost = stats.datagrams > snapshot.PacketCount() ? stats.datagrams - snapshot.PacketCount() : 0;
+    if (!snapshot.Log().empty()) {
+        result.seconds = std::chrono::duration<double>(snapshot.Log().back().arrival - start).count();
+    }
+    if (reliable) {
+        result.ok = stats.complete && received && *received == image;
+    }
+    return result;
+}
+
+// Records the unreliable upload, then replays the log as fast as possible to a fresh receiver,
+// which shows what batching the sends with sendmmsg gains over one send per datagram.
+static BenchResult RunReplay(const Options& options) {
+    BenchResult result;
+    result.name = "replay";
+
+    const std::vector<std::uint16_t> image = MakeNoiseImage(options.words);
+    const std::string path = "tdsp-bench-replay.cap";
+    {
+        ReceiverService receiver{Loopback(), 0.0};
+        boost::asio::io_service io_service;
+        udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+        auto capture = CaptureWriter::Create(path);
+        if (!capture) {
+            result.ok = false;
+            return result;
+        }
+        StreamImage(socket, receiver.Endpoint(), image.data(), image.size(), 0, 0, capture.get());
+        result.ok = capture->Flush();
+    }
+    const auto log = LoadCaptureLog(path);
+    std::remove(path.c_str());
+    if (!log) {
+        result.ok = false;
+        return result;
+    }
+
+    ReceiverService receiver{Loopback(), 0.0, 1, true};
+    boost::asio::io_service io_service;
+    udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+
+    const auto start = TransferClock::now();
+    const auto stats = Replay(socket, *log, {receiver.Endpoint()}, true);
+    receiver.WaitForImage(std::chrono::milliseconds{200});
+    const DspReceiver snapshot = receiver.Snapshot();
+
+    result.packets = snapshot.PacketCount();
+    result.words = snapshot.PayloadWordCount();
+    result.lost = stats.datagrams > snapshot.PacketCount() ? stats.datagrams - snapshot.PacketCount() : 0;
+    if (!snapshot.Log().empty()) {
+        result.seconds = std::chrono::duration<double>(snapshot.Log().back().arrival - start).count();
+    }
+    result.ok = result.ok && stats.errors == 0;
+    return result;
+}
+
+static std::optional<std::vector<std::uint16_t>> LoadProgramImage(const Options& options) {
+    if (options.image.empty())
+        return MakeProgramImage(options.words);
+
+    std::ifstream file{options.image, std::ios::binary};
+    std::vector<char> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (!file.eof() || bytes.size() % sizeof(std::uint16_t) != 0)
+        return std::nullopt;
+    std::vector<std::uint16_t> image(bytes.size() / sizeof(std::uint16_t));
+    std::memcpy(image.data(), bytes.data(), bytes.size());
+    return image;
+}
+
+static double Milliseconds(TransferClock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static void PrintCompression(const std::vector<std::uint16_t>& image) {
+    const auto start = TransferClock::now();
+    const auto stream = LzCompress(image.data(), image.size());
+    const auto compressed = TransferClock::now();
+    const auto decompressed = LzDecompress(stream.data(), stream.size());
+    const auto end = TransferClock::now();
+
+    const double megabytes = image.size() * sizeof(std::uint16_t) / 1e6;
+    printf("lz: %zu words to %zu (%.1f%%), compress %.1f MB/s, decompress %.1f MB/s%s\n",
+           image.size(), stream.size(), 100.0 * stream.size() / std::max<size_t>(1, image.size()),
+           megabytes / std::max(1e-9, Milliseconds(compressed - start) / 1000),
+           megabytes / std::max(1e-9, Milliseconds(end - compressed) / 1000),
+           decompressed && *decompressed == image ? "" : "  FAILED");
+}
+
+// Reliable upload of a program image, optionally compressed. Time runs from before
+// compression until the receiver holds the decompressed image, and words/s counts image words.
+static BenchResult RunProgramUpload(const Options& options, const std::vector<std::uint16_t>& image, bool compress) {
+    BenchResult result;
+    result.name = compress ? "prog-lz" : "prog";
+
+    ReceiverService receiver{Loopback(), options.loss_rate};
+    boost::asio::io_service io_service;
+    udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+
+    ReliableUploadOptions transfer{options.window_size};
+    transfer.rate = options.rate;
+
+    const auto start = TransferClock::now();
+    std::vector<std::uint16_t> stream;
+    if (compress) {
+        stream = LzCompress(image.data(), image.size());
+        transfer.chunk_flags = chunk_flag_compressed;
+    }
+    const std::vector<std::uint16_t>& sent = compress ? stream : image;
+    const auto stats = ReliableUpload(io_service, socket, receiver.Endpoint(), sent.data(), sent.size(), transfer);
+    const auto received = receiver.WaitForImage(std::chrono::milliseconds{200});
+
+    result.seconds = std::chrono::duration<double>(TransferClock::now() - start).count();
+    result.packets = receiver.GetCounters().packets;
+    result.words = image.size();
+    result.lost = stats.retransmissions;
+    result.ok = stats.complete && received && *received == image;
+    return result;
+}
+
+static void PrintResult(const BenchResult& result) {
+    const double seconds = std::max(result.seconds, 1e-9);
+    printf("%-9s %10zu %12.0f %12.0f %8zu",
+           result.name.c_str(), result.packets, result.packets / seconds, result.words / seconds, result.lost);
+    if (!result.latencies_us.empty()) {
+        printf(" %9.1f %9.1f", Percentile(result.latencies_us, 0.50), Percentile(result.latencies_us, 0.99));
+    } else {
+        printf(" %9s %9s", "-", "-");
+    }
+    printf("%s\n", result.ok ? "" : "  FAILED");
+}
+
+int main(int argc, char** argv) {
+    const auto options = ParseOptions(argc, argv);
+    if (!options) {
+        printf("Usage: program [--count <instructions>] [--words <upload words>] [--window <chunks>] [--loss <percent>]\n");
+        printf("               [--image <file>] [--rate <datagrams/s>]\n");
+        printf("Measures the sender over loopback against an in-process receiver stand-in.\n");
+        printf("--loss only applies to the reliable uploads. The prog rows upload --image, or a generated\n");
+        printf("program-shaped image of --words, with and without compression, paced at --rate. The replay\n");
+        printf("row resends a recording of the upload row in batches.\n");
+        return 1;
+    }
+
+    const auto program = LoadProgramImage(*options);
+    if (!program) {
+        printf("Could not read %s.\n", options->image.c_str());
+        return 1;
+    }
+
+    printf("%-9s %10s %12s %12s %8s %9s %9s\n", "format", "packets", "packets/s", "words/s", "lost", "p50 us", "p99 us");
+
+    bool ok = true;
+    for (const BenchResult& result : {RunPipeline(*options, false), RunPipeline(*options, true),
+                                      RunUpload(*options, false), RunUpload(*options, true), RunReplay(*options),
+                                      RunProgramUpload(*options, *program, false),
+                                      RunProgramUpload(*options, *program, true)}) {
+        PrintResult(result);
+        ok = ok && result.ok;
+    }
+    PrintCompression(*program);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <vector>
+
+#include "assembler.h"
+#include "emu_core.h"
+#include "emu_lockstep.h"
+
+struct Options {
+    // Cycles each dispatch mode runs for, and the lockstep instances run for between them.
+    std::uint64_t cycles = 10000000;
+};
+
+// Runs `source` for `cycles` in each dispatch mode and prints their speeds.
+static bool PrintProgramBench(const char* name, const char* text, std::uint64_t cycles) {
+    std::istringstream source{text};
+    const auto program = AssembleProgram(BuildParserTable(), source);
+
+    DspEmulator emulators[3];
+    double seconds[3];
+    const DispatchMode modes[3]{DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit};
+    for (size_t i = 0; i < 3; i++) {
+        emulators[i].SetDispatchMode(modes[i]);
+        emulators[i].LoadProgram(program.words.data(), program.words.size());
+        const auto start = std::chrono::steady_clock::now();
+        emulators[i].Run(cycles);
+        seconds[i] = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    bool ok = program.errors.empty();
+    for (size_t i = 1; i < 3; i++) {
+        const DspState& a = emulators[0].State();
+        const DspState& b = emulators[i].State();
+        ok = ok && a.acc == b.acc && a.r == b.r && a.pc == b.pc && emulators[0].Cycles() == emulators[i].Cycles();
+    }
+    printf("emu %s: %llu cycles, switch %.1f M/s, block %.1f M/s (%.1fx), jit %.1f M/s (%.1fx)%s\n",
+           name, static_cast<unsigned long long>(cycles), cycles / seconds[0] / 1e6, cycles / seconds[1] / 1e6,
+           seconds[0] / seconds[1], cycles / seconds[2] / 1e6, seconds[0] / seconds[2], ok ? "" : "  FAILED");
+    return ok;
+}
+
+// Runs `source` on 16 instances for `cycles` between them, one emulator after another and then in
+// lockstep, and prints both speeds in instance cycles.
+static bool PrintLockstepBench(const char* name, const char* text, std::uint64_t cycles) {
+    std::istringstream source{text};
+    const auto program = AssembleProgram(BuildParserTable(), source);
+    constexpr size_t instances = 16;
+    const std::uint64_t each = cycles / instances;
+
+    std::vector<DspEmulator> emulators(instances);
+    for (DspEmulator& emulator : emulators) {
+        emulator.LoadProgram(program.words.data(), program.words.size());
+    }
+    DspLockstep lockstep{instances};
+    lockstep.LoadProgram(program.words.data(), program.words.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    for (DspEmulator& emulator : emulators) {
+        emulator.Run(each);
+    }
+    const auto middle = std::chrono::steady_clock::now();
+    lockstep.Run(each);
+    const double block = std::max(1e-9, std::chrono::duration<double>(middle - start).count());
+    const double together = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - middle).count());
+
+    bool ok = program.errors.empty();
+    for (size_t i = 0; i < instances; i++) {
+        const DspState state = lockstep.State(i);
+        ok = ok && lockstep.InLockstep(i) && state.acc == emulators[i].State().acc && state.r == emulators[i].State().r &&
+             lockstep.Cycles(i) == emulators[i].Cycles();
+    }
+    const double total = static_cast<double>(each * instances);
+    printf("emu %s x%zu: %llu cycles, block %.1f M/s, lockstep %.1f M/s (%.1fx)%s\n",
+           name, instances, static_cast<unsigned long long>(each * instances), total / block / 1e6,
+           total / together / 1e6, block / together, ok ? "" : "  FAILED");
+    return ok;
+}
+
+static std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            options.cycles = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    const auto options = ParseOptions(argc, argv);
+    if (!options) {
+        printf("Usage: tdsp-emu-bench [--cycles <emulator cycles>]\n");
+        printf("Runs a multiply-accumulate loop and a filter in the emulator for --cycles with each dispatch\n");
+        printf("mode, and the filter in lockstep across instances, and prints their speeds. Block mode only\n");
+        printf("saves dispatch overhead, so it gains little where the handlers dominate; jit is the fast mode.\n");
+        return 1;
+    }
+
+    // A 16-tap filter under rep and a straight-line block repeat, as DSP inner loops are.
+    const char* const fir = "mov 0x100, r1\nmov 0x200, r0\n"
+                            "bkrep 200, 10\nclr 0, a0, true\nmov [r0], y0 || r0+1\nrep 14\nmac y0, [r0], a0 || r0+1\n"
+                            "mov a0h, [r1] || r1+1\n"
+                            "bkrep 63, 14\nmov [r0], b0 || r0-1\nadd b0, a1\nbr 2, true";
+    bool ok = PrintProgramBench("mac",
+        "mov 0x100, r0\nmov 0x7fff, a1h\n"
+        "mov [r0], y0 || r0+1\nmac y0, [r0], a0 || r0+1\nadd a0, b0\nmov a0l, [r1] || r1+1\n"
+        "xor 0x55, a0\ndec 1, a1, true\nbrr -8, neq\ntrap",
+        options->cycles);
+    ok = PrintProgramBench("fir", fir, options->cycles) && ok;
+    ok = PrintLockstepBench("fir", fir, options->cycles) && ok;
+    return ok ? 0 : 1;
+}
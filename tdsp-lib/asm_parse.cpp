@@ -59,6 +59,10 @@ static const std::string instruction_table =
 #include "instruction_table.inc"
 ;
 
+const std::string& InstructionTableSource() {
+    return instruction_table;
+}
+
 std::vector<InstructionParser> BuildParserTable() {
     std::vector<InstructionParser> table;
 
@@ -88,7 +92,9 @@ std::vector<InstructionParser> BuildParserTable() {
             };
 
             const auto parse_at_bit_pos = [&]() -> size_t {
-                assert(lexer.NextToken().type == InstructionTableToken::AT);
+                const auto at = lexer.NextToken();
+                assert(at.type == InstructionTableToken::AT);
+                (void)at;
                 if (str_starts_with(lexer.PeekToken().payload, "not")) {
                     invert = true;
                     return std::strtol(lexer.NextToken().payload.c_str() + 3, nullptr, 10);
@@ -121,7 +127,9 @@ std::vector<InstructionParser> BuildParserTable() {
                 // Ignore
                 continue;
             } else if (token.payload == "NoReverse") {
-                assert(lexer.NextToken().payload == ",");
+                const auto comma = lexer.NextToken();
+                assert(comma.payload == ",");
+                (void)comma;
                 continue;
             } else if (str_starts_with(token.payload, "Unused")) {
                 parse_at_bit_pos(); // Ignore
@@ -188,7 +196,9 @@ std::vector<InstructionParser> BuildParserTable() {
             } else if (token.payload == "Address16") {
                 part_list.emplace_back(std::make_shared<Address16>(parse_at_bit_pos()));
             } else if (token.payload == "Address18") {
-                assert(parse_at_bit_pos() == 16 && !invert);
+                const size_t position = parse_at_bit_pos();
+                assert(position == 16 && !invert);
+                (void)position;
                 assert(str_starts_with(lexer.PeekToken().payload, "and"));
                 const size_t i = std::strtol(lexer.NextToken().payload.c_str() + 3, nullptr, 10);
                 part_list.emplace_back(std::make_shared<Address18>(i));
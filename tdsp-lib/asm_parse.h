@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include "part_parse_result.h"
@@ -25,3 +26,6 @@ private:
 };
 
 std::vector<InstructionParser> BuildParserTable();
+
+// The text of the instruction table both the parser table and the emulator's decoder are built from.
+const std::string& InstructionTableSource();
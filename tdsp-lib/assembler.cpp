@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <variant>
+
+#include "assembler.h"
+
+std::optional<std::vector<std::uint16_t>> AssembleLine(const std::vector<InstructionParser>& table, const TokenList& line) {
+    for (auto& parser : table) {
+        if (auto result = parser.TryParse(line)) {
+            return result;
+        }
+    }
+    return std::nullopt;
+}
+
+AssembledProgram AssembleProgram(const std::vector<InstructionParser>& table, std::istream& source, StageTimings* timings) {
+    AssembledProgram program;
+    AsmLexer lexer{source};
+
+    for (size_t line_number = 1;; line_number++) {
+        std::optional<TokenList> line;
+        {
+            StageTimer timer{timings, SenderStage::Lex};
+            line = GetLine(lexer);
+        }
+
+        if (!line) {
+            program.errors.push_back({line_number, "Error during lex."});
+
+            while (true) {
+                auto token = lexer.NextToken();
+                if (std::holds_alternative<AsmToken::EndOfFile>(token))
+                    return program;
+                if (std::holds_alternative<AsmToken::EndOfLine>(token))
+                    break;
+            }
+
+            continue;
+        }
+
+        // A label names the address of what follows it.
+        if (line->size() >= 2 && std::holds_alternative<AsmToken::Identifier>(line->front()) &&
+            std::holds_alternative<AsmToken::Colon>(*std::next(line->begin()))) {
+            std::string name = std::get<AsmToken::Identifier>(line->front()).value;
+            line->erase(line->begin(), std::next(line->begin(), 2));
+            const bool defined = std::any_of(program.symbols.begin(), program.symbols.end(),
+                                             [&](const AsmSymbol& symbol) { return symbol.name == name; });
+            if (defined) {
+                program.errors.push_back({line_number, "Duplicate label."});
+            } else {
+                program.symbols.push_back({std::move(name), static_cast<std::uint32_t>(program.words.size())});
+            }
+        }
+
+        if (!line->empty()) {
+            std::optional<std::vector<std::uint16_t>> result;
+            {
+                StageTimer timer{timings, SenderStage::Lookup};
+                result = AssembleLine(table, *line);
+            }
+            if (result) {
+                program.words.insert(program.words.end(), result->begin(), result->end());
+            } else {
+                program.errors.push_back({line_number, "Failed to parse."});
+            }
+        }
+
+        if (std::holds_alternative<AsmToken::EndOfFile>(lexer.PeekToken())) {
+            return program;
+        }
+    }
+}
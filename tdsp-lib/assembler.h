@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "asm_lexer.h"
+#include "asm_parse.h"
+#include "stage_timing.h"
+
+struct AssemblyError {
+    size_t line;
+    std::string message;
+};
+
+// A label, defined by starting a line with `name:`.
+struct AsmSymbol {
+    std::string name;
+    std::uint32_t address;
+};
+
+struct AssembledProgram {
+    std::vector<std::uint16_t> words;
+    std::vector<AssemblyError> errors;
+    // In address order.
+    std::vector<AsmSymbol> symbols;
+};
+
+// Encodes one line using the first matching parser in the table.
+std::optional<std::vector<std::uint16_t>> AssembleLine(const std::vector<InstructionParser>& table, const TokenList& line);
+
+// Assembles a whole source file into a flat program image. Lines that fail to lex or parse
+// are reported in `errors` and skipped, as are labels defined twice. Lexing and table lookup are timed into `timings` if given.
+AssembledProgram AssembleProgram(const std::vector<InstructionParser>& table, std::istream& source,
+                                 StageTimings* timings = nullptr);
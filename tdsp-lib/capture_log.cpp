@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "capture_log.h"
+#include "varint.h"
+
+constexpr char capture_magic[8] = {'T', 'D', 'S', 'P', 'C', 'A', 'P', '1'};
+
+std::unique_ptr<CaptureWriter> CaptureWriter::Create(const std::string& path) {
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file)
+        return nullptr;
+    file.write(capture_magic, sizeof(capture_magic));
+    return std::unique_ptr<CaptureWriter>(new CaptureWriter(std::move(file)));
+}
+
+void CaptureWriter::Record(CaptureClock::time_point time, std::uint32_t target, const void* data, size_t size,
+                           const void* data2, size_t size2) {
+    std::lock_guard<std::mutex> lock{mutex};
+
+    const auto delta = last_time && time > *last_time ? time - *last_time : CaptureClock::duration{};
+    last_time = std::max(time, last_time.value_or(time));
+
+    PutVarint(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(delta).count()), buffer);
+    PutVarint(target, buffer);
+    PutVarint(size + size2, buffer);
+    buffer.insert(buffer.end(), static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+    if (size2 != 0) {
+        buffer.insert(buffer.end(), static_cast<const unsigned char*>(data2), static_cast<const unsigned char*>(data2) + size2);
+    }
+    datagrams++;
+
+    // Write in large pieces so recording does not slow the sender down.
+    if (buffer.size() >= (1 << 16)) {
+        file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        buffer.clear();
+    }
+}
+
+bool CaptureWriter::Flush() {
+    std::lock_guard<std::mutex> lock{mutex};
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    buffer.clear();
+    file.flush();
+    return static_cast<bool>(file);
+}
+
+std::optional<CaptureLog> LoadCaptureLog(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        return std::nullopt;
+    const std::vector<unsigned char> contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (contents.size() < sizeof(capture_magic) || std::memcmp(contents.data(), capture_magic, sizeof(capture_magic)) != 0)
+        return std::nullopt;
+
+    CaptureLog log;
+    log.data.reserve(contents.size());
+    std::chrono::nanoseconds time{0};
+    size_t position = sizeof(capture_magic);
+    while (position < contents.size()) {
+        const auto delta = GetVarint(contents.data(), contents.size(), position);
+        const auto target = GetVarint(contents.data(), contents.size(), position);
+        const auto size = GetVarint(contents.data(), contents.size(), position);
+        if (!delta || !target || !size || *target > 0xFFFFFFFF || *size > contents.size() - position)
+            return std::nullopt;
+
+        time += std::chrono::nanoseconds{*delta};
+        log.datagrams.push_back({time, static_cast<std::uint32_t>(*target), log.data.size(), static_cast<size_t>(*size)});
+        log.data.insert(log.data.end(), contents.begin() + position, contents.begin() + position + *size);
+        log.target_count = std::max(log.target_count, static_cast<std::uint32_t>(*target) + 1);
+        position += *size;
+    }
+    return log;
+}
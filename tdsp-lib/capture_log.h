@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Binary log of the datagrams a sender put on the wire, for replaying them later.
+//
+// "TDSPCAP1", then one record per datagram:
+//   [nanoseconds since the previous record] [target] [bytes] [datagram bytes...]
+// where the first three fields are LEB128 varints. `target` numbers the destinations of one
+// session (0 for a single endpoint), so a replay can map them onto other endpoints.
+
+using CaptureClock = std::chrono::steady_clock;
+
+class CaptureWriter {
+public:
+    // Returns nullptr if the file cannot be created.
+    static std::unique_ptr<CaptureWriter> Create(const std::string& path);
+
+    // Thread-safe. A datagram may be given in two pieces, e.g. a header and a payload.
+    void Record(CaptureClock::time_point time, std::uint32_t target, const void* data, size_t size,
+                const void* data2 = nullptr, size_t size2 = 0);
+
+    size_t DatagramCount() const { return datagrams; }
+    // Flushes everything recorded so far; returns false if any write failed.
+    bool Flush();
+
+private:
+    explicit CaptureWriter(std::ofstream file) : file(std::move(file)) {}
+
+    std::mutex mutex;
+    std::ofstream file;
+    std::optional<CaptureClock::time_point> last_time;
+    std::vector<unsigned char> buffer;
+    size_t datagrams = 0;
+};
+
+struct CaptureLog {
+    struct Datagram {
+        // Since the first datagram.
+        std::chrono::nanoseconds time;
+        std::uint32_t target;
+        size_t offset;
+        size_t size;
+    };
+
+    // Datagram bytes, back to back.
+    std::vector<unsigned char> data;
+    std::vector<Datagram> datagrams;
+    std::uint32_t target_count = 0;
+
+    const unsigned char* Bytes(const Datagram& datagram) const { return data.data() + datagram.offset; }
+};
+
+// Returns std::nullopt if the file cannot be read or is not a valid log.
+std::optional<CaptureLog> LoadCaptureLog(const std::string& path);
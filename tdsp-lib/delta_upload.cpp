@@ -0,0 +1,69 @@
+#include <cstring>
+#include <fstream>
+
+#include "delta_upload.h"
+#include "transfer.h"
+
+constexpr char record_magic[8] = {'T', 'D', 'S', 'P', 'R', 'E', 'C', '1'};
+
+UploadRecord MakeUploadRecord(const std::uint16_t* image, size_t word_count) {
+    const Sha256Tree tree = MakeImageTree(image, word_count);
+
+    UploadRecord record;
+    record.total_words = static_cast<std::uint32_t>(word_count);
+    record.root = tree.Root();
+    record.chunk_hashes = tree.LeafHashes();
+    return record;
+}
+
+std::optional<UploadRecord> LoadUploadRecord(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        return std::nullopt;
+
+    char magic[sizeof(record_magic)];
+    UploadRecord record;
+    std::uint32_t chunk_count = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&record.total_words), sizeof(record.total_words));
+    file.read(reinterpret_cast<char*>(&chunk_count), sizeof(chunk_count));
+    file.read(reinterpret_cast<char*>(record.root.data()), record.root.size());
+    if (!file || std::memcmp(magic, record_magic, sizeof(magic)) != 0 || chunk_count != ChunkCountFor(record.total_words))
+        return std::nullopt;
+
+    record.chunk_hashes.resize(chunk_count);
+    file.read(reinterpret_cast<char*>(record.chunk_hashes.data()), chunk_count * sizeof(Sha256Tree::Hash));
+    if (!file)
+        return std::nullopt;
+    return record;
+}
+
+bool SaveUploadRecord(const std::string& path, const UploadRecord& record) {
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    const std::uint32_t chunk_count = static_cast<std::uint32_t>(record.chunk_hashes.size());
+    file.write(record_magic, sizeof(record_magic));
+    file.write(reinterpret_cast<const char*>(&record.total_words), sizeof(record.total_words));
+    file.write(reinterpret_cast<const char*>(&chunk_count), sizeof(chunk_count));
+    file.write(reinterpret_cast<const char*>(record.root.data()), record.root.size());
+    file.write(reinterpret_cast<const char*>(record.chunk_hashes.data()), chunk_count * sizeof(Sha256Tree::Hash));
+    return static_cast<bool>(file);
+}
+
+Manifest PlanUpload(const UploadRecord& next, const std::optional<UploadRecord>& previous) {
+    Manifest manifest;
+    manifest.total_words = next.total_words;
+    manifest.root = next.root;
+
+    if (!previous || next.chunk_hashes.size() > max_manifest_bitmap_bits)
+        return manifest;
+
+    manifest.flags = manifest_flag_delta;
+    manifest.base_root = previous->root;
+    // Chunk boundaries do not depend on the image size, so chunks are compared pairwise; any
+    // chunk past the end of the previous image is new.
+    manifest.changed.resize(next.chunk_hashes.size());
+    for (size_t i = 0; i < next.chunk_hashes.size(); i++) {
+        manifest.changed[i] = i >= previous->chunk_hashes.size() || next.chunk_hashes[i] != previous->chunk_hashes[i];
+    }
+    return manifest;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "dsp_protocol.h"
+#include "sha256_tree.h"
+
+// What the sender remembers about the last image uploaded to an endpoint: the hash of every
+// chunk, so the next upload can send only the chunks that changed.
+struct UploadRecord {
+    std::uint32_t total_words = 0;
+    Sha256Tree::Hash root{};
+    std::vector<Sha256Tree::Hash> chunk_hashes;
+};
+
+UploadRecord MakeUploadRecord(const std::uint16_t* image, size_t word_count);
+
+// Returns std::nullopt if the file does not exist or is not a valid record.
+std::optional<UploadRecord> LoadUploadRecord(const std::string& path);
+bool SaveUploadRecord(const std::string& path, const UploadRecord& record);
+
+// The manifest for uploading `next` to a receiver that holds `previous`: a delta listing the
+// changed chunks when possible, otherwise a full upload.
+Manifest PlanUpload(const UploadRecord& next, const std::optional<UploadRecord>& previous);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "dsp_protocol.h"
+
+size_t ChunkCountFor(size_t word_count) {
+    return std::max<size_t>(1, (word_count + max_chunk_payload_words - 1) / max_chunk_payload_words);
+}
+
+std::vector<std::uint16_t> EncodeSingle(const std::vector<std::uint16_t>& instruction) {
+    std::vector<std::uint16_t> message;
+    message.reserve(1 + instruction.size());
+    message.push_back(message_single);
+    message.insert(message.end(), instruction.begin(), instruction.end());
+    return message;
+}
+
+BatchEncoder::BatchEncoder(size_t max_size_in_bytes) : max_words(max_size_in_bytes / sizeof(std::uint16_t)) {
+    assert(max_words > 2);
+    message.reserve(max_words);
+    Clear();
+}
+
+bool BatchEncoder::TryAppend(const std::vector<std::uint16_t>& instruction) {
+    if (message.size() + 1 + instruction.size() > max_words)
+        return false;
+
+    message.push_back(static_cast<std::uint16_t>(instruction.size()));
+    message.insert(message.end(), instruction.begin(), instruction.end());
+    message[1] = static_cast<std::uint16_t>(++instruction_count);
+    return true;
+}
+
+void BatchEncoder::Clear() {
+    instruction_count = 0;
+    message.clear();
+    message.push_back(message_batch);
+    message.push_back(0);
+}
+
+std::optional<std::vector<std::vector<std::uint16_t>>> DecodeInstructions(const std::uint16_t* words, size_t word_count) {
+    if (word_count == 0)
+        return std::nullopt;
+
+    if (words[0] == message_single) {
+        if (word_count < 2)
+            return std::nullopt;
+        return std::vector<std::vector<std::uint16_t>>{{words + 1, words + word_count}};
+    }
+
+    if (words[0] != message_batch || word_count < 2)
+        return std::nullopt;
+
+    std::vector<std::vector<std::uint16_t>> result;
+    size_t pos = 2;
+    for (size_t i = 0; i < words[1]; i++) {
+        if (pos >= word_count)
+            return std::nullopt;
+        const size_t length = words[pos++];
+        if (length == 0 || pos + length > word_count)
+            return std::nullopt;
+        result.emplace_back(words + pos, words + pos + length);
+        pos += length;
+    }
+    if (pos != word_count)
+        return std::nullopt;
+
+    return result;
+}
+
+void EncodeChunk(const ChunkHeader& header, const std::uint16_t* payload, size_t payload_words,
+                 std::vector<std::uint16_t>& out) {
+    assert(payload_words <= max_chunk_payload_words);
+
+    out.resize(chunk_header_words + payload_words);
+    EncodeChunkHeader(header, out.data());
+    std::copy(payload, payload + payload_words, out.begin() + chunk_header_words);
+}
+
+void EncodeChunkHeader(const ChunkHeader& header, std::uint16_t* out) {
+    out[0] = message_chunk;
+    out[1] = header.flags;
+    out[2] = static_cast<std::uint16_t>(header.sequence);
+    out[3] = static_cast<std::uint16_t>(header.sequence >> 16);
+    out[4] = static_cast<std::uint16_t>(header.offset);
+    out[5] = static_cast<std::uint16_t>(header.offset >> 16);
+    out[6] = static_cast<std::uint16_t>(header.total_words);
+    out[7] = static_cast<std::uint16_t>(header.total_words >> 16);
+}
+
+std::optional<ChunkHeader> DecodeChunkHeader(const std::uint16_t* words, size_t word_count) {
+    if (word_count < chunk_header_words || words[0] != message_chunk)
+        return std::nullopt;
+
+    ChunkHeader header;
+    header.flags = words[1];
+    header.sequence = words[2] | (static_cast<std::uint32_t>(words[3]) << 16);
+    header.offset = words[4] | (static_cast<std::uint32_t>(words[5]) << 16);
+    header.total_words = words[6] | (static_cast<std::uint32_t>(words[7]) << 16);
+
+    const size_t payload_words = word_count - chunk_header_words;
+    if (static_cast<std::uint64_t>(header.offset) + payload_words > header.total_words)
+        return std::nullopt;
+
+    return header;
+}
+
+void EncodeAck(const AckInfo& ack, std::vector<std::uint16_t>& out) {
+    out.resize(ack_header_words + ack_bitmap_words);
+    out[0] = message_ack;
+    out[1] = ack.flags;
+    out[2] = static_cast<std::uint16_t>(ack.cumulative);
+    out[3] = static_cast<std::uint16_t>(ack.cumulative >> 16);
+    std::copy(ack.bitmap.begin(), ack.bitmap.end(), out.begin() + ack_header_words);
+}
+
+std::optional<AckInfo> DecodeAck(const std::uint16_t* words, size_t word_count) {
+    if (word_count != ack_header_words + ack_bitmap_words || words[0] != message_ack)
+        return std::nullopt;
+
+    AckInfo ack;
+    ack.flags = words[1];
+    ack.cumulative = words[2] | (static_cast<std::uint32_t>(words[3]) << 16);
+    std::copy(words + ack_header_words, words + word_count, ack.bitmap.begin());
+    return ack;
+}
+
+static void EncodeHash(const std::array<unsigned char, 32>& hash, std::uint16_t* out) {
+    for (size_t i = 0; i < 16; i++) {
+        out[i] = static_cast<std::uint16_t>(hash[2 * i] | (hash[2 * i + 1] << 8));
+    }
+}
+
+static void DecodeHash(const std::uint16_t* words, std::array<unsigned char, 32>& hash) {
+    for (size_t i = 0; i < 16; i++) {
+        hash[2 * i] = static_cast<unsigned char>(words[i]);
+        hash[2 * i + 1] = static_cast<unsigned char>(words[i] >> 8);
+    }
+}
+
+bool EncodeManifest(const Manifest& manifest, std::vector<std::uint16_t>& out) {
+    const bool delta = manifest.flags & manifest_flag_delta;
+    if (delta && manifest.changed.size() > max_manifest_bitmap_bits)
+        return false;
+
+    out.assign(manifest_header_words + (delta ? manifest_base_root_words + (manifest.changed.size() + 15) / 16 : 0), 0);
+    out[0] = message_manifest;
+    out[1] = manifest.flags;
+    out[2] = static_cast<std::uint16_t>(manifest.total_words);
+    out[3] = static_cast<std::uint16_t>(manifest.total_words >> 16);
+    EncodeHash(manifest.root, out.data() + 4);
+    if (delta) {
+        EncodeHash(manifest.base_root, out.data() + manifest_header_words);
+        std::uint16_t* bitmap = out.data() + manifest_header_words + manifest_base_root_words;
+        for (size_t i = 0; i < manifest.changed.size(); i++) {
+            if (manifest.changed[i]) {
+                bitmap[i / 16] |= static_cast<std::uint16_t>(1 << (i % 16));
+            }
+        }
+    }
+    return true;
+}
+
+std::optional<Manifest> DecodeManifest(const std::uint16_t* words, size_t word_count) {
+    if (word_count < manifest_header_words || words[0] != message_manifest)
+        return std::nullopt;
+
+    Manifest manifest;
+    manifest.flags = words[1];
+    manifest.total_words = words[2] | (static_cast<std::uint32_t>(words[3]) << 16);
+    if (manifest.total_words > max_image_words)
+        return std::nullopt;
+    DecodeHash(words + 4, manifest.root);
+
+    if (manifest.flags & manifest_flag_delta) {
+        const size_t chunk_count = ChunkCountFor(manifest.total_words);
+        if (word_count != manifest_header_words + manifest_base_root_words + (chunk_count + 15) / 16)
+            return std::nullopt;
+        DecodeHash(words + manifest_header_words, manifest.base_root);
+        const std::uint16_t* bitmap = words + manifest_header_words + manifest_base_root_words;
+        manifest.changed.resize(chunk_count);
+        for (size_t i = 0; i < chunk_count; i++) {
+            manifest.changed[i] = (bitmap[i / 16] >> (i % 16)) & 1;
+        }
+    } else if (word_count != manifest_header_words) {
+        return std::nullopt;
+    }
+
+    return manifest;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Messages sent to the DSP stub are sequences of 16-bit words in host byte order.
+// The first word identifies the message type.
+
+// [magic] [instruction words...]
+constexpr std::uint16_t message_single = 0xD590;
+// [magic] [count] ([length] [instruction words...]) * count
+constexpr std::uint16_t message_batch = 0xD591;
+// [magic] [flags] [sequence:2] [offset:2] [total words:2] [payload words...]
+// 32-bit fields are sent low word first. Offsets and sizes are in words.
+constexpr std::uint16_t message_chunk = 0xD592;
+// [magic] [flags] [cumulative:2] [selective ack bitmap words...]
+// Sent by the receiver for manifests and for chunks flagged chunk_flag_ack_requested. `cumulative` is the lowest
+// sequence not yet received; bit i of the bitmap (word i / 16, bit i % 16) is set if
+// sequence cumulative + 1 + i has been received.
+constexpr std::uint16_t message_ack = 0xD593;
+// [magic] [flags] [total words:2] [root:16] [base root:16] [changed chunk bitmap words...]
+// Starts an acknowledged upload of an image whose Sha256Tree root (one leaf per chunk) is
+// `root`. With manifest_flag_delta only the chunks whose bit is set in the bitmap are sent;
+// the rest are kept from the receiver's current image, which must have the root `base root`.
+// Without it every chunk is sent, and base root and bitmap are omitted.
+constexpr std::uint16_t message_manifest = 0xD594;
+
+// Largest UDP payload that fits a 1500-byte Ethernet MTU without fragmentation.
+constexpr size_t max_datagram_size = 1500 - 20 - 8;
+
+constexpr size_t chunk_header_words = 8;
+// Largest upload, as transferred, a receiver allocates room for: 32 MiB.
+constexpr size_t max_image_words = size_t{1} << 24;
+constexpr size_t max_chunk_payload_words = max_datagram_size / sizeof(std::uint16_t) - chunk_header_words;
+
+constexpr std::uint16_t chunk_flag_ack_requested = 1 << 0;
+// The chunks carry an LzCompress stream of the image rather than the image itself; sequence,
+// offset and total words all refer to the stream, as do the total words and root of a manifest
+// before them, which cannot be a delta.
+constexpr std::uint16_t chunk_flag_compressed = 1 << 1;
+
+constexpr std::uint16_t manifest_flag_delta = 1 << 0;
+
+constexpr size_t manifest_header_words = 4 + 16;
+constexpr size_t manifest_base_root_words = 16;
+constexpr size_t max_manifest_bitmap_bits =
+    (max_datagram_size / sizeof(std::uint16_t) - manifest_header_words - manifest_base_root_words) * 16;
+
+// The receiver's image does not match the base of a delta manifest.
+constexpr std::uint16_t ack_flag_rejected = 1 << 0;
+
+constexpr size_t ack_header_words = 4;
+constexpr size_t ack_bitmap_words = 8;
+constexpr size_t ack_bitmap_bits = ack_bitmap_words * 16;
+
+struct ChunkHeader {
+    std::uint16_t flags = 0;
+    std::uint32_t sequence = 0;
+    std::uint32_t offset = 0;
+    std::uint32_t total_words = 0;
+};
+
+struct Manifest {
+    std::uint16_t flags = 0;
+    std::uint32_t total_words = 0;
+    std::array<unsigned char, 32> root{};
+    std::array<unsigned char, 32> base_root{};
+    // One entry per chunk when manifest_flag_delta is set.
+    std::vector<bool> changed;
+};
+
+struct AckInfo {
+    std::uint16_t flags = 0;
+    std::uint32_t cumulative = 0;
+    std::array<std::uint16_t, ack_bitmap_words> bitmap{};
+
+    bool Selected(std::uint32_t sequence) const {
+        if (sequence <= cumulative || sequence - cumulative - 1 >= ack_bitmap_bits)
+            return false;
+        const std::uint32_t i = sequence - cumulative - 1;
+        return (bitmap[i / 16] >> (i % 16)) & 1;
+    }
+};
+
+// Number of chunks an image of `word_count` words is split into; an empty image still has one.
+size_t ChunkCountFor(size_t word_count);
+
+std::vector<std::uint16_t> EncodeSingle(const std::vector<std::uint16_t>& instruction);
+
+// Packs as many instructions as fit into one batch message.
+class BatchEncoder {
+public:
+    explicit BatchEncoder(size_t max_size_in_bytes = max_datagram_size);
+
+    // Returns false if the instruction does not fit; flush and retry.
+    bool TryAppend(const std::vector<std::uint16_t>& instruction);
+
+    bool Empty() const { return instruction_count == 0; }
+    size_t InstructionCount() const { return instruction_count; }
+    const std::vector<std::uint16_t>& Message() const { return message; }
+
+    void Clear();
+
+private:
+    size_t max_words;
+    size_t instruction_count = 0;
+    std::vector<std::uint16_t> message;
+};
+
+// Splits a single or batch message back into instructions.
+// Returns std::nullopt if the message is malformed.
+std::optional<std::vector<std::vector<std::uint16_t>>> DecodeInstructions(const std::uint16_t* words, size_t word_count);
+
+// Writes header and payload into `out`, replacing its contents.
+void EncodeChunk(const ChunkHeader& header, const std::uint16_t* payload, size_t payload_words,
+                 std::vector<std::uint16_t>& out);
+// Writes only the chunk_header_words header, for callers that send the payload from its own buffer.
+void EncodeChunkHeader(const ChunkHeader& header, std::uint16_t* out);
+
+// Returns std::nullopt if this is not a well-formed chunk message.
+std::optional<ChunkHeader> DecodeChunkHeader(const std::uint16_t* words, size_t word_count);
+
+void EncodeAck(const AckInfo& ack, std::vector<std::uint16_t>& out);
+std::optional<AckInfo> DecodeAck(const std::uint16_t* words, size_t word_count);
+
+// Returns false if the manifest's bitmap does not fit one datagram.
+bool EncodeManifest(const Manifest& manifest, std::vector<std::uint16_t>& out);
+std::optional<Manifest> DecodeManifest(const std::uint16_t* words, size_t word_count);
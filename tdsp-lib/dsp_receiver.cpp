@@ -0,0 +1,84 @@
+#include "dsp_receiver.h"
+
+static std::uint32_t GetTag(const std::uint16_t* payload, size_t payload_words) {
+    std::uint32_t tag = 0;
+    if (payload_words > 0)
+        tag |= payload[0];
+    if (payload_words > 1)
+        tag |= static_cast<std::uint32_t>(payload[1]) << 16;
+    return tag;
+}
+
+DspReceiver::DspReceiver(bool record_packets) : record_packets(record_packets) {}
+
+bool DspReceiver::HandleDatagram(const std::uint16_t* words, size_t word_count, TransferClock::time_point arrival,
+                                 std::vector<std::uint16_t>& reply) {
+    reply.clear();
+
+    if (word_count == 0) {
+        invalid++;
+        return false;
+    }
+
+    Packet packet{arrival, words[0], 0, 0};
+
+    switch (words[0]) {
+    case message_single:
+    case message_batch: {
+        const auto decoded = DecodeInstructions(words, word_count);
+        if (!decoded) {
+            invalid++;
+            return false;
+        }
+        for (const auto& instruction : *decoded) {
+            packet.payload_words += instruction.size();
+        }
+        if (!decoded->empty()) {
+            packet.tag = GetTag(decoded->front().data(), decoded->front().size());
+        }
+        instructions += decoded->size();
+        break;
+    }
+    case message_chunk: {
+        const auto header = DecodeChunkHeader(words, word_count);
+        if (!header || !upload.OnChunk(*header, words + chunk_header_words, word_count - chunk_header_words)) {
+            invalid++;
+            return false;
+        }
+        packet.payload_words = word_count - chunk_header_words;
+        packet.tag = header->sequence;
+        if (header->flags & chunk_flag_ack_requested) {
+            EncodeAck(upload.Ack(), reply);
+        }
+        break;
+    }
+    case message_manifest: {
+        const auto manifest = DecodeManifest(words, word_count);
+        if (!manifest) {
+            invalid++;
+            return false;
+        }
+        const bool accepted = upload.Begin(*manifest);
+        AckInfo ack = upload.Ack();
+        if (!accepted) {
+            ack.flags |= ack_flag_rejected;
+        }
+        EncodeAck(ack, reply);
+        packet.payload_words = word_count - manifest_header_words;
+        break;
+    }
+    default:
+        invalid++;
+        return false;
+    }
+
+    if (packets++ == 0) {
+        first_arrival = arrival;
+    }
+    last_arrival = arrival;
+    payload_words += packet.payload_words;
+    if (record_packets) {
+        log.push_back(packet);
+    }
+    return true;
+}
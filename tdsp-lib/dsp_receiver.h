@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dsp_protocol.h"
+#include "transfer.h"
+
+// What the DSP stub does with incoming messages, minus the socket: decodes and validates
+// every message format, reassembles chunk uploads and produces acks.
+class DspReceiver {
+public:
+    struct Packet {
+        TransferClock::time_point arrival;
+        std::uint16_t type;
+        size_t payload_words;
+        // First two payload words (low word first); the chunk sequence for chunk messages.
+        // Benchmarks use this to tag packets.
+        std::uint32_t tag;
+    };
+
+    // Keep a log of every valid packet.
+    explicit DspReceiver(bool record_packets = false);
+
+    // Returns false if the datagram is malformed. If the sender asked for an acknowledgement,
+    // `reply` is filled with it; otherwise `reply` is cleared.
+    bool HandleDatagram(const std::uint16_t* words, size_t word_count, TransferClock::time_point arrival,
+                        std::vector<std::uint16_t>& reply);
+
+    size_t PacketCount() const { return packets; }
+    size_t InvalidCount() const { return invalid; }
+    size_t InstructionCount() const { return instructions; }
+    size_t PayloadWordCount() const { return payload_words; }
+    // When the first and the latest valid packets arrived, if there were any; kept without the log.
+    TransferClock::time_point FirstArrival() const { return first_arrival; }
+    TransferClock::time_point LastArrival() const { return last_arrival; }
+
+    const std::vector<Packet>& Log() const { return log; }
+    const WindowedReceiver& Upload() const { return upload; }
+
+private:
+    bool record_packets;
+    size_t packets = 0;
+    size_t invalid = 0;
+    size_t instructions = 0;
+    size_t payload_words = 0;
+    TransferClock::time_point first_arrival;
+    TransferClock::time_point last_arrival;
+    std::vector<Packet> log;
+    WindowedReceiver upload;
+};
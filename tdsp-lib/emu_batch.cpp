@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "emu_batch.h"
+#include "emu_snapshot.h"
+#include "varint.h"
+
+constexpr char results_magic[8] = {'T', 'D', 'S', 'P', 'R', 'U', 'N', '1'};
+
+// A worker's jobs, as indices: the worker takes from the front, thieves from the back.
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+static std::optional<size_t> TakeJob(std::vector<WorkQueue>& queues, size_t self) {
+    {
+        WorkQueue& own = queues[self];
+        std::lock_guard lock{own.mutex};
+        if (!own.jobs.empty()) {
+            const size_t job = own.jobs.front();
+            own.jobs.pop_front();
+            return job;
+        }
+    }
+    // Nothing is queued once the batch starts, so empty queues stay empty.
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkQueue& victim = queues[(self + i) % queues.size()];
+        std::lock_guard lock{victim.mutex};
+        if (!victim.jobs.empty()) {
+            const size_t job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return job;
+        }
+    }
+    return std::nullopt;
+}
+
+static void RunJob(DspEmulator& emulator, const BatchJob& job, BatchResult& result) {
+    for (const BatchInput& input : job.inputs) {
+        for (size_t i = 0; i < input.words->size(); i++) {
+            emulator.WriteData(static_cast<std::uint16_t>(input.address + i), (*input.words)[i]);
+        }
+    }
+    std::optional<DspProfiler> profiler;
+    if (job.profile_period) {
+        profiler.emplace(emulator, job.profile_period, job.symbols ? *job.symbols : std::vector<AsmSymbol>{});
+    }
+    const RunResult run = emulator.Run(job.max_cycles);
+
+    result.name = job.name;
+    result.reason = run.reason;
+    result.cycles = run.cycles;
+    result.pc = run.pc;
+    result.acc = emulator.State().acc;
+    result.output.resize(job.output_words);
+    for (size_t i = 0; i < job.output_words; i++) {
+        result.output[i] = emulator.ReadData(static_cast<std::uint16_t>(job.output_address + i));
+    }
+    if (profiler) {
+        result.folded_stacks = profiler->FoldedStacks();
+        result.profile = profiler->Instructions();
+    }
+}
+
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, size_t threads, DispatchMode mode) {
+    std::vector<BatchResult> results(jobs.size());
+    const size_t worker_count = std::max<size_t>(1, std::min(threads, jobs.size()));
+    std::vector<WorkQueue> queues(worker_count);
+    for (size_t i = 0; i < worker_count; i++) {
+        for (size_t job = i * jobs.size() / worker_count; job < (i + 1) * jobs.size() / worker_count; job++) {
+            queues[i].jobs.push_back(job);
+        }
+    }
+
+    const auto work = [&](size_t self) {
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        const DspSnapshot blank = emulator.Snapshot();
+        // The emulator just after loading the program of the last job. Jobs of the same program
+        // go back to it, which leaves the program's blocks and compiled code in place.
+        const std::vector<std::uint16_t>* loaded = nullptr;
+        DspSnapshot start;
+        while (const auto job = TakeJob(queues, self)) {
+            if (jobs[*job].program.get() != loaded) {
+                emulator.Restore(blank);
+                loaded = jobs[*job].program.get();
+                emulator.LoadProgram(loaded->data(), loaded->size());
+                start = emulator.Snapshot();
+            }
+            RunJob(emulator, jobs[*job], results[*job]);
+            emulator.Restore(start);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < worker_count; i++) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return results;
+}
+
+std::vector<unsigned char> EncodeBatchResults(const std::vector<BatchResult>& results) {
+    std::vector<unsigned char> out{std::begin(results_magic), std::end(results_magic)};
+    PutVarint(results.size(), out);
+    for (const BatchResult& result : results) {
+        PutVarint(result.name.size(), out);
+        out.insert(out.end(), result.name.begin(), result.name.end());
+    }
+    for (const BatchResult& result : results) {
+        PutVarint(static_cast<std::uint64_t>(result.reason), out);
+    }
+    for (const BatchResult& result : results) {
+        PutVarint(result.cycles, out);
+    }
+    for (const BatchResult& result : results) {
+        PutVarint(result.pc, out);
+    }
+    for (size_t acc = 0; acc < 4; acc++) {
+        for (const BatchResult& result : results) {
+            const auto value = static_cast<std::uint64_t>(result.acc[acc]);
+            PutVarint(value << 1 ^ (result.acc[acc] < 0 ? ~std::uint64_t{0} : 0), out);
+        }
+    }
+    for (const BatchResult& result : results) {
+        PutVarint(result.output.size(), out);
+        for (const std::uint16_t word : result.output) {
+            PutVarint(word, out);
+        }
+    }
+    return out;
+}
+
+std::optional<std::vector<BatchResult>> DecodeBatchResults(const unsigned char* bytes, size_t size) {
+    if (size < sizeof(results_magic) || std::memcmp(bytes, results_magic, sizeof(results_magic)) != 0)
+        return std::nullopt;
+    size_t position = sizeof(results_magic);
+    const auto count = GetVarint(bytes, size, position);
+    // Every job takes at least a byte in each column.
+    if (!count || *count > size - position)
+        return std::nullopt;
+
+    std::vector<BatchResult> results(*count);
+    for (BatchResult& result : results) {
+        const auto length = GetVarint(bytes, size, position);
+        if (!length || *length > size - position)
+            return std::nullopt;
+        result.name.assign(reinterpret_cast<const char*>(bytes + position), *length);
+        position += *length;
+    }
+    for (BatchResult& result : results) {
+        const auto reason = GetVarint(bytes, size, position);
+        if (!reason || *reason > static_cast<std::uint64_t>(StopReason::Undefined))
+            return std::nullopt;
+        result.reason = static_cast<StopReason>(*reason);
+    }
+    for (BatchResult& result : results) {
+        const auto cycles = GetVarint(bytes, size, position);
+        if (!cycles)
+            return std::nullopt;
+        result.cycles = *cycles;
+    }
+    for (BatchResult& result : results) {
+        const auto pc = GetVarint(bytes, size, position);
+        if (!pc || *pc > 0xFFFFFFFF)
+            return std::nullopt;
+        result.pc = static_cast<std::uint32_t>(*pc);
+    }
+    for (size_t acc = 0; acc < 4; acc++) {
+        for (BatchResult& result : results) {
+            const auto value = GetVarint(bytes, size, position);
+            if (!value)
+                return std::nullopt;
+            result.acc[acc] = static_cast<std::int64_t>(*value >> 1 ^ (*value & 1 ? ~std::uint64_t{0} : 0));
+        }
+    }
+    for (BatchResult& result : results) {
+        const auto words = GetVarint(bytes, size, position);
+        if (!words || *words > size - position)
+            return std::nullopt;
+        result.output.resize(*words);
+        for (std::uint16_t& word : result.output) {
+            const auto value = GetVarint(bytes, size, position);
+            if (!value || *value > 0xFFFF)
+                return std::nullopt;
+            word = static_cast<std::uint16_t>(*value);
+        }
+    }
+    if (position != size)
+        return std::nullopt;
+    return results;
+}
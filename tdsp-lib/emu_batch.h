@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "assembler.h"
+#include "emu_core.h"
+#include "emu_profiler.h"
+
+// Words copied into data memory before a job runs.
+struct BatchInput {
+    std::uint16_t address = 0;
+    std::shared_ptr<const std::vector<std::uint16_t>> words;
+};
+
+// One program run from reset. Jobs usually share programs and inputs, so both are shared.
+struct BatchJob {
+    std::string name;
+    std::shared_ptr<const std::vector<std::uint16_t>> program;
+    std::vector<BatchInput> inputs;
+    std::uint64_t max_cycles = 1000000;
+    // Data memory read back once the run stops.
+    std::uint16_t output_address = 0;
+    std::uint16_t output_words = 0;
+    // Samples the run every this many cycles if not 0, naming code by the symbols if given.
+    std::uint64_t profile_period = 0;
+    std::shared_ptr<const std::vector<AsmSymbol>> symbols;
+};
+
+struct BatchResult {
+    std::string name;
+    StopReason reason = StopReason::CycleLimit;
+    std::uint64_t cycles = 0;
+    std::uint32_t pc = 0;
+    // a0, a1, b0, b1.
+    std::array<std::int64_t, 4> acc{};
+    std::vector<std::uint16_t> output;
+    // From DspProfiler, if the job was profiled.
+    std::string folded_stacks;
+    std::vector<InstructionProfile> profile;
+};
+
+// Runs the jobs on `threads` workers, each with one DspEmulator it reuses: after a job the
+// emulator is restored to a snapshot taken with just the program loaded, which only copies back
+// the pages the job wrote and keeps the compiled code for the next job of the same program.
+// Jobs are dealt out in contiguous runs; a worker whose run is done steals from the back of the
+// others', so uneven jobs still keep every worker busy. Results are in job order.
+std::vector<BatchResult> RunBatch(const std::vector<BatchJob>& jobs, size_t threads, DispatchMode mode);
+
+// Results as columns, for reading back a whole column at a time; profiles are left out: "TDSPRUN1", the job count,
+// then each column in turn with a value per job, all as LEB128 varints:
+//   names      [bytes] [bytes...]
+//   reasons    StopReason
+//   cycles
+//   pcs
+//   a0 a1 b0 b1  zigzag-encoded, a column each
+//   outputs    [words] [words...], each word a varint
+std::vector<unsigned char> EncodeBatchResults(const std::vector<BatchResult>& results);
+// Returns std::nullopt if the bytes are malformed.
+std::optional<std::vector<BatchResult>> DecodeBatchResults(const unsigned char* bytes, size_t size);
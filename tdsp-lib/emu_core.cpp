@@ -0,0 +1,1571 @@
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#include "emu_core.h"
+#include "emu_snapshot.h"
+
+static constexpr std::uint64_t acc_mask = (std::uint64_t{1} << 40) - 1;
+static constexpr size_t max_block_ops = 64;
+// Where interrupt lines 0 to 2 go.
+static constexpr std::array<std::uint32_t, 3> interrupt_vectors{0x0006, 0x000E, 0x0016};
+
+static std::int64_t SignExtend(std::int64_t value, unsigned bits) {
+    const unsigned shift = 64 - bits;
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(value) << shift) >> shift;
+}
+
+static std::uint8_t AccIndex(std::uint8_t reg) {
+    return static_cast<std::uint8_t>(reg - static_cast<std::uint8_t>(DspReg::A0));
+}
+
+const char* StopReasonName(StopReason reason) {
+    switch (reason) {
+    case StopReason::CycleLimit:
+        return "cycle limit";
+    case StopReason::EndOfProgram:
+        return "end of program";
+    case StopReason::Trap:
+        return "trap";
+    case StopReason::Unimplemented:
+        return "unimplemented instruction";
+    case StopReason::Undefined:
+        return "undefined instruction";
+    }
+    return "?";
+}
+
+DspEmulator::DspEmulator() : table(GetDecodeTable()), loop_ends(program_memory_words) {}
+
+void DspEmulator::LoadProgram(const std::uint16_t* words, size_t count, std::uint32_t address) {
+    if (running) {
+        // The block running, and the op the Switch mode is executing, come from what this would
+        // replace; Service stores the words before the next.
+        program_writes.push_back({address, std::vector<std::uint16_t>(words, words + count)});
+        service_at = 0;
+        return;
+    }
+    StoreProgram(words, count, address);
+}
+
+void DspEmulator::StoreProgram(const std::uint16_t* words, size_t count, std::uint32_t address) {
+    if (address >= program_memory_words)
+        return;
+    count = std::min<size_t>(count, program_memory_words - address);
+    if (address + count > decoded.size()) {
+        decoded.resize(address + count);
+        blocks.resize(address + count);
+        repeat_blocks.resize(address + count);
+    }
+    memory.WriteProgram(address, words, count);
+    // The instruction before may take its second word from the new code.
+    const std::uint32_t first = address ? address - 1 : 0;
+    for (std::uint32_t i = first; i < address + count; i++) {
+        Decode(i);
+    }
+    InvalidateBlocks(first, static_cast<std::uint32_t>(address + count));
+}
+
+void DspEmulator::WriteProgram(std::uint32_t address, std::uint16_t value) {
+    LoadProgram(&value, 1, address);
+}
+
+void DspEmulator::StoreProgramWrites() {
+    for (const ProgramWrite& write : program_writes) {
+        StoreProgram(write.words.data(), write.words.size(), write.address);
+    }
+    program_writes.clear();
+}
+
+DspSnapshot DspEmulator::Snapshot() {
+    MaterializeFlags();
+    DspSnapshot snapshot;
+    snapshot.state = state;
+    snapshot.cycles = cycles;
+    snapshot.data = std::make_shared<const std::vector<std::uint16_t>>(memory.Data(), memory.Data() + data_memory_words);
+    snapshot.program = std::make_shared<const std::vector<std::uint16_t>>(memory.Program(), memory.Program() + decoded.size());
+    snapshot.id = NewSnapshotId();
+    memory.ClearDirty();
+    memory_snapshot = snapshot.id;
+    return snapshot;
+}
+
+void DspEmulator::Restore(const DspSnapshot& snapshot) {
+    assert(!running);
+    constexpr size_t page_words = size_t{1} << memory_page_bits;
+    const bool all = snapshot.id != memory_snapshot;
+    for (size_t page = 0; page < data_pages; page++) {
+        if (all || memory.DataDirty(page)) {
+            const std::uint16_t* words = snapshot.data->data() + page * page_words;
+            std::copy(words, words + page_words, memory.Data() + page * page_words);
+        }
+    }
+
+    // Program memory past the snapshot's program goes back to zero, and undecoded.
+    const std::vector<std::uint16_t>& program = *snapshot.program;
+    const auto end = static_cast<std::uint32_t>(program.size());
+    if (decoded.size() > end) {
+        std::fill(memory.Program() + end, memory.Program() + decoded.size(), std::uint16_t{0});
+        InvalidateBlocks(end ? end - 1 : 0, static_cast<std::uint32_t>(decoded.size()));
+        decoded.resize(end);
+        blocks.resize(end);
+        repeat_blocks.resize(end);
+        if (end) {
+            Decode(end - 1);
+        }
+    }
+    for (std::uint32_t first = 0; first < end; first += page_words) {
+        if (all || memory.ProgramDirty(first >> memory_page_bits)) {
+            StoreProgram(program.data() + first, std::min<size_t>(page_words, end - first), first);
+        }
+    }
+
+    state = snapshot.state;
+    cycles = snapshot.cycles;
+    events.Clear();
+    service_at = 0;
+    memory.ClearDirty();
+    memory_snapshot = snapshot.id;
+}
+
+void DspEmulator::MapMmio(size_t first_page, size_t pages, const MmioHandler& handler) {
+    assert(!running);
+    memory.MapMmio(first_page, pages, handler);
+    // Code compiled while no page was mapped goes straight to memory.
+    DropCompiledCode();
+}
+
+void DspEmulator::UnmapMmio(size_t first_page, size_t pages) {
+    assert(!running);
+    memory.UnmapMmio(first_page, pages);
+    DropCompiledCode();
+}
+
+void DspEmulator::Decode(std::uint32_t address) {
+    const std::uint16_t* program = memory.Program();
+    const std::uint16_t extension = address + 1 < program_memory_words ? program[address + 1] : 0;
+    const DecodedOp op = table.Decode(program[address], extension, address);
+    decoded[address] = op;
+
+    // Blocks end where a repeat body does, so the repeat is checked there; one may already run
+    // through the new end.
+    if ((op.op == EmuOp::Bkrep || op.op == EmuOp::BkrepReg) && op.imm < loop_ends.size() && !loop_ends[op.imm]) {
+        loop_ends[op.imm] = true;
+        InvalidateBlocks(op.imm, op.imm + 1);
+    }
+}
+
+void DspEmulator::InvalidateBlocks(std::uint32_t first, std::uint32_t end) {
+    bool dropped = false;
+    const std::uint32_t from = first > 2 * max_block_ops ? static_cast<std::uint32_t>(first - 2 * max_block_ops) : 0;
+    for (std::uint32_t start = from; start < end && start < blocks.size(); start++) {
+        for (auto* cache : {&blocks, &repeat_blocks}) {
+            std::unique_ptr<Block>& block = (*cache)[start];
+            if (block && block->end > first) {
+                block.reset();
+                dropped = true;
+            }
+        }
+    }
+    if (dropped) {
+        block_epoch++;
+    }
+}
+
+// Whether the pc may go anywhere but the next instruction, the run may stop or an interrupt may
+// become due.
+static bool EndsBlock(const DecodedOp& op) {
+    const auto writes_pc = [&](size_t i) {
+        const auto reg = static_cast<DspReg>(op.f[i]);
+        return reg == DspReg::Pc || reg == DspReg::St0 || reg == DspReg::St2;
+    };
+    switch (op.op) {
+    case EmuOp::Undefined:
+    case EmuOp::Unimplemented:
+    case EmuOp::Trap:
+    case EmuOp::Br:
+    case EmuOp::Call:
+    case EmuOp::CallReg:
+    case EmuOp::Ret:
+    case EmuOp::Reti:
+    case EmuOp::Rets:
+    case EmuOp::Rep:
+    case EmuOp::RepReg:
+    case EmuOp::Bkrep:
+    case EmuOp::BkrepReg:
+    case EmuOp::BkrepSto:
+    case EmuOp::BkrepRst:
+    case EmuOp::Break:
+    case EmuOp::Eint:
+    case EmuOp::Cntx:
+        return true;
+    case EmuOp::MovImmReg:
+    case EmuOp::MovMemImm8Reg:
+    case EmuOp::MovMemImm16Reg:
+    case EmuOp::MovMemR7Reg:
+    case EmuOp::MovMemRnReg:
+    case EmuOp::Pop:
+    case EmuOp::BitReg:
+        return writes_pc(0);
+    case EmuOp::MovRegReg:
+        return writes_pc(1);
+    default:
+        return false;
+    }
+}
+
+std::unique_ptr<DspEmulator::Block> DspEmulator::BuildBlock(std::uint32_t start, size_t limit) const {
+    auto block = std::make_unique<Block>();
+    block->start = start;
+    block->epoch = block_epoch;
+    std::uint32_t pc = start;
+    while (pc < decoded.size() && block->ops.size() < limit) {
+        const DecodedOp& op = decoded[pc];
+        pc += op.length;
+        block->ops.push_back(ThreadedOp{nullptr, op, pc});
+        if (EndsBlock(op) || (pc - 1 < loop_ends.size() && loop_ends[pc - 1]))
+            break;
+    }
+    block->end = pc;
+    block->ops.push_back(ThreadedOp{nullptr, DecodedOp{}, pc});
+    return block;
+}
+
+DspEmulator::Block& DspEmulator::NextBlock(Block* previous, std::uint32_t pc) {
+    if (previous && previous->epoch == block_epoch) {
+        for (Block* successor : previous->successors) {
+            if (successor && successor->start == pc)
+                return *successor;
+        }
+    }
+
+    std::unique_ptr<Block>& block = blocks[pc];
+    if (!block) {
+        block = BuildBlock(pc, max_block_ops);
+    }
+    if (previous) {
+        if (previous->epoch != block_epoch) {
+            previous->successors = {};
+            previous->epoch = block_epoch;
+        }
+        previous->successors = {block.get(), previous->successors[0]};
+    }
+    return *block;
+}
+
+void DspEmulator::Reset() {
+    state = DspState{};
+    cycles = 0;
+    events.Clear();
+    service_at = 0;
+}
+
+std::uint16_t DspEmulator::ReadRegister(DspReg reg) const {
+    const auto index = static_cast<std::uint8_t>(reg);
+    switch (reg) {
+    case DspReg::R0: case DspReg::R1: case DspReg::R2: case DspReg::R3:
+    case DspReg::R4: case DspReg::R5: case DspReg::R6: case DspReg::R7:
+        return state.r[index];
+    case DspReg::Y0: case DspReg::Y1:
+        return state.y[index - static_cast<std::uint8_t>(DspReg::Y0)];
+    case DspReg::X0: case DspReg::X1:
+        return state.x[index - static_cast<std::uint8_t>(DspReg::X0)];
+    case DspReg::P0: case DspReg::P1:
+        return static_cast<std::uint16_t>(Product(index - static_cast<std::uint8_t>(DspReg::P0)));
+    case DspReg::A0: case DspReg::A1: case DspReg::B0: case DspReg::B1:
+        return static_cast<std::uint16_t>(state.acc[AccIndex(index)]);
+    case DspReg::A0L: case DspReg::A1L: case DspReg::B0L: case DspReg::B1L:
+        return static_cast<std::uint16_t>(state.acc[index - static_cast<std::uint8_t>(DspReg::A0L)]);
+    case DspReg::A0H: case DspReg::A1H: case DspReg::B0H: case DspReg::B1H:
+        return static_cast<std::uint16_t>(state.acc[index - static_cast<std::uint8_t>(DspReg::A0H)] >> 16);
+    case DspReg::A0E: case DspReg::A1E: case DspReg::B0E: case DspReg::B1E:
+        return static_cast<std::uint16_t>(state.acc[index - static_cast<std::uint8_t>(DspReg::A0E)] >> 32);
+    case DspReg::P0H:
+        return static_cast<std::uint16_t>(state.p[0] >> 16);
+    case DspReg::St0: {
+        const DspFlags f = Flags();
+        return static_cast<std::uint16_t>(state.sat | state.ie << 1 | (state.im & 3) << 2 | f.r << 4 | f.l << 5 |
+                                          f.e << 6 | f.c << 7 | f.v << 8 | f.n << 9 | f.m << 10 | f.z << 11 |
+                                          ((state.acc[0] >> 32) & 0xF) << 12);
+    }
+    case DspReg::St1:
+        return static_cast<std::uint16_t>(state.page | state.ps << 10 | ((state.acc[1] >> 32) & 0xF) << 12);
+    case DspReg::St2:
+        return state.st2;
+    case DspReg::Pc:
+        return static_cast<std::uint16_t>(state.pc);
+    case DspReg::Sp:
+        return state.sp;
+    case DspReg::Cfgi:
+        return state.cfgi;
+    case DspReg::Cfgj:
+        return state.cfgj;
+    case DspReg::Stepi0:
+        return state.stepi0;
+    case DspReg::Stepj0:
+        return state.stepj0;
+    case DspReg::Ext0: case DspReg::Ext1: case DspReg::Ext2: case DspReg::Ext3:
+        return state.ext[index - static_cast<std::uint8_t>(DspReg::Ext0)];
+    case DspReg::Lc:
+        return state.loops[state.loop_depth ? state.loop_depth - 1 : 0].lc;
+    case DspReg::Sv:
+        return state.sv;
+    case DspReg::Repc:
+        return state.repc;
+    case DspReg::Mixp:
+        return state.mixp;
+    case DspReg::Icr:
+        return state.icr;
+    case DspReg::Page:
+        return state.page;
+    case DspReg::Ps:
+        return state.ps;
+    case DspReg::Modi:
+        return state.cfgi >> 7;
+    case DspReg::Modj:
+        return state.cfgj >> 7;
+    case DspReg::Stepi:
+        return state.cfgi & 0x7F;
+    case DspReg::Stepj:
+        return state.cfgj & 0x7F;
+    case DspReg::Invalid:
+        break;
+    }
+    assert(false);
+    return 0;
+}
+
+void DspEmulator::WriteRegister(DspReg reg, std::uint16_t value) {
+    const auto index = static_cast<std::uint8_t>(reg);
+    switch (reg) {
+    case DspReg::R0: case DspReg::R1: case DspReg::R2: case DspReg::R3:
+    case DspReg::R4: case DspReg::R5: case DspReg::R6: case DspReg::R7:
+        state.r[index] = value;
+        return;
+    case DspReg::Y0: case DspReg::Y1:
+        state.y[index - static_cast<std::uint8_t>(DspReg::Y0)] = value;
+        return;
+    case DspReg::X0: case DspReg::X1:
+        state.x[index - static_cast<std::uint8_t>(DspReg::X0)] = value;
+        return;
+    case DspReg::P0: case DspReg::P1:
+        state.p[index - static_cast<std::uint8_t>(DspReg::P0)] = static_cast<std::int16_t>(value);
+        return;
+    case DspReg::A0: case DspReg::A1: case DspReg::B0: case DspReg::B1:
+        SetAccumulator(AccIndex(index), static_cast<std::int16_t>(value));
+        return;
+    case DspReg::A0L: case DspReg::A1L: case DspReg::B0L: case DspReg::B1L:
+        SetAccumulator(index - static_cast<std::uint8_t>(DspReg::A0L), value);
+        return;
+    case DspReg::A0H: case DspReg::A1H: case DspReg::B0H: case DspReg::B1H:
+        SetAccumulator(index - static_cast<std::uint8_t>(DspReg::A0H), SignExtend(std::int64_t{value} << 16, 32));
+        return;
+    case DspReg::A0E: case DspReg::A1E: case DspReg::B0E: case DspReg::B1E: {
+        std::int64_t& acc = state.acc[index - static_cast<std::uint8_t>(DspReg::A0E)];
+        acc = SignExtend((acc & 0xFFFFFFFF) | std::int64_t{value & 0xFF} << 32, 40);
+        return;
+    }
+    case DspReg::P0H:
+        state.p[0] = (state.p[0] & 0xFFFF) | std::int64_t{static_cast<std::int16_t>(value)} * 0x10000;
+        return;
+    case DspReg::St0: {
+        DspFlags& f = state.flags;
+        state.flag_source = FlagSource::None;
+        state.sat = value & 1;
+        state.ie = (value >> 1) & 1;
+        state.im = (state.im & ~3) | ((value >> 2) & 3);
+        f.r = (value >> 4) & 1;
+        f.l = (value >> 5) & 1;
+        f.e = (value >> 6) & 1;
+        f.c = (value >> 7) & 1;
+        f.v = (value >> 8) & 1;
+        f.n = (value >> 9) & 1;
+        f.m = (value >> 10) & 1;
+        f.z = (value >> 11) & 1;
+        state.acc[0] = SignExtend((state.acc[0] & 0xFFFFFFFF) | std::int64_t{value >> 12} << 32, 36);
+        CheckInterrupts();
+        return;
+    }
+    case DspReg::St1:
+        state.page = static_cast<std::uint8_t>(value);
+        state.ps = (value >> 10) & 3;
+        state.acc[1] = SignExtend((state.acc[1] & 0xFFFFFFFF) | std::int64_t{value >> 12} << 32, 36);
+        return;
+    case DspReg::St2:
+        state.st2 = value;
+        state.im = static_cast<std::uint8_t>((state.im & 3) | ((value >> 6) & 1) << 2);
+        UpdateAddressing();
+        CheckInterrupts();
+        return;
+    case DspReg::Pc:
+        state.pc = value;
+        return;
+    case DspReg::Sp:
+        state.sp = value;
+        return;
+    case DspReg::Cfgi:
+        state.cfgi = value;
+        UpdateAddressing();
+        return;
+    case DspReg::Cfgj:
+        state.cfgj = value;
+        UpdateAddressing();
+        return;
+    case DspReg::Stepi0:
+        state.stepi0 = value;
+        return;
+    case DspReg::Stepj0:
+        state.stepj0 = value;
+        return;
+    case DspReg::Ext0: case DspReg::Ext1: case DspReg::Ext2: case DspReg::Ext3:
+        state.ext[index - static_cast<std::uint8_t>(DspReg::Ext0)] = value;
+        return;
+    case DspReg::Lc:
+        state.loops[state.loop_depth ? state.loop_depth - 1 : 0].lc = value;
+        return;
+    case DspReg::Sv:
+        state.sv = value;
+        return;
+    case DspReg::Repc:
+        state.repc = value;
+        return;
+    case DspReg::Mixp:
+        state.mixp = value;
+        return;
+    case DspReg::Icr:
+        state.icr = value;
+        return;
+    case DspReg::Page:
+        state.page = static_cast<std::uint8_t>(value);
+        return;
+    case DspReg::Ps:
+        state.ps = value & 3;
+        return;
+    case DspReg::Modi:
+        state.cfgi = static_cast<std::uint16_t>((state.cfgi & 0x7F) | value << 7);
+        UpdateAddressing();
+        return;
+    case DspReg::Modj:
+        state.cfgj = static_cast<std::uint16_t>((state.cfgj & 0x7F) | value << 7);
+        UpdateAddressing();
+        return;
+    case DspReg::Stepi:
+        state.cfgi = static_cast<std::uint16_t>((state.cfgi & ~0x7F) | (value & 0x7F));
+        UpdateAddressing();
+        return;
+    case DspReg::Stepj:
+        state.cfgj = static_cast<std::uint16_t>((state.cfgj & ~0x7F) | (value & 0x7F));
+        UpdateAddressing();
+        return;
+    case DspReg::Invalid:
+        break;
+    }
+    assert(false);
+}
+
+bool DspEmulator::Condition(std::uint8_t cond) {
+    if (cond == 0)
+        return true;
+    // z and m follow from the pending result alone, so loop branches leave the rest pending.
+    if (cond <= 6 && state.flag_source != FlagSource::None) {
+        std::int64_t value = state.flag_a;
+        if (state.flag_source != FlagSource::Result) {
+            value = SignExtend(state.flag_source == FlagSource::Sub ? state.flag_a - state.flag_b : state.flag_a + state.flag_b, 40);
+        }
+        switch (cond) {
+        case 1: return value == 0;
+        case 2: return value != 0;
+        case 3: return value > 0;
+        case 4: return value >= 0;
+        case 5: return value < 0;
+        default: return value <= 0;
+        }
+    }
+    MaterializeFlags();
+    const DspFlags& f = state.flags;
+    switch (cond) {
+    case 0: return true;
+    case 1: return f.z;
+    case 2: return !f.z;
+    case 3: return !f.z && !f.m;
+    case 4: return !f.m;
+    case 5: return f.m;
+    case 6: return f.z || f.m;
+    case 7: return !f.n;
+    case 8: return f.c;
+    case 9: return f.v;
+    case 10: return f.e;
+    case 11: return f.l;
+    case 12: return !f.r;
+    // niu0, iu0, iu1: the user input pins, which nothing drives.
+    case 13: return true;
+    default: return false;
+    }
+}
+
+// The update for a step on a register, taking it round modulo `mod` if `modulo`. Like the DSP,
+// the buffer is the power of two that holds both the modulo and the step.
+static AddressUpdate StepUpdate(std::uint16_t step, bool modulo, std::uint16_t mod) {
+    AddressUpdate update;
+    update.step = step;
+    update.wrap = step;
+    if (!modulo || step == 0)
+        return update;
+    const bool down = step & 0x8000;
+    std::uint16_t span = mod | static_cast<std::uint16_t>(down ? ~step : step);
+    std::uint16_t mask = 0;
+    for (; span; span >>= 1) {
+        mask = static_cast<std::uint16_t>(mask << 1 | 1);
+    }
+    update.mask = mod ? mask : 0;
+    update.edge = down ? 0 : mod;
+    update.wrap = down ? mod : 0;
+    return update;
+}
+
+void DspEmulator::UpdateAddressing() {
+    for (std::uint8_t reg = 0; reg < 8; ++reg) {
+        const std::uint16_t cfg = reg < 4 ? state.cfgi : state.cfgj;
+        // st2 enables modulo for r0 to r5; r6 and r7 always step linearly.
+        const bool modulo = reg < 6 && ((state.st2 >> reg) & 1);
+        const std::uint16_t mod = cfg >> 7;
+        auto& updates = state.address_updates[reg];
+        updates[static_cast<size_t>(StepCode::Zero)] = StepUpdate(0, modulo, mod);
+        updates[static_cast<size_t>(StepCode::Inc)] = StepUpdate(1, modulo, mod);
+        updates[static_cast<size_t>(StepCode::Dec)] = StepUpdate(0xFFFF, modulo, mod);
+        updates[static_cast<size_t>(StepCode::Inc2)] = StepUpdate(2, modulo, mod);
+        updates[static_cast<size_t>(StepCode::Dec2)] = StepUpdate(0xFFFE, modulo, mod);
+        const auto step = static_cast<std::uint16_t>(SignExtend(cfg & 0x7F, 7));
+        updates[static_cast<size_t>(StepCode::PlusStep)] = StepUpdate(step, modulo, mod);
+    }
+}
+
+std::uint16_t DspEmulator::Address(std::uint8_t reg, StepCode step) {
+    std::uint16_t& r = state.r[reg];
+    const std::uint16_t address = r;
+    const AddressUpdate& update = state.address_updates[reg][static_cast<size_t>(step)];
+    const std::uint16_t low = r & update.mask;
+    const std::uint16_t next = low == update.edge ? update.wrap : static_cast<std::uint16_t>((low + update.step) & update.mask);
+    r = static_cast<std::uint16_t>((r & ~update.mask) | next);
+    return address;
+}
+
+// With dmod, modr steps linearly whatever the modulo.
+void DspEmulator::Modr(const DecodedOp& op) {
+    if (op.aux) {
+        state.r[op.f[0]] += state.address_updates[op.f[0]][op.f[1]].step;
+    } else {
+        Address(op.f[0], static_cast<StepCode>(op.f[1]));
+    }
+    state.flags.r = state.r[op.f[0]] == 0;
+}
+
+// The value of a result for the z, m, n and e flags.
+static void SetResultFlags(DspFlags& f, std::int64_t value) {
+    f.z = value == 0;
+    f.m = value < 0;
+    f.e = value != SignExtend(value, 32);
+    f.n = f.z || (!f.e && (((value >> 31) ^ (value >> 30)) & 1));
+}
+
+void DspEmulator::SetAccumulator(std::uint8_t acc, std::int64_t value) {
+    state.acc[acc] = SignExtend(value, 40);
+    DeferResult(state.acc[acc]);
+}
+
+void DspEmulator::SetArithmetic(std::uint8_t acc, std::int64_t a, std::int64_t b, bool subtract) {
+    state.acc[acc] = SignExtend(subtract ? a - b : a + b, 40);
+    DeferArithmetic(a, b, subtract);
+}
+
+std::int64_t DspEmulator::Product(size_t index) const {
+    const std::int64_t p = state.p[index];
+    switch (state.ps) {
+    case 1:
+        return p >> 1;
+    case 2:
+        return p * 2;
+    case 3:
+        return p * 4;
+    }
+    return p;
+}
+
+// Adds or subtracts 40-bit values, setting the carry and overflow flags.
+static std::int64_t Arithmetic(DspFlags& f, std::int64_t a, std::int64_t b, bool subtract) {
+    const std::int64_t result = subtract ? a - b : a + b;
+    const auto ua = static_cast<std::uint64_t>(a) & acc_mask;
+    const auto ub = static_cast<std::uint64_t>(b) & acc_mask;
+    f.c = subtract ? ua < ub : ((ua + ub) >> 40) & 1;
+    f.v = result != SignExtend(result, 40);
+    f.l = f.l || f.v;
+    return result;
+}
+
+// Applies the state's pending flag-producing operation to `f`.
+static void WorkOutFlags(DspFlags& f, const DspState& state) {
+    switch (state.flag_source) {
+    case FlagSource::None:
+        break;
+    case FlagSource::Result:
+        SetResultFlags(f, state.flag_a);
+        break;
+    case FlagSource::Add:
+    case FlagSource::Sub:
+        SetResultFlags(f, SignExtend(Arithmetic(f, state.flag_a, state.flag_b, state.flag_source == FlagSource::Sub), 40));
+        break;
+    }
+}
+
+DspFlags DspEmulator::Flags() const {
+    DspFlags f = state.flags;
+    WorkOutFlags(f, state);
+    return f;
+}
+
+void DspEmulator::MaterializeFlags() {
+    WorkOutFlags(state.flags, state);
+    state.flag_source = FlagSource::None;
+}
+
+void DspEmulator::DeferResult(std::int64_t value) {
+    // A result alone leaves c and v as the pending arithmetic set them.
+    if (state.flag_source == FlagSource::Add || state.flag_source == FlagSource::Sub) {
+        Arithmetic(state.flags, state.flag_a, state.flag_b, state.flag_source == FlagSource::Sub);
+    }
+    state.flag_source = FlagSource::Result;
+    state.flag_a = value;
+}
+
+void DspEmulator::DeferArithmetic(std::int64_t a, std::int64_t b, bool subtract) {
+    // Everything but l is replaced, which keeps the pending operation's overflow.
+    if (state.flag_source == FlagSource::Add || state.flag_source == FlagSource::Sub) {
+        const std::int64_t result = state.flag_source == FlagSource::Sub ? state.flag_a - state.flag_b : state.flag_a + state.flag_b;
+        state.flags.l = state.flags.l || result != SignExtend(result, 40);
+    }
+    state.flag_source = subtract ? FlagSource::Sub : FlagSource::Add;
+    state.flag_a = a;
+    state.flag_b = b;
+}
+
+std::int64_t AluOperand(AluOp op, std::uint16_t value) {
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Sub:
+    case AluOp::Cmp:
+        return static_cast<std::int16_t>(value);
+    case AluOp::Addh:
+    case AluOp::Subh:
+        return std::int64_t{static_cast<std::int16_t>(value)} * 0x10000;
+    default:
+        return value;
+    }
+}
+
+void DspEmulator::Alu(AluOp op, std::uint8_t acc, std::int64_t operand) {
+    const std::int64_t value = state.acc[acc];
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Addh:
+    case AluOp::Addl:
+        SetArithmetic(acc, value, operand, false);
+        return;
+    case AluOp::Sub:
+    case AluOp::Subh:
+    case AluOp::Subl:
+        SetArithmetic(acc, value, operand, true);
+        return;
+    case AluOp::Cmp:
+    case AluOp::Cmpu:
+        DeferArithmetic(value, operand, true);
+        return;
+    case AluOp::And:
+        SetAccumulator(acc, value & operand);
+        return;
+    case AluOp::Or:
+        SetAccumulator(acc, value | operand);
+        return;
+    case AluOp::Xor:
+        SetAccumulator(acc, value ^ operand);
+        return;
+    }
+}
+
+void DspEmulator::Shift(std::uint8_t from, std::uint8_t to, std::int16_t amount) {
+    const std::int64_t value = state.acc[from];
+    amount = std::clamp<std::int16_t>(amount, -40, 40);
+    MaterializeFlags();
+    std::int64_t result = value;
+    if (amount > 0) {
+        const auto u = static_cast<std::uint64_t>(value) & acc_mask;
+        state.flags.c = (u >> (40 - amount)) & 1;
+        result = SignExtend(static_cast<std::int64_t>(u << amount), 40);
+        state.flags.v = amount == 40 ? value != 0 : (result >> amount) != value;
+        state.flags.l = state.flags.l || state.flags.v;
+    } else if (amount < 0) {
+        state.flags.c = (value >> (-amount - 1)) & 1;
+        result = value >> -amount;
+        state.flags.v = false;
+    }
+    SetAccumulator(to, result);
+}
+
+void DspEmulator::Unary(UnaryOp op, std::uint8_t acc, std::uint8_t source) {
+    const std::int64_t value = state.acc[acc];
+    const auto u = static_cast<std::uint64_t>(value) & acc_mask;
+    switch (op) {
+    case UnaryOp::Clr:
+        SetAccumulator(acc, 0);
+        return;
+    case UnaryOp::Clrr:
+        SetAccumulator(acc, 0x8000);
+        return;
+    case UnaryOp::Inc:
+        SetArithmetic(acc, value, 1, false);
+        return;
+    case UnaryOp::Dec:
+        SetArithmetic(acc, value, 1, true);
+        return;
+    case UnaryOp::Neg:
+        SetArithmetic(acc, 0, value, true);
+        return;
+    case UnaryOp::Not:
+        SetAccumulator(acc, ~value);
+        return;
+    case UnaryOp::Shl:
+        Shift(acc, acc, 1);
+        return;
+    case UnaryOp::Shr:
+        Shift(acc, acc, -1);
+        return;
+    case UnaryOp::Shl4:
+        Shift(acc, acc, 4);
+        return;
+    case UnaryOp::Shr4:
+        Shift(acc, acc, -4);
+        return;
+    case UnaryOp::Copy:
+        SetAccumulator(acc, state.acc[AccIndex(source)]);
+        return;
+    case UnaryOp::Rnd:
+        SetArithmetic(acc, value, 0x8000, false);
+        return;
+    case UnaryOp::Rol: {
+        MaterializeFlags();
+        const bool carry = state.flags.c;
+        state.flags.c = (u >> 39) & 1;
+        SetAccumulator(acc, static_cast<std::int64_t>((u << 1) | carry));
+        return;
+    }
+    case UnaryOp::Ror: {
+        MaterializeFlags();
+        const bool carry = state.flags.c;
+        state.flags.c = u & 1;
+        SetAccumulator(acc, static_cast<std::int64_t>((u >> 1) | std::uint64_t{carry} << 39));
+        return;
+    }
+    case UnaryOp::Pacr:
+        SetArithmetic(acc, Product(0), 0x8000, false);
+        return;
+    }
+}
+
+void DspEmulator::Multiply(MulOp op, std::uint8_t acc, std::uint16_t y, std::uint16_t x) {
+    // The accumulating forms add the previous product before forming the new one.
+    switch (op) {
+    case MulOp::Mac:
+    case MulOp::Macsu:
+    case MulOp::Macus:
+    case MulOp::Macuu:
+    case MulOp::Sqra:
+        SetArithmetic(acc, state.acc[acc], Product(0), false);
+        break;
+    case MulOp::Msu:
+        SetArithmetic(acc, state.acc[acc], Product(0), true);
+        break;
+    case MulOp::Maa:
+    case MulOp::Maasu:
+        SetArithmetic(acc, state.acc[acc], Product(0) >> 16, false);
+        break;
+    default:
+        break;
+    }
+
+    state.y[0] = y;
+    state.x[0] = x;
+    const bool y_signed = op != MulOp::Macus && op != MulOp::Macuu;
+    const bool x_signed = op != MulOp::Mpysu && op != MulOp::Macsu && op != MulOp::Maasu && op != MulOp::Macuu;
+    const std::int64_t sy = y_signed ? std::int64_t{static_cast<std::int16_t>(y)} : std::int64_t{y};
+    const std::int64_t sx = x_signed ? std::int64_t{static_cast<std::int16_t>(x)} : std::int64_t{x};
+    state.p[0] = sy * sx;
+}
+
+// Whether a bit operation stores its result; cmpv and the tests only set flags.
+static bool WritesBack(BitOp op) {
+    return op != BitOp::Cmpv && op != BitOp::Tst0 && op != BitOp::Tst1;
+}
+
+std::uint16_t DspEmulator::BitOperation(BitOp op, std::uint16_t value, std::uint16_t operand) {
+    MaterializeFlags();
+    DspFlags& f = state.flags;
+    std::uint32_t result = value;
+    switch (op) {
+    case BitOp::Set:
+        result = value | operand;
+        break;
+    case BitOp::Rst:
+        result = value & ~operand;
+        break;
+    case BitOp::Chng:
+        result = value ^ operand;
+        break;
+    case BitOp::Addv:
+        result = std::uint32_t{value} + operand;
+        f.c = result >> 16;
+        break;
+    case BitOp::Subv:
+    case BitOp::Cmpv:
+        result = std::uint32_t{value} - operand;
+        f.c = value < operand;
+        break;
+    case BitOp::Tst0:
+        f.z = (value & operand) == 0;
+        return value;
+    case BitOp::Tst1:
+        f.z = (~value & operand) == 0;
+        return value;
+    }
+    f.z = (result & 0xFFFF) == 0;
+    f.m = (result >> 15) & 1;
+    return op == BitOp::Cmpv ? value : static_cast<std::uint16_t>(result);
+}
+
+void DspEmulator::Push(std::uint16_t value) {
+    memory.Store(--state.sp, value);
+}
+
+std::uint16_t DspEmulator::Pop() {
+    return memory.Load(state.sp++);
+}
+
+void DspEmulator::PushPc() {
+    Push(static_cast<std::uint16_t>(state.pc >> 16));
+    Push(static_cast<std::uint16_t>(state.pc));
+}
+
+void DspEmulator::PopPc() {
+    const std::uint16_t low = Pop();
+    state.pc = low | static_cast<std::uint32_t>(Pop() & 3) << 16;
+}
+
+void DspEmulator::RestoreShadows() {
+    const std::int64_t a0 = state.acc[0];
+    const std::int64_t a1 = state.acc[1];
+    WriteRegister(DspReg::St0, state.shadows[0]);
+    WriteRegister(DspReg::St1, state.shadows[1]);
+    WriteRegister(DspReg::St2, state.shadows[2]);
+    state.acc[0] = a0;
+    state.acc[1] = a1;
+    std::swap(state.acc[1], state.acc[3]);
+}
+
+bool DspEmulator::Execute(const DecodedOp& op) {
+    const auto reg = [&](size_t i) { return static_cast<DspReg>(op.f[i]); };
+    const auto page_address = [&](std::uint8_t low) { return static_cast<std::uint16_t>(state.page << 8 | low); };
+    const auto alu_op = static_cast<AluOp>(op.aux);
+    const auto step = [&](size_t i) { return static_cast<StepCode>(op.f[i]); };
+    // The address of the instruction, as the pc is past it.
+    const auto at = [&](std::uint32_t next) { return next - op.length; };
+
+    switch (op.op) {
+    case EmuOp::Undefined:
+        stop = StopReason::Undefined;
+        return false;
+    case EmuOp::Unimplemented:
+        stop = StopReason::Unimplemented;
+        return false;
+    case EmuOp::Trap:
+        stop = StopReason::Trap;
+        return false;
+    case EmuOp::Nop:
+        return true;
+
+    case EmuOp::AluImm:
+        Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, static_cast<std::uint16_t>(op.imm)));
+        return true;
+    case EmuOp::AluMemImm8:
+        Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, memory.Load(page_address(op.f[1]))));
+        return true;
+    case EmuOp::AluMemImm16:
+        Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, memory.Load(static_cast<std::uint16_t>(op.imm))));
+        return true;
+    case EmuOp::AluMemR7:
+        Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, memory.Load(static_cast<std::uint16_t>(state.r[7] + op.imm))));
+        return true;
+    case EmuOp::AluMemRn:
+        Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, memory.Load(Address(op.f[1], step(2)))));
+        return true;
+    case EmuOp::AluReg:
+        if (reg(1) == DspReg::P0 || reg(1) == DspReg::P1) {
+            Alu(alu_op, AccIndex(op.f[0]), Product(reg(1) == DspReg::P1));
+        } else {
+            Alu(alu_op, AccIndex(op.f[0]), AluOperand(alu_op, ReadRegister(reg(1))));
+        }
+        return true;
+    case EmuOp::AluAcc:
+        Alu(alu_op, AccIndex(op.f[0]), state.acc[AccIndex(op.f[1])]);
+        return true;
+
+    case EmuOp::AccUnary:
+        if (Condition(op.f[1])) {
+            Unary(static_cast<UnaryOp>(op.aux), AccIndex(op.f[0]), op.f[2]);
+        }
+        return true;
+
+    case EmuOp::MovImmReg:
+        WriteRegister(reg(0), static_cast<std::uint16_t>(op.imm));
+        return true;
+    case EmuOp::MovRegReg:
+        WriteRegister(reg(1), ReadRegister(reg(0)));
+        return true;
+    case EmuOp::MovAccAcc:
+        SetAccumulator(AccIndex(op.f[1]), state.acc[AccIndex(op.f[0])]);
+        return true;
+    case EmuOp::MovMemImm8Reg:
+        WriteRegister(reg(0), memory.Load(page_address(op.f[1])));
+        return true;
+    case EmuOp::MovRegMemImm8:
+        memory.Store(page_address(op.f[1]), ReadRegister(reg(0)));
+        return true;
+    case EmuOp::MovMemImm16Reg:
+        WriteRegister(reg(0), memory.Load(static_cast<std::uint16_t>(op.imm)));
+        return true;
+    case EmuOp::MovRegMemImm16:
+        memory.Store(static_cast<std::uint16_t>(op.imm), ReadRegister(reg(0)));
+        return true;
+    case EmuOp::MovMemR7Reg:
+        WriteRegister(reg(0), memory.Load(static_cast<std::uint16_t>(state.r[7] + op.imm)));
+        return true;
+    case EmuOp::MovRegMemR7:
+        memory.Store(static_cast<std::uint16_t>(state.r[7] + op.imm), ReadRegister(reg(0)));
+        return true;
+    case EmuOp::MovMemRnReg:
+        WriteRegister(reg(0), memory.Load(Address(op.f[1], step(2))));
+        return true;
+    case EmuOp::MovRegMemRn: {
+        // The source is read first, in case it is the address register itself.
+        const std::uint16_t value = ReadRegister(reg(0));
+        memory.Store(Address(op.f[1], step(2)), value);
+        return true;
+    }
+
+    case EmuOp::Br:
+        if (Condition(op.f[0])) {
+            state.pc = op.imm;
+        }
+        return true;
+    case EmuOp::Call:
+        if (Condition(op.f[0])) {
+            const std::uint32_t return_pc = state.pc;
+            PushPc();
+            state.pc = op.imm;
+            Flow(FlowEvent::Call, at(return_pc), return_pc);
+        }
+        return true;
+    case EmuOp::CallReg: {
+        const bool whole = reg(0) >= DspReg::A0 && reg(0) <= DspReg::B1;
+        const std::uint32_t target = whole ? static_cast<std::uint32_t>(state.acc[AccIndex(op.f[0])] & 0x3FFFF) : ReadRegister(reg(0));
+        const std::uint32_t return_pc = state.pc;
+        PushPc();
+        state.pc = target;
+        Flow(FlowEvent::Call, at(return_pc), return_pc);
+        return true;
+    }
+    case EmuOp::Ret:
+        if (Condition(op.f[0])) {
+            const std::uint32_t address = at(state.pc);
+            PopPc();
+            Flow(FlowEvent::Return, address, state.pc);
+        }
+        return true;
+    case EmuOp::Reti:
+        if (Condition(op.f[0])) {
+            const std::uint32_t address = at(state.pc);
+            PopPc();
+            if (op.aux) {
+                RestoreShadows();
+            }
+            state.ie = true;
+            CheckInterrupts();
+            Flow(FlowEvent::Return, address, state.pc);
+        }
+        return true;
+    case EmuOp::Rets: {
+        const std::uint32_t address = at(state.pc);
+        PopPc();
+        state.sp = static_cast<std::uint16_t>(state.sp + op.imm);
+        Flow(FlowEvent::Return, address, state.pc);
+        return true;
+    }
+    case EmuOp::Rep:
+    case EmuOp::RepReg:
+        state.repeating = true;
+        state.rep_pc = state.pc;
+        state.repc = op.op == EmuOp::Rep ? static_cast<std::uint16_t>(op.imm) : ReadRegister(reg(0));
+        return true;
+    case EmuOp::Bkrep:
+    case EmuOp::BkrepReg: {
+        if (state.loop_depth == state.loops.size()) {
+            stop = StopReason::Unimplemented;
+            return false;
+        }
+        const std::uint16_t count = op.op == EmuOp::Bkrep ? std::uint16_t{op.f[0]} : ReadRegister(reg(0));
+        state.loops[state.loop_depth++] = BlockRepeat{state.pc, op.imm, count};
+        return true;
+    }
+    case EmuOp::BkrepSto: {
+        // Four words, stored downwards as pushes are: lc, the end, the start, then the high bits
+        // of both addresses.
+        std::uint16_t& pointer = op.aux ? state.sp : state.r[op.f[0]];
+        const BlockRepeat& loop = state.loops[state.loop_depth ? state.loop_depth - 1 : 0];
+        for (const std::uint32_t word : {std::uint32_t{loop.lc}, loop.end, loop.start, (loop.start >> 16) | (loop.end >> 16) << 8}) {
+            memory.Store(--pointer, static_cast<std::uint16_t>(word));
+        }
+        if (state.loop_depth) {
+            state.loop_depth--;
+        }
+        return true;
+    }
+    case EmuOp::BkrepRst: {
+        std::uint16_t& pointer = op.aux ? state.sp : state.r[op.f[0]];
+        const std::uint16_t high = memory.Load(pointer);
+        const BlockRepeat loop{memory.Load(static_cast<std::uint16_t>(pointer + 1)) | (high & 3u) << 16,
+                               memory.Load(static_cast<std::uint16_t>(pointer + 2)) | ((high >> 8) & 3u) << 16,
+                               memory.Load(static_cast<std::uint16_t>(pointer + 3))};
+        // Blocks only stop where the body of some bkrep in the program ends.
+        if (state.loop_depth == state.loops.size() || loop.end >= loop_ends.size() || !loop_ends[loop.end]) {
+            stop = StopReason::Unimplemented;
+            return false;
+        }
+        pointer += 4;
+        state.loops[state.loop_depth++] = loop;
+        return true;
+    }
+    case EmuOp::Break:
+        if (state.loop_depth) {
+            state.loop_depth--;
+        }
+        return true;
+    case EmuOp::Eint:
+        state.ie = true;
+        CheckInterrupts();
+        return true;
+    case EmuOp::Dint:
+        state.ie = false;
+        return true;
+    case EmuOp::Cntx:
+        if (op.aux) {
+            RestoreShadows();
+        } else {
+            state.shadows = {ReadRegister(DspReg::St0), ReadRegister(DspReg::St1), ReadRegister(DspReg::St2)};
+            std::swap(state.acc[1], state.acc[3]);
+        }
+        return true;
+    case EmuOp::Push:
+        Push(ReadRegister(reg(0)));
+        return true;
+    case EmuOp::PushImm:
+        Push(static_cast<std::uint16_t>(op.imm));
+        return true;
+    case EmuOp::Pop:
+        WriteRegister(reg(0), Pop());
+        return true;
+    case EmuOp::Modr:
+        Modr(op);
+        return true;
+
+    case EmuOp::MulReg:
+    case EmuOp::MulMemImm8:
+    case EmuOp::MulMemRn: {
+        const auto mul_op = static_cast<MulOp>(op.aux);
+        std::uint16_t value;
+        if (op.op == EmuOp::MulReg) {
+            value = ReadRegister(reg(0));
+        } else if (op.op == EmuOp::MulMemImm8) {
+            value = memory.Load(page_address(op.f[0]));
+        } else {
+            value = memory.Load(Address(op.f[0], step(2)));
+        }
+        const bool square = mul_op == MulOp::Sqr || mul_op == MulOp::Sqra;
+        Multiply(mul_op, AccIndex(op.f[1]), square ? value : state.y[0], value);
+        return true;
+    }
+    case EmuOp::MulMemRnImm: {
+        const std::uint16_t value = memory.Load(Address(op.f[0], step(2)));
+        Multiply(static_cast<MulOp>(op.aux), AccIndex(op.f[1]), value, static_cast<std::uint16_t>(op.imm));
+        return true;
+    }
+    case EmuOp::Mpyi:
+        Multiply(MulOp::Mpy, 0, state.y[0], static_cast<std::uint16_t>(op.imm));
+        return true;
+    case EmuOp::Clrp:
+        state.p[reg(0) == DspReg::P1] = 0;
+        return true;
+
+    case EmuOp::BitReg: {
+        const auto bit_op = static_cast<BitOp>(op.aux);
+        const std::uint16_t value = BitOperation(bit_op, ReadRegister(reg(0)), static_cast<std::uint16_t>(op.imm));
+        if (WritesBack(bit_op)) {
+            WriteRegister(reg(0), value);
+        }
+        return true;
+    }
+    case EmuOp::BitMemImm8: {
+        const auto bit_op = static_cast<BitOp>(op.aux);
+        const std::uint16_t address = page_address(op.f[0]);
+        const std::uint16_t value = BitOperation(bit_op, memory.Load(address), static_cast<std::uint16_t>(op.imm));
+        if (WritesBack(bit_op)) {
+            memory.Store(address, value);
+        }
+        return true;
+    }
+    case EmuOp::BitMemRn: {
+        const auto bit_op = static_cast<BitOp>(op.aux);
+        const std::uint16_t address = Address(op.f[0], step(1));
+        const std::uint16_t value = BitOperation(bit_op, memory.Load(address), static_cast<std::uint16_t>(op.imm));
+        if (WritesBack(bit_op)) {
+            memory.Store(address, value);
+        }
+        return true;
+    }
+    case EmuOp::TstbReg:
+        MaterializeFlags();
+        state.flags.z = (ReadRegister(reg(0)) >> op.f[1]) & 1;
+        return true;
+    case EmuOp::TstbMemImm8:
+        MaterializeFlags();
+        state.flags.z = (memory.Load(page_address(op.f[0])) >> op.f[1]) & 1;
+        return true;
+    case EmuOp::TstbMemRn:
+        MaterializeFlags();
+        state.flags.z = (memory.Load(Address(op.f[0], step(2))) >> op.f[1]) & 1;
+        return true;
+    case EmuOp::Shfi:
+        Shift(AccIndex(op.f[0]), AccIndex(op.f[1]), static_cast<std::int16_t>(op.imm));
+        return true;
+    case EmuOp::Shfc:
+        if (Condition(op.f[2])) {
+            Shift(AccIndex(op.f[0]), AccIndex(op.f[1]), static_cast<std::int16_t>(state.sv));
+        }
+        return true;
+    case EmuOp::Count:
+        break;
+    }
+    stop = StopReason::Undefined;
+    return false;
+}
+
+bool DspEmulator::Step() {
+    const std::uint32_t pc = state.pc;
+    const DecodedOp& op = decoded[pc];
+    state.pc = pc + op.length;
+    if (!Execute(op)) {
+        if (stop == StopReason::Trap) {
+            cycles++;
+        } else {
+            state.pc = pc;
+        }
+        return false;
+    }
+    cycles++;
+
+    if (state.repeating && pc == state.rep_pc) {
+        if (state.repc == 0) {
+            state.repeating = false;
+        } else {
+            state.repc--;
+            state.pc = pc;
+        }
+    }
+    CheckBlockRepeat();
+    return true;
+}
+
+bool DspEmulator::RepeatsInPlace(std::uint32_t pc) const {
+    // Step would also end a block repeat at each repetition if the pc stayed on its end.
+    return !EndsBlock(decoded[pc]) && !(state.loop_depth && state.loops[state.loop_depth - 1].end + 1 == pc);
+}
+
+bool DspEmulator::RunRepeat(std::uint64_t budget) {
+    const std::uint32_t pc = state.rep_pc;
+    std::unique_ptr<Block>& body = repeat_blocks[pc];
+    if (!body) {
+        body = BuildBlock(pc, 1);
+        body->repeat = true;
+    }
+    if (dispatch == DispatchMode::Jit && !body->repeat_code && body->runs++ == jit_threshold) {
+        Compile(*body);
+    }
+    if (body->repeat_code) {
+        // All the repetitions the budget has room for in one call.
+        const std::uint64_t times = std::min<std::uint64_t>(budget, std::uint64_t{state.repc} + 1);
+        MaterializeFlags();
+        body->repeat_code(&state, memory.Data(), static_cast<std::uint32_t>(times));
+        cycles += times;
+        if (times <= state.repc) {
+            state.repc = static_cast<std::uint16_t>(state.repc - times);
+            state.pc = pc;
+        } else {
+            state.repc = 0;
+            state.repeating = false;
+            CheckBlockRepeat();
+        }
+        return true;
+    }
+    for (; budget; budget--) {
+        if (!RunBlock(*body))
+            return false;
+        if (state.repc == 0) {
+            state.repeating = false;
+            CheckBlockRepeat();
+            return true;
+        }
+        state.repc--;
+        state.pc = pc;
+    }
+    return true;
+}
+
+std::uint64_t DspEmulator::ScheduleEvent(std::uint64_t cycle, EventCallback callback, void* context) {
+    service_at = std::min(service_at, cycle);
+    return events.Schedule(cycle, callback, context);
+}
+
+bool DspEmulator::CancelEvent(std::uint64_t id) {
+    return events.Cancel(id);
+}
+
+void DspEmulator::RaiseInterrupt(unsigned line) {
+    assert(line < interrupt_vectors.size());
+    state.ip |= 1 << line;
+    service_at = 0;
+}
+
+void DspEmulator::CheckInterrupts() {
+    if (state.ip) {
+        service_at = 0;
+    }
+}
+
+void DspEmulator::Service() {
+    events.RunDue(cycles);
+    if (!program_writes.empty()) {
+        StoreProgramWrites();
+    }
+    service_at = events.NextCycle();
+    const unsigned ready = state.ie ? state.ip & state.im : 0;
+    if (!ready)
+        return;
+    // A rep runs to the end first; line 0 goes before 1, and 1 before 2.
+    if (state.repeating) {
+        service_at = cycles + 1;
+        return;
+    }
+    unsigned line = 0;
+    while (!((ready >> line) & 1)) {
+        line++;
+    }
+    state.ip &= ~(1 << line);
+    state.ie = false;
+    const std::uint32_t interrupted = state.pc;
+    PushPc();
+    state.pc = interrupt_vectors[line];
+    Flow(FlowEvent::Interrupt, interrupted, interrupted);
+}
+
+void DspEmulator::CheckBlockRepeat() {
+    if (state.loop_depth) {
+        BlockRepeat& loop = state.loops[state.loop_depth - 1];
+        if (state.pc == loop.end + 1) {
+            if (loop.lc == 0) {
+                state.loop_depth--;
+            } else {
+                loop.lc--;
+                state.pc = loop.start;
+            }
+        }
+    }
+}
+
+bool DspEmulator::RunBlock(Block& block) {
+    ThreadedOp* op = block.ops.data();
+#if defined(__GNUC__)
+    // Direct threading: each op holds the address of its handler, and each handler jumps
+    // straight to the next op's, so there is no loop or switch between instructions. The common
+    // operations have handlers of their own; the rest go through Execute.
+    if (!block.threaded) {
+        for (ThreadedOp& threaded : block.ops) {
+            switch (threaded.op.op) {
+            case EmuOp::Nop:
+                threaded.handler = &&nop;
+                break;
+            case EmuOp::AluImm:
+                threaded.handler = &&alu_imm;
+                break;
+            case EmuOp::AluMemRn:
+                threaded.handler = &&alu_mem_rn;
+                break;
+            case EmuOp::AluAcc:
+                threaded.handler = &&alu_acc;
+                break;
+            case EmuOp::AccUnary:
+                threaded.handler = &&acc_unary;
+                break;
+            case EmuOp::MovImmReg:
+                threaded.handler = &&mov_imm_reg;
+                break;
+            case EmuOp::MovRegReg:
+                threaded.handler = &&mov_reg_reg;
+                break;
+            case EmuOp::MovMemRnReg:
+                threaded.handler = &&mov_mem_rn_reg;
+                break;
+            case EmuOp::MovRegMemRn:
+                threaded.handler = &&mov_reg_mem_rn;
+                break;
+            case EmuOp::MulMemRn:
+                threaded.handler = &&mul_mem_rn;
+                break;
+            case EmuOp::Modr:
+                threaded.handler = &&modr;
+                break;
+            default:
+                threaded.handler = &&generic;
+                break;
+            }
+        }
+        block.ops.back().handler = &&leave;
+        block.threaded = true;
+    }
+    goto *op->handler;
+
+    // Each handler starts with the pc past its instruction, as Execute expects.
+generic:
+    state.pc = op->next;
+    if (!Execute(op->op))
+        goto stopped;
+    goto *(++op)->handler;
+nop:
+    state.pc = op->next;
+    goto *(++op)->handler;
+alu_imm: {
+    state.pc = op->next;
+    const auto alu_op = static_cast<AluOp>(op->op.aux);
+    Alu(alu_op, AccIndex(op->op.f[0]), AluOperand(alu_op, static_cast<std::uint16_t>(op->op.imm)));
+    goto *(++op)->handler;
+}
+alu_mem_rn: {
+    state.pc = op->next;
+    const auto alu_op = static_cast<AluOp>(op->op.aux);
+    Alu(alu_op, AccIndex(op->op.f[0]), AluOperand(alu_op, memory.Load(Address(op->op.f[1], static_cast<StepCode>(op->op.f[2])))));
+    goto *(++op)->handler;
+}
+alu_acc:
+    state.pc = op->next;
+    Alu(static_cast<AluOp>(op->op.aux), AccIndex(op->op.f[0]), state.acc[AccIndex(op->op.f[1])]);
+    goto *(++op)->handler;
+acc_unary:
+    state.pc = op->next;
+    if (Condition(op->op.f[1])) {
+        Unary(static_cast<UnaryOp>(op->op.aux), AccIndex(op->op.f[0]), op->op.f[2]);
+    }
+    goto *(++op)->handler;
+mov_imm_reg:
+    state.pc = op->next;
+    WriteRegister(static_cast<DspReg>(op->op.f[0]), static_cast<std::uint16_t>(op->op.imm));
+    goto *(++op)->handler;
+mov_reg_reg:
+    state.pc = op->next;
+    WriteRegister(static_cast<DspReg>(op->op.f[1]), ReadRegister(static_cast<DspReg>(op->op.f[0])));
+    goto *(++op)->handler;
+mov_mem_rn_reg:
+    state.pc = op->next;
+    WriteRegister(static_cast<DspReg>(op->op.f[0]), memory.Load(Address(op->op.f[1], static_cast<StepCode>(op->op.f[2]))));
+    goto *(++op)->handler;
+mov_reg_mem_rn: {
+    state.pc = op->next;
+    const std::uint16_t value = ReadRegister(static_cast<DspReg>(op->op.f[0]));
+    memory.Store(Address(op->op.f[1], static_cast<StepCode>(op->op.f[2])), value);
+    goto *(++op)->handler;
+}
+mul_mem_rn: {
+    state.pc = op->next;
+    const auto mul_op = static_cast<MulOp>(op->op.aux);
+    const std::uint16_t value = memory.Load(Address(op->op.f[0], static_cast<StepCode>(op->op.f[2])));
+    const bool square = mul_op == MulOp::Sqr || mul_op == MulOp::Sqra;
+    Multiply(mul_op, AccIndex(op->op.f[1]), square ? value : state.y[0], value);
+    goto *(++op)->handler;
+}
+modr:
+    state.pc = op->next;
+    Modr(op->op);
+    goto *(++op)->handler;
+leave:
+#else
+    // Without computed goto a block still saves Step's checks after each instruction.
+    for (const ThreadedOp* last = &block.ops.back(); op != last; ++op) {
+        state.pc = op->next;
+        if (!Execute(op->op))
+            goto stopped;
+    }
+#endif
+    cycles += block.ops.size() - 1;
+    return true;
+
+stopped:
+    StopInBlock(block, op - block.ops.data());
+    return false;
+}
+
+void DspEmulator::StopInBlock(const Block& block, size_t index) {
+    // Only the last instruction of a block can stop the run.
+    const ThreadedOp& op = block.ops[index];
+    cycles += index;
+    if (stop == StopReason::Trap) {
+        cycles++;
+    } else {
+        state.pc = op.next - op.op.length;
+    }
+}
+
+bool DspEmulator::ExecuteFromJit(void* context, const DecodedOp* op, std::uint32_t next) {
+    DspEmulator& emulator = *static_cast<DspEmulator*>(context);
+    emulator.state.pc = next;
+    // Compiled code keeps the flags worked out.
+    const bool ok = emulator.Execute(*op);
+    emulator.MaterializeFlags();
+    return ok;
+}
+
+void DspEmulator::Compile(Block& block) {
+    if (!jit) {
+        jit = std::make_unique<JitCompiler>(&DspEmulator::ExecuteFromJit);
+    }
+    jit->SetDirectData(!memory.HasMmio());
+    if (block.repeat) {
+        // Only native code can repeat, and a full buffer leaves the repeat to RunBlock until the
+        // next flush.
+        block.repeat_code = jit->CompileRepeat(JitInstruction{&block.ops[0].op, block.ops[0].next});
+        return;
+    }
+    std::vector<JitInstruction> instructions;
+    for (size_t i = 0; i + 1 < block.ops.size(); i++) {
+        instructions.push_back(JitInstruction{&block.ops[i].op, block.ops[i].next});
+    }
+    block.code = jit->Compile(instructions.data(), instructions.size());
+    if (!block.code && JitCompiler::Available()) {
+        // The code buffer is full: start over, recompiling blocks as they get hot again.
+        DropCompiledCode();
+        block.code = jit->Compile(instructions.data(), instructions.size());
+    }
+}
+
+void DspEmulator::DropCompiledCode() {
+    if (!jit)
+        return;
+    jit->Flush();
+    for (auto* cache : {&blocks, &repeat_blocks}) {
+        for (const auto& block : *cache) {
+            if (block) {
+                block->code = nullptr;
+                block->repeat_code = nullptr;
+                block->runs = 0;
+            }
+        }
+    }
+}
+
+bool DspEmulator::RunCachedBlock(Block& block) {
+    if (dispatch == DispatchMode::Jit && !block.code && block.runs++ == jit_threshold) {
+        Compile(block);
+    }
+    return block.code ? RunCompiled(block) : RunBlock(block);
+}
+
+bool DspEmulator::RunCompiled(Block& block) {
+    MaterializeFlags();
+    const std::uint32_t ran = block.code(&state, memory.Data(), this);
+    if (ran + 1 < block.ops.size()) {
+        StopInBlock(block, ran);
+        return false;
+    }
+    cycles += ran;
+    return true;
+}
+
+RunResult DspEmulator::Run(std::uint64_t max_cycles) {
+    running = true;
+    const RunResult result = RunInstructions(max_cycles);
+    running = false;
+    StoreProgramWrites();
+    return result;
+}
+
+RunResult DspEmulator::RunInstructions(std::uint64_t max_cycles) {
+    const std::uint64_t start = cycles;
+    const auto stopped = [&] {
+        MaterializeFlags();
+        return RunResult{stop, cycles - start, state.pc,
+                         stop == StopReason::Trap ? std::uint16_t{0} : memory.Program()[state.pc]};
+    };
+
+    UpdateAddressing();
+    // Cycles left before the budget runs out or something needs servicing.
+    const auto budget = [&] { return std::min(max_cycles - (cycles - start), service_at > cycles ? service_at - cycles : 0); };
+    Block* block = nullptr;
+    while (cycles - start < max_cycles) {
+        if (cycles >= service_at) {
+            block = nullptr;
+            Service();
+        }
+        const std::uint32_t pc = state.pc;
+        if (pc >= decoded.size()) {
+            MaterializeFlags();
+            return RunResult{StopReason::EndOfProgram, cycles - start, pc, 0};
+        }
+
+        // A repeated instruction loops in place where it can; otherwise it runs on its own, as
+        // does a block the budget has no room for.
+        if (dispatch != DispatchMode::Switch && state.repeating && pc == state.rep_pc && RepeatsInPlace(pc)) {
+            block = nullptr;
+            if (!RunRepeat(budget()))
+                return stopped();
+            continue;
+        }
+        if (dispatch != DispatchMode::Switch && !state.repeating) {
+            block = &NextBlock(block, pc);
+            const size_t length = block->ops.size() - 1;
+            if (length <= budget()) {
+                if (!RunCachedBlock(*block))
+                    return stopped();
+                // A block that is a whole repeat body goes round again without being looked up.
+                while (state.loop_depth && length <= budget()) {
+                    BlockRepeat& loop = state.loops[state.loop_depth - 1];
+                    if (loop.lc == 0 || loop.start != block->start || state.pc != loop.end + 1)
+                        break;
+                    loop.lc--;
+                    state.pc = loop.start;
+                    if (!RunCachedBlock(*block))
+                        return stopped();
+                }
+                CheckBlockRepeat();
+                continue;
+            }
+        }
+        block = nullptr;
+        if (!Step())
+            return stopped();
+    }
+    MaterializeFlags();
+    return RunResult{StopReason::CycleLimit, cycles - start, state.pc, 0};
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "emu_decode.h"
+#include "emu_events.h"
+#include "emu_jit.h"
+#include "emu_memory.h"
+
+struct DspSnapshot;
+
+struct DspFlags {
+    bool z = false;
+    bool m = false;
+    bool n = false;
+    bool v = false;
+    bool c = false;
+    bool e = false;
+    bool l = false;
+    bool r = false;
+};
+
+// The last operation that set flags but has not had them worked out yet.
+enum class FlagSource : std::uint8_t {
+    None,
+    // z, m, n and e of the 40-bit value flag_a.
+    Result,
+    // All but r of flag_a + flag_b, or flag_a - flag_b, with l accumulating v.
+    Add,
+    Sub,
+};
+
+struct BlockRepeat {
+    std::uint32_t start = 0;
+    // Last address of the body.
+    std::uint32_t end = 0;
+    std::uint16_t lc = 0;
+};
+
+// How one step moves an address register: the bits under `mask` go up by `step`, except that
+// they wrap from `edge` to `wrap`. A linear update's edge steps to its wrap anyway, and a modulo
+// of 0 leaves no bits under the mask.
+struct AddressUpdate {
+    std::uint16_t step = 0;
+    std::uint16_t mask = 0xFFFF;
+    std::uint16_t edge = 0;
+    std::uint16_t wrap = 0;
+};
+
+struct DspState {
+    // a0, a1, b0, b1: 40 bits, sign-extended.
+    std::array<std::int64_t, 4> acc{};
+    std::array<std::uint16_t, 8> r{};
+    std::array<std::uint16_t, 2> x{};
+    std::array<std::uint16_t, 2> y{};
+    std::array<std::int64_t, 2> p{};
+    // Lags behind while flag_source is pending during a run; Run and State() settle it.
+    DspFlags flags;
+    FlagSource flag_source = FlagSource::None;
+    std::int64_t flag_a = 0;
+    std::int64_t flag_b = 0;
+    std::uint32_t pc = 0;
+    std::uint16_t sp = 0;
+    std::uint16_t sv = 0;
+    std::uint16_t cfgi = 0;
+    std::uint16_t cfgj = 0;
+    std::uint16_t stepi0 = 0;
+    std::uint16_t stepj0 = 0;
+    std::array<std::uint16_t, 4> ext{};
+    std::uint16_t mixp = 0;
+    std::uint16_t icr = 0;
+    std::uint16_t st2 = 0;
+    std::uint8_t page = 0;
+    std::uint8_t ps = 0;
+    bool sat = false;
+    bool ie = false;
+    // im0 and im1 from st0, im2 from st2.
+    std::uint8_t im = 0;
+    // Interrupt lines raised and not yet taken, a bit each.
+    std::uint8_t ip = 0;
+    // By register and StepCode, worked out from cfgi, cfgj and st2 whenever they are written, and
+    // by Run on entry for changes made through State().
+    std::array<std::array<AddressUpdate, 6>, 8> address_updates{};
+    // st0, st1 and st2 as cntx s saved them, for cntx r to bring back; the accumulator bits in
+    // st0 and st1 are not restored.
+    std::array<std::uint16_t, 3> shadows{};
+
+    // The instruction after a rep runs repc + 1 times.
+    bool repeating = false;
+    std::uint32_t rep_pc = 0;
+    std::uint16_t repc = 0;
+    // Active block repeats, innermost last.
+    std::array<BlockRepeat, 4> loops{};
+    std::uint8_t loop_depth = 0;
+};
+
+enum class StopReason {
+    // The cycle budget ran out.
+    CycleLimit,
+    // The pc left the loaded program.
+    EndOfProgram,
+    // A trap instruction ran; the pc is past it, so running again resumes.
+    Trap,
+    // An instruction the emulator does not support; the pc is at it.
+    Unimplemented,
+    // A word that is no instruction; the pc is at it.
+    Undefined,
+};
+
+struct RunResult {
+    StopReason reason;
+    // Cycles spent by this call.
+    std::uint64_t cycles;
+    std::uint32_t pc;
+    // The instruction word at the pc for Unimplemented and Undefined.
+    std::uint16_t opcode;
+};
+
+const char* StopReasonName(StopReason reason);
+
+// How the pc moves between routines.
+enum class FlowEvent {
+    Call,
+    Interrupt,
+    Return,
+};
+
+// Called with the context it was set with once a call, interrupt or return has moved the pc.
+// `at` is the address of the instruction, or for an interrupt of the one it came before;
+// `return_pc` is the pc pushed to return to, or for a return the pc popped.
+using FlowCallback = void (*)(void* context, FlowEvent event, std::uint32_t at, std::uint32_t return_pc);
+
+// A 16-bit operand of an ALU operation as the accumulator sees it: sign-extended, shifted to the
+// high word or zero-extended.
+std::int64_t AluOperand(AluOp op, std::uint16_t value);
+
+// How Run dispatches instructions. Both give the same results cycle for cycle.
+enum class DispatchMode {
+    // One DecodedOp at a time through a switch, checking repeats after each.
+    Switch,
+    // Basic blocks translated to threaded code on first use, cached and chained to their
+    // successors; repeats are only checked between blocks. The instruction under a rep loops on
+    // its own, and a block that is a whole bkrep body loops on itself. This only saves dispatch:
+    // in a Release build it runs the tdsp-emu-bench loops 1.1x to 1.5x as fast as Switch, where
+    // Jit reaches 2x to 3x.
+    Block,
+    // As Block, but blocks that keep running are compiled to host code where the host has a JIT
+    // (JitCompiler::Available).
+    Jit,
+};
+
+// A TeakLite interpreter for running DSP code headlessly, e.g. in tests. Program memory is
+// predecoded when loaded, so the run loop only dispatches on DecodedOps. Every instruction takes
+// one cycle; timers and other devices are events scheduled at cycle counts, which may raise
+// interrupts. Parallel forms and the rarer instructions stop the run as Unimplemented.
+class DspEmulator {
+public:
+    DspEmulator();
+
+    void SetDispatchMode(DispatchMode mode) { dispatch = mode; }
+    // How often a block runs before the Jit mode compiles it.
+    void SetJitThreshold(std::uint32_t runs) { jit_threshold = runs; }
+    // Instructions compiled to host code of their own, rather than calls into the interpreter.
+    std::uint64_t JitNativeCount() const { return jit ? jit->NativeCount() : 0; }
+
+    // Copies words into program memory at `address` and decodes them; the program ends after the
+    // last word loaded. Words past the program address space are dropped. Written during Run, by
+    // an I/O handler or event, the words are only loaded once the block or repeat running ends,
+    // as the Switch mode does after the instruction.
+    void LoadProgram(const std::uint16_t* words, size_t count, std::uint32_t address = 0);
+    void WriteProgram(std::uint32_t address, std::uint16_t value);
+    const std::uint16_t* Program() const { return memory.Program(); }
+    std::uint32_t ProgramSize() const { return static_cast<std::uint32_t>(decoded.size()); }
+
+    // Memory itself, under any I/O mapped over it.
+    std::uint16_t ReadData(std::uint16_t address) const { return memory.Data()[address]; }
+    void WriteData(std::uint16_t address, std::uint16_t value) { memory.Write(address, value); }
+    // Sends the program's accesses to whole data pages to a handler. Compiled code leaves
+    // instructions that touch data to the interpreter while any page is mapped. Handlers may
+    // write program memory, but not map or unmap pages or Restore.
+    void MapMmio(size_t first_page, size_t pages, const MmioHandler& handler);
+    void UnmapMmio(size_t first_page, size_t pages);
+
+    // Clears registers and flags and starts again at address zero; memory is kept.
+    void Reset();
+
+    // Copies the whole state, which Restore puts back, e.g. to rerun a test from the same point.
+    // Memory written since the last Snapshot or Restore of a snapshot is tracked by page, so
+    // restoring that snapshot again only copies the pages written since. Restore drops pending
+    // events, as Reset does; I/O mappings stay.
+    DspSnapshot Snapshot();
+    void Restore(const DspSnapshot& snapshot);
+
+    DspState& State() {
+        MaterializeFlags();
+        return state;
+    }
+    const DspState& State() const { return state; }
+    std::uint64_t Cycles() const { return cycles; }
+
+    std::uint16_t ReadRegister(DspReg reg) const;
+    void WriteRegister(DspReg reg, std::uint16_t value);
+
+    // Runs `callback` between instructions once Cycles() reaches `cycle`. Run cuts its blocks and
+    // repeats short to stop there, rather than checking for events after every instruction.
+    std::uint64_t ScheduleEvent(std::uint64_t cycle, EventCallback callback, void* context);
+    bool CancelEvent(std::uint64_t id);
+    // Raises interrupt line 0, 1 or 2. It is taken between instructions once ie and its im bit
+    // allow and no rep is running: the pc is pushed, ie cleared and the line's vector run. Raised
+    // from an I/O handler, the Block and Jit modes only take it after the block.
+    void RaiseInterrupt(unsigned line);
+
+    // Tells `callback` of every call, interrupt and return from then on, e.g. to follow the call
+    // stack; nullptr for none. Calls, returns and interrupts run in the interpreter in every
+    // mode, so this costs the modes nothing elsewhere.
+    void SetFlowCallback(FlowCallback callback, void* context) {
+        flow = callback;
+        flow_context = context;
+    }
+
+    RunResult Run(std::uint64_t max_cycles);
+
+private:
+    struct ThreadedOp {
+        // The label in RunBlock that runs `op`; set when the block first runs.
+        const void* handler = nullptr;
+        DecodedOp op;
+        // The address after the instruction.
+        std::uint32_t next = 0;
+    };
+
+    // Straight-line code from `start` up to and including the first instruction that can change
+    // the pc other than by falling through, or that ends a block repeat body.
+    struct Block {
+        std::uint32_t start = 0;
+        std::uint32_t end = 0;
+        // Followed by one more entry that leaves the block.
+        std::vector<ThreadedOp> ops;
+        bool threaded = false;
+        // The blocks most recently run after this one, valid while `epoch` is the emulator's.
+        std::array<Block*, 2> successors{};
+        std::uint32_t epoch = 0;
+        std::uint32_t runs = 0;
+        JitCode code = nullptr;
+        // A block of the one instruction under a rep, which compiles to repeat_code instead.
+        bool repeat = false;
+        JitRepeatCode repeat_code = nullptr;
+    };
+
+    struct ProgramWrite {
+        std::uint32_t address;
+        std::vector<std::uint16_t> words;
+    };
+
+    // LoadProgram, other than during Run.
+    void StoreProgram(const std::uint16_t* words, size_t count, std::uint32_t address);
+    void StoreProgramWrites();
+    RunResult RunInstructions(std::uint64_t max_cycles);
+    void Decode(std::uint32_t address);
+    // Drops the cached blocks that cover any address from `first` up to `end`.
+    void InvalidateBlocks(std::uint32_t first, std::uint32_t end);
+    std::unique_ptr<Block> BuildBlock(std::uint32_t start, size_t limit) const;
+    Block& NextBlock(Block* previous, std::uint32_t pc);
+
+    // False if the run has to stop, with the reason in `stop`.
+    bool Execute(const DecodedOp& op);
+    // Runs one instruction, as the Switch mode does for all of them.
+    bool Step();
+    // Whether the instruction under a rep at `pc` can loop in RunRepeat: it must not change the
+    // pc or stop the run.
+    bool RepeatsInPlace(std::uint32_t pc) const;
+    // Runs the instruction under a rep, as a block of its own, until the repeat ends or `budget`
+    // cycles pass.
+    bool RunRepeat(std::uint64_t budget);
+    // Runs a whole block, compiled once it is hot in the Jit mode.
+    bool RunCachedBlock(Block& block);
+    // Runs a whole block, counting its cycles; the pc is wherever it leaves to.
+    bool RunBlock(Block& block);
+    bool RunCompiled(Block& block);
+    // Accounts for a run that stopped at the instruction `index` into the block.
+    void StopInBlock(const Block& block, size_t index);
+    void Compile(Block& block);
+    // Empties the code buffer; blocks compile again once they are hot.
+    void DropCompiledCode();
+    static bool ExecuteFromJit(void* context, const DecodedOp* op, std::uint32_t next);
+    // Ends an iteration of the innermost block repeat if the pc just left its body.
+    void CheckBlockRepeat();
+    // Has Run service events and interrupts before the next instruction, if an interrupt is
+    // pending; for when ie or im change.
+    void CheckInterrupts();
+    // Runs the events due and takes an interrupt if one can be, then works out service_at.
+    void Service();
+
+    // Flags are only worked out when something reads them: a condition, st0 or the host.
+    DspFlags Flags() const;
+    void MaterializeFlags();
+    void DeferResult(std::int64_t value);
+    void DeferArithmetic(std::int64_t a, std::int64_t b, bool subtract);
+
+    bool Condition(std::uint8_t cond);
+    void UpdateAddressing();
+    // The address in register `reg`, which then takes the step.
+    std::uint16_t Address(std::uint8_t reg, StepCode step);
+    void Modr(const DecodedOp& op);
+    void Alu(AluOp op, std::uint8_t acc, std::int64_t operand);
+    void Unary(UnaryOp op, std::uint8_t acc, std::uint8_t source);
+    void Multiply(MulOp op, std::uint8_t acc, std::uint16_t y, std::uint16_t x);
+    std::uint16_t BitOperation(BitOp op, std::uint16_t value, std::uint16_t operand);
+    void Shift(std::uint8_t from, std::uint8_t to, std::int16_t amount);
+    void SetAccumulator(std::uint8_t acc, std::int64_t value);
+    // Sets accumulator `acc` to a +/- b.
+    void SetArithmetic(std::uint8_t acc, std::int64_t a, std::int64_t b, bool subtract);
+    std::int64_t Product(size_t index) const;
+    void Push(std::uint16_t value);
+    std::uint16_t Pop();
+    void PushPc();
+    void PopPc();
+    void Flow(FlowEvent event, std::uint32_t at, std::uint32_t return_pc) {
+        if (flow) {
+            flow(flow_context, event, at, return_pc);
+        }
+    }
+    // cntx r: st0, st1 and st2 back from the shadows, and a1 swapped with b1 again.
+    void RestoreShadows();
+
+    const DecodeTable& table;
+    std::vector<DecodedOp> decoded;
+    // By start address; blocks may overlap when code branches into the middle of one.
+    std::vector<std::unique_ptr<Block>> blocks;
+    // Blocks of just the instruction at an address, for when a rep repeats it.
+    std::vector<std::unique_ptr<Block>> repeat_blocks;
+    // Addresses some bkrep in the program names as the last of its body.
+    std::vector<bool> loop_ends;
+    // Bumped whenever blocks are dropped, which invalidates all successor links.
+    std::uint32_t block_epoch = 0;
+    DispatchMode dispatch = DispatchMode::Block;
+    // Created on first use.
+    std::unique_ptr<JitCompiler> jit;
+    std::uint32_t jit_threshold = 16;
+    DspMemory memory;
+    DspState state;
+    std::uint64_t cycles = 0;
+    // The snapshot memory was last taken for or restored from, which differs from it only in
+    // dirty pages.
+    std::uint64_t memory_snapshot = 0;
+    EventQueue events;
+    // The cycle Run next calls Service at: the next event's, or sooner for an interrupt.
+    std::uint64_t service_at = 0;
+    StopReason stop = StopReason::CycleLimit;
+    // Set while Run executes instructions, whose blocks and decoded ops must outlive them.
+    bool running = false;
+    // Program written while running, which Service stores.
+    std::vector<ProgramWrite> program_writes;
+    FlowCallback flow = nullptr;
+    void* flow_context = nullptr;
+};
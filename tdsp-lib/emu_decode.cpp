@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include "asm_instruction_part.h"
+#include "asm_parse.h"
+#include "emu_decode.h"
+#include "instruction_table_lexer.h"
+
+static const char* const register_names[] = {
+    "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+    "y0", "y1", "x0", "x1",
+    "p0", "p1",
+    "a0", "a1", "b0", "b1",
+    "a0l", "a1l", "b0l", "b1l",
+    "a0h", "a1h", "b0h", "b1h",
+    "a0e", "a1e", "b0e", "b1e",
+    "p0h",
+    "st0", "st1", "st2",
+    "pc", "sp", "cfgi", "cfgj", "stepi0", "stepj0",
+    "ext0", "ext1", "ext2", "ext3",
+    "lc", "sv", "repc", "mixp", "icr",
+    "page", "ps", "modi", "modj", "stepi", "stepj",
+};
+static_assert(std::size(register_names) == static_cast<size_t>(DspReg::Invalid));
+
+const char* DspRegName(DspReg reg) {
+    return reg < DspReg::Invalid ? register_names[static_cast<size_t>(reg)] : "?";
+}
+
+static DspReg RegisterByName(const std::string& name) {
+    for (size_t i = 0; i < std::size(register_names); i++) {
+        if (name == register_names[i])
+            return static_cast<DspReg>(i);
+    }
+    return DspReg::Invalid;
+}
+
+// The category a literal register stands for when no handler takes the literal itself.
+static const char* LiteralCategory(const std::string& name) {
+    const DspReg reg = RegisterByName(name);
+    if (reg == DspReg::Invalid)
+        return nullptr;
+    if (reg == DspReg::P0 || reg == DspReg::P1)
+        return "Product";
+    if (reg >= DspReg::A0 && reg <= DspReg::B1)
+        return "Acc";
+    return "Reg";
+}
+
+struct OperandKind {
+    const char* name;
+    const char* category;
+    std::uint8_t width;
+    bool is_signed;
+    const std::vector<std::string>* set;
+};
+
+static const OperandKind operand_kinds[] = {
+    {"Rn", "Reg", 3, false, &set_Rn},
+    {"Ax", "Acc", 1, false, &set_Ax},
+    {"Axl", "Reg", 1, false, &set_Axl},
+    {"Axh", "Reg", 1, false, &set_Axh},
+    {"Bx", "Acc", 1, false, &set_Bx},
+    {"Bxl", "Reg", 1, false, &set_Bxl},
+    {"Bxh", "Reg", 1, false, &set_Bxh},
+    {"Ab", "Acc", 2, false, &set_Ab},
+    {"Abl", "Reg", 2, false, &set_Abl},
+    {"Abh", "Reg", 2, false, &set_Abh},
+    {"Abe", "Reg", 2, false, &set_Abe},
+    {"Px", "Product", 1, false, &set_Px},
+    {"Ablh", "Reg", 3, false, &set_Ablh},
+    {"Cond", "Cond", 4, false, &set_Cond},
+    {"Register", "Reg", 5, false, &set_Register},
+    {"RegisterP0", "Reg", 5, false, &set_RegisterP0},
+    {"R0123457y0", "Reg", 3, false, &set_R0123457y0},
+    {"R01", "Reg", 1, false, &set_R01},
+    {"R04", "Reg", 1, false, &set_R04},
+    {"R45", "Reg", 1, false, &set_R45},
+    {"R0123", "Reg", 2, false, &set_R0123},
+    {"R0425", "Reg", 2, false, &set_R0425},
+    {"R4567", "Reg", 2, false, &set_R4567},
+    {"ArArpSttMod", "ArArpSttMod", 4, false, &set_ArArpSttMod},
+    {"ArArp", "ArArp", 3, false, &set_ArArp},
+    {"SttMod", "SttMod", 3, false, &set_SttMod},
+    {"Ar", "Ar", 1, false, &set_Ar},
+    {"Arp", "Arp", 2, false, &set_Arp},
+    {"MemRn", "MemRn", 3, false, &set_Rn},
+    {"MemR01", "MemRn", 1, false, &set_R01},
+    {"MemR0123", "MemRn", 2, false, &set_R0123},
+    {"MemR04", "MemRn", 1, false, &set_R04},
+    {"MemR0425", "MemRn", 2, false, &set_R0425},
+    {"MemR45", "MemRn", 1, false, &set_R45},
+    {"MemR4567", "MemRn", 2, false, &set_R4567},
+    {"MemR0", "MemR0", 0, false, nullptr},
+    {"MemSp", "MemSp", 0, false, nullptr},
+    {"ProgMemRn", "ProgMemRn", 3, false, &set_Rn},
+    {"ProgMemR45", "ProgMemRn", 1, false, &set_R45},
+    {"ProgMemAxl", "ProgMemAxl", 1, false, nullptr},
+    {"ProgMemAx", "ProgMemAx", 1, false, nullptr},
+    {"MemImm8", "MemImm8", 8, false, nullptr},
+    {"MemImm16", "MemImm16", 16, false, nullptr},
+    {"MemR7Imm7s", "MemR7", 7, true, nullptr},
+    {"MemR7Imm16", "MemR7", 16, false, nullptr},
+    {"BankFlags6", "BankFlags6", 6, false, nullptr},
+    {"SwapTypes4", "SwapTypes4", 4, false, nullptr},
+    {"Address16", "Address", 16, false, nullptr},
+    {"Address18", "Address", 16, false, nullptr},
+    // Resolved to the absolute target when decoding.
+    {"RelAddr7", "Address", 7, true, nullptr},
+    {"Imm2u", "Imm", 2, false, nullptr},
+    {"Imm4", "Imm", 4, false, nullptr},
+    {"Imm4u", "Imm", 4, false, nullptr},
+    {"Imm5s", "Imm", 5, true, nullptr},
+    {"Imm5u", "Imm", 5, false, nullptr},
+    {"Imm6s", "Imm", 6, true, nullptr},
+    {"Imm7s", "Imm", 7, true, nullptr},
+    {"Imm8", "Imm", 8, false, nullptr},
+    {"Imm8s", "Imm", 8, true, nullptr},
+    {"Imm9u", "Imm", 9, false, nullptr},
+    {"Imm8u", "Imm", 8, false, nullptr},
+    {"Imm16", "Imm", 16, false, nullptr},
+    {"Imm4bitno", "Imm", 4, false, nullptr},
+    {"stepZIDS", "Step", 2, false, nullptr},
+    {"modrstepZIDS", "Step", 2, false, nullptr},
+    {"stepII2D2S", "Step", 2, false, nullptr},
+    {"stepII2D2S0", "Step", 2, false, nullptr},
+    {"modrstepII2D2S0", "Step", 2, false, nullptr},
+    {"stepD2S", "Step", 1, false, nullptr},
+    {"stepII2", "Step", 1, false, nullptr},
+    {"modrstepI2", "Step", 0, false, nullptr},
+    {"modrstepD2", "Step", 0, false, nullptr},
+    // Written without a position, as modr's fixed steps.
+    {"stepI2", "Step", 0, false, nullptr},
+    {"stepD2", "Step", 0, false, nullptr},
+    {"offsZI", "Offset", 1, false, nullptr},
+    {"offsI", "Offset", 0, false, nullptr},
+    {"offsZIDZ", "Offset", 2, false, nullptr},
+    {"ConstZero", "Const", 0, false, nullptr},
+    {"Const1", "Const", 0, false, nullptr},
+    {"Const4", "Const", 0, false, nullptr},
+    {"Const8000h", "Const", 0, false, nullptr},
+};
+
+static const OperandKind* FindOperandKind(const std::string& name) {
+    for (const auto& kind : operand_kinds) {
+        if (name == kind.name)
+            return &kind;
+    }
+    return nullptr;
+}
+
+struct Handler {
+    EmuOp op;
+    std::uint8_t aux;
+    const char* layout;
+};
+
+static std::map<std::string, Handler> BuildHandlers() {
+    std::map<std::string, Handler> handlers;
+    const auto add = [&](const std::string& shape, EmuOp op, const char* layout, std::uint8_t aux = 0) {
+        handlers.emplace(shape, Handler{op, aux, layout});
+    };
+
+    const char* const alu_ops[] = {"add", "sub", "cmp", "and", "or", "xor", "addh", "addl", "subh", "subl", "cmpu"};
+    for (std::uint8_t i = 0; i < std::size(alu_ops); i++) {
+        const std::string m = alu_ops[i];
+        add(m + " Imm Acc", EmuOp::AluImm, "i0", i);
+        add(m + " MemImm8 Acc", EmuOp::AluMemImm8, "10", i);
+        add(m + " MemImm16 Acc", EmuOp::AluMemImm16, "i0", i);
+        add(m + " MemR7 Acc", EmuOp::AluMemR7, "i0", i);
+        add(m + " MemRn Acc Step", EmuOp::AluMemRn, "102", i);
+        add(m + " Reg Acc", EmuOp::AluReg, "10", i);
+        add(m + " Product Acc", EmuOp::AluReg, "10", i);
+        add(m + " Acc Acc", EmuOp::AluAcc, "10", i);
+    }
+
+    const char* const unary_ops[] = {"clr", "clrr", "inc", "dec", "neg", "not", "shl", "shr", "shl4", "shr4", "copy",
+                                     "rnd", "rol", "ror", "pacr"};
+    for (std::uint8_t i = 0; i < std::size(unary_ops); i++) {
+        const std::string m = unary_ops[i];
+        add(m + " Const Acc Cond", EmuOp::AccUnary, "-01", i);
+        add(m + " Acc Cond", EmuOp::AccUnary, "01", i);
+    }
+    add("copy Acc Acc Cond", EmuOp::AccUnary, "201", static_cast<std::uint8_t>(UnaryOp::Copy));
+    add("pacr Const p0 Acc Cond", EmuOp::AccUnary, "--01", static_cast<std::uint8_t>(UnaryOp::Pacr));
+
+    for (const std::string m : {"mov", "load"}) {
+        add(m + " Imm Reg", EmuOp::MovImmReg, "i0");
+        add(m + " Imm Acc", EmuOp::MovImmReg, "i0");
+    }
+    add("mov Reg Reg", EmuOp::MovRegReg, "01");
+    add("mov Reg Acc", EmuOp::MovRegReg, "01");
+    add("mov Acc Reg", EmuOp::MovRegReg, "01");
+    add("mov Acc Acc", EmuOp::MovAccAcc, "01");
+    for (const std::string r : {"Reg", "Acc"}) {
+        add("mov MemImm8 " + r, EmuOp::MovMemImm8Reg, "10");
+        add("mov " + r + " MemImm8", EmuOp::MovRegMemImm8, "01");
+        add("mov MemImm16 " + r, EmuOp::MovMemImm16Reg, "i0");
+        add("mov " + r + " MemImm16", EmuOp::MovRegMemImm16, "0i");
+        add("mov MemR7 " + r, EmuOp::MovMemR7Reg, "i0");
+        add("mov " + r + " MemR7", EmuOp::MovRegMemR7, "0i");
+        add("mov MemRn " + r + " Step", EmuOp::MovMemRnReg, "102");
+        add("mov " + r + " MemRn Step", EmuOp::MovRegMemRn, "012");
+    }
+
+    for (const std::string m : {"br", "brr"}) {
+        add(m + " Address Cond", EmuOp::Br, "i0");
+    }
+    for (const std::string m : {"call", "callr"}) {
+        add(m + " Address Cond", EmuOp::Call, "i0");
+    }
+    add("calla Reg", EmuOp::CallReg, "0");
+    add("calla Acc", EmuOp::CallReg, "0");
+    add("ret Cond", EmuOp::Ret, "0");
+    add("reti Cond", EmuOp::Reti, "0");
+    add("reti Cond context", EmuOp::Reti, "0-", 1);
+    add("rets Imm", EmuOp::Rets, "i");
+    add("rep Imm", EmuOp::Rep, "i");
+    add("rep Reg", EmuOp::RepReg, "0");
+    add("bkrep Imm Address", EmuOp::Bkrep, "0i");
+    add("bkrep Reg Address", EmuOp::BkrepReg, "0i");
+    add("bkrepsto MemRn", EmuOp::BkrepSto, "0");
+    add("bkrepsto MemSp", EmuOp::BkrepSto, "-", 1);
+    add("bkreprst MemRn", EmuOp::BkrepRst, "0");
+    add("bkreprst MemSp", EmuOp::BkrepRst, "-", 1);
+    add("break", EmuOp::Break, "");
+    add("eint", EmuOp::Eint, "");
+    add("dint", EmuOp::Dint, "");
+    add("cntx s", EmuOp::Cntx, "-");
+    add("cntx r", EmuOp::Cntx, "-", 1);
+    add("nop", EmuOp::Nop, "");
+    add("trap", EmuOp::Trap, "");
+    add("undefined", EmuOp::Undefined, "");
+    add("push Reg", EmuOp::Push, "0");
+    add("push Imm", EmuOp::PushImm, "i");
+    add("pop Reg", EmuOp::Pop, "0");
+    add("pop Acc", EmuOp::Pop, "0");
+    add("modr MemRn Step", EmuOp::Modr, "01");
+    add("modr MemRn Step dmod", EmuOp::Modr, "01-", 1);
+
+    const char* const mul_ops[] = {"mpy", "mpysu", "mac", "macsu", "macus", "macuu", "msu", "maa", "maasu"};
+    for (std::uint8_t i = 0; i < std::size(mul_ops); i++) {
+        const std::string m = mul_ops[i];
+        add(m + " y0 Reg", EmuOp::MulReg, "-0", i);
+        add(m + " y0 Reg Acc", EmuOp::MulReg, "-01", i);
+        add(m + " y0 MemImm8", EmuOp::MulMemImm8, "-0", i);
+        add(m + " y0 MemImm8 Acc", EmuOp::MulMemImm8, "-01", i);
+        add(m + " y0 MemRn Step", EmuOp::MulMemRn, "-02", i);
+        add(m + " y0 MemRn Acc Step", EmuOp::MulMemRn, "-012", i);
+        add(m + " MemRn Imm Step", EmuOp::MulMemRnImm, "0i2", i);
+        add(m + " MemRn Imm Acc Step", EmuOp::MulMemRnImm, "0i12", i);
+    }
+    for (const auto& [m, op] : {std::pair{"sqr", MulOp::Sqr}, std::pair{"sqra", MulOp::Sqra}}) {
+        const auto aux = static_cast<std::uint8_t>(op);
+        add(std::string{m} + " Reg", EmuOp::MulReg, "0", aux);
+        add(std::string{m} + " Reg Acc", EmuOp::MulReg, "01", aux);
+        add(std::string{m} + " MemImm8", EmuOp::MulMemImm8, "0", aux);
+        add(std::string{m} + " MemImm8 Acc", EmuOp::MulMemImm8, "01", aux);
+        add(std::string{m} + " MemRn Step", EmuOp::MulMemRn, "02", aux);
+        add(std::string{m} + " MemRn Acc Step", EmuOp::MulMemRn, "012", aux);
+    }
+    add("mpyi p0 y0 Imm", EmuOp::Mpyi, "--i");
+    add("clrp Product", EmuOp::Clrp, "0");
+
+    const char* const bit_ops[] = {"set", "rst", "chng", "addv", "subv", "cmpv", "tst0", "tst1"};
+    for (std::uint8_t i = 0; i < std::size(bit_ops); i++) {
+        const std::string m = bit_ops[i];
+        add(m + " Imm Reg", EmuOp::BitReg, "i0", i);
+        add(m + " Imm MemImm8", EmuOp::BitMemImm8, "i0", i);
+        add(m + " Imm MemRn Step", EmuOp::BitMemRn, "i01", i);
+    }
+    add("tstb Reg Imm", EmuOp::TstbReg, "01");
+    add("tstb MemImm8 Imm", EmuOp::TstbMemImm8, "01");
+    add("tstb MemRn Imm Step", EmuOp::TstbMemRn, "012");
+    add("shfi Imm Acc Acc", EmuOp::Shfi, "i01");
+    add("shfc sv Acc Acc Cond", EmuOp::Shfc, "-012");
+    return handlers;
+}
+
+// Turns the operands into the handler's shape. A step clause ("|| Rn@0stepZIDS@3") names the
+// register of the memory operand again, which is dropped; what remains are the operands that
+// have a place in the layout.
+static void Classify(InstructionForm& form, const std::map<std::string, Handler>& handlers) {
+    auto& operands = form.operands;
+    const auto separators = std::count_if(operands.begin(), operands.end(),
+                                          [](const OperandField& o) { return o.category == "||" || o.category == "_"; });
+    if (separators == 1 && operands.size() >= 3) {
+        const size_t n = operands.size();
+        const OperandField& reg = operands[n - 2];
+        const bool step_clause = operands[n - 3].category == "||" && operands[n - 1].category == "Step" &&
+                                 (reg.category == "Reg" || reg.kind == "r0");
+        if (step_clause) {
+            operands.erase(operands.begin() + (n - 3), operands.begin() + (n - 1));
+        }
+    }
+
+    std::vector<std::string> words{form.mnemonic};
+    std::vector<size_t> literal_registers;
+    for (size_t i = 0; i < operands.size(); i++) {
+        if (operands[i].literal && LiteralCategory(operands[i].kind)) {
+            literal_registers.push_back(i + 1);
+        }
+        words.push_back(operands[i].category);
+    }
+
+    const auto join = [&] {
+        std::string shape;
+        for (const auto& word : words) {
+            shape += shape.empty() ? word : " " + word;
+        }
+        return shape;
+    };
+
+    form.shape = join();
+    form.op = EmuOp::Unimplemented;
+    form.layout.clear();
+    // Literal registers are tried as themselves first, then from the last one back as the
+    // category they belong to.
+    for (size_t generalized = 0; generalized <= literal_registers.size(); generalized++) {
+        if (generalized > 0) {
+            const size_t word = literal_registers[literal_registers.size() - generalized];
+            words[word] = LiteralCategory(words[word]);
+        }
+        const auto handler = handlers.find(join());
+        if (handler != handlers.end()) {
+            assert(std::string{handler->second.layout}.size() == operands.size());
+            form.op = handler->second.op;
+            form.aux = handler->second.aux;
+            form.layout = handler->second.layout;
+            return;
+        }
+    }
+}
+
+DecodeTable::DecodeTable() {
+    const auto handlers = BuildHandlers();
+
+    std::istringstream stream{InstructionTableSource()};
+    InstructionTableLexer lexer{stream};
+
+    while (true) {
+        while (lexer.PeekToken().type == InstructionTableToken::END_OF_LINE)
+            lexer.NextToken();
+
+        if (lexer.PeekToken().type == InstructionTableToken::END_OF_FILE)
+            break;
+
+        InstructionForm form;
+        form.bits = static_cast<std::uint16_t>(std::strtol(lexer.NextToken().payload.c_str(), nullptr, 16));
+        std::uint32_t operand_mask = 0;
+
+        const auto parse_at_bit_pos = [&](bool& invert) -> std::uint8_t {
+            const auto at = lexer.NextToken();
+            assert(at.type == InstructionTableToken::AT);
+            (void)at;
+            auto position = lexer.NextToken().payload;
+            if (position.compare(0, 3, "not") == 0) {
+                invert = true;
+                position = position.substr(3);
+            }
+            return static_cast<std::uint8_t>(std::strtol(position.c_str(), nullptr, 10));
+        };
+
+        while (lexer.PeekToken().type != InstructionTableToken::END_OF_LINE) {
+            const auto token = lexer.NextToken();
+            const std::string& name = token.payload;
+
+            if (form.mnemonic.empty()) {
+                form.mnemonic = name;
+                continue;
+            }
+            if (name == "Implied" || name == "Not" || name == "NoReverse" || name == ",")
+                continue;
+            if (name.compare(0, 6, "Unused") == 0) {
+                bool invert = false;
+                const auto position = parse_at_bit_pos(invert);
+                operand_mask |= Ones<std::uint32_t>(std::strtol(name.c_str() + 6, nullptr, 10)) << position;
+                continue;
+            }
+            if (name == "Bogus") {
+                while (lexer.PeekToken().payload != "||" && lexer.PeekToken().payload != "," &&
+                       lexer.PeekToken().type != InstructionTableToken::END_OF_LINE) {
+                    lexer.NextToken();
+                }
+                continue;
+            }
+
+            OperandField operand;
+            operand.kind = name;
+            if (name == "||" || name == "_") {
+                operand.category = name;
+            } else if (name == "R0stepZIDS") {
+                operand.kind = operand.category = "r0";
+                operand.literal = true;
+                form.operands.push_back(operand);
+                operand = OperandField{};
+                operand.kind = "stepZIDS";
+                operand.category = "Step";
+                operand.width = 2;
+                operand.position = parse_at_bit_pos(operand.inverted);
+            } else if (const OperandKind* kind = FindOperandKind(name)) {
+                operand.category = kind->category;
+                operand.width = kind->width;
+                operand.is_signed = kind->is_signed;
+                operand.set = kind->set;
+                if (name == "Address18") {
+                    parse_at_bit_pos(operand.inverted);
+                    operand.position = 16;
+                    operand.high_position = static_cast<std::uint8_t>(std::strtol(lexer.NextToken().payload.c_str() + 3, nullptr, 10));
+                    operand_mask |= 0b11u << operand.high_position;
+                } else if (lexer.PeekToken().type == InstructionTableToken::AT) {
+                    operand.position = parse_at_bit_pos(operand.inverted);
+                }
+            } else {
+                operand.category = name;
+                operand.literal = true;
+            }
+            operand_mask |= Ones<std::uint32_t>(operand.width) << operand.position;
+            form.operands.push_back(operand);
+        }
+
+        form.fixed_mask = static_cast<std::uint16_t>(~operand_mask);
+        form.length = (operand_mask >> 16) ? 2 : 1;
+        Classify(form, handlers);
+        forms.push_back(std::move(form));
+    }
+
+    // The most specific form wins; among equally specific ones, the first in the table.
+    form_of_opcode.assign(0x10000, 0);
+    std::vector<std::uint8_t> fixed_bits(0x10000, 0);
+    for (size_t i = 0; i < forms.size(); i++) {
+        const auto& form = forms[i];
+        const std::uint16_t free = static_cast<std::uint16_t>(~form.fixed_mask);
+        const auto count = static_cast<std::uint8_t>(16 - __builtin_popcount(free));
+        std::uint16_t subset = 0;
+        do {
+            const std::uint16_t opcode = (form.bits & form.fixed_mask) | subset;
+            if (form_of_opcode[opcode] == 0 || count > fixed_bits[opcode]) {
+                form_of_opcode[opcode] = static_cast<std::uint16_t>(i + 1);
+                fixed_bits[opcode] = count;
+            }
+            subset = (subset - free) & free;
+        } while (subset != 0);
+    }
+}
+
+const InstructionForm* DecodeTable::FormOf(std::uint16_t opcode) const {
+    const std::uint16_t index = form_of_opcode[opcode];
+    return index ? &forms[index - 1] : nullptr;
+}
+
+size_t DecodeTable::LengthOf(std::uint16_t opcode) const {
+    const InstructionForm* form = FormOf(opcode);
+    return form ? form->length : 1;
+}
+
+static std::uint32_t OperandValue(const InstructionForm& form, const OperandField& operand, std::uint32_t words,
+                                  std::uint32_t address) {
+    if (operand.literal)
+        return static_cast<std::uint32_t>(RegisterByName(operand.kind));
+
+    std::uint32_t raw = (words >> operand.position) & Ones<std::uint32_t>(operand.width);
+    if (operand.inverted) {
+        raw ^= Ones<std::uint32_t>(operand.width);
+    }
+    if (operand.kind == "Address18")
+        return raw | ((words >> operand.high_position) & 0b11) << 16;
+    if (operand.is_signed && operand.width != 0 && (raw >> (operand.width - 1)) & 1) {
+        raw |= ~Ones<std::uint32_t>(operand.width);
+    }
+    if (operand.kind == "RelAddr7")
+        return (address + form.length + raw) & 0x3FFFF;
+
+    if (operand.set) {
+        const std::string& name = (*operand.set)[raw];
+        if (operand.category == "MemRn")
+            return static_cast<std::uint32_t>(name[1] - '0');
+        if (operand.category == "Cond")
+            return raw;
+        return static_cast<std::uint32_t>(RegisterByName(name));
+    }
+
+    if (operand.category == "Step") {
+        static const std::map<std::string, std::vector<StepCode>> step_codes{
+            {"stepZIDS", {StepCode::Zero, StepCode::Inc, StepCode::Dec, StepCode::PlusStep}},
+            {"modrstepZIDS", {StepCode::Zero, StepCode::Inc, StepCode::Dec, StepCode::PlusStep}},
+            {"stepII2D2S", {StepCode::Inc, StepCode::Inc2, StepCode::Dec2, StepCode::PlusStep}},
+            {"stepII2D2S0", {StepCode::Inc, StepCode::Inc2, StepCode::Dec2, StepCode::PlusStep}},
+            {"modrstepII2D2S0", {StepCode::Inc, StepCode::Inc2, StepCode::Dec2, StepCode::PlusStep}},
+            {"stepD2S", {StepCode::Dec2, StepCode::PlusStep}},
+            {"stepII2", {StepCode::Inc, StepCode::Inc2}},
+            {"modrstepI2", {StepCode::Inc2}},
+            {"modrstepD2", {StepCode::Dec2}},
+            {"stepI2", {StepCode::Inc2}},
+            {"stepD2", {StepCode::Dec2}},
+        };
+        return static_cast<std::uint32_t>(step_codes.at(operand.kind).at(raw));
+    }
+    return raw;
+}
+
+DecodedOp DecodeTable::Decode(std::uint16_t opcode, std::uint16_t extension, std::uint32_t address) const {
+    DecodedOp op;
+    const InstructionForm* form = FormOf(opcode);
+    if (!form)
+        return op;
+
+    op.op = form->op;
+    op.aux = form->aux;
+    op.length = form->length;
+    if (op.op == EmuOp::Unimplemented)
+        return op;
+
+    const std::uint32_t words = opcode | static_cast<std::uint32_t>(extension) << 16;
+    for (size_t i = 0; i < form->layout.size(); i++) {
+        const char slot = form->layout[i];
+        if (slot == '-')
+            continue;
+        const std::uint32_t value = OperandValue(*form, form->operands[i], words, address);
+        if (slot == 'i') {
+            op.imm = value;
+        } else {
+            op.f[slot - '0'] = static_cast<std::uint8_t>(value);
+        }
+    }
+    return op;
+}
+
+const DecodeTable& GetDecodeTable() {
+    static const DecodeTable table;
+    return table;
+}
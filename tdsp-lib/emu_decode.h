@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Decoding of TeakLite machine code for the emulator, driven by the same instruction table as
+// the assembler. Each line of the table becomes an InstructionForm; every 16-bit opcode maps to
+// the most specific form whose fixed bits it matches. A form's operands are classified into a
+// "shape" (e.g. "add MemRn Acc Step") which selects the handler that executes it, and decoding an
+// instruction extracts its operand fields into a compact DecodedOp once, at load time.
+
+// Registers as the emulator names them; operand fields of every register kind in the table are
+// translated to these when decoding.
+enum class DspReg : std::uint8_t {
+    R0, R1, R2, R3, R4, R5, R6, R7,
+    Y0, Y1, X0, X1,
+    // Whole products and accumulators; a0, a1, b0, b1 in that order.
+    P0, P1,
+    A0, A1, B0, B1,
+    A0L, A1L, B0L, B1L,
+    A0H, A1H, B0H, B1H,
+    A0E, A1E, B0E, B1E,
+    P0H,
+    St0, St1, St2,
+    Pc, Sp, Cfgi, Cfgj, Stepi0, Stepj0,
+    Ext0, Ext1, Ext2, Ext3,
+    Lc, Sv, Repc, Mixp, Icr,
+    // Fields of other registers that instructions address by name.
+    Page, Ps, Modi, Modj, Stepi, Stepj,
+    Invalid,
+};
+
+// The handler an instruction runs. Operand fields are in DecodedOp::f and DecodedOp::imm as
+// noted; `aux` selects the operation within a family.
+enum class EmuOp : std::uint8_t {
+    Undefined,
+    Unimplemented,
+    Nop,
+    Trap,
+    // aux: AluOp. f0 accumulator (DspReg), imm value or address, or f1 as noted.
+    AluImm,        // imm value
+    AluMemImm8,    // f1 address low byte
+    AluMemImm16,   // imm address
+    AluMemR7,      // imm offset from r7
+    AluMemRn,      // f1 register, f2 step
+    AluReg,        // f1 DspReg
+    AluAcc,        // f1 source accumulator
+    // aux: UnaryOp. f0 accumulator, f1 condition, f2 source accumulator for copy.
+    AccUnary,
+    // f0 destination or source register as the name says, imm value or address, f1 register or
+    // address low byte, f2 step.
+    MovImmReg,
+    MovRegReg,     // f0 source, f1 destination
+    MovAccAcc,     // f0 source, f1 destination, all 40 bits
+    MovMemImm8Reg, // f1 address low byte
+    MovRegMemImm8,
+    MovMemImm16Reg,
+    MovRegMemImm16,
+    MovMemR7Reg,
+    MovRegMemR7,
+    MovMemRnReg,   // f1 address register, f2 step
+    MovRegMemRn,
+    // Control flow. imm target, f0 condition.
+    Br,
+    Call,
+    CallReg,       // f0 register holding the target
+    Ret,           // f0 condition
+    Reti,          // f0 condition; aux 1 also restores the shadows as cntx r does
+    Rets,          // imm words to drop from the stack
+    Rep,           // imm count
+    RepReg,        // f0 register holding the count
+    Bkrep,         // f0 count, imm last address of the body
+    BkrepReg,      // f0 register holding the count, imm last address
+    BkrepSto,      // f0 address register, or aux 1 for sp: saves the innermost repeat and drops it
+    BkrepRst,      // f0 address register, or aux 1 for sp: brings a saved repeat back
+    Break,
+    Eint,
+    Dint,
+    Cntx,          // aux 0 saves the shadows, 1 restores them
+    Push,          // f0 register
+    PushImm,       // imm value
+    Pop,           // f0 register
+    Modr,          // f0 register, f1 step
+    // aux: MulOp. f0 source (register, address register or address low byte), f1 accumulator,
+    // f2 step; imm the second factor for the MemRn, Imm16 forms.
+    MulReg,
+    MulMemImm8,
+    MulMemRn,
+    MulMemRnImm,
+    Mpyi,          // imm factor
+    Clrp,          // f0 product
+    // aux: BitOp. imm mask or value, f0 register or address low byte, f1 step.
+    BitReg,
+    BitMemImm8,
+    BitMemRn,
+    // f0 register or address, f1 bit number, f2 step.
+    TstbReg,
+    TstbMemImm8,
+    TstbMemRn,
+    // Shifts of f0 into f1: by imm (signed) or, with condition f2, by sv.
+    Shfi,
+    Shfc,
+    Count,
+};
+
+enum class AluOp : std::uint8_t { Add, Sub, Cmp, And, Or, Xor, Addh, Addl, Subh, Subl, Cmpu };
+enum class UnaryOp : std::uint8_t { Clr, Clrr, Inc, Dec, Neg, Not, Shl, Shr, Shl4, Shr4, Copy, Rnd, Rol, Ror, Pacr };
+enum class MulOp : std::uint8_t { Mpy, Mpysu, Mac, Macsu, Macus, Macuu, Msu, Maa, Maasu, Sqr, Sqra };
+enum class BitOp : std::uint8_t { Set, Rst, Chng, Addv, Subv, Cmpv, Tst0, Tst1 };
+
+// Post-modification of an address register after an access.
+enum class StepCode : std::uint8_t { Zero, Inc, Dec, Inc2, Dec2, PlusStep };
+
+struct DecodedOp {
+    EmuOp op = EmuOp::Undefined;
+    std::uint8_t length = 1;
+    std::uint8_t aux = 0;
+    std::array<std::uint8_t, 3> f{};
+    std::uint32_t imm = 0;
+};
+
+struct OperandField {
+    // A kind from the table ("MemRn", "Imm8s", "Address18"...), a literal identifier ("r6",
+    // "sv", "ge"...) or a separator ("||", "_").
+    std::string kind;
+    // What the shape calls it: "Reg", "Acc", "MemRn", "Imm", "Step"... or, for literals and
+    // separators, the kind itself.
+    std::string category;
+    bool literal = false;
+    std::uint8_t position = 0;
+    std::uint8_t width = 0;
+    bool inverted = false;
+    bool is_signed = false;
+    // Where Address18 keeps its top two bits.
+    std::uint8_t high_position = 0;
+    // The identifiers a register field selects between, in encoding order.
+    const std::vector<std::string>* set = nullptr;
+};
+
+struct InstructionForm {
+    std::uint16_t bits = 0;
+    // Bits of the first word that are fixed, i.e. not operands or unused.
+    std::uint16_t fixed_mask = 0;
+    std::uint8_t length = 1;
+    std::string mnemonic;
+    // In table order, without the register a step clause names again.
+    std::vector<OperandField> operands;
+    // Mnemonic and operand categories the handler was chosen by.
+    std::string shape;
+    EmuOp op = EmuOp::Unimplemented;
+    std::uint8_t aux = 0;
+    // For each operand, where its value goes: 0-2 a field of DecodedOp::f, 'i' imm, '-' nowhere.
+    std::string layout;
+};
+
+class DecodeTable {
+public:
+    DecodeTable();
+
+    // The form of an opcode, or nullptr if no line of the table matches it.
+    const InstructionForm* FormOf(std::uint16_t opcode) const;
+    // Words the instruction starting with `opcode` occupies.
+    size_t LengthOf(std::uint16_t opcode) const;
+    // `address` is where the instruction is, for relative branches.
+    DecodedOp Decode(std::uint16_t opcode, std::uint16_t extension, std::uint32_t address) const;
+
+    const std::vector<InstructionForm>& Forms() const { return forms; }
+
+private:
+    std::vector<InstructionForm> forms;
+    // Index into `forms` plus one, per opcode; zero if none matches.
+    std::vector<std::uint16_t> form_of_opcode;
+};
+
+// Built on first use and shared; safe to call from several threads.
+const DecodeTable& GetDecodeTable();
+
+const char* DspRegName(DspReg reg);
@@ -0,0 +1,32 @@
+#include <algorithm>
+
+#include "emu_events.h"
+
+bool EventQueue::Later(const Event& a, const Event& b) {
+    return a.cycle != b.cycle ? a.cycle > b.cycle : a.id > b.id;
+}
+
+std::uint64_t EventQueue::Schedule(std::uint64_t cycle, EventCallback callback, void* context) {
+    const std::uint64_t id = next_id++;
+    heap.push_back(Event{cycle, id, callback, context});
+    std::push_heap(heap.begin(), heap.end(), &EventQueue::Later);
+    return id;
+}
+
+bool EventQueue::Cancel(std::uint64_t id) {
+    const auto event = std::find_if(heap.begin(), heap.end(), [&](const Event& each) { return each.id == id; });
+    if (event == heap.end())
+        return false;
+    heap.erase(event);
+    std::make_heap(heap.begin(), heap.end(), &EventQueue::Later);
+    return true;
+}
+
+void EventQueue::RunDue(std::uint64_t cycle) {
+    while (!heap.empty() && heap.front().cycle <= cycle) {
+        std::pop_heap(heap.begin(), heap.end(), &EventQueue::Later);
+        const Event event = heap.back();
+        heap.pop_back();
+        event.callback(event.context, event.cycle);
+    }
+}
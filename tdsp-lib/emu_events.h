@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Called with the context it was scheduled with and the cycle it was due at.
+using EventCallback = void (*)(void* context, std::uint64_t cycle);
+
+// Callbacks due at cycle counts, in a min-heap. Events due at the same cycle run in the order
+// they were scheduled, so runs that schedule the same events go the same way.
+class EventQueue {
+public:
+    static constexpr std::uint64_t never = std::numeric_limits<std::uint64_t>::max();
+
+    // An id for Cancel; ids are not reused.
+    std::uint64_t Schedule(std::uint64_t cycle, EventCallback callback, void* context);
+    // False if the event already ran or was cancelled.
+    bool Cancel(std::uint64_t id);
+    void Clear() { heap.clear(); }
+
+    // The cycle the earliest event is due at, or never.
+    std::uint64_t NextCycle() const { return heap.empty() ? never : heap.front().cycle; }
+    size_t Size() const { return heap.size(); }
+    // Runs the events due by `cycle`, including any they schedule for it.
+    void RunDue(std::uint64_t cycle);
+
+private:
+    struct Event {
+        std::uint64_t cycle;
+        std::uint64_t id;
+        EventCallback callback;
+        void* context;
+    };
+    // Orders the heap with the earliest event at the front.
+    static bool Later(const Event& a, const Event& b);
+
+    std::vector<Event> heap;
+    std::uint64_t next_id = 0;
+};
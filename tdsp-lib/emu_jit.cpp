@@ -0,0 +1,861 @@
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#endif
+
+#include "emu_core.h"
+#include "emu_jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+static constexpr size_t code_buffer_size = 8 << 20;
+
+// Host registers by encoding. rbx holds the DspState, r12 data memory and r13 the fallback's
+// context throughout; rax, rcx and rdx are scratch, and rsi, rdi, r8-r10 scratch within a helper.
+static constexpr std::uint8_t rax = 0, rcx = 1, rdx = 2, rbx = 3, rsi = 6, rdi = 7, r8 = 8, r9 = 9, r10 = 10, r12 = 12, r13 = 13;
+
+// Condition codes for setcc.
+static constexpr std::uint8_t cc_b = 2, cc_e = 4, cc_ne = 5, cc_s = 8;
+
+// Opcodes of "op r/m64, r64".
+static constexpr std::uint8_t op_add = 0x01, op_or = 0x09, op_and = 0x21, op_sub = 0x29, op_xor = 0x31, op_cmp = 0x39, op_test = 0x85;
+
+// Extensions of the shift group.
+static constexpr std::uint8_t shift_shl = 4, shift_shr = 5, shift_sar = 7;
+
+static constexpr std::uint64_t acc_mask = (std::uint64_t{1} << 40) - 1;
+
+// Sets of DspFlags, for working out which flag writes later code reads. l is never in a write
+// set, since arithmetic only adds to it.
+static constexpr std::uint8_t flag_z = 1, flag_m = 2, flag_n = 4, flag_e = 8, flag_c = 16, flag_v = 32, flag_l = 64, flag_r = 128;
+static constexpr std::uint8_t result_flags = flag_z | flag_m | flag_n | flag_e;
+static constexpr std::uint8_t arithmetic_flags = result_flags | flag_c | flag_v;
+static constexpr std::uint8_t all_flags = 0xFF;
+
+// Appends x86-64 instructions. Memory operands are either a field of the state, [rbx + offset],
+// or a word of data memory, [r12 + rax * 2].
+class Emitter {
+public:
+    std::vector<std::uint8_t> code;
+    // The flags something reads before the instruction being emitted sets them again; writes to
+    // the others are left out.
+    std::uint8_t live = all_flags;
+    // Whether anything emitted reads or writes data memory.
+    bool uses_data = false;
+
+    void LoadWord(std::uint8_t reg, std::int32_t offset) { Rex(false, reg, rbx); Bytes({0x0F, 0xB7}); State(reg, offset); }
+    void LoadByte(std::uint8_t reg, std::int32_t offset) { Rex(false, reg, rbx); Bytes({0x0F, 0xB6}); State(reg, offset); }
+    void LoadQword(std::uint8_t reg, std::int32_t offset) { Rex(true, reg, rbx); Byte(0x8B); State(reg, offset); }
+    void StoreQword(std::uint8_t reg, std::int32_t offset) { Rex(true, reg, rbx); Byte(0x89); State(reg, offset); }
+    void StoreWord(std::uint8_t reg, std::int32_t offset) { Byte(0x66); Rex(false, reg, rbx); Byte(0x89); State(reg, offset); }
+    // Only for al, cl and dl.
+    void StoreByte(std::uint8_t reg, std::int32_t offset) { Byte(0x88); State(reg, offset); }
+    void StoreWordImm(std::int32_t offset, std::uint16_t value) { Bytes({0x66, 0xC7}); State(0, offset); Word(value); }
+    void StoreDwordImm(std::int32_t offset, std::uint32_t value) { Byte(0xC7); State(0, offset); Dword(value); }
+    void AddWordImm(std::int32_t offset, std::uint16_t value) { Bytes({0x66, 0x81}); State(0, offset); Word(value); }
+    void AddWord(std::uint8_t reg, std::int32_t offset) { Byte(0x66); Rex(false, reg, rbx); Byte(0x01); State(reg, offset); }
+    void LoadData(std::uint8_t reg) { uses_data = true; Rex(false, reg, r12); Bytes({0x0F, 0xB7}); Data(reg); }
+    // Also marks the page dirty, through rdx.
+    void StoreData(std::uint8_t reg) { uses_data = true; Byte(0x66); Rex(false, reg, r12); Byte(0x89); Data(reg); MarkDirty(); }
+
+    void MovImm(std::uint8_t reg, std::uint64_t value) { Rex(true, 0, reg); Byte(0xB8 + (reg & 7)); Qword(value); }
+    void Mov(std::uint8_t dst, std::uint8_t src) { Arith(0x89, dst, src); }
+    // Flags as for dst - src with op_cmp.
+    void Arith(std::uint8_t opcode, std::uint8_t dst, std::uint8_t src) { Rex(true, src, dst); Byte(opcode); Direct(src, dst); }
+    void Shift(std::uint8_t kind, std::uint8_t reg, std::uint8_t count) {
+        Rex(true, 0, reg);
+        Byte(0xC1);
+        Direct(kind, reg);
+        Byte(count);
+    }
+    void ShiftCl(std::uint8_t kind, std::uint8_t reg) { Rex(true, 0, reg); Byte(0xD3); Direct(kind, reg); }
+    void Not(std::uint8_t reg) { Rex(true, 0, reg); Byte(0xF7); Direct(2, reg); }
+    void Movsx16(std::uint8_t dst, std::uint8_t src) { Rex(true, dst, src); Bytes({0x0F, 0xBF}); Direct(dst, src); }
+    void Movzx16(std::uint8_t dst, std::uint8_t src) { Rex(false, dst, src); Bytes({0x0F, 0xB7}); Direct(dst, src); }
+    void Movsxd(std::uint8_t dst, std::uint8_t src) { Rex(true, dst, src); Byte(0x63); Direct(dst, src); }
+    void Imul(std::uint8_t dst, std::uint8_t src) { Rex(true, dst, src); Bytes({0x0F, 0xAF}); Direct(dst, src); }
+    void Bt(std::uint8_t reg, std::uint8_t bit) { Rex(true, 0, reg); Bytes({0x0F, 0xBA}); Direct(4, reg); Byte(bit); }
+    // 32-bit forms, which clear the upper half.
+    void MovImm32(std::uint8_t reg, std::uint32_t value) { Rex(false, 0, reg); Byte(0xB8 + (reg & 7)); Dword(value); }
+    void AndImm32(std::uint8_t reg, std::uint8_t value) { Rex(false, 0, reg); Byte(0x83); Direct(4, reg); Byte(value); }
+    void Cmov32(std::uint8_t cc, std::uint8_t dst, std::uint8_t src) {
+        Rex(false, dst, src);
+        Bytes({0x0F, static_cast<std::uint8_t>(0x40 + cc)});
+        Direct(dst, src);
+    }
+    void StoreDword(std::uint8_t reg, std::int32_t offset) { Rex(false, reg, rbx); Byte(0x89); State(reg, offset); }
+    void CmpByteImm(std::int32_t offset, std::uint8_t value) { Byte(0x80); State(7, offset); Byte(value); }
+    void ShiftCl32(std::uint8_t kind, std::uint8_t reg) { Rex(false, 0, reg); Byte(0xD3); Direct(kind, reg); }
+
+    // setcc into the state, or into al, cl or dl.
+    void SetState(std::uint8_t cc, std::int32_t offset) { Bytes({0x0F, static_cast<std::uint8_t>(0x90 + cc)}); State(0, offset); }
+    void SetReg(std::uint8_t cc, std::uint8_t reg) { Bytes({0x0F, static_cast<std::uint8_t>(0x90 + cc)}); Direct(0, reg); }
+    void AndByte(std::uint8_t dst, std::uint8_t src) { Byte(0x20); Direct(src, dst); }
+    void OrByte(std::uint8_t dst, std::uint8_t src) { Byte(0x08); Direct(src, dst); }
+    void OrByteState(std::uint8_t reg, std::int32_t offset) { Byte(0x08); State(reg, offset); }
+
+    void Byte(std::uint8_t value) { code.push_back(value); }
+    void Bytes(std::initializer_list<std::uint8_t> values) { code.insert(code.end(), values); }
+    void Word(std::uint16_t value) { Little(value, 2); }
+    void Dword(std::uint32_t value) { Little(value, 4); }
+    void Qword(std::uint64_t value) { Little(value, 8); }
+
+private:
+    void Rex(bool wide, std::uint8_t reg, std::uint8_t base) {
+        const std::uint8_t rex = static_cast<std::uint8_t>(0x40 | wide << 3 | (reg >> 3) << 2 | (base >> 3));
+        if (rex != 0x40) {
+            Byte(rex);
+        }
+    }
+    void Direct(std::uint8_t reg, std::uint8_t rm) { Byte(static_cast<std::uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))); }
+    void State(std::uint8_t reg, std::int32_t offset) {
+        Byte(static_cast<std::uint8_t>(0x80 | (reg & 7) << 3 | rbx));
+        Dword(static_cast<std::uint32_t>(offset));
+    }
+    void Data(std::uint8_t reg) {
+        Byte(static_cast<std::uint8_t>((reg & 7) << 3 | 4));
+        Byte(0x40 | rax << 3 | (r12 & 7));
+    }
+    // mov byte [r12 + (rax >> memory_page_bits) + dirty_flags_offset], 1
+    void MarkDirty() {
+        Mov(rdx, rax);
+        Shift(shift_shr, rdx, memory_page_bits);
+        Bytes({0x41, 0xC6, 0x84, static_cast<std::uint8_t>(rdx << 3 | (r12 & 7))});
+        Dword(static_cast<std::uint32_t>(dirty_flags_offset));
+        Byte(1);
+    }
+    void Little(std::uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) {
+            Byte(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+    }
+};
+
+static std::int32_t Field(size_t offset) {
+    return static_cast<std::int32_t>(offset);
+}
+
+static std::int32_t AccField(size_t acc) {
+    return Field(offsetof(DspState, acc) + acc * sizeof(std::int64_t));
+}
+
+static std::int32_t FlagField(size_t offset) {
+    return Field(offsetof(DspState, flags) + offset);
+}
+
+static std::int32_t RegField(size_t index) {
+    return Field(offsetof(DspState, r) + index * sizeof(std::uint16_t));
+}
+
+// Where the state keeps a register as a plain word, or -1.
+static std::int32_t WordField(DspReg reg) {
+    const auto index = static_cast<size_t>(reg);
+    if (reg >= DspReg::R0 && reg <= DspReg::R7)
+        return RegField(index);
+    if (reg == DspReg::Y0 || reg == DspReg::Y1)
+        return Field(offsetof(DspState, y) + (index - static_cast<size_t>(DspReg::Y0)) * sizeof(std::uint16_t));
+    if (reg == DspReg::X0 || reg == DspReg::X1)
+        return Field(offsetof(DspState, x) + (index - static_cast<size_t>(DspReg::X0)) * sizeof(std::uint16_t));
+    return -1;
+}
+
+static bool InRange(DspReg reg, DspReg first, DspReg last) {
+    return reg >= first && reg <= last;
+}
+
+static size_t AccOf(std::uint8_t reg, DspReg first) {
+    return static_cast<size_t>(reg - static_cast<std::uint8_t>(first));
+}
+
+// The z, m, n and e flags of the value in rax, which is first sign-extended from 40 bits; with
+// `store`, also the value of accumulator `acc`. Uses rcx and rdx.
+static void EmitResult(Emitter& e, bool store, size_t acc) {
+    e.Shift(shift_shl, rax, 24);
+    e.Shift(shift_sar, rax, 24);
+    if (store) {
+        e.StoreQword(rax, AccField(acc));
+    }
+    // n is z, or the value fits 32 bits but not 31.
+    if (e.live & flag_n) {
+        e.Mov(rcx, rax);
+        e.Shift(shift_shl, rcx, 33);
+        e.Shift(shift_sar, rcx, 33);
+        e.Arith(op_cmp, rcx, rax);
+        e.SetReg(cc_ne, rdx);
+    }
+    if (e.live & (flag_n | flag_e)) {
+        e.Movsxd(rcx, rax);
+        e.Arith(op_cmp, rcx, rax);
+        if (e.live & flag_e) {
+            e.SetState(cc_ne, FlagField(offsetof(DspFlags, e)));
+        }
+        if (e.live & flag_n) {
+            e.SetReg(cc_e, rcx);
+            e.AndByte(rdx, rcx);
+        }
+    }
+    if (!(e.live & (flag_z | flag_m | flag_n)))
+        return;
+    e.Arith(op_test, rax, rax);
+    if (e.live & flag_z) {
+        e.SetState(cc_e, FlagField(offsetof(DspFlags, z)));
+    }
+    if (e.live & flag_m) {
+        e.SetState(cc_s, FlagField(offsetof(DspFlags, m)));
+    }
+    if (e.live & flag_n) {
+        e.SetReg(cc_e, rcx);
+        e.OrByte(rdx, rcx);
+        e.StoreByte(rdx, FlagField(offsetof(DspFlags, n)));
+    }
+}
+
+// rax = rax +/- rcx, setting the c, v and l flags.
+static void EmitArithmetic(Emitter& e, bool subtract) {
+    if (e.live & flag_c) {
+        e.Mov(rsi, rax);
+        e.Mov(rdi, rcx);
+        e.MovImm(r8, acc_mask);
+        e.Arith(op_and, rsi, r8);
+        e.Arith(op_and, rdi, r8);
+    }
+    if (subtract) {
+        e.Arith(op_sub, rax, rcx);
+        if (e.live & flag_c) {
+            e.Arith(op_cmp, rsi, rdi);
+            e.SetState(cc_b, FlagField(offsetof(DspFlags, c)));
+        }
+    } else {
+        e.Arith(op_add, rax, rcx);
+        if (e.live & flag_c) {
+            e.Arith(op_add, rsi, rdi);
+            e.Bt(rsi, 40);
+            e.SetState(cc_b, FlagField(offsetof(DspFlags, c)));
+        }
+    }
+    if (!(e.live & (flag_v | flag_l)))
+        return;
+    e.Mov(rcx, rax);
+    e.Shift(shift_shl, rcx, 24);
+    e.Shift(shift_sar, rcx, 24);
+    e.Arith(op_cmp, rcx, rax);
+    e.SetReg(cc_ne, rdx);
+    if (e.live & flag_v) {
+        e.StoreByte(rdx, FlagField(offsetof(DspFlags, v)));
+    }
+    if (e.live & flag_l) {
+        e.OrByteState(rdx, FlagField(offsetof(DspFlags, l)));
+    }
+}
+
+// The 16-bit value in rcx as an ALU operand.
+static void EmitAluOperand(Emitter& e, AluOp op) {
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Sub:
+    case AluOp::Cmp:
+        e.Movsx16(rcx, rcx);
+        return;
+    case AluOp::Addh:
+    case AluOp::Subh:
+        e.Movsx16(rcx, rcx);
+        e.Shift(shift_shl, rcx, 16);
+        return;
+    default:
+        return;
+    }
+}
+
+// Accumulator `acc` combined with the operand in rcx.
+static void EmitAlu(Emitter& e, AluOp op, size_t acc) {
+    e.LoadQword(rax, AccField(acc));
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Addh:
+    case AluOp::Addl:
+        EmitArithmetic(e, false);
+        EmitResult(e, true, acc);
+        return;
+    case AluOp::Sub:
+    case AluOp::Subh:
+    case AluOp::Subl:
+        EmitArithmetic(e, true);
+        EmitResult(e, true, acc);
+        return;
+    case AluOp::Cmp:
+    case AluOp::Cmpu:
+        EmitArithmetic(e, true);
+        EmitResult(e, false, acc);
+        return;
+    case AluOp::And:
+        e.Arith(op_and, rax, rcx);
+        break;
+    case AluOp::Or:
+        e.Arith(op_or, rax, rcx);
+        break;
+    case AluOp::Xor:
+        e.Arith(op_xor, rax, rcx);
+        break;
+    }
+    EmitResult(e, true, acc);
+}
+
+static std::int32_t UpdateField(std::uint8_t rn, StepCode step, size_t member) {
+    return Field(offsetof(DspState, address_updates) + (rn * 6 + static_cast<size_t>(step)) * sizeof(AddressUpdate) + member);
+}
+
+// rax = the address in rn, which is then stepped as DspState::address_updates has it, so the code
+// holds whatever cfgi, cfgj and st2 are set to. Uses rdx, rsi, rdi and r8.
+static void EmitAddress(Emitter& e, std::uint8_t rn, StepCode step) {
+    const std::int32_t field = RegField(rn);
+    e.LoadWord(rax, field);
+    if (step == StepCode::Zero)
+        return;
+    e.LoadWord(rsi, UpdateField(rn, step, offsetof(AddressUpdate, step)));
+    // r6 and r7 have no modulo.
+    if (rn >= 6) {
+        e.AddWord(rsi, field);
+        return;
+    }
+    // Registers outside a circular buffer, nearly all of them, take the step in one add past a
+    // branch that always goes the same way.
+    e.LoadWord(rdx, Field(offsetof(DspState, st2)));
+    e.Bt(rdx, rn);
+    // jc modulo
+    e.Bytes({0x72, 0});
+    const size_t to_modulo = e.code.size();
+    e.AddWord(rsi, field);
+    // jmp done
+    e.Bytes({0xEB, 0});
+    const size_t to_done = e.code.size();
+    e.code[to_modulo - 1] = static_cast<std::uint8_t>(to_done - to_modulo);
+    // The low bits step under the mask and wrap at the edge, without a branch.
+    e.LoadWord(rdi, UpdateField(rn, step, offsetof(AddressUpdate, mask)));
+    e.Mov(rdx, rax);
+    e.Arith(op_and, rdx, rdi);
+    e.Arith(op_add, rsi, rdx);
+    e.Arith(op_and, rsi, rdi);
+    e.LoadWord(r8, UpdateField(rn, step, offsetof(AddressUpdate, edge)));
+    e.Arith(op_cmp, rdx, r8);
+    e.LoadWord(r8, UpdateField(rn, step, offsetof(AddressUpdate, wrap)));
+    e.Cmov32(cc_e, rsi, r8);
+    e.Not(rdi);
+    e.Mov(rdx, rax);
+    e.Arith(op_and, rdx, rdi);
+    e.Arith(op_or, rdx, rsi);
+    e.StoreWord(rdx, field);
+    e.code[to_done - 1] = static_cast<std::uint8_t>(e.code.size() - to_done);
+}
+
+// rax = the address of a MemImm8 operand in the current page.
+static void EmitPageAddress(Emitter& e, std::uint8_t low) {
+    e.LoadByte(rax, Field(offsetof(DspState, page)));
+    e.Shift(shift_shl, rax, 8);
+    e.MovImm32(rcx, low);
+    e.Arith(op_or, rax, rcx);
+}
+
+// rcx = a register as ReadRegister gives it, if it is one the code reads itself.
+static bool EmitRead(Emitter& e, DspReg reg) {
+    const std::int32_t field = WordField(reg);
+    if (field >= 0) {
+        e.LoadWord(rcx, field);
+        return true;
+    }
+    if (InRange(reg, DspReg::A0, DspReg::B1) || InRange(reg, DspReg::A0L, DspReg::B1L)) {
+        const DspReg first = InRange(reg, DspReg::A0, DspReg::B1) ? DspReg::A0 : DspReg::A0L;
+        e.LoadQword(rcx, AccField(AccOf(static_cast<std::uint8_t>(reg), first)));
+        e.Movzx16(rcx, rcx);
+        return true;
+    }
+    if (InRange(reg, DspReg::A0H, DspReg::B1H)) {
+        e.LoadQword(rcx, AccField(AccOf(static_cast<std::uint8_t>(reg), DspReg::A0H)));
+        e.Shift(shift_shr, rcx, 16);
+        e.Movzx16(rcx, rcx);
+        return true;
+    }
+    return false;
+}
+
+// Whether EmitWrite handles the register.
+static bool Writable(DspReg reg) {
+    return WordField(reg) >= 0 || InRange(reg, DspReg::A0, DspReg::B1) || InRange(reg, DspReg::A0L, DspReg::B1L) ||
+           InRange(reg, DspReg::A0H, DspReg::B1H);
+}
+
+// Writes the zero-extended word in rcx to a register, as WriteRegister does.
+static void EmitWrite(Emitter& e, DspReg reg) {
+    const std::int32_t field = WordField(reg);
+    if (field >= 0) {
+        e.StoreWord(rcx, field);
+    } else if (InRange(reg, DspReg::A0, DspReg::B1)) {
+        e.Movsx16(rax, rcx);
+        EmitResult(e, true, AccOf(static_cast<std::uint8_t>(reg), DspReg::A0));
+    } else if (InRange(reg, DspReg::A0L, DspReg::B1L)) {
+        e.Mov(rax, rcx);
+        EmitResult(e, true, AccOf(static_cast<std::uint8_t>(reg), DspReg::A0L));
+    } else {
+        e.Movsx16(rax, rcx);
+        e.Shift(shift_shl, rax, 16);
+        EmitResult(e, true, AccOf(static_cast<std::uint8_t>(reg), DspReg::A0H));
+    }
+}
+
+// rax = p0 shifted as ps says: p0 * 4 >> {2, 3, 1, 0}[ps]. Uses rcx and rdx.
+static void EmitProduct(Emitter& e) {
+    e.LoadByte(rcx, Field(offsetof(DspState, ps)));
+    e.Arith(op_add, rcx, rcx);
+    e.MovImm32(rdx, 0x1E);
+    e.ShiftCl32(shift_shr, rdx);
+    e.AndImm32(rdx, 3);
+    e.Mov(rcx, rdx);
+    e.LoadQword(rax, Field(offsetof(DspState, p)));
+    e.Shift(shift_shl, rax, 2);
+    e.ShiftCl(shift_sar, rax);
+}
+
+// Multiply with the factors zero-extended in r9 (y) and r10 (x).
+static void EmitMultiply(Emitter& e, MulOp op, size_t acc) {
+    switch (op) {
+    case MulOp::Mac:
+    case MulOp::Macsu:
+    case MulOp::Macus:
+    case MulOp::Macuu:
+    case MulOp::Sqra:
+    case MulOp::Msu:
+    case MulOp::Maa:
+    case MulOp::Maasu:
+        EmitProduct(e);
+        if (op == MulOp::Maa || op == MulOp::Maasu) {
+            e.Shift(shift_sar, rax, 16);
+        }
+        e.Mov(rcx, rax);
+        e.LoadQword(rax, AccField(acc));
+        EmitArithmetic(e, op == MulOp::Msu);
+        EmitResult(e, true, acc);
+        break;
+    default:
+        break;
+    }
+
+    e.StoreWord(r9, Field(offsetof(DspState, y)));
+    e.StoreWord(r10, Field(offsetof(DspState, x)));
+    if (op != MulOp::Macus && op != MulOp::Macuu) {
+        e.Movsx16(r9, r9);
+    }
+    if (op != MulOp::Mpysu && op != MulOp::Macsu && op != MulOp::Maasu && op != MulOp::Macuu) {
+        e.Movsx16(r10, r10);
+    }
+    e.Imul(r9, r10);
+    e.StoreQword(r9, Field(offsetof(DspState, p)));
+}
+
+// Sets the pc to `target` if condition `cond` holds and to `next` otherwise, for the conditions
+// that test a single flag.
+static bool EmitBranch(Emitter& e, std::uint8_t cond, std::uint32_t target, std::uint32_t next) {
+    struct FlagTest {
+        size_t flag;
+        bool when_set;
+    };
+    FlagTest test;
+    switch (cond) {
+    case 0:
+        e.StoreDwordImm(Field(offsetof(DspState, pc)), target);
+        return true;
+    case 1: test = {offsetof(DspFlags, z), true}; break;
+    case 2: test = {offsetof(DspFlags, z), false}; break;
+    case 4: test = {offsetof(DspFlags, m), false}; break;
+    case 5: test = {offsetof(DspFlags, m), true}; break;
+    case 7: test = {offsetof(DspFlags, n), false}; break;
+    case 8: test = {offsetof(DspFlags, c), true}; break;
+    case 9: test = {offsetof(DspFlags, v), true}; break;
+    case 10: test = {offsetof(DspFlags, e), true}; break;
+    case 11: test = {offsetof(DspFlags, l), true}; break;
+    case 12: test = {offsetof(DspFlags, r), false}; break;
+    default:
+        return false;
+    }
+    e.MovImm32(rax, next);
+    e.MovImm32(rcx, target);
+    e.CmpByteImm(FlagField(test.flag), 0);
+    e.Cmov32(test.when_set ? cc_ne : cc_e, rax, rcx);
+    e.StoreDword(rax, Field(offsetof(DspState, pc)));
+    return true;
+}
+
+// Emits code of its own for an instruction, if it has any.
+static bool EmitNative(Emitter& e, const DecodedOp& op, std::uint32_t next) {
+    const auto reg = [&](size_t i) { return static_cast<DspReg>(op.f[i]); };
+    const auto step = [&](size_t i) { return static_cast<StepCode>(op.f[i]); };
+    const auto acc = [&](size_t i) { return AccOf(op.f[i], DspReg::A0); };
+    const auto alu_op = static_cast<AluOp>(op.aux);
+
+    switch (op.op) {
+    case EmuOp::Nop:
+        return true;
+
+    case EmuOp::AluImm:
+        e.MovImm(rcx, static_cast<std::uint64_t>(AluOperand(alu_op, static_cast<std::uint16_t>(op.imm))));
+        EmitAlu(e, alu_op, acc(0));
+        return true;
+    case EmuOp::AluMemRn:
+        EmitAddress(e, op.f[1], step(2));
+        e.LoadData(rcx);
+        EmitAluOperand(e, alu_op);
+        EmitAlu(e, alu_op, acc(0));
+        return true;
+    case EmuOp::AluReg:
+        if (WordField(reg(1)) < 0)
+            return false;
+        e.LoadWord(rcx, WordField(reg(1)));
+        EmitAluOperand(e, alu_op);
+        EmitAlu(e, alu_op, acc(0));
+        return true;
+    case EmuOp::AluAcc:
+        e.LoadQword(rcx, AccField(acc(1)));
+        EmitAlu(e, alu_op, acc(0));
+        return true;
+
+    case EmuOp::AccUnary:
+        if (op.f[1] != 0)
+            return false;
+        switch (static_cast<UnaryOp>(op.aux)) {
+        case UnaryOp::Clr:
+            e.MovImm(rax, 0);
+            break;
+        case UnaryOp::Clrr:
+            e.MovImm(rax, 0x8000);
+            break;
+        case UnaryOp::Inc:
+        case UnaryOp::Dec:
+        case UnaryOp::Rnd:
+            e.LoadQword(rax, AccField(acc(0)));
+            e.MovImm(rcx, static_cast<UnaryOp>(op.aux) == UnaryOp::Rnd ? 0x8000 : 1);
+            EmitArithmetic(e, static_cast<UnaryOp>(op.aux) == UnaryOp::Dec);
+            break;
+        case UnaryOp::Neg:
+            e.LoadQword(rcx, AccField(acc(0)));
+            e.MovImm(rax, 0);
+            EmitArithmetic(e, true);
+            break;
+        case UnaryOp::Not:
+            e.LoadQword(rax, AccField(acc(0)));
+            e.Not(rax);
+            break;
+        case UnaryOp::Copy:
+            e.LoadQword(rax, AccField(acc(2)));
+            break;
+        default:
+            return false;
+        }
+        EmitResult(e, true, acc(0));
+        return true;
+
+    case EmuOp::MovImmReg:
+        if (!Writable(reg(0)))
+            return false;
+        e.MovImm32(rcx, static_cast<std::uint16_t>(op.imm));
+        EmitWrite(e, reg(0));
+        return true;
+    case EmuOp::MovRegReg:
+        if (!Writable(reg(1)) || !EmitRead(e, reg(0)))
+            return false;
+        EmitWrite(e, reg(1));
+        return true;
+    case EmuOp::MovAccAcc:
+        e.LoadQword(rax, AccField(acc(0)));
+        EmitResult(e, true, acc(1));
+        return true;
+    case EmuOp::MovMemRnReg:
+        if (!Writable(reg(0)))
+            return false;
+        EmitAddress(e, op.f[1], step(2));
+        e.LoadData(rcx);
+        EmitWrite(e, reg(0));
+        return true;
+    case EmuOp::MovRegMemRn:
+        // The source is read first, in case it is the address register itself.
+        if (!EmitRead(e, reg(0)))
+            return false;
+        EmitAddress(e, op.f[1], step(2));
+        e.StoreData(rcx);
+        return true;
+    case EmuOp::MovMemImm8Reg:
+        if (!Writable(reg(0)))
+            return false;
+        EmitPageAddress(e, op.f[1]);
+        e.LoadData(rcx);
+        EmitWrite(e, reg(0));
+        return true;
+    case EmuOp::MovRegMemImm8:
+        if (!EmitRead(e, reg(0)))
+            return false;
+        e.Mov(r9, rcx);
+        EmitPageAddress(e, op.f[1]);
+        e.Mov(rcx, r9);
+        e.StoreData(rcx);
+        return true;
+    case EmuOp::Modr:
+        if (op.aux) {
+            // dmod: a linear step whatever the modulo.
+            e.LoadWord(rdx, UpdateField(op.f[0], step(1), offsetof(AddressUpdate, step)));
+            e.AddWord(rdx, RegField(op.f[0]));
+        } else {
+            EmitAddress(e, op.f[0], step(1));
+        }
+        if (e.live & flag_r) {
+            e.LoadWord(rax, RegField(op.f[0]));
+            e.Arith(op_test, rax, rax);
+            e.SetState(cc_e, FlagField(offsetof(DspFlags, r)));
+        }
+        return true;
+
+    case EmuOp::MulMemRn: {
+        const auto mul_op = static_cast<MulOp>(op.aux);
+        EmitAddress(e, op.f[0], step(2));
+        e.LoadData(r10);
+        if (mul_op == MulOp::Sqr || mul_op == MulOp::Sqra) {
+            e.Mov(r9, r10);
+        } else {
+            e.LoadWord(r9, Field(offsetof(DspState, y)));
+        }
+        EmitMultiply(e, mul_op, acc(1));
+        return true;
+    }
+    case EmuOp::MulReg: {
+        const auto mul_op = static_cast<MulOp>(op.aux);
+        if (!EmitRead(e, reg(0)))
+            return false;
+        e.Mov(r10, rcx);
+        if (mul_op == MulOp::Sqr || mul_op == MulOp::Sqra) {
+            e.Mov(r9, r10);
+        } else {
+            e.LoadWord(r9, Field(offsetof(DspState, y)));
+        }
+        EmitMultiply(e, mul_op, acc(1));
+        return true;
+    }
+    case EmuOp::Mpyi:
+        e.LoadWord(r9, Field(offsetof(DspState, y)));
+        e.MovImm32(r10, static_cast<std::uint16_t>(op.imm));
+        EmitMultiply(e, MulOp::Mpy, 0);
+        return true;
+    case EmuOp::Br:
+        return EmitBranch(e, op.f[0], op.imm, next);
+    case EmuOp::Clrp:
+        e.MovImm(rax, 0);
+        e.StoreQword(rax, Field(offsetof(DspState, p) + (reg(0) == DspReg::P1) * sizeof(std::int64_t)));
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool AccumulatorReg(DspReg reg) {
+    return InRange(reg, DspReg::A0, DspReg::B1) || InRange(reg, DspReg::A0L, DspReg::B1L) ||
+           InRange(reg, DspReg::A0H, DspReg::B1H);
+}
+
+// The flags an instruction EmitNative has code for always sets.
+static std::uint8_t FlagsWritten(const DecodedOp& op) {
+    const auto alu_op = static_cast<AluOp>(op.aux);
+    const auto mul_op = static_cast<MulOp>(op.aux);
+    switch (op.op) {
+    case EmuOp::AluImm:
+    case EmuOp::AluMemRn:
+    case EmuOp::AluReg:
+    case EmuOp::AluAcc:
+        return alu_op == AluOp::And || alu_op == AluOp::Or || alu_op == AluOp::Xor ? result_flags : arithmetic_flags;
+    case EmuOp::AccUnary:
+        if (op.f[1] != 0)
+            return 0;
+        switch (static_cast<UnaryOp>(op.aux)) {
+        case UnaryOp::Inc:
+        case UnaryOp::Dec:
+        case UnaryOp::Rnd:
+        case UnaryOp::Neg:
+            return arithmetic_flags;
+        default:
+            return result_flags;
+        }
+    case EmuOp::MovImmReg:
+    case EmuOp::MovMemRnReg:
+    case EmuOp::MovMemImm8Reg:
+        return AccumulatorReg(static_cast<DspReg>(op.f[0])) ? result_flags : 0;
+    case EmuOp::MovRegReg:
+        return AccumulatorReg(static_cast<DspReg>(op.f[1])) ? result_flags : 0;
+    case EmuOp::MovAccAcc:
+        return result_flags;
+    case EmuOp::MulMemRn:
+    case EmuOp::MulReg:
+        switch (mul_op) {
+        case MulOp::Mac:
+        case MulOp::Macsu:
+        case MulOp::Macus:
+        case MulOp::Macuu:
+        case MulOp::Sqra:
+        case MulOp::Msu:
+        case MulOp::Maa:
+        case MulOp::Maasu:
+            return arithmetic_flags;
+        default:
+            return 0;
+        }
+    case EmuOp::Modr:
+        return flag_r;
+    default:
+        return 0;
+    }
+}
+
+JitCompiler::JitCompiler(JitFallback fallback) : fallback(fallback) {}
+
+JitCompiler::~JitCompiler() {
+    if (buffer) {
+        munmap(buffer, code_buffer_size);
+    }
+}
+
+bool JitCompiler::Available() {
+    return true;
+}
+
+JitCode JitCompiler::Compile(const JitInstruction* instructions, size_t count) {
+    // Which instructions get code of their own, then which flags each leaves for later code: all
+    // of them at the exits, which includes every call to the fallback. The only native code that
+    // tests flags is a branch, which ends the block.
+    std::vector<bool> has_code(count);
+    for (size_t i = 0; i < count; i++) {
+        Emitter scratch;
+        has_code[i] = EmitNative(scratch, *instructions[i].op, instructions[i].next) && (direct_data || !scratch.uses_data);
+    }
+    std::vector<std::uint8_t> live_after(count);
+    std::uint8_t live = all_flags;
+    for (size_t i = count; i-- > 0;) {
+        live_after[i] = live;
+        const DecodedOp& op = *instructions[i].op;
+        live = has_code[i] ? static_cast<std::uint8_t>(live & ~FlagsWritten(op)) : all_flags;
+    }
+
+    Emitter e;
+    // push rbx, r12, r13, which also aligns the stack for calls; then pin the arguments.
+    e.Bytes({0x53, 0x41, 0x54, 0x41, 0x55});
+    e.Mov(rbx, rdi);
+    e.Mov(r12, rsi);
+    e.Mov(r13, rdx);
+
+    // Jumps to the exit, which is only placed at the end.
+    std::vector<size_t> exits;
+    size_t native = 0;
+    bool pc_set = false;
+    for (size_t i = 0; i < count; i++) {
+        const JitInstruction& instruction = instructions[i];
+        e.live = live_after[i];
+        if (has_code[i] && EmitNative(e, *instruction.op, instruction.next)) {
+            native++;
+            pc_set = instruction.op->op == EmuOp::Br;
+            continue;
+        }
+        e.Mov(rdi, r13);
+        e.MovImm(rsi, reinterpret_cast<std::uintptr_t>(instruction.op));
+        e.MovImm32(rdx, instruction.next);
+        e.MovImm(rax, reinterpret_cast<std::uintptr_t>(fallback));
+        e.Bytes({0xFF, 0xD0}); // call rax
+        // test al, al; jnz past the exit with i.
+        e.Bytes({0x84, 0xC0, 0x75, 10});
+        e.MovImm32(rax, static_cast<std::uint32_t>(i));
+        e.Byte(0xE9);
+        exits.push_back(e.code.size());
+        e.Dword(0);
+        pc_set = true;
+    }
+    // The fallback and branches set the pc themselves; other native code leaves it to the end.
+    if (count && !pc_set) {
+        e.StoreDwordImm(Field(offsetof(DspState, pc)), instructions[count - 1].next);
+    }
+    e.MovImm32(rax, static_cast<std::uint32_t>(count));
+    for (const size_t exit : exits) {
+        const auto distance = static_cast<std::uint32_t>(e.code.size() - (exit + 4));
+        std::memcpy(e.code.data() + exit, &distance, sizeof(distance));
+    }
+    // pop r13, r12, rbx; ret
+    e.Bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+    void* code = Install(e.code);
+    if (code) {
+        native_count += native;
+    }
+    return reinterpret_cast<JitCode>(code);
+}
+
+JitRepeatCode JitCompiler::CompileRepeat(const JitInstruction& instruction) {
+    Emitter e;
+    // push rbx, r12, r13; r13 counts the repetitions down.
+    e.Bytes({0x53, 0x41, 0x54, 0x41, 0x55});
+    e.Mov(rbx, rdi);
+    e.Mov(r12, rsi);
+    e.Mov(r13, rdx);
+    const size_t top = e.code.size();
+    if (!EmitNative(e, *instruction.op, instruction.next) || (!direct_data && e.uses_data))
+        return nullptr;
+    // dec r13d; jnz top
+    e.Bytes({0x41, 0xFF, 0xCD, 0x0F, 0x85});
+    e.Dword(static_cast<std::uint32_t>(top - (e.code.size() + 4)));
+    e.StoreDwordImm(Field(offsetof(DspState, pc)), instruction.next);
+    e.Bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+    void* code = Install(e.code);
+    if (code) {
+        native_count++;
+    }
+    return reinterpret_cast<JitRepeatCode>(code);
+}
+
+void* JitCompiler::Install(const std::vector<std::uint8_t>& code) {
+    if (!buffer) {
+        void* memory = mmap(nullptr, code_buffer_size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return nullptr;
+        buffer = static_cast<std::uint8_t*>(memory);
+    }
+    const size_t start = (used + 15) & ~size_t{15};
+    if (start + code.size() > code_buffer_size)
+        return nullptr;
+    if (mprotect(buffer, code_buffer_size, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    std::memcpy(buffer + start, code.data(), code.size());
+    mprotect(buffer, code_buffer_size, PROT_READ | PROT_EXEC);
+    used = start + code.size();
+    return buffer + start;
+}
+
+void JitCompiler::Flush() {
+    used = 0;
+}
+
+#else
+
+JitCompiler::JitCompiler(JitFallback fallback) : fallback(fallback) {}
+
+JitCompiler::~JitCompiler() = default;
+
+bool JitCompiler::Available() {
+    return false;
+}
+
+JitCode JitCompiler::Compile(const JitInstruction*, size_t) {
+    return nullptr;
+}
+
+JitRepeatCode JitCompiler::CompileRepeat(const JitInstruction&) {
+    return nullptr;
+}
+
+void JitCompiler::Flush() {}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "emu_decode.h"
+
+struct DspState;
+
+// Machine code for a run of instructions, called with the state, data memory and the context the
+// fallback gets. Returns how many instructions ran: all of them, unless the fallback returned
+// false for one, which is then the one the run stopped at.
+using JitCode = std::uint32_t (*)(DspState* state, std::uint16_t* data, void* context);
+
+// Machine code that runs one instruction `times` times, at least once, for a rep.
+using JitRepeatCode = void (*)(DspState* state, std::uint16_t* data, std::uint32_t times);
+
+// Runs an instruction the compiler has no code of its own for; the state's pc is not yet set.
+// False if the run has to stop.
+using JitFallback = bool (*)(void* context, const DecodedOp* op, std::uint32_t next);
+
+struct JitInstruction {
+    const DecodedOp* op;
+    // The address after the instruction.
+    std::uint32_t next;
+};
+
+// Compiles straight-line TeakLite code to x86-64. Accumulators, address registers and flags stay
+// in the DspState, which the code keeps a pointer to in a callee-saved register, so compiled and
+// interpreted instructions can interleave freely. Only built for x86-64 Unix; elsewhere
+// Compile always fails.
+class JitCompiler {
+public:
+    explicit JitCompiler(JitFallback fallback);
+    ~JitCompiler();
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    static bool Available();
+
+    // nullptr if the code buffer is full, or there is no JIT on this host. The instructions are
+    // referenced by the code and must outlive it.
+    JitCode Compile(const JitInstruction* instructions, size_t count);
+    // nullptr as for Compile, or if the instruction has no code of its own; the fallback is never
+    // called from a repeat. The instruction must not change the pc.
+    JitRepeatCode CompileRepeat(const JitInstruction& instruction);
+    // Discards all code compiled so far.
+    void Flush();
+    // While false, instructions that read or write data memory are left to the fallback, which
+    // sees mapped I/O that compiled code does not. Applies to code compiled from then on.
+    void SetDirectData(bool direct) { direct_data = direct; }
+
+    // Instructions compiled to code of their own rather than calls to the fallback, in total.
+    std::uint64_t NativeCount() const { return native_count; }
+
+private:
+    // Copies code into the buffer; nullptr if it is full.
+    void* Install(const std::vector<std::uint8_t>& code);
+
+    JitFallback fallback;
+    std::uint8_t* buffer = nullptr;
+    size_t used = 0;
+    std::uint64_t native_count = 0;
+    bool direct_data = true;
+};
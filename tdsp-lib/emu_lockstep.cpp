@@ -0,0 +1,840 @@
+#include <algorithm>
+#include <utility>
+
+#include "emu_lockstep.h"
+#include "emu_snapshot.h"
+
+static constexpr std::uint64_t acc_mask = (std::uint64_t{1} << 40) - 1;
+
+static std::int64_t SignExtend(std::int64_t value, unsigned bits) {
+    const unsigned shift = 64 - bits;
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(value) << shift) >> shift;
+}
+
+// A product as ps shifts it.
+static std::int64_t Scale(std::int64_t product, std::uint8_t ps) {
+    switch (ps) {
+    case 1:
+        return product >> 1;
+    case 2:
+        return product * 2;
+    case 3:
+        return product * 4;
+    }
+    return product;
+}
+
+// The bits of DspLockstep::flags.
+constexpr std::uint8_t flag_z = 1 << 0, flag_m = 1 << 1, flag_n = 1 << 2, flag_e = 1 << 3;
+constexpr std::uint8_t flag_c = 1 << 4, flag_v = 1 << 5, flag_l = 1 << 6, flag_r = 1 << 7;
+
+// The lane loops are also built for AVX2, which the loader picks where the host has it; the rest
+// of the build keeps to the baseline instruction set.
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__)
+#define LANE_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define LANE_KERNEL
+#endif
+
+static std::uint8_t AccIndex(std::uint8_t reg) {
+    return static_cast<std::uint8_t>(reg - static_cast<std::uint8_t>(DspReg::A0));
+}
+
+DspLockstep::DspLockstep(size_t instances)
+    : count(instances), table(GetDecodeTable()), program(std::make_shared<const std::vector<std::uint16_t>>()),
+      group(shared.State()), data(data_memory_words * instances), live(instances, 1), live_count(instances),
+      scalar(instances), words_a(instances), words_b(instances), values_a(instances), values_b(instances),
+      mask(instances) {
+    for (auto& lanes : acc) {
+        lanes.resize(count);
+    }
+    for (auto& lanes : r) {
+        lanes.resize(count);
+    }
+    for (auto* file : {&x, &y}) {
+        for (auto& lanes : *file) {
+            lanes.resize(count);
+        }
+    }
+    for (auto& lanes : p) {
+        lanes.resize(count);
+    }
+    flags.resize(count);
+    // Works out the address updates of the reset state, as Run does for an emulator.
+    shared.WriteRegister(DspReg::St2, 0);
+}
+
+void DspLockstep::LoadProgram(const std::uint16_t* words, size_t size) {
+    size = std::min(size, program_memory_words);
+    program = std::make_shared<const std::vector<std::uint16_t>>(words, words + size);
+    decoded.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        decoded[i] = table.Decode(words[i], i + 1 < size ? words[i + 1] : 0, static_cast<std::uint32_t>(i));
+    }
+    for (const auto& emulator : scalar) {
+        if (emulator) {
+            emulator->LoadProgram(words, size);
+        }
+    }
+}
+
+std::uint16_t DspLockstep::ReadData(size_t instance, std::uint16_t address) const {
+    return scalar[instance] ? scalar[instance]->ReadData(address) : data[address * count + instance];
+}
+
+void DspLockstep::WriteData(size_t instance, std::uint16_t address, std::uint16_t value) {
+    if (scalar[instance]) {
+        scalar[instance]->WriteData(address, value);
+    } else {
+        data[address * count + instance] = value;
+    }
+}
+
+DspState DspLockstep::State(size_t instance) const {
+    if (scalar[instance])
+        return scalar[instance]->State();
+    DspState state = group;
+    for (size_t i = 0; i < acc.size(); i++) {
+        state.acc[i] = acc[i][instance];
+    }
+    for (size_t i = 0; i < r.size(); i++) {
+        state.r[i] = r[i][instance];
+    }
+    for (size_t i = 0; i < 2; i++) {
+        state.x[i] = x[i][instance];
+        state.y[i] = y[i][instance];
+        state.p[i] = p[i][instance];
+    }
+    const std::uint8_t bits = flags[instance];
+    state.flags = DspFlags{(bits & flag_z) != 0, (bits & flag_m) != 0, (bits & flag_n) != 0, (bits & flag_v) != 0,
+                           (bits & flag_c) != 0, (bits & flag_e) != 0, (bits & flag_l) != 0, (bits & flag_r) != 0};
+    state.flag_source = FlagSource::None;
+    return state;
+}
+
+std::uint64_t DspLockstep::Cycles(size_t instance) const {
+    return scalar[instance] ? scalar[instance]->Cycles() : cycles;
+}
+
+size_t DspLockstep::FirstLive() const {
+    return static_cast<size_t>(std::find(live.begin(), live.end(), 1) - live.begin());
+}
+
+// Hands the instance its own emulator, where it goes on from the same pc and cycle.
+void DspLockstep::Drop(size_t instance) {
+    std::vector<std::uint16_t> words(data_memory_words);
+    for (size_t address = 0; address < data_memory_words; address++) {
+        words[address] = data[address * count + instance];
+    }
+    DspSnapshot snapshot;
+    snapshot.state = State(instance);
+    snapshot.cycles = cycles;
+    snapshot.data = std::make_shared<const std::vector<std::uint16_t>>(std::move(words));
+    snapshot.program = program;
+    snapshot.id = NewSnapshotId();
+
+    auto emulator = std::make_unique<DspEmulator>();
+    emulator->SetDispatchMode(dispatch);
+    emulator->Restore(snapshot);
+    scalar[instance] = std::move(emulator);
+    live[instance] = 0;
+    live_count--;
+}
+
+bool DspLockstep::LaneRegister(DspReg reg) {
+    return reg <= DspReg::P1 || (reg >= DspReg::A0 && reg <= DspReg::B1H);
+}
+
+// st0 and st1 hold flags and accumulator bits, and pc, lc and repc belong to the control flow.
+bool DspLockstep::SharedRegister(DspReg reg) {
+    return reg >= DspReg::St2 && reg < DspReg::Invalid && reg != DspReg::Pc && reg != DspReg::Lc && reg != DspReg::Repc;
+}
+
+void DspLockstep::ReadLanes(DspReg reg, std::uint16_t* values) const {
+    const auto index = static_cast<std::uint8_t>(reg);
+    if (reg <= DspReg::R7) {
+        std::copy(r[index].begin(), r[index].end(), values);
+    } else if (reg <= DspReg::Y1) {
+        std::copy(y[index - static_cast<std::uint8_t>(DspReg::Y0)].begin(),
+                  y[index - static_cast<std::uint8_t>(DspReg::Y0)].end(), values);
+    } else if (reg <= DspReg::X1) {
+        std::copy(x[index - static_cast<std::uint8_t>(DspReg::X0)].begin(),
+                  x[index - static_cast<std::uint8_t>(DspReg::X0)].end(), values);
+    } else if (reg <= DspReg::P1) {
+        const std::int64_t* product = p[index - static_cast<std::uint8_t>(DspReg::P0)].data();
+        for (size_t i = 0; i < count; i++) {
+            values[i] = static_cast<std::uint16_t>(Scale(product[i], group.ps));
+        }
+    } else if (reg <= DspReg::B1L) {
+        const std::int64_t* value = acc[(index - static_cast<std::uint8_t>(DspReg::A0)) % 4].data();
+        for (size_t i = 0; i < count; i++) {
+            values[i] = static_cast<std::uint16_t>(value[i]);
+        }
+    } else if (reg <= DspReg::B1H) {
+        const std::int64_t* value = acc[index - static_cast<std::uint8_t>(DspReg::A0H)].data();
+        for (size_t i = 0; i < count; i++) {
+            values[i] = static_cast<std::uint16_t>(value[i] >> 16);
+        }
+    } else {
+        std::fill(values, values + count, shared.ReadRegister(reg));
+    }
+}
+
+void DspLockstep::WriteLanes(DspReg reg, const std::uint16_t* values) {
+    const auto index = static_cast<std::uint8_t>(reg);
+    if (reg <= DspReg::R7) {
+        std::copy(values, values + count, r[index].begin());
+    } else if (reg <= DspReg::Y1) {
+        std::copy(values, values + count, y[index - static_cast<std::uint8_t>(DspReg::Y0)].begin());
+    } else if (reg <= DspReg::X1) {
+        std::copy(values, values + count, x[index - static_cast<std::uint8_t>(DspReg::X0)].begin());
+    } else if (reg <= DspReg::P1) {
+        std::int64_t* product = p[index - static_cast<std::uint8_t>(DspReg::P0)].data();
+        for (size_t i = 0; i < count; i++) {
+            product[i] = static_cast<std::int16_t>(values[i]);
+        }
+    } else if (reg <= DspReg::B1) {
+        for (size_t i = 0; i < count; i++) {
+            values_b[i] = static_cast<std::int16_t>(values[i]);
+        }
+        SetAccumulator(AccIndex(index), values_b.data());
+    } else if (reg <= DspReg::B1L) {
+        for (size_t i = 0; i < count; i++) {
+            values_b[i] = values[i];
+        }
+        SetAccumulator(static_cast<std::uint8_t>(index - static_cast<std::uint8_t>(DspReg::A0L)), values_b.data());
+    } else if (reg <= DspReg::B1H) {
+        for (size_t i = 0; i < count; i++) {
+            values_b[i] = SignExtend(std::int64_t{values[i]} << 16, 32);
+        }
+        SetAccumulator(static_cast<std::uint8_t>(index - static_cast<std::uint8_t>(DspReg::A0H)), values_b.data());
+    } else {
+        // Only immediates go to shared registers, so every instance has the same value.
+        shared.WriteRegister(reg, values[0]);
+    }
+}
+
+void DspLockstep::Address(std::uint8_t reg, StepCode step, std::uint16_t* addresses) {
+    const AddressUpdate& update = group.address_updates[reg][static_cast<size_t>(step)];
+    std::uint16_t* value = r[reg].data();
+    for (size_t i = 0; i < count; i++) {
+        addresses[i] = value[i];
+        const std::uint16_t low = value[i] & update.mask;
+        const std::uint16_t next = low == update.edge ? update.wrap : static_cast<std::uint16_t>((low + update.step) & update.mask);
+        value[i] = static_cast<std::uint16_t>((value[i] & ~update.mask) | next);
+    }
+}
+
+// Instances usually address the same word, which is then a contiguous run of them.
+static bool SameAddress(size_t count, const std::uint16_t* addresses) {
+    std::uint16_t differ = 0;
+    for (size_t i = 1; i < count; i++) {
+        differ |= addresses[i] ^ addresses[0];
+    }
+    return differ == 0;
+}
+
+void DspLockstep::Load(const std::uint16_t* addresses, std::uint16_t* values) const {
+    if (SameAddress(count, addresses)) {
+        std::copy_n(data.begin() + addresses[0] * count, count, values);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        values[i] = data[addresses[i] * count + i];
+    }
+}
+
+void DspLockstep::Store(const std::uint16_t* addresses, const std::uint16_t* values) {
+    if (SameAddress(count, addresses)) {
+        std::copy_n(values, count, data.begin() + addresses[0] * count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        data[addresses[i] * count + i] = values[i];
+    }
+}
+
+void DspLockstep::Condition(std::uint8_t cond, std::uint8_t* taken) const {
+    // Holds when any of the `set` bits is, or when none of the `clear` bits is.
+    const auto each = [&](std::uint8_t set, std::uint8_t clear) {
+        const std::uint8_t* bits = flags.data();
+        for (size_t i = 0; i < count; i++) {
+            taken[i] = (bits[i] & set) != 0 || (clear && !(bits[i] & clear));
+        }
+    };
+    switch (cond) {
+    case 0:
+    case 13:
+        std::fill(taken, taken + count, std::uint8_t{1});
+        return;
+    case 1: each(flag_z, 0); return;
+    case 2: each(0, flag_z); return;
+    case 3: each(0, flag_z | flag_m); return;
+    case 4: each(0, flag_m); return;
+    case 5: each(flag_m, 0); return;
+    case 6: each(flag_z | flag_m, 0); return;
+    case 7: each(0, flag_n); return;
+    case 8: each(flag_c, 0); return;
+    case 9: each(flag_v, 0); return;
+    case 10: each(flag_e, 0); return;
+    case 11: each(flag_l, 0); return;
+    case 12: each(0, flag_r); return;
+    default:
+        std::fill(taken, taken + count, std::uint8_t{0});
+        return;
+    }
+}
+
+void DspLockstep::Products(size_t index, std::int64_t* values) const {
+    const std::int64_t* product = p[index].data();
+    const std::uint8_t ps = group.ps;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = Scale(product[i], ps);
+    }
+}
+
+// z, m, n and e of a result. Kept to integer arithmetic, without branches, so the lane loops
+// vectorize.
+static std::uint8_t ResultFlags(std::int64_t value) {
+    const std::int64_t z = value == 0;
+    const std::int64_t e = value != SignExtend(value, 32);
+    const std::int64_t n = z | ((e ^ 1) & ((value >> 31) ^ (value >> 30)) & 1);
+    return static_cast<std::uint8_t>(z * flag_z | (value < 0) * flag_m | n * flag_n | e * flag_e);
+}
+
+static std::uint8_t ArithmeticFlags(std::uint8_t flags, std::int64_t a, std::int64_t b, bool subtract, std::int64_t& result) {
+    const std::int64_t sum = subtract ? a - b : a + b;
+    const auto ua = static_cast<std::uint64_t>(a) & acc_mask;
+    const auto ub = static_cast<std::uint64_t>(b) & acc_mask;
+    const std::int64_t c = subtract ? ua < ub : ((ua + ub) >> 40) & 1;
+    result = SignExtend(sum, 40);
+    const std::int64_t v = sum != result;
+    return static_cast<std::uint8_t>((flags & (flag_l | flag_r)) | c * flag_c | v * (flag_v | flag_l) | ResultFlags(result));
+}
+
+LANE_KERNEL static void SetLanes(size_t count, std::int64_t* acc, const std::int64_t* values, std::uint8_t* flags) {
+    for (size_t i = 0; i < count; i++) {
+        const std::int64_t value = SignExtend(values[i], 40);
+        acc[i] = value;
+        flags[i] = static_cast<std::uint8_t>((flags[i] & (flag_c | flag_v | flag_l | flag_r)) | ResultFlags(value));
+    }
+}
+
+LANE_KERNEL static void AddLanes(size_t count, std::int64_t* result, const std::int64_t* a, const std::int64_t* b,
+                                 std::uint8_t* flags) {
+    for (size_t i = 0; i < count; i++) {
+        flags[i] = ArithmeticFlags(flags[i], a[i], b[i], false, result[i]);
+    }
+}
+
+LANE_KERNEL static void SubLanes(size_t count, std::int64_t* result, const std::int64_t* a, const std::int64_t* b,
+                                 std::uint8_t* flags) {
+    for (size_t i = 0; i < count; i++) {
+        flags[i] = ArithmeticFlags(flags[i], a[i], b[i], true, result[i]);
+    }
+}
+
+void DspLockstep::SetAccumulator(std::uint8_t index, const std::int64_t* values, const std::uint8_t* only) {
+    std::int64_t* value = acc[index].data();
+    if (!only) {
+        SetLanes(count, value, values, flags.data());
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (only[i]) {
+            value[i] = SignExtend(values[i], 40);
+            flags[i] = static_cast<std::uint8_t>((flags[i] & (flag_c | flag_v | flag_l | flag_r)) | ResultFlags(value[i]));
+        }
+    }
+}
+
+void DspLockstep::Arithmetic(std::int64_t* result, const std::int64_t* a, const std::int64_t* b, bool subtract,
+                             const std::uint8_t* only) {
+    if (!only) {
+        (subtract ? SubLanes : AddLanes)(count, result, a, b, flags.data());
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (only[i]) {
+            flags[i] = ArithmeticFlags(flags[i], a[i], b[i], subtract, result[i]);
+        }
+    }
+}
+
+void DspLockstep::Alu(AluOp op, std::uint8_t index, const std::uint16_t* words) {
+    std::int64_t* operands = values_a.data();
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Sub:
+    case AluOp::Cmp:
+        for (size_t i = 0; i < count; i++) {
+            operands[i] = static_cast<std::int16_t>(words[i]);
+        }
+        break;
+    case AluOp::Addh:
+    case AluOp::Subh:
+        for (size_t i = 0; i < count; i++) {
+            operands[i] = std::int64_t{static_cast<std::int16_t>(words[i])} * 0x10000;
+        }
+        break;
+    default:
+        for (size_t i = 0; i < count; i++) {
+            operands[i] = words[i];
+        }
+        break;
+    }
+    Alu(op, index, operands);
+}
+
+void DspLockstep::Alu(AluOp op, std::uint8_t index, const std::int64_t* operands) {
+    std::int64_t* value = acc[index].data();
+    std::int64_t* results = values_b.data();
+    switch (op) {
+    case AluOp::Add:
+    case AluOp::Addh:
+    case AluOp::Addl:
+        Arithmetic(value, value, operands, false);
+        return;
+    case AluOp::Sub:
+    case AluOp::Subh:
+    case AluOp::Subl:
+        Arithmetic(value, value, operands, true);
+        return;
+    case AluOp::Cmp:
+    case AluOp::Cmpu:
+        Arithmetic(values_b.data(), value, operands, true);
+        return;
+    case AluOp::And:
+        for (size_t i = 0; i < count; i++) {
+            results[i] = value[i] & operands[i];
+        }
+        break;
+    case AluOp::Or:
+        for (size_t i = 0; i < count; i++) {
+            results[i] = value[i] | operands[i];
+        }
+        break;
+    case AluOp::Xor:
+        for (size_t i = 0; i < count; i++) {
+            results[i] = value[i] ^ operands[i];
+        }
+        break;
+    }
+    SetAccumulator(index, results);
+}
+
+void DspLockstep::Unary(UnaryOp op, std::uint8_t index, std::uint8_t source, const std::uint8_t* only) {
+    std::int64_t* value = acc[index].data();
+    std::int64_t* a = values_a.data();
+    std::int64_t* b = values_b.data();
+    switch (op) {
+    case UnaryOp::Clr:
+    case UnaryOp::Clrr:
+        std::fill(b, b + count, op == UnaryOp::Clr ? 0 : 0x8000);
+        SetAccumulator(index, b, only);
+        return;
+    case UnaryOp::Inc:
+    case UnaryOp::Dec:
+        std::fill(b, b + count, 1);
+        Arithmetic(value, value, b, op == UnaryOp::Dec, only);
+        return;
+    case UnaryOp::Neg:
+        std::fill(a, a + count, 0);
+        Arithmetic(value, a, value, true, only);
+        return;
+    case UnaryOp::Not:
+        for (size_t i = 0; i < count; i++) {
+            b[i] = ~value[i];
+        }
+        SetAccumulator(index, b, only);
+        return;
+    case UnaryOp::Copy:
+        SetAccumulator(index, acc[AccIndex(source)].data(), only);
+        return;
+    case UnaryOp::Rnd:
+        std::fill(b, b + count, 0x8000);
+        Arithmetic(value, value, b, false, only);
+        return;
+    case UnaryOp::Pacr:
+        Products(0, a);
+        std::fill(b, b + count, 0x8000);
+        Arithmetic(value, a, b, false, only);
+        return;
+    default:
+        // Shifts and rotates are not covered.
+        return;
+    }
+}
+
+void DspLockstep::Multiply(MulOp op, std::uint8_t index, const std::uint16_t* y_values, const std::uint16_t* x_values) {
+    std::int64_t* value = acc[index].data();
+    std::int64_t* product = values_a.data();
+    // The accumulating forms add the previous product before forming the new one.
+    switch (op) {
+    case MulOp::Mac:
+    case MulOp::Macsu:
+    case MulOp::Macus:
+    case MulOp::Macuu:
+    case MulOp::Sqra:
+        Products(0, product);
+        Arithmetic(value, value, product, false);
+        break;
+    case MulOp::Msu:
+        Products(0, product);
+        Arithmetic(value, value, product, true);
+        break;
+    case MulOp::Maa:
+    case MulOp::Maasu:
+        Products(0, product);
+        for (size_t i = 0; i < count; i++) {
+            product[i] >>= 16;
+        }
+        Arithmetic(value, value, product, false);
+        break;
+    default:
+        break;
+    }
+
+    const bool y_signed = op != MulOp::Macus && op != MulOp::Macuu;
+    const bool x_signed = op != MulOp::Mpysu && op != MulOp::Macsu && op != MulOp::Maasu && op != MulOp::Macuu;
+    std::uint16_t* y0 = y[0].data();
+    std::uint16_t* x0 = x[0].data();
+    std::int64_t* p0 = p[0].data();
+    for (size_t i = 0; i < count; i++) {
+        const std::uint16_t y_value = y_values[i];
+        const std::uint16_t x_value = x_values[i];
+        y0[i] = y_value;
+        x0[i] = x_value;
+        const std::int64_t sy = y_signed ? std::int64_t{static_cast<std::int16_t>(y_value)} : std::int64_t{y_value};
+        const std::int64_t sx = x_signed ? std::int64_t{static_cast<std::int16_t>(x_value)} : std::int64_t{x_value};
+        p0[i] = sy * sx;
+    }
+}
+
+bool DspLockstep::Covers(const DecodedOp& op) const {
+    const auto reg = [&](size_t i) { return static_cast<DspReg>(op.f[i]); };
+    const auto readable = [&](size_t i) { return LaneRegister(reg(i)) || SharedRegister(reg(i)); };
+    switch (op.op) {
+    case EmuOp::Nop:
+    case EmuOp::Trap:
+    case EmuOp::AluImm:
+    case EmuOp::AluMemImm8:
+    case EmuOp::AluMemImm16:
+    case EmuOp::AluMemR7:
+    case EmuOp::AluMemRn:
+    case EmuOp::AluAcc:
+    case EmuOp::MovAccAcc:
+    case EmuOp::Br:
+    case EmuOp::Rep:
+    case EmuOp::Modr:
+    case EmuOp::MulMemImm8:
+    case EmuOp::MulMemRn:
+    case EmuOp::MulMemRnImm:
+    case EmuOp::Mpyi:
+    case EmuOp::Clrp:
+        return true;
+    case EmuOp::AluReg:
+        return readable(1);
+    case EmuOp::AccUnary:
+        switch (static_cast<UnaryOp>(op.aux)) {
+        case UnaryOp::Shl:
+        case UnaryOp::Shr:
+        case UnaryOp::Shl4:
+        case UnaryOp::Shr4:
+        case UnaryOp::Rol:
+        case UnaryOp::Ror:
+            return false;
+        default:
+            return true;
+        }
+    case EmuOp::MovImmReg:
+    case EmuOp::MovRegMemImm8:
+    case EmuOp::MovRegMemImm16:
+    case EmuOp::MovRegMemR7:
+    case EmuOp::MovRegMemRn:
+    case EmuOp::MulReg:
+        return readable(0);
+    case EmuOp::MovRegReg:
+        return readable(0) && LaneRegister(reg(1));
+    case EmuOp::MovMemImm8Reg:
+    case EmuOp::MovMemImm16Reg:
+    case EmuOp::MovMemR7Reg:
+    case EmuOp::MovMemRnReg:
+        return LaneRegister(reg(0));
+    case EmuOp::Bkrep:
+        return group.loop_depth < group.loops.size();
+    default:
+        return false;
+    }
+}
+
+bool DspLockstep::Execute(const DecodedOp& op) {
+    const auto reg = [&](size_t i) { return static_cast<DspReg>(op.f[i]); };
+    const auto page_address = [&](std::uint8_t low) { return static_cast<std::uint16_t>(group.page << 8 | low); };
+    const auto alu_op = static_cast<AluOp>(op.aux);
+    const auto step = [&](size_t i) { return static_cast<StepCode>(op.f[i]); };
+    std::uint16_t* values = words_a.data();
+    std::uint16_t* addresses = words_b.data();
+    const auto at = [&](std::uint16_t address) { std::fill(addresses, addresses + count, address); };
+    const auto at_r7 = [&] {
+        for (size_t i = 0; i < count; i++) {
+            addresses[i] = static_cast<std::uint16_t>(r[7][i] + op.imm);
+        }
+    };
+
+    switch (op.op) {
+    case EmuOp::Trap:
+        stop = StopReason::Trap;
+        return false;
+
+    case EmuOp::AluImm:
+        std::fill(values, values + count, static_cast<std::uint16_t>(op.imm));
+        Alu(alu_op, AccIndex(op.f[0]), values);
+        return true;
+    case EmuOp::AluMemImm8:
+        at(page_address(op.f[1]));
+        Load(addresses, values);
+        Alu(alu_op, AccIndex(op.f[0]), values);
+        return true;
+    case EmuOp::AluMemImm16:
+        at(static_cast<std::uint16_t>(op.imm));
+        Load(addresses, values);
+        Alu(alu_op, AccIndex(op.f[0]), values);
+        return true;
+    case EmuOp::AluMemR7:
+        at_r7();
+        Load(addresses, values);
+        Alu(alu_op, AccIndex(op.f[0]), values);
+        return true;
+    case EmuOp::AluMemRn:
+        Address(op.f[1], step(2), addresses);
+        Load(addresses, values);
+        Alu(alu_op, AccIndex(op.f[0]), values);
+        return true;
+    case EmuOp::AluReg:
+        if (reg(1) == DspReg::P0 || reg(1) == DspReg::P1) {
+            Products(reg(1) == DspReg::P1, values_a.data());
+            Alu(alu_op, AccIndex(op.f[0]), values_a.data());
+        } else {
+            ReadLanes(reg(1), values);
+            Alu(alu_op, AccIndex(op.f[0]), values);
+        }
+        return true;
+    case EmuOp::AluAcc:
+        Alu(alu_op, AccIndex(op.f[0]), acc[AccIndex(op.f[1])].data());
+        return true;
+
+    case EmuOp::AccUnary:
+        // A condition masks the instances rather than branching.
+        if (op.f[1] == 0) {
+            Unary(static_cast<UnaryOp>(op.aux), AccIndex(op.f[0]), op.f[2], nullptr);
+        } else {
+            Condition(op.f[1], mask.data());
+            Unary(static_cast<UnaryOp>(op.aux), AccIndex(op.f[0]), op.f[2], mask.data());
+        }
+        return true;
+
+    case EmuOp::MovImmReg:
+        std::fill(values, values + count, static_cast<std::uint16_t>(op.imm));
+        WriteLanes(reg(0), values);
+        return true;
+    case EmuOp::MovRegReg:
+        ReadLanes(reg(0), values);
+        WriteLanes(reg(1), values);
+        return true;
+    case EmuOp::MovAccAcc:
+        SetAccumulator(AccIndex(op.f[1]), acc[AccIndex(op.f[0])].data());
+        return true;
+    case EmuOp::MovMemImm8Reg:
+        at(page_address(op.f[1]));
+        Load(addresses, values);
+        WriteLanes(reg(0), values);
+        return true;
+    case EmuOp::MovRegMemImm8:
+        ReadLanes(reg(0), values);
+        at(page_address(op.f[1]));
+        Store(addresses, values);
+        return true;
+    case EmuOp::MovMemImm16Reg:
+        at(static_cast<std::uint16_t>(op.imm));
+        Load(addresses, values);
+        WriteLanes(reg(0), values);
+        return true;
+    case EmuOp::MovRegMemImm16:
+        ReadLanes(reg(0), values);
+        at(static_cast<std::uint16_t>(op.imm));
+        Store(addresses, values);
+        return true;
+    case EmuOp::MovMemR7Reg:
+        at_r7();
+        Load(addresses, values);
+        WriteLanes(reg(0), values);
+        return true;
+    case EmuOp::MovRegMemR7:
+        ReadLanes(reg(0), values);
+        at_r7();
+        Store(addresses, values);
+        return true;
+    case EmuOp::MovMemRnReg:
+        Address(op.f[1], step(2), addresses);
+        Load(addresses, values);
+        WriteLanes(reg(0), values);
+        return true;
+    case EmuOp::MovRegMemRn:
+        // The source is read first, in case it is the address register itself.
+        ReadLanes(reg(0), values);
+        Address(op.f[1], step(2), addresses);
+        Store(addresses, values);
+        return true;
+
+    case EmuOp::Rep:
+        group.repeating = true;
+        group.rep_pc = group.pc;
+        group.repc = static_cast<std::uint16_t>(op.imm);
+        return true;
+    case EmuOp::Bkrep:
+        group.loops[group.loop_depth++] = BlockRepeat{group.pc, op.imm, std::uint16_t{op.f[0]}};
+        return true;
+    case EmuOp::Modr: {
+        // With dmod, modr steps linearly whatever the modulo.
+        std::uint16_t* value = r[op.f[0]].data();
+        if (op.aux) {
+            const std::uint16_t linear = group.address_updates[op.f[0]][op.f[1]].step;
+            for (size_t i = 0; i < count; i++) {
+                value[i] = static_cast<std::uint16_t>(value[i] + linear);
+            }
+        } else {
+            Address(op.f[0], step(1), addresses);
+        }
+        for (size_t i = 0; i < count; i++) {
+            flags[i] = static_cast<std::uint8_t>((flags[i] & ~flag_r) | (value[i] == 0) * flag_r);
+        }
+        return true;
+    }
+
+    case EmuOp::MulReg:
+    case EmuOp::MulMemImm8:
+    case EmuOp::MulMemRn: {
+        const auto mul_op = static_cast<MulOp>(op.aux);
+        if (op.op == EmuOp::MulReg) {
+            ReadLanes(reg(0), values);
+        } else {
+            if (op.op == EmuOp::MulMemImm8) {
+                at(page_address(op.f[0]));
+            } else {
+                Address(op.f[0], step(2), addresses);
+            }
+            Load(addresses, values);
+        }
+        const bool square = mul_op == MulOp::Sqr || mul_op == MulOp::Sqra;
+        Multiply(mul_op, AccIndex(op.f[1]), square ? values : y[0].data(), values);
+        return true;
+    }
+    case EmuOp::MulMemRnImm:
+        Address(op.f[0], step(2), addresses);
+        Load(addresses, values);
+        std::fill(addresses, addresses + count, static_cast<std::uint16_t>(op.imm));
+        Multiply(static_cast<MulOp>(op.aux), AccIndex(op.f[1]), values, addresses);
+        return true;
+    case EmuOp::Mpyi:
+        std::fill(values, values + count, static_cast<std::uint16_t>(op.imm));
+        Multiply(MulOp::Mpy, 0, y[0].data(), values);
+        return true;
+    case EmuOp::Clrp:
+        std::fill(p[reg(0) == DspReg::P1].begin(), p[reg(0) == DspReg::P1].end(), 0);
+        return true;
+
+    default:
+        // Nop, and the branch Step takes itself.
+        return true;
+    }
+}
+
+void DspLockstep::CheckBlockRepeat() {
+    if (group.loop_depth) {
+        BlockRepeat& loop = group.loops[group.loop_depth - 1];
+        if (group.pc == loop.end + 1) {
+            if (loop.lc == 0) {
+                group.loop_depth--;
+            } else {
+                loop.lc--;
+                group.pc = loop.start;
+            }
+        }
+    }
+}
+
+bool DspLockstep::Step() {
+    const std::uint32_t pc = group.pc;
+    const DecodedOp& op = decoded[pc];
+    if (!Covers(op)) {
+        for (size_t i = 0; i < count; i++) {
+            if (live[i]) {
+                Drop(i);
+            }
+        }
+        return false;
+    }
+    bool taken = false;
+    if (op.op == EmuOp::Br) {
+        // Instances that go the other way than the first drop out before the branch.
+        Condition(op.f[0], mask.data());
+        const size_t first = FirstLive();
+        taken = mask[first];
+        for (size_t i = first + 1; i < count; i++) {
+            if (live[i] && mask[i] != mask[first]) {
+                Drop(i);
+            }
+        }
+    }
+
+    group.pc = pc + op.length;
+    if (!Execute(op)) {
+        cycles++;
+        return false;
+    }
+    if (taken) {
+        group.pc = op.imm;
+    }
+    cycles++;
+
+    if (group.repeating && pc == group.rep_pc) {
+        if (group.repc == 0) {
+            group.repeating = false;
+        } else {
+            group.repc--;
+            group.pc = pc;
+        }
+    }
+    CheckBlockRepeat();
+    return true;
+}
+
+std::vector<RunResult> DspLockstep::Run(std::uint64_t max_cycles) {
+    std::vector<std::uint64_t> start(count);
+    for (size_t i = 0; i < count; i++) {
+        start[i] = Cycles(i);
+    }
+    const std::uint64_t group_start = cycles;
+    stop = StopReason::CycleLimit;
+    while (live_count && cycles - group_start < max_cycles) {
+        if (group.pc >= decoded.size()) {
+            stop = StopReason::EndOfProgram;
+            break;
+        }
+        if (!Step())
+            break;
+    }
+
+    std::vector<RunResult> results(count);
+    for (size_t i = 0; i < count; i++) {
+        if (live[i]) {
+            results[i] = RunResult{stop, cycles - group_start, group.pc, 0};
+            continue;
+        }
+        DspEmulator& emulator = *scalar[i];
+        results[i] = emulator.Run(max_cycles - (emulator.Cycles() - start[i]));
+        results[i].cycles = emulator.Cycles() - start[i];
+    }
+    return results;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "emu_core.h"
+
+// Runs one program as many instances in lockstep, e.g. to fuzz a kernel with different inputs.
+// While the instances share a pc, each of their registers and flags is an array with an entry per
+// instance, data memory is interleaved word by word, and every instruction runs as loops across
+// the instances that the compiler can vectorize. An instance whose branch goes another way than
+// the first instance's drops out to a DspEmulator of its own, as they all do at an instruction
+// lockstep does not cover; either way each instance ends as it would have run alone. Instances
+// start from reset, with no events or interrupts.
+class DspLockstep {
+public:
+    explicit DspLockstep(size_t instances);
+
+    // How instances that drop out run.
+    void SetDispatchMode(DispatchMode mode) { dispatch = mode; }
+    // Replaces the program of every instance; the program starts at address zero.
+    void LoadProgram(const std::uint16_t* words, size_t size);
+
+    size_t Instances() const { return count; }
+    std::uint16_t ReadData(size_t instance, std::uint16_t address) const;
+    void WriteData(size_t instance, std::uint16_t address, std::uint16_t value);
+    DspState State(size_t instance) const;
+    std::uint64_t Cycles(size_t instance) const;
+    bool InLockstep(size_t instance) const { return !scalar[instance]; }
+
+    // Runs every instance for up to `max_cycles`; a result per instance.
+    std::vector<RunResult> Run(std::uint64_t max_cycles);
+
+private:
+    // Whether lockstep runs the instruction; otherwise every instance drops out before it.
+    bool Covers(const DecodedOp& op) const;
+    size_t FirstLive() const;
+    // Runs the instruction at the pc across the instances, as DspEmulator::Step does; false if
+    // it stopped the run, with the reason in `stop`.
+    bool Step();
+    bool Execute(const DecodedOp& op);
+    void CheckBlockRepeat();
+    void Drop(size_t instance);
+
+    // A register each instance has its own of, or one they share, which lockstep reads from and
+    // writes immediates to.
+    static bool LaneRegister(DspReg reg);
+    static bool SharedRegister(DspReg reg);
+    void ReadLanes(DspReg reg, std::uint16_t* values) const;
+    void WriteLanes(DspReg reg, const std::uint16_t* values);
+    void Address(std::uint8_t reg, StepCode step, std::uint16_t* addresses);
+    void Load(const std::uint16_t* addresses, std::uint16_t* values) const;
+    void Store(const std::uint16_t* addresses, const std::uint16_t* values);
+    void Condition(std::uint8_t cond, std::uint8_t* taken) const;
+    void Products(size_t index, std::int64_t* values) const;
+
+    // Each of these skips the instances `only` is zero for, if given.
+    void SetAccumulator(std::uint8_t acc, const std::int64_t* values, const std::uint8_t* only = nullptr);
+    // Sets `result` to a +/- b, with the flags.
+    void Arithmetic(std::int64_t* result, const std::int64_t* a, const std::int64_t* b, bool subtract,
+                    const std::uint8_t* only = nullptr);
+    void Alu(AluOp op, std::uint8_t acc, const std::uint16_t* words);
+    void Alu(AluOp op, std::uint8_t acc, const std::int64_t* operands);
+    void Unary(UnaryOp op, std::uint8_t acc, std::uint8_t source, const std::uint8_t* only);
+    void Multiply(MulOp op, std::uint8_t acc, const std::uint16_t* y_values, const std::uint16_t* x_values);
+
+    size_t count;
+    DispatchMode dispatch = DispatchMode::Block;
+    const DecodeTable& table;
+    std::shared_ptr<const std::vector<std::uint16_t>> program;
+    std::vector<DecodedOp> decoded;
+
+    // Holds what the instances share: the pc, repeats, and registers other than those below,
+    // which it works out the address updates for when written.
+    DspEmulator shared;
+    DspState& group;
+    std::uint64_t cycles = 0;
+    StopReason stop = StopReason::CycleLimit;
+
+    // By register, then instance.
+    std::array<std::vector<std::int64_t>, 4> acc;
+    std::array<std::vector<std::uint16_t>, 8> r;
+    std::array<std::vector<std::uint16_t>, 2> x;
+    std::array<std::vector<std::uint16_t>, 2> y;
+    std::array<std::vector<std::int64_t>, 2> p;
+    // Always worked out: a byte per instance, with a bit per flag.
+    std::vector<std::uint8_t> flags;
+    // Word `address` of instance i is at address * count + i.
+    std::vector<std::uint16_t> data;
+    // Instances that have dropped out keep computing here, on their own data, but nothing reads
+    // their values.
+    std::vector<std::uint8_t> live;
+    size_t live_count;
+    std::vector<std::unique_ptr<DspEmulator>> scalar;
+
+    // Operands, one per instance.
+    std::vector<std::uint16_t> words_a;
+    std::vector<std::uint16_t> words_b;
+    std::vector<std::int64_t> values_a;
+    std::vector<std::int64_t> values_b;
+    std::vector<std::uint8_t> mask;
+};
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "emu_memory.h"
+
+static constexpr size_t host_page_bytes = 4096;
+
+static_assert(-dirty_flags_offset == host_page_bytes && data_pages <= host_page_bytes);
+
+DspMemory::DspMemory() : data(Allocate(data_memory_words, host_page_bytes)), program(Allocate(program_memory_words, 0)) {}
+
+void DspMemory::AlignedFree::operator()(std::uint16_t* words) const {
+    ::operator delete[](reinterpret_cast<std::uint8_t*>(words) - prefix, std::align_val_t{host_page_bytes});
+}
+
+DspMemory::Words DspMemory::Allocate(size_t words, size_t prefix) {
+    const size_t bytes = prefix + words * sizeof(std::uint16_t);
+    auto* memory = static_cast<std::uint8_t*>(::operator new[](bytes, std::align_val_t{host_page_bytes}));
+    std::memset(memory, 0, bytes);
+    return Words{reinterpret_cast<std::uint16_t*>(memory + prefix), AlignedFree{prefix}};
+}
+
+void DspMemory::WriteProgram(std::uint32_t address, const std::uint16_t* words, size_t count) {
+    std::copy(words, words + count, program.get() + address);
+    for (size_t page = address >> memory_page_bits; page < program_pages && page << memory_page_bits < address + count; page++) {
+        program_dirty[page] = true;
+    }
+}
+
+void DspMemory::ClearDirty() {
+    std::memset(DirtyFlags(), 0, data_pages);
+    program_dirty.fill(false);
+}
+
+void DspMemory::MapMmio(size_t first_page, size_t pages, const MmioHandler& handler) {
+    for (size_t page = first_page; page < first_page + pages && page < data_pages; page++) {
+        mapped_count += !mapped[page];
+        mapped[page] = true;
+        handlers[page] = handler;
+    }
+}
+
+void DspMemory::UnmapMmio(size_t first_page, size_t pages) {
+    for (size_t page = first_page; page < first_page + pages && page < data_pages; page++) {
+        mapped_count -= mapped[page];
+        mapped[page] = false;
+        handlers[page] = MmioHandler{};
+    }
+}
+
+std::uint16_t DspMemory::LoadMmio(std::uint16_t address) const {
+    const MmioHandler& handler = handlers[address >> memory_page_bits];
+    return handler.read ? handler.read(handler.context, address) : 0;
+}
+
+void DspMemory::StoreMmio(std::uint16_t address, std::uint16_t value) {
+    const MmioHandler& handler = handlers[address >> memory_page_bits];
+    if (handler.write) {
+        handler.write(handler.context, address, value);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+constexpr size_t data_memory_words = 0x10000;
+constexpr size_t program_memory_words = 0x40000;
+// I/O is mapped and writes are tracked in pages of 256 words, the span the page register gives
+// MemImm8 operands.
+constexpr unsigned memory_page_bits = 8;
+constexpr size_t data_pages = data_memory_words >> memory_page_bits;
+constexpr size_t program_pages = program_memory_words >> memory_page_bits;
+// The dirty flags of the data pages, a byte each, start this many bytes before data memory, so
+// compiled code can mark them from its data pointer.
+constexpr std::ptrdiff_t dirty_flags_offset = -4096;
+
+// Reads and writes to a window of I/O registers; both get the context back. A null function
+// reads as zero or drops the write.
+struct MmioHandler {
+    std::uint16_t (*read)(void* context, std::uint16_t address) = nullptr;
+    void (*write)(void* context, std::uint16_t address, std::uint16_t value) = nullptr;
+    void* context = nullptr;
+};
+
+// Data and program memory as flat arrays aligned to host pages, covering the whole address spaces
+// so no access needs a bounds check. Data pages can be sent to I/O handlers instead, which a table
+// of one flag per page finds; plain memory only pays for the lookup. Pages written since
+// ClearDirty are flagged, for snapshots to copy back only those.
+class DspMemory {
+public:
+    DspMemory();
+
+    // Memory itself, whatever is mapped over it; the host's view, and compiled code's while no
+    // page is mapped.
+    std::uint16_t* Data() { return data.get(); }
+    const std::uint16_t* Data() const { return data.get(); }
+    std::uint16_t* Program() { return program.get(); }
+    const std::uint16_t* Program() const { return program.get(); }
+
+    // A data access as the DSP makes it.
+    std::uint16_t Load(std::uint16_t address) const {
+        if (mapped[address >> memory_page_bits])
+            return LoadMmio(address);
+        return data[address];
+    }
+    void Store(std::uint16_t address, std::uint16_t value) {
+        if (mapped[address >> memory_page_bits]) {
+            StoreMmio(address, value);
+            return;
+        }
+        Write(address, value);
+    }
+    // Writes memory under any mapped I/O.
+    void Write(std::uint16_t address, std::uint16_t value) {
+        data[address] = value;
+        DirtyFlags()[address >> memory_page_bits] = 1;
+    }
+    void WriteProgram(std::uint32_t address, const std::uint16_t* words, size_t count);
+
+    bool DataDirty(size_t page) const { return DirtyFlags()[page] != 0; }
+    bool ProgramDirty(size_t page) const { return program_dirty[page]; }
+    void ClearDirty();
+
+    // Sends the data pages from `first_page` on to the handler, or back to memory with Unmap.
+    void MapMmio(size_t first_page, size_t pages, const MmioHandler& handler);
+    void UnmapMmio(size_t first_page, size_t pages);
+    bool HasMmio() const { return mapped_count != 0; }
+
+private:
+    struct AlignedFree {
+        size_t prefix;
+        void operator()(std::uint16_t* words) const;
+    };
+    using Words = std::unique_ptr<std::uint16_t[], AlignedFree>;
+
+    // `prefix` bytes before the words, a whole number of host pages.
+    static Words Allocate(size_t words, size_t prefix);
+    std::uint8_t* DirtyFlags() { return reinterpret_cast<std::uint8_t*>(data.get()) + dirty_flags_offset; }
+    const std::uint8_t* DirtyFlags() const { return reinterpret_cast<const std::uint8_t*>(data.get()) + dirty_flags_offset; }
+    std::uint16_t LoadMmio(std::uint16_t address) const;
+    void StoreMmio(std::uint16_t address, std::uint16_t value);
+
+    Words data;
+    Words program;
+    std::array<bool, data_pages> mapped{};
+    std::array<MmioHandler, data_pages> handlers{};
+    size_t mapped_count = 0;
+    std::array<bool, program_pages> program_dirty{};
+};
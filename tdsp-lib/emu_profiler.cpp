@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <utility>
+
+#include "emu_profiler.h"
+
+DspProfiler::DspProfiler(DspEmulator& emulator, std::uint64_t period, std::vector<AsmSymbol> symbols)
+    : emulator(emulator), period(std::max<std::uint64_t>(1, period)), symbols(std::move(symbols)) {
+    std::stable_sort(this->symbols.begin(), this->symbols.end(),
+                     [](const AsmSymbol& a, const AsmSymbol& b) { return a.address < b.address; });
+    event = emulator.ScheduleEvent(emulator.Cycles() + this->period, &DspProfiler::Sample, this);
+    emulator.SetFlowCallback(&DspProfiler::Follow, this);
+}
+
+DspProfiler::~DspProfiler() {
+    emulator.CancelEvent(event);
+    emulator.SetFlowCallback(nullptr, nullptr);
+}
+
+void DspProfiler::Sample(void* context, std::uint64_t cycle) {
+    DspProfiler& profiler = *static_cast<DspProfiler*>(context);
+    profiler.Record(std::as_const(profiler.emulator).State().pc);
+    profiler.event = profiler.emulator.ScheduleEvent(cycle + profiler.period, &DspProfiler::Sample, context);
+}
+
+void DspProfiler::Follow(void* context, FlowEvent event, std::uint32_t at, std::uint32_t return_pc) {
+    std::vector<Frame>& frames = static_cast<DspProfiler*>(context)->frames;
+    if (event != FlowEvent::Return) {
+        frames.push_back({at, return_pc});
+        return;
+    }
+    for (size_t i = frames.size(); i-- > 0;) {
+        if (frames[i].return_pc == return_pc) {
+            frames.resize(i);
+            return;
+        }
+    }
+}
+
+void DspProfiler::Record(std::uint32_t pc) {
+    samples++;
+    const auto charge = [&](std::uint32_t address) {
+        Counts& entry = counts[address];
+        if (entry.sample != samples) {
+            entry.sample = samples;
+            entry.cycles += period;
+        }
+    };
+    stack.clear();
+    for (const Frame& frame : frames) {
+        stack.push_back(LabelAddress(frame.site));
+        charge(frame.site);
+    }
+    stack.push_back(LabelAddress(pc));
+    charge(pc);
+    counts[pc].hits++;
+    stacks[stack]++;
+}
+
+std::uint32_t DspProfiler::LabelAddress(std::uint32_t address) const {
+    const auto next = std::upper_bound(symbols.begin(), symbols.end(), address,
+                                       [](std::uint32_t a, const AsmSymbol& symbol) { return a < symbol.address; });
+    return next == symbols.begin() ? address : std::prev(next)->address;
+}
+
+std::string DspProfiler::Symbolize(std::uint32_t address) const {
+    const auto next = std::upper_bound(symbols.begin(), symbols.end(), address,
+                                       [](std::uint32_t a, const AsmSymbol& symbol) { return a < symbol.address; });
+    char text[16];
+    if (next == symbols.begin()) {
+        std::snprintf(text, sizeof(text), "0x%05x", address);
+        return text;
+    }
+    const AsmSymbol& symbol = *std::prev(next);
+    if (address == symbol.address)
+        return symbol.name;
+    std::snprintf(text, sizeof(text), "+0x%x", address - symbol.address);
+    return symbol.name + text;
+}
+
+std::string DspProfiler::FoldedStacks() const {
+    std::string out;
+    for (const auto& [addresses, count] : stacks) {
+        for (size_t i = 0; i < addresses.size(); i++) {
+            if (i) {
+                out += ';';
+            }
+            out += Symbolize(addresses[i]);
+        }
+        out += ' ' + std::to_string(count) + '\n';
+    }
+    return out;
+}
+
+std::vector<InstructionProfile> DspProfiler::Instructions() const {
+    std::vector<InstructionProfile> instructions;
+    for (const auto& [pc, entry] : counts) {
+        instructions.push_back({pc, Symbolize(pc), entry.hits, entry.cycles});
+    }
+    return instructions;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "assembler.h"
+#include "emu_core.h"
+
+struct InstructionProfile {
+    std::uint32_t pc = 0;
+    // As Symbolize names it.
+    std::string symbol;
+    // Samples taken with the pc at the instruction.
+    std::uint64_t hits = 0;
+    // Cycles the samples stand for: those at the instruction and, for a call, those spent in
+    // what it called.
+    std::uint64_t cycles = 0;
+};
+
+// Samples the pc of an emulator every `period` cycles, with an event, while it is attached. It
+// follows calls, interrupts and returns to know the call stack at each sample, and names code by
+// the nearest label at or before it, or by its address before the first label. A return pops
+// back to the innermost frame it returns to; one that returns to none leaves the stack as it
+// is. Reset and Restore drop the sampling event with the emulator's others, so attach after them.
+class DspProfiler {
+public:
+    DspProfiler(DspEmulator& emulator, std::uint64_t period, std::vector<AsmSymbol> symbols);
+    ~DspProfiler();
+    DspProfiler(const DspProfiler&) = delete;
+    DspProfiler& operator=(const DspProfiler&) = delete;
+
+    std::uint64_t Period() const { return period; }
+    std::uint64_t Samples() const { return samples; }
+    // "label", "label+offset", or the address itself before the first label.
+    std::string Symbolize(std::uint32_t address) const;
+
+    // A line per call stack sampled, outermost frame first, with the number of samples taken in
+    // it, as flamegraph.pl reads them: "main;filter;mac 12".
+    std::string FoldedStacks() const;
+    // Every instruction that was sampled or had a call in progress, in address order.
+    std::vector<InstructionProfile> Instructions() const;
+
+private:
+    struct Frame {
+        // The call, or the instruction an interrupt came before.
+        std::uint32_t site;
+        std::uint32_t return_pc;
+    };
+
+    struct Counts {
+        std::uint64_t hits = 0;
+        std::uint64_t cycles = 0;
+        // The sample cycles were last added for, so recursion only adds them once.
+        std::uint64_t sample = 0;
+    };
+
+    static void Sample(void* context, std::uint64_t cycle);
+    static void Follow(void* context, FlowEvent event, std::uint32_t at, std::uint32_t return_pc);
+    void Record(std::uint32_t pc);
+    // The address of the label `address` is under, or the address itself before the first label.
+    std::uint32_t LabelAddress(std::uint32_t address) const;
+
+    DspEmulator& emulator;
+    std::uint64_t period;
+    std::vector<AsmSymbol> symbols;
+    std::uint64_t event = 0;
+    std::vector<Frame> frames;
+    std::uint64_t samples = 0;
+    // By the label address of each frame, then of the pc.
+    std::map<std::vector<std::uint32_t>, std::uint64_t> stacks;
+    std::map<std::uint32_t, Counts> counts;
+    std::vector<std::uint32_t> stack;
+};
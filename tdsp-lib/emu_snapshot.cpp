@@ -0,0 +1,100 @@
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "emu_snapshot.h"
+#include "varint.h"
+#include "word_lz.h"
+
+static_assert(std::is_trivially_copyable_v<DspState> && std::is_standard_layout_v<DspState>);
+// A bool per byte, which DeserializeSnapshot checks.
+static_assert(sizeof(DspFlags) == 8 && sizeof(bool) == 1);
+
+constexpr char snapshot_magic[8] = {'T', 'D', 'S', 'P', 'S', 'N', 'P', '1'};
+
+std::uint64_t NewSnapshotId() {
+    static std::atomic<std::uint64_t> next_id{1};
+    return next_id++;
+}
+
+static void PutWords(const std::vector<std::uint16_t>& words, std::vector<unsigned char>& out) {
+    const std::vector<std::uint16_t> compressed = LzCompress(words.data(), words.size());
+    PutVarint(compressed.size() * 2, out);
+    for (const std::uint16_t word : compressed) {
+        out.push_back(static_cast<unsigned char>(word));
+        out.push_back(static_cast<unsigned char>(word >> 8));
+    }
+}
+
+static std::optional<std::vector<std::uint16_t>> GetWords(const unsigned char* in, size_t size, size_t& position,
+                                                          size_t max_words) {
+    const auto bytes = GetVarint(in, size, position);
+    if (!bytes || *bytes > size - position || *bytes % 2)
+        return std::nullopt;
+    std::vector<std::uint16_t> compressed(*bytes / 2);
+    for (size_t i = 0; i < compressed.size(); i++) {
+        compressed[i] = static_cast<std::uint16_t>(in[position + 2 * i] | in[position + 2 * i + 1] << 8);
+    }
+    position += *bytes;
+    auto words = LzDecompress(compressed.data(), compressed.size());
+    if (!words || words->size() > max_words)
+        return std::nullopt;
+    return words;
+}
+
+std::vector<unsigned char> SerializeSnapshot(const DspSnapshot& snapshot) {
+    std::vector<unsigned char> out{std::begin(snapshot_magic), std::end(snapshot_magic)};
+    PutVarint(sizeof(DspState), out);
+    const auto* state = reinterpret_cast<const unsigned char*>(&snapshot.state);
+    out.insert(out.end(), state, state + sizeof(DspState));
+    PutVarint(snapshot.cycles, out);
+    PutWords(*snapshot.data, out);
+    PutWords(*snapshot.program, out);
+    return out;
+}
+
+std::optional<DspSnapshot> DeserializeSnapshot(const unsigned char* bytes, size_t size) {
+    if (size < sizeof(snapshot_magic) || std::memcmp(bytes, snapshot_magic, sizeof(snapshot_magic)) != 0)
+        return std::nullopt;
+    size_t position = sizeof(snapshot_magic);
+    const auto state_size = GetVarint(bytes, size, position);
+    if (!state_size || *state_size != sizeof(DspState) || *state_size > size - position)
+        return std::nullopt;
+
+    // A bool holding anything but 0 or 1 is undefined, so they are checked before the copy.
+    const unsigned char* const state = bytes + position;
+    for (size_t i = 0; i < sizeof(DspFlags); i++) {
+        if (state[offsetof(DspState, flags) + i] > 1)
+            return std::nullopt;
+    }
+    for (const size_t offset : {offsetof(DspState, sat), offsetof(DspState, ie), offsetof(DspState, repeating)}) {
+        if (state[offset] > 1)
+            return std::nullopt;
+    }
+
+    DspSnapshot snapshot;
+    std::memcpy(&snapshot.state, state, sizeof(DspState));
+    position += sizeof(DspState);
+    // The emulator indexes by these: loops by the depth, interrupt vectors by the lines in ip and im.
+    if (snapshot.state.loop_depth > snapshot.state.loops.size() || snapshot.state.flag_source > FlagSource::Sub ||
+        snapshot.state.ip > 7 || snapshot.state.im > 7)
+        return std::nullopt;
+    const auto cycles = GetVarint(bytes, size, position);
+    if (!cycles)
+        return std::nullopt;
+    auto data = GetWords(bytes, size, position, data_memory_words);
+    if (!data || data->size() != data_memory_words)
+        return std::nullopt;
+    auto program = GetWords(bytes, size, position, program_memory_words);
+    if (!program || position != size)
+        return std::nullopt;
+
+    snapshot.cycles = *cycles;
+    snapshot.data = std::make_shared<const std::vector<std::uint16_t>>(std::move(*data));
+    snapshot.program = std::make_shared<const std::vector<std::uint16_t>>(std::move(*program));
+    snapshot.id = NewSnapshotId();
+    return snapshot;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "emu_core.h"
+
+// Everything a run depends on at one point, as DspEmulator::Snapshot takes it: registers and
+// shadows, repeat and loop stacks, the cycle count and both memories. Events and I/O mappings
+// belong to the host and are left out. Memory is shared between copies, so a snapshot is cheap to
+// hand to many emulators.
+struct DspSnapshot {
+    DspState state;
+    std::uint64_t cycles = 0;
+    std::shared_ptr<const std::vector<std::uint16_t>> data;
+    // Up to the end of the loaded program.
+    std::shared_ptr<const std::vector<std::uint16_t>> program;
+    // Tells Restore whether an emulator's memory still only differs from this snapshot where it
+    // has been written since.
+    std::uint64_t id = 0;
+};
+
+// A fresh id, never 0.
+std::uint64_t NewSnapshotId();
+
+// "TDSPSNP1", then as LEB128 varints each followed by that many bytes: the DspState as this build
+// lays it out, then the data and program memories as little-endian LzCompress streams; the cycle
+// count, a varint, comes between state and memory.
+std::vector<unsigned char> SerializeSnapshot(const DspSnapshot& snapshot);
+// Returns std::nullopt if the bytes are malformed or from a build with another DspState.
+std::optional<DspSnapshot> DeserializeSnapshot(const unsigned char* bytes, size_t size);
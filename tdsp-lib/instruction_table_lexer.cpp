@@ -1,3 +1,5 @@
+#include <utility>
+
 #include "instruction_table_lexer.h"
 
 InstructionTableLexer::InstructionTableLexer(std::istream& stream) : s(stream) {}
@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "pacing.h"
+
+constexpr double decrease_factor = 0.7;
+constexpr TransferClock::duration min_control_rtt = std::chrono::milliseconds{10};
+
+TokenBucket::TokenBucket(double rate, double burst) : rate(rate), burst(std::max(1.0, burst)), tokens(this->burst) {}
+
+void TokenBucket::Refill(TransferClock::time_point now) {
+    if (last_refill && now > *last_refill) {
+        tokens = std::min(burst, tokens + std::chrono::duration<double>(now - *last_refill).count() * rate);
+    }
+    if (!last_refill || now > *last_refill) {
+        last_refill = now;
+    }
+}
+
+bool TokenBucket::Ready(TransferClock::time_point now) {
+    Refill(now);
+    return tokens >= 1.0;
+}
+
+void TokenBucket::Consume(TransferClock::time_point now) {
+    Refill(now);
+    tokens -= 1.0;
+}
+
+TransferClock::time_point TokenBucket::ReadyAt(TransferClock::time_point now) {
+    Refill(now);
+    if (tokens >= 1.0)
+        return now;
+    return now + std::chrono::duration_cast<TransferClock::duration>(std::chrono::duration<double>((1.0 - tokens) / rate));
+}
+
+RateController::RateController(double initial_rate, double min_rate, double max_rate)
+    : rate(std::clamp(initial_rate, min_rate, max_rate)), min_rate(min_rate), max_rate(max_rate), peak_rate(rate) {}
+
+void RateController::OnAcked(size_t acked, TransferClock::duration rtt, bool rate_limited) {
+    if (!rate_limited || acked == 0)
+        return;
+
+    const double rtt_seconds = std::chrono::duration<double>(std::max(rtt, min_control_rtt)).count();
+
+    // About rate * rtt datagrams are acked per round trip.
+    if (slow_start) {
+        rate += acked / rtt_seconds;
+    } else {
+        rate += acked / (rate * rtt_seconds * rtt_seconds);
+    }
+    rate = std::min(rate, max_rate);
+    peak_rate = std::max(peak_rate, rate);
+}
+
+void RateController::OnLoss(TransferClock::time_point now, TransferClock::duration rtt) {
+    if (last_decrease && now - *last_decrease < std::max(rtt, min_control_rtt))
+        return;
+
+    slow_start = false;
+    last_decrease = now;
+    decreases++;
+    rate = std::max(min_rate, rate * decrease_factor);
+}
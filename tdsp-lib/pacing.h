@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+#include "transfer.h"
+
+// Send pacing. A TokenBucket spaces datagrams out to a target rate; a RateController moves
+// that rate to what the receiver sustains, from acks and losses. Rates are in datagrams per
+// second, since device-side overruns depend on packet count much more than on size.
+
+constexpr double min_adaptive_rate = 50.0;
+constexpr double max_adaptive_rate = 1e6;
+constexpr double default_adaptive_start_rate = 1000.0;
+
+class TokenBucket {
+public:
+    // Refills at `rate` tokens per second up to `burst` tokens; starts full.
+    TokenBucket(double rate, double burst);
+
+    void SetRate(double new_rate) { rate = new_rate; }
+    double Rate() const { return rate; }
+
+    // Whether a datagram may be sent now.
+    bool Ready(TransferClock::time_point now);
+    // Takes a token for a datagram. The bucket may go into debt, which delays Ready().
+    void Consume(TransferClock::time_point now);
+    // The earliest time Ready() will be true.
+    TransferClock::time_point ReadyAt(TransferClock::time_point now);
+
+private:
+    void Refill(TransferClock::time_point now);
+
+    double rate;
+    double burst;
+    double tokens;
+    std::optional<TransferClock::time_point> last_refill;
+};
+
+// Additive-increase/multiplicative-decrease of a send rate. Until the first loss the rate
+// doubles every round trip; after that each round trip adds about one datagram to what is sent
+// per round trip, and each loss episode cuts the rate by 30%. Round trips under 10 ms count as
+// 10 ms, or on a local link the rate would swing by orders of magnitude between losses.
+class RateController {
+public:
+    RateController(double initial_rate, double min_rate = min_adaptive_rate, double max_rate = max_adaptive_rate);
+
+    // `acked` datagrams were newly acknowledged. The rate only grows if the pacer, rather than
+    // the window or the application, was what limited sending.
+    void OnAcked(size_t acked, TransferClock::duration rtt, bool rate_limited);
+    // A datagram was found lost. Losses within one round trip of a decrease belong to the same
+    // episode and are ignored.
+    void OnLoss(TransferClock::time_point now, TransferClock::duration rtt);
+
+    double Rate() const { return rate; }
+    double PeakRate() const { return peak_rate; }
+    size_t DecreaseCount() const { return decreases; }
+
+private:
+    double rate;
+    double min_rate;
+    double max_rate;
+    double peak_rate;
+    bool slow_start = true;
+    std::optional<TransferClock::time_point> last_decrease;
+    size_t decreases = 0;
+};
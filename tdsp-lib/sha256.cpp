@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <climits>
 #include <cstddef>
@@ -5,8 +6,36 @@
 #include <cstring>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "sha256.h"
 
+static const std::array<std::uint32_t, 64> k {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const std::array<std::uint32_t, 8> initial_hash {
+    0x6a09e667,
+    0xbb67ae85,
+    0x3c6ef372,
+    0xa54ff53a,
+    0x510e527f,
+    0x9b05688c,
+    0x1f83d9ab,
+    0x5be0cd19,
+};
+
+constexpr size_t chunk_size = 64;
+
 static std::uint32_t RotateRight(std::uint32_t x, size_t amount) {
     amount %= 32;
     if (amount == 0)
@@ -18,8 +47,9 @@ static size_t AlignUp(size_t value, size_t alignment) {
     return value + (alignment - value % alignment) % alignment;
 }
 
-static uint32_t GetBigEndianValue(const unsigned char* data) {
-    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+static std::uint32_t GetBigEndianValue(const unsigned char* data) {
+    return (static_cast<std::uint32_t>(data[0]) << 24) | (static_cast<std::uint32_t>(data[1]) << 16) |
+           (static_cast<std::uint32_t>(data[2]) << 8) | static_cast<std::uint32_t>(data[3]);
 }
 
 static void ToBigEndianBytes(uint32_t value, unsigned char* data) {
@@ -29,101 +59,270 @@ static void ToBigEndianBytes(uint32_t value, unsigned char* data) {
     data[3] = value >> 0;
 }
 
+static size_t GetChunkCount(size_t data_size) {
+    return AlignUp(data_size + 1 + 8, chunk_size) / chunk_size;
+}
+
+// Produces the message words of chunk `chunk_index` of the padded message.
+static void LoadChunk(const unsigned char* data, size_t data_size, size_t chunk_index, std::uint32_t* w) {
+    std::array<unsigned char, chunk_size> chunk{};
+
+    const size_t offset = chunk_index * chunk_size;
+    if (offset < data_size) {
+        std::memcpy(chunk.data(), data + offset, std::min(chunk_size, data_size - offset));
+    }
+    if (offset <= data_size && data_size < offset + chunk_size) {
+        chunk[data_size - offset] = 0x80;
+    }
+    if (chunk_index == GetChunkCount(data_size) - 1) {
+        const std::uint64_t bit_size = static_cast<std::uint64_t>(data_size) * 8;
+        ToBigEndianBytes(static_cast<std::uint32_t>(bit_size >> 32), chunk.data() + chunk_size - 8);
+        ToBigEndianBytes(static_cast<std::uint32_t>(bit_size), chunk.data() + chunk_size - 4);
+    }
+
+    for (size_t i = 0; i < chunk_size / 4; i++) {
+        w[i] = GetBigEndianValue(chunk.data() + i * 4);
+    }
+}
+
+static std::array<unsigned char, 32> ToDigest(const std::array<std::uint32_t, 8>& hash) {
+    std::array<unsigned char, 32> result;
+    for (size_t i = 0; i < 8; i++) {
+        ToBigEndianBytes(hash[i], result.data() + i * 4);
+    }
+    return result;
+}
+
+static void Compress(std::array<std::uint32_t, 8>& hash, std::array<std::uint32_t, 64>& w) {
+    for (size_t i = 16; i < 64; i++) {
+        const uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    std::uint32_t a = hash[0];
+    std::uint32_t b = hash[1];
+    std::uint32_t c = hash[2];
+    std::uint32_t d = hash[3];
+    std::uint32_t e = hash[4];
+    std::uint32_t f = hash[5];
+    std::uint32_t g = hash[6];
+    std::uint32_t h = hash[7];
+
+    for (size_t i = 0; i < 64; i++) {
+        const std::uint32_t S1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+        const std::uint32_t ch = (e & f) ^ ((~e) & g);
+        const std::uint32_t temp1 = h + S1 + ch + k[i] + w[i];
+        const std::uint32_t S0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+        const std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        const std::uint32_t temp2 = S0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    hash[0] += a;
+    hash[1] += b;
+    hash[2] += c;
+    hash[3] += d;
+    hash[4] += e;
+    hash[5] += f;
+    hash[6] += g;
+    hash[7] += h;
+}
+
 std::array<unsigned char, 32> Sha256(const unsigned char* data, const size_t original_data_size) {
-    static const std::array<std::uint32_t, 64> k {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
-    };
+    std::array<std::uint32_t, 8> hash = initial_hash;
 
-    std::array<std::uint32_t, 8> hash {
-        0x6a09e667,
-        0xbb67ae85,
-        0x3c6ef372,
-        0xa54ff53a,
-        0x510e527f,
-        0x9b05688c,
-        0x1f83d9ab,
-        0x5be0cd19,
-    };
+    const size_t chunk_count = GetChunkCount(original_data_size);
+    for (size_t chunk_index = 0; chunk_index < chunk_count; chunk_index++) {
+        std::array<std::uint32_t, 64> w;
+        LoadChunk(data, original_data_size, chunk_index, w.data());
+        Compress(hash, w);
+    }
 
-    constexpr size_t chunk_size = 64;
+    return ToDigest(hash);
+}
 
-    size_t remaining_data_size = original_data_size;
-    size_t remaining_message_size = AlignUp(original_data_size + 1 + 8, chunk_size);
+#if defined(__SSE2__)
 
-    for (; remaining_message_size != 0; remaining_data_size -= chunk_size, remaining_message_size -= chunk_size, data += chunk_size) {
-        std::array<std::uint32_t, 64> w{};
+struct Sse2Lanes {
+    using Vec = __m128i;
+    static constexpr size_t count = 4;
 
-        const size_t to_copy = std::min(chunk_size, remaining_data_size);
-        std::memcpy(w.data(), data, to_copy);
-        reinterpret_cast<unsigned char*>(w.data())[to_copy] = 0x80;
-        for (std::uint32_t& x : w) {
-            std::array<unsigned char, 4> y;
-            std::memcpy(y.data(), &x, sizeof(std::uint32_t));
-            x = (static_cast<std::uint32_t>(y[0]) << 24) | (static_cast<std::uint32_t>(y[1]) << 16) | (static_cast<std::uint32_t>(y[2]) << 8) | static_cast<std::uint32_t>(y[3]);
-        }
-        if (remaining_message_size == chunk_size) {
-            w[chunk_size / 4 - 1] = original_data_size * 8;
-            w[chunk_size / 4 - 2] = (original_data_size * 8) >> 32;
-        }
+    static Vec Load(const std::uint32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void Store(std::uint32_t* p, Vec x) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x); }
+    static Vec Set1(std::uint32_t x) { return _mm_set1_epi32(static_cast<int>(x)); }
+    static Vec Add(Vec x, Vec y) { return _mm_add_epi32(x, y); }
+    static Vec Xor(Vec x, Vec y) { return _mm_xor_si128(x, y); }
+    static Vec And(Vec x, Vec y) { return _mm_and_si128(x, y); }
+    static Vec AndNot(Vec x, Vec y) { return _mm_andnot_si128(x, y); }
+    template <int amount>
+    static Vec ShiftRight(Vec x) { return _mm_srli_epi32(x, amount); }
+    template <int amount>
+    static Vec RotateRight(Vec x) { return _mm_or_si128(_mm_srli_epi32(x, amount), _mm_slli_epi32(x, 32 - amount)); }
+};
+
+#if defined(__AVX2__)
+struct Avx2Lanes {
+    using Vec = __m256i;
+    static constexpr size_t count = 8;
+
+    static Vec Load(const std::uint32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void Store(std::uint32_t* p, Vec x) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x); }
+    static Vec Set1(std::uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+    static Vec Add(Vec x, Vec y) { return _mm256_add_epi32(x, y); }
+    static Vec Xor(Vec x, Vec y) { return _mm256_xor_si256(x, y); }
+    static Vec And(Vec x, Vec y) { return _mm256_and_si256(x, y); }
+    static Vec AndNot(Vec x, Vec y) { return _mm256_andnot_si256(x, y); }
+    template <int amount>
+    static Vec ShiftRight(Vec x) { return _mm256_srli_epi32(x, amount); }
+    template <int amount>
+    static Vec RotateRight(Vec x) { return _mm256_or_si256(_mm256_srli_epi32(x, amount), _mm256_slli_epi32(x, 32 - amount)); }
+};
+using HostLanes = Avx2Lanes;
+#else
+using HostLanes = Sse2Lanes;
+#endif
+
+// Runs one compression on every lane. `w` and `hash` are stored lane-interleaved,
+// i.e. w[i * L::count + lane].
+template <typename L>
+static void CompressLanes(std::uint32_t* hash, const std::uint32_t* message) {
+    using Vec = typename L::Vec;
+
+    Vec w[64];
+    for (size_t i = 0; i < 16; i++) {
+        w[i] = L::Load(message + i * L::count);
+    }
+    for (size_t i = 16; i < 64; i++) {
+        const Vec s0 = L::Xor(L::Xor(L::template RotateRight<7>(w[i - 15]), L::template RotateRight<18>(w[i - 15])),
+                              L::template ShiftRight<3>(w[i - 15]));
+        const Vec s1 = L::Xor(L::Xor(L::template RotateRight<17>(w[i - 2]), L::template RotateRight<19>(w[i - 2])),
+                              L::template ShiftRight<10>(w[i - 2]));
+        w[i] = L::Add(L::Add(w[i - 16], s0), L::Add(w[i - 7], s1));
+    }
+
+    Vec a = L::Load(hash + 0 * L::count);
+    Vec b = L::Load(hash + 1 * L::count);
+    Vec c = L::Load(hash + 2 * L::count);
+    Vec d = L::Load(hash + 3 * L::count);
+    Vec e = L::Load(hash + 4 * L::count);
+    Vec f = L::Load(hash + 5 * L::count);
+    Vec g = L::Load(hash + 6 * L::count);
+    Vec h = L::Load(hash + 7 * L::count);
+
+    for (size_t i = 0; i < 64; i++) {
+        const Vec S1 = L::Xor(L::Xor(L::template RotateRight<6>(e), L::template RotateRight<11>(e)), L::template RotateRight<25>(e));
+        const Vec ch = L::Xor(L::And(e, f), L::AndNot(e, g));
+        const Vec temp1 = L::Add(L::Add(h, S1), L::Add(L::Add(ch, L::Set1(k[i])), w[i]));
+        const Vec S0 = L::Xor(L::Xor(L::template RotateRight<2>(a), L::template RotateRight<13>(a)), L::template RotateRight<22>(a));
+        const Vec maj = L::Xor(L::Xor(L::And(a, b), L::And(a, c)), L::And(b, c));
+        const Vec temp2 = L::Add(S0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = L::Add(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = L::Add(temp1, temp2);
+    }
+
+    L::Store(hash + 0 * L::count, L::Add(L::Load(hash + 0 * L::count), a));
+    L::Store(hash + 1 * L::count, L::Add(L::Load(hash + 1 * L::count), b));
+    L::Store(hash + 2 * L::count, L::Add(L::Load(hash + 2 * L::count), c));
+    L::Store(hash + 3 * L::count, L::Add(L::Load(hash + 3 * L::count), d));
+    L::Store(hash + 4 * L::count, L::Add(L::Load(hash + 4 * L::count), e));
+    L::Store(hash + 5 * L::count, L::Add(L::Load(hash + 5 * L::count), f));
+    L::Store(hash + 6 * L::count, L::Add(L::Load(hash + 6 * L::count), g));
+    L::Store(hash + 7 * L::count, L::Add(L::Load(hash + 7 * L::count), h));
+}
 
-        for (size_t i = 16; i < 64; i++) {
-            const uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
-            const uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
-            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+std::vector<std::array<unsigned char, 32>> Sha256Many(const std::vector<Sha256Input>& inputs) {
+    using L = HostLanes;
+
+    struct Lane {
+        bool active = false;
+        size_t input_index;
+        size_t chunk_index;
+        size_t chunk_count;
+    };
+
+    std::vector<std::array<unsigned char, 32>> results(inputs.size());
+
+    std::array<Lane, L::count> lanes;
+    std::array<std::uint32_t, 8 * L::count> hash{};
+    std::array<std::uint32_t, 16 * L::count> message{};
+    size_t next_input = 0;
+
+    while (true) {
+        // Refill idle lanes with the next pending message.
+        size_t active_count = 0;
+        for (size_t lane = 0; lane < L::count; lane++) {
+            if (!lanes[lane].active && next_input < inputs.size()) {
+                lanes[lane] = {true, next_input, 0, GetChunkCount(inputs[next_input].size)};
+                for (size_t i = 0; i < 8; i++) {
+                    hash[i * L::count + lane] = initial_hash[i];
+                }
+                next_input++;
+            }
+            if (lanes[lane].active) {
+                active_count++;
+            }
         }
 
-        std::uint32_t a = hash[0];
-        std::uint32_t b = hash[1];
-        std::uint32_t c = hash[2];
-        std::uint32_t d = hash[3];
-        std::uint32_t e = hash[4];
-        std::uint32_t f = hash[5];
-        std::uint32_t g = hash[6];
-        std::uint32_t h = hash[7];
-
-        for (size_t i = 0; i < 64; i++) {
-            const std::uint32_t S1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
-            const std::uint32_t ch = (e & f) ^ ((~e) & g);
-            const std::uint32_t temp1 = h + S1 + ch + k[i] + w[i];
-            const std::uint32_t S0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
-            const std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-            const std::uint32_t temp2 = S0 + maj;
-     
-            h = g;
-            g = f;
-            f = e;
-            e = d + temp1;
-            d = c;
-            c = b;
-            b = a;
-            a = temp1 + temp2;
+        if (active_count == 0)
+            break;
+
+        // Transpose the current chunk of each lane into the interleaved layout.
+        for (size_t lane = 0; lane < L::count; lane++) {
+            std::array<std::uint32_t, 16> w{};
+            if (lanes[lane].active) {
+                const Sha256Input& input = inputs[lanes[lane].input_index];
+                LoadChunk(input.data, input.size, lanes[lane].chunk_index, w.data());
+            }
+            for (size_t i = 0; i < 16; i++) {
+                message[i * L::count + lane] = w[i];
+            }
         }
 
-        hash[0] += a;
-        hash[1] += b;
-        hash[2] += c;
-        hash[3] += d;
-        hash[4] += e;
-        hash[5] += f;
-        hash[6] += g;
-        hash[7] += h;
+        CompressLanes<L>(hash.data(), message.data());
+
+        for (size_t lane = 0; lane < L::count; lane++) {
+            Lane& l = lanes[lane];
+            if (!l.active)
+                continue;
+            if (++l.chunk_index == l.chunk_count) {
+                std::array<std::uint32_t, 8> lane_hash;
+                for (size_t i = 0; i < 8; i++) {
+                    lane_hash[i] = hash[i * L::count + lane];
+                }
+                results[l.input_index] = ToDigest(lane_hash);
+                l.active = false;
+            }
+        }
     }
 
-    std::array<unsigned char, 32> result;
-    ToBigEndianBytes(hash[0], result.data() + 0 * 4);
-    ToBigEndianBytes(hash[1], result.data() + 1 * 4);
-    ToBigEndianBytes(hash[2], result.data() + 2 * 4);
-    ToBigEndianBytes(hash[3], result.data() + 3 * 4);
-    ToBigEndianBytes(hash[4], result.data() + 4 * 4);
-    ToBigEndianBytes(hash[5], result.data() + 5 * 4);
-    ToBigEndianBytes(hash[6], result.data() + 6 * 4);
-    ToBigEndianBytes(hash[7], result.data() + 7 * 4);
-    return result;
+    return results;
 }
+
+#else
+
+std::vector<std::array<unsigned char, 32>> Sha256Many(const std::vector<Sha256Input>& inputs) {
+    std::vector<std::array<unsigned char, 32>> results;
+    results.reserve(inputs.size());
+    for (const Sha256Input& input : inputs) {
+        results.emplace_back(Sha256(input.data, input.size));
+    }
+    return results;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "sha256.h"
+#include "sha256_tree.h"
+
+// Below this many leaves per thread it is cheaper to stay on the calling thread.
+constexpr size_t min_leaves_per_thread = 64;
+// Leaves handed to Sha256Many at once; bounds the scratch memory per thread.
+constexpr size_t leaf_batch_size = 64;
+
+static Sha256Tree::Hash HashNode(const Sha256Tree::Hash& left, const Sha256Tree::Hash& right) {
+    std::array<unsigned char, 1 + 32 + 32> buffer;
+    buffer[0] = 0x01;
+    std::memcpy(buffer.data() + 1, left.data(), left.size());
+    std::memcpy(buffer.data() + 1 + 32, right.data(), right.size());
+    return Sha256(buffer.data(), buffer.size());
+}
+
+Sha256Tree::Sha256Tree(size_t leaf_size) : leaf_size(leaf_size) {
+    assert(leaf_size != 0);
+}
+
+size_t Sha256Tree::LeafCountFor(size_t size, size_t leaf_size) {
+    return std::max<size_t>(1, (size + leaf_size - 1) / leaf_size);
+}
+
+void Sha256Tree::Build(const unsigned char* data, size_t size) {
+    image_size = size;
+    levels.clear();
+    levels.emplace_back(LeafCountFor(size, leaf_size));
+    HashLeaves(data, size, 0, levels[0].size());
+    RebuildParents(0, levels[0].size());
+}
+
+void Sha256Tree::Update(const unsigned char* data, size_t size, size_t offset, size_t length) {
+    if (levels.empty()) {
+        Build(data, size);
+        return;
+    }
+
+    const size_t leaf_count = LeafCountFor(size, leaf_size);
+    size_t first = std::min(offset / leaf_size, leaf_count - 1);
+    size_t last = std::min((offset + std::max<size_t>(length, 1) - 1) / leaf_size + 1, leaf_count);
+
+    if (size != image_size) {
+        // The old last leaf may have been partial, so it has to be rehashed as well.
+        first = std::min(first, std::min(image_size, size) / leaf_size);
+        first = std::min(first, leaf_count - 1);
+        last = leaf_count;
+        image_size = size;
+        levels[0].resize(leaf_count);
+    }
+
+    HashLeaves(data, size, first, last);
+    RebuildParents(first, last);
+}
+
+Sha256Tree::Hash Sha256Tree::Root() const {
+    assert(!levels.empty());
+    return levels.back()[0];
+}
+
+void Sha256Tree::HashLeaves(const unsigned char* data, size_t size, size_t first, size_t last) {
+    const auto hash_range = [&](size_t begin, size_t end) {
+        std::vector<std::vector<unsigned char>> scratch;
+        for (size_t batch = begin; batch < end; batch += leaf_batch_size) {
+            const size_t batch_end = std::min(end, batch + leaf_batch_size);
+            scratch.resize(batch_end - batch);
+            for (size_t i = batch; i < batch_end; i++) {
+                const size_t offset = i * leaf_size;
+                const size_t length = offset < size ? std::min(leaf_size, size - offset) : 0;
+                std::vector<unsigned char>& leaf = scratch[i - batch];
+                leaf.resize(1 + length);
+                leaf[0] = 0x00;
+                std::memcpy(leaf.data() + 1, data + offset, length);
+            }
+            const auto hashes = Sha256Many(scratch);
+            std::copy(hashes.begin(), hashes.end(), levels[0].begin() + batch);
+        }
+    };
+
+    const size_t count = last - first;
+    const size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count / min_leaves_per_thread);
+    if (thread_count <= 1) {
+        hash_range(first, last);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    const size_t per_thread = (count + thread_count - 1) / thread_count;
+    for (size_t begin = first; begin < last; begin += per_thread) {
+        threads.emplace_back(hash_range, begin, std::min(last, begin + per_thread));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void Sha256Tree::RebuildParents(size_t first, size_t last) {
+    size_t level = 0;
+    for (; levels[level].size() > 1; level++) {
+        const size_t parent_count = (levels[level].size() + 1) / 2;
+        if (levels.size() == level + 1) {
+            levels.emplace_back();
+        }
+        levels[level + 1].resize(parent_count);
+
+        first /= 2;
+        last = (last + 1) / 2;
+        for (size_t i = first; i < last; i++) {
+            const std::vector<Hash>& children = levels[level];
+            if (2 * i + 1 < children.size()) {
+                levels[level + 1][i] = HashNode(children[2 * i], children[2 * i + 1]);
+            } else {
+                levels[level + 1][i] = children[2 * i];
+            }
+        }
+    }
+    // The tree may have become shallower.
+    levels.resize(level + 1);
+}
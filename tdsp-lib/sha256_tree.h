@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Merkle tree over fixed-size leaves of a byte image, built on Sha256.
+//
+// Leaves are hashed as Sha256(0x00 || leaf) and interior nodes as Sha256(0x01 || left || right),
+// so a leaf can never be confused with a node. A node without a sibling is promoted unchanged
+// to the next level. Leaves are hashed in parallel across cores; after an edit only the touched
+// leaves and their paths to the root are recomputed.
+class Sha256Tree {
+public:
+    using Hash = std::array<unsigned char, 32>;
+
+    explicit Sha256Tree(size_t leaf_size = 4096);
+
+    // Hashes the entire image, replacing any previous state.
+    void Build(const unsigned char* data, size_t size);
+
+    // `data`/`size` is the full image after the edit; [offset, offset + length) is the range
+    // that changed. If the image size changed, everything from `offset` onwards is rehashed.
+    void Update(const unsigned char* data, size_t size, size_t offset, size_t length);
+
+    Hash Root() const;
+
+    size_t LeafSize() const { return leaf_size; }
+    size_t LeafCount() const { return levels.empty() ? 0 : levels[0].size(); }
+    const std::vector<Hash>& LeafHashes() const { return levels[0]; }
+
+    // Number of leaves for an image of `size` bytes (an empty image has one empty leaf).
+    static size_t LeafCountFor(size_t size, size_t leaf_size);
+
+private:
+    void HashLeaves(const unsigned char* data, size_t size, size_t first, size_t last);
+    void RebuildParents(size_t first_leaf, size_t last_leaf);
+
+    size_t leaf_size;
+    size_t image_size = 0;
+    std::vector<std::vector<Hash>> levels;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity), mask(capacity - 1) {
+        assert(capacity != 0 && (capacity & (capacity - 1)) == 0 && "capacity must be a power of two");
+    }
+
+    // Producer only. Returns false if the queue is full.
+    bool TryPush(T&& value) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache == slots.size()) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache == slots.size())
+                return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns std::nullopt if the queue is empty.
+    std::optional<T> TryPop() {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache)
+                return std::nullopt;
+        }
+        std::optional<T> result{std::move(slots[h & mask])};
+        head.store(h + 1, std::memory_order_release);
+        return result;
+    }
+
+    // Consumer only.
+    bool Empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots;
+    const size_t mask;
+
+    // Each index lives on its own cache line together with the side that writes it, so the
+    // producer and consumer do not false-share.
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+};
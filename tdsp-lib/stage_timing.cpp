@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "stage_timing.h"
+
+size_t LatencyHistogram::BucketOf(std::uint64_t nanoseconds) {
+    if (nanoseconds < 32)
+        return static_cast<size_t>(nanoseconds);
+
+    size_t top_bit = 5;
+    while (top_bit < 63 && nanoseconds >> (top_bit + 1)) {
+        top_bit++;
+    }
+    // The top five bits select the bucket: the top one the power of two, the other four which
+    // sixteenth of it.
+    const size_t shift = top_bit - 4;
+    return 32 + (shift - 1) * 16 + static_cast<size_t>((nanoseconds >> shift) - 16);
+}
+
+std::uint64_t LatencyHistogram::BucketLimit(size_t bucket) {
+    if (bucket < 32)
+        return bucket;
+
+    const size_t shift = (bucket - 32) / 16 + 1;
+    const std::uint64_t mantissa = (bucket - 32) % 16 + 16;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds latency) {
+    const std::uint64_t value = latency.count() > 0 ? static_cast<std::uint64_t>(latency.count()) : 0;
+    counts[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+
+    std::uint64_t previous = max.load(std::memory_order_relaxed);
+    while (value > previous && !max.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+std::uint64_t LatencyHistogram::Count() const {
+    std::uint64_t count = 0;
+    for (const auto& bucket : counts) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+std::chrono::nanoseconds LatencyHistogram::Percentile(double fraction) const {
+    const std::uint64_t count = Count();
+    if (count == 0)
+        return std::chrono::nanoseconds{0};
+
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(fraction * count + 0.5));
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(std::chrono::nanoseconds{BucketLimit(i)}, Max());
+    }
+    return Max();
+}
+
+const char* SenderStageName(SenderStage stage) {
+    switch (stage) {
+    case SenderStage::Lex:
+        return "lex";
+    case SenderStage::Lookup:
+        return "lookup";
+    case SenderStage::Queue:
+        return "queue";
+    case SenderStage::Encode:
+        return "encode";
+    case SenderStage::Socket:
+        return "socket";
+    }
+    return "?";
+}
+
+static double Microseconds(std::chrono::nanoseconds duration) {
+    return duration.count() / 1000.0;
+}
+
+void StageTimings::Print() const {
+    std::printf("%-8s %10s %10s %10s %10s %10s %12s\n", "stage", "count", "p50 us", "p90 us", "p99 us", "max us", "total ms");
+    for (size_t i = 0; i < sender_stage_count; i++) {
+        const LatencyHistogram& histogram = stages[i];
+        const std::uint64_t count = histogram.Count();
+        if (count == 0)
+            continue;
+        std::printf("%-8s %10llu %10.2f %10.2f %10.2f %10.2f %12.3f\n",
+                    SenderStageName(static_cast<SenderStage>(i)), static_cast<unsigned long long>(count),
+                    Microseconds(histogram.Percentile(0.50)), Microseconds(histogram.Percentile(0.90)),
+                    Microseconds(histogram.Percentile(0.99)), Microseconds(histogram.Max()),
+                    histogram.Total().count() / 1e6);
+    }
+    std::fflush(stdout);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Latency histogram in the style of HdrHistogram: buckets are exact below 32 ns and then
+// 16 per power of two, so any recorded value is reported within about 6%, from nanoseconds to
+// centuries, in a fixed 8 KB. Recording is wait-free and may happen on one thread while
+// another reads.
+class LatencyHistogram {
+public:
+    static constexpr size_t bucket_count = 32 + 59 * 16;
+
+    void Record(std::chrono::nanoseconds latency);
+
+    std::uint64_t Count() const;
+    std::chrono::nanoseconds Max() const { return std::chrono::nanoseconds{max.load(std::memory_order_relaxed)}; }
+    std::chrono::nanoseconds Total() const { return std::chrono::nanoseconds{total.load(std::memory_order_relaxed)}; }
+    // The smallest value at least `fraction` of the recorded values are no greater than, up to
+    // bucket precision; zero if empty.
+    std::chrono::nanoseconds Percentile(double fraction) const;
+
+    static size_t BucketOf(std::uint64_t nanoseconds);
+    // The largest value that falls into the bucket.
+    static std::uint64_t BucketLimit(size_t bucket);
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+    std::atomic<std::uint64_t> max{0};
+    std::atomic<std::uint64_t> total{0};
+};
+
+// Where the sender's time goes, from reading a line of assembly to the datagram leaving the
+// socket. Socket time runs from submitting a send to its completion.
+enum class SenderStage {
+    Lex,
+    Lookup,
+    Queue,
+    Encode,
+    Socket,
+};
+
+constexpr size_t sender_stage_count = 5;
+
+const char* SenderStageName(SenderStage stage);
+
+class StageTimings {
+public:
+    void Record(SenderStage stage, std::chrono::steady_clock::duration latency) {
+        stages[static_cast<size_t>(stage)].Record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency));
+    }
+    const LatencyHistogram& Stage(SenderStage stage) const { return stages[static_cast<size_t>(stage)]; }
+
+    // One line per stage that recorded anything: count, p50, p90, p99, max and total.
+    void Print() const;
+
+private:
+    std::array<LatencyHistogram, sender_stage_count> stages;
+};
+
+// Records the time from construction to destruction into a stage; does nothing without timings.
+class StageTimer {
+public:
+    StageTimer(StageTimings* timings, SenderStage stage) : timings(timings), stage(stage) {
+        if (timings) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer() {
+        if (timings) {
+            timings->Record(stage, std::chrono::steady_clock::now() - start);
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    StageTimings* timings;
+    SenderStage stage;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#include "transfer.h"
+#include "word_lz.h"
+
+// A chunk is presumed lost once this many later chunks have been acknowledged.
+constexpr std::uint32_t reorder_threshold = 3;
+
+constexpr TransferClock::duration initial_rto = std::chrono::milliseconds{100};
+constexpr TransferClock::duration min_rto = std::chrono::milliseconds{2};
+constexpr TransferClock::duration max_rto = std::chrono::seconds{1};
+
+Sha256Tree MakeImageTree(const std::uint16_t* image, size_t word_count) {
+    Sha256Tree tree{max_chunk_payload_words * sizeof(std::uint16_t)};
+    tree.Build(reinterpret_cast<const unsigned char*>(image), word_count * sizeof(std::uint16_t));
+    return tree;
+}
+
+Sha256Tree::Hash ImageRoot(const std::uint16_t* image, size_t word_count) {
+    return MakeImageTree(image, word_count).Root();
+}
+
+WindowedSender::WindowedSender(const std::uint16_t* image, size_t word_count, size_t window_size,
+                               std::vector<bool> chunks_to_send)
+    : image(image), word_count(word_count), window_size(std::clamp<size_t>(window_size, 1, ack_bitmap_bits)),
+      chunks(ChunkCountFor(word_count)), rto(initial_rto) {
+    if (!chunks_to_send.empty()) {
+        assert(chunks_to_send.size() == chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++) {
+            chunks[i].acked = !chunks_to_send[i];
+        }
+        while (base < chunks.size() && chunks[base].acked) {
+            base++;
+        }
+        SkipUnsentChunks();
+    }
+}
+
+void WindowedSender::SkipUnsentChunks() {
+    while (next_new < chunks.size() && chunks[next_new].acked && chunks[next_new].transmissions == 0) {
+        next_new++;
+    }
+}
+
+std::optional<std::uint32_t> WindowedSender::NextToSend(TransferClock::time_point now) const {
+    for (std::uint32_t i = base; i < next_new; i++) {
+        if (!chunks[i].acked && chunks[i].lost)
+            return i;
+    }
+    for (std::uint32_t i = base; i < next_new; i++) {
+        if (!chunks[i].acked && chunks[i].sent_at + rto <= now)
+            return i;
+    }
+    if (next_new < chunks.size() && next_new < base + window_size)
+        return next_new;
+    return std::nullopt;
+}
+
+ChunkHeader ImageChunkHeader(size_t word_count, std::uint32_t sequence, std::uint16_t extra_flags) {
+    ChunkHeader header;
+    header.flags = chunk_flag_ack_requested | extra_flags;
+    header.sequence = sequence;
+    header.offset = static_cast<std::uint32_t>(sequence * max_chunk_payload_words);
+    header.total_words = static_cast<std::uint32_t>(word_count);
+    return header;
+}
+
+size_t ImageChunkWords(size_t word_count, std::uint32_t sequence) {
+    return std::min(max_chunk_payload_words, word_count - sequence * max_chunk_payload_words);
+}
+
+void WindowedSender::EncodeForSend(std::uint32_t sequence, TransferClock::time_point now, std::vector<std::uint16_t>& out) {
+    MarkSent(sequence, now);
+
+    const ChunkHeader header = ImageChunkHeader(word_count, sequence, chunk_flags);
+    EncodeChunk(header, image + header.offset, ImageChunkWords(word_count, sequence), out);
+}
+
+void WindowedSender::MarkSent(std::uint32_t sequence, TransferClock::time_point now) {
+    assert(sequence < chunks.size());
+    Chunk& chunk = chunks[sequence];
+
+    if (chunk.transmissions != 0) {
+        stats.retransmissions++;
+        if (chunk.lost) {
+            stats.fast_retransmissions++;
+        } else {
+            stats.timeouts++;
+            // Back off once per loss episode, as TCP does with its single retransmit timer.
+            if (sequence == base) {
+                rto = std::min(max_rto, rto * 2);
+            }
+        }
+    }
+
+    chunk.lost = false;
+    chunk.transmissions++;
+    chunk.sent_at = now;
+    if (sequence == next_new) {
+        next_new++;
+        SkipUnsentChunks();
+    }
+    stats.chunks_sent++;
+}
+
+void WindowedSender::OnAck(const AckInfo& ack, TransferClock::time_point now) {
+    stats.acks_received++;
+
+    TransferClock::time_point newest_acked_send{};
+    const std::uint32_t cumulative = std::min<std::uint32_t>(ack.cumulative, next_new);
+    for (std::uint32_t i = base; i < cumulative; i++) {
+        MarkAcked(i, now, newest_acked_send);
+    }
+    for (std::uint32_t i = std::max(base, cumulative + 1); i < next_new && i <= cumulative + ack_bitmap_bits; i++) {
+        if (ack.Selected(i)) {
+            MarkAcked(i, now, newest_acked_send);
+        }
+    }
+
+    while (base < chunks.size() && chunks[base].acked) {
+        base++;
+    }
+
+    // Anything sent before a chunk that has since been acknowledged, and far enough behind it,
+    // was most likely dropped. Retransmit it without waiting for the timer.
+    for (std::uint32_t i = base; i + reorder_threshold <= highest_acked && i < next_new; i++) {
+        Chunk& chunk = chunks[i];
+        if (!chunk.acked && !chunk.lost && chunk.sent_at < newest_acked_send) {
+            chunk.lost = true;
+        }
+    }
+}
+
+void WindowedSender::MarkAcked(std::uint32_t sequence, TransferClock::time_point now,
+                               TransferClock::time_point& newest_acked_send) {
+    Chunk& chunk = chunks[sequence];
+    if (chunk.acked || chunk.transmissions == 0)
+        return;
+
+    chunk.acked = true;
+    acked_count++;
+    highest_acked = std::max(highest_acked, sequence);
+    newest_acked_send = std::max(newest_acked_send, chunk.sent_at);
+
+    // Karn's algorithm: a retransmitted chunk's ack is ambiguous, so it is not an RTT sample.
+    if (chunk.transmissions == 1) {
+        SampleRtt(now - chunk.sent_at);
+    }
+}
+
+void WindowedSender::SampleRtt(TransferClock::duration rtt) {
+    // RFC 6298
+    if (!srtt) {
+        srtt = rtt;
+        rttvar = rtt / 2;
+    } else {
+        const TransferClock::duration error = *srtt > rtt ? *srtt - rtt : rtt - *srtt;
+        rttvar = (rttvar * 3 + error) / 4;
+        srtt = (*srtt * 7 + rtt) / 8;
+    }
+    rto = std::clamp(*srtt + 4 * rttvar, min_rto, max_rto);
+}
+
+std::optional<TransferClock::time_point> WindowedSender::NextTimeout() const {
+    std::optional<TransferClock::time_point> result;
+    for (std::uint32_t i = base; i < next_new; i++) {
+        if (!chunks[i].acked && (!result || chunks[i].sent_at + rto < *result)) {
+            result = chunks[i].sent_at + rto;
+        }
+    }
+    return result;
+}
+
+bool WindowedReceiver::Begin(const Manifest& new_manifest) {
+    if (manifest && manifest->flags == new_manifest.flags && manifest->total_words == new_manifest.total_words &&
+        manifest->root == new_manifest.root && manifest->base_root == new_manifest.base_root)
+        return true;
+    if (new_manifest.total_words > max_image_words)
+        return false;
+
+    if (!(new_manifest.flags & manifest_flag_delta)) {
+        Reset(new_manifest.total_words);
+        manifest = new_manifest;
+        return true;
+    }
+
+    if (!Complete() || ImageRoot(Image().data(), Image().size()) != new_manifest.base_root)
+        return false;
+
+    std::vector<std::uint16_t> previous = std::move(compressed ? decompressed : image);
+    Reset(new_manifest.total_words);
+    manifest = new_manifest;
+
+    // Unchanged chunks are kept from the previous image; the rest will be overwritten.
+    previous.resize(new_manifest.total_words, 0);
+    image = std::move(previous);
+    for (size_t i = 0; i < received.size(); i++) {
+        if (!new_manifest.changed[i]) {
+            received[i] = true;
+            received_count++;
+        }
+    }
+    UpdateCumulative();
+    CheckComplete();
+    return true;
+}
+
+bool WindowedReceiver::OnChunk(const ChunkHeader& header, const std::uint16_t* payload, size_t payload_words) {
+    // Before anything is reset, so a stray or forged chunk neither allocates for its total nor
+    // drops the upload in progress.
+    if (header.total_words > max_image_words || header.sequence >= ChunkCountFor(header.total_words) ||
+        header.offset != header.sequence * max_chunk_payload_words)
+        return false;
+    if (payload_words != ImageChunkWords(header.total_words, header.sequence))
+        return false;
+
+    const bool new_stream = Complete() && !(header.flags & chunk_flag_ack_requested) && header.sequence == 0;
+    const bool chunk_compressed = header.flags & chunk_flag_compressed;
+    if (manifest && received_count == 0 && header.total_words == image.size()) {
+        // The manifest sized the upload; its first chunk says whether it is compressed.
+        compressed = chunk_compressed;
+    } else if (!Started() || header.total_words != image.size() || chunk_compressed != compressed || new_stream) {
+        Reset(header.total_words);
+        compressed = chunk_compressed;
+    }
+
+    if (received[header.sequence]) {
+        duplicates++;
+        return true;
+    }
+
+    std::copy(payload, payload + payload_words, image.begin() + header.offset);
+    received[header.sequence] = true;
+    received_count++;
+    UpdateCumulative();
+    CheckComplete();
+    return true;
+}
+
+void WindowedReceiver::Reset(size_t total_words) {
+    image.assign(total_words, 0);
+    received.assign(ChunkCountFor(total_words), false);
+    cumulative = 0;
+    received_count = 0;
+    duplicates = 0;
+    compressed = false;
+    decompressed.clear();
+    decompression_failed = false;
+    manifest.reset();
+    verified.reset();
+}
+
+void WindowedReceiver::CheckComplete() {
+    if (!Complete())
+        return;
+    if (compressed && decompressed.empty() && !decompression_failed) {
+        auto words = LzDecompress(image.data(), image.size());
+        decompression_failed = !words;
+        if (words) {
+            decompressed = std::move(*words);
+        }
+    }
+    if (manifest && !verified) {
+        verified = ImageRoot(image.data(), image.size()) == manifest->root;
+    }
+}
+
+void WindowedReceiver::UpdateCumulative() {
+    while (cumulative < received.size() && received[cumulative]) {
+        cumulative++;
+    }
+}
+
+AckInfo WindowedReceiver::Ack() const {
+    AckInfo ack;
+    ack.cumulative = cumulative;
+    for (size_t i = 0; i < ack_bitmap_bits; i++) {
+        const size_t sequence = cumulative + 1 + i;
+        if (sequence >= received.size())
+            break;
+        if (received[sequence]) {
+            ack.bitmap[i / 16] |= static_cast<std::uint16_t>(1 << (i % 16));
+        }
+    }
+    return ack;
+}
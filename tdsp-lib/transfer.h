@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "dsp_protocol.h"
+#include "sha256_tree.h"
+
+// Sliding-window transfer of an image as chunk messages, with selective acks and retransmit
+// timers. These classes only track protocol state; the caller owns the socket and the clock.
+//
+// Every chunk except the last carries exactly max_chunk_payload_words words, so chunk
+// `sequence` always starts at word sequence * max_chunk_payload_words.
+
+using TransferClock = std::chrono::steady_clock;
+
+// Sha256Tree root of an image with one leaf per chunk, as used by delta manifests.
+Sha256Tree::Hash ImageRoot(const std::uint16_t* image, size_t word_count);
+Sha256Tree MakeImageTree(const std::uint16_t* image, size_t word_count);
+
+// Header of chunk `sequence` of an image as sent by WindowedSender.
+ChunkHeader ImageChunkHeader(size_t word_count, std::uint32_t sequence, std::uint16_t extra_flags = 0);
+// Number of payload words in chunk `sequence`.
+size_t ImageChunkWords(size_t word_count, std::uint32_t sequence);
+
+struct TransferStats {
+    size_t chunks_sent = 0;
+    size_t retransmissions = 0;
+    size_t timeouts = 0;
+    size_t fast_retransmissions = 0;
+    size_t acks_received = 0;
+};
+
+class WindowedSender {
+public:
+    // If `chunks_to_send` is non-empty, only chunks whose entry is true are transferred; the
+    // receiver is expected to already have the rest (see Manifest).
+    WindowedSender(const std::uint16_t* image, size_t word_count, size_t window_size = ack_bitmap_bits,
+                   std::vector<bool> chunks_to_send = {});
+
+    // The chunk that should go on the wire next, if any: chunks presumed lost from acks come
+    // first, then chunks whose retransmit timer expired, then new chunks while the window has room.
+    std::optional<std::uint32_t> NextToSend(TransferClock::time_point now) const;
+
+    // Encodes chunk `sequence` into `out` and (re)starts its retransmit timer.
+    void EncodeForSend(std::uint32_t sequence, TransferClock::time_point now, std::vector<std::uint16_t>& out);
+    // Same, for callers that encode the chunk themselves (see ImageChunkHeader).
+    void MarkSent(std::uint32_t sequence, TransferClock::time_point now);
+
+    void OnAck(const AckInfo& ack, TransferClock::time_point now);
+
+    // Flags set on every chunk besides chunk_flag_ack_requested, e.g. chunk_flag_compressed.
+    void SetChunkFlags(std::uint16_t flags) { chunk_flags = flags; }
+
+    // When the earliest retransmit timer expires; std::nullopt if nothing is in flight.
+    std::optional<TransferClock::time_point> NextTimeout() const;
+
+    bool Done() const { return base == chunks.size(); }
+    size_t ChunkCount() const { return chunks.size(); }
+    size_t AckedCount() const { return acked_count; }
+    TransferClock::duration RetransmitTimeout() const { return rto; }
+    std::optional<TransferClock::duration> SmoothedRtt() const { return srtt; }
+    const TransferStats& Stats() const { return stats; }
+
+private:
+    struct Chunk {
+        bool acked = false;
+        bool lost = false;
+        unsigned transmissions = 0;
+        TransferClock::time_point sent_at;
+    };
+
+    void SkipUnsentChunks();
+    void MarkAcked(std::uint32_t sequence, TransferClock::time_point now, TransferClock::time_point& newest_acked_send);
+    void SampleRtt(TransferClock::duration rtt);
+
+    const std::uint16_t* image;
+    size_t word_count;
+    size_t window_size;
+    std::uint16_t chunk_flags = 0;
+
+    std::vector<Chunk> chunks;
+    std::uint32_t base = 0;
+    std::uint32_t next_new = 0;
+    std::uint32_t highest_acked = 0;
+    size_t acked_count = 0;
+
+    std::optional<TransferClock::duration> srtt;
+    TransferClock::duration rttvar{};
+    TransferClock::duration rto;
+
+    TransferStats stats;
+};
+
+class WindowedReceiver {
+public:
+    // Starts an upload described by a manifest. Returns false if it is a delta against an
+    // image other than the current one, or larger than max_image_words; the upload is then
+    // rejected and nothing changes.
+    // A repeat of the manifest of the upload in progress is accepted without restarting it.
+    bool Begin(const Manifest& manifest);
+
+    // Stores the payload of a chunk. Returns false, changing nothing, if the chunk is not one of
+    // an image of its total size, which may be at most max_image_words. Without a manifest, a
+    // chunk with a different total size or compression, or an unacknowledged chunk 0 after a
+    // completed upload, starts a new upload. Acknowledged chunks cannot tell a new upload of the
+    // same size from retransmissions of the last one, so reliable uploads start with a manifest.
+    bool OnChunk(const ChunkHeader& header, const std::uint16_t* payload, size_t payload_words);
+
+    AckInfo Ack() const;
+
+    bool Started() const { return !received.empty(); }
+    bool Complete() const { return Started() && received_count == received.size(); }
+    // For a compressed upload, empty until it is complete and decompressed.
+    const std::vector<std::uint16_t>& Image() const { return compressed ? decompressed : image; }
+    // A compressed upload completed but its stream was malformed.
+    bool DecompressionFailed() const { return decompression_failed; }
+    size_t DuplicateCount() const { return duplicates; }
+    // For a completed upload that began with a manifest: whether the words transferred match
+    // its root.
+    std::optional<bool> Verified() const { return verified; }
+
+private:
+    void Reset(size_t total_words);
+    void UpdateCumulative();
+    void CheckComplete();
+
+    // The words as transferred; the LzCompress stream of a compressed upload.
+    std::vector<std::uint16_t> image;
+    bool compressed = false;
+    std::vector<std::uint16_t> decompressed;
+    bool decompression_failed = false;
+    std::vector<bool> received;
+    std::uint32_t cumulative = 0;
+    size_t received_count = 0;
+    size_t duplicates = 0;
+    std::optional<Manifest> manifest;
+    std::optional<bool> verified;
+};
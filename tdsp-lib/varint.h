@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// LEB128: seven bits a byte, least significant first, with the top bit set on all but the last.
+// The capture log, snapshot and batch result formats store their counts and sizes this way.
+inline void PutVarint(std::uint64_t value, std::vector<unsigned char>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+// std::nullopt if the bytes run out, or go on past 64 bits, before the last.
+inline std::optional<std::uint64_t> GetVarint(const unsigned char* in, size_t size, size_t& position) {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && position < size; shift += 7) {
+        const unsigned char byte = in[position++];
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    return std::nullopt;
+}
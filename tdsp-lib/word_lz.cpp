@@ -0,0 +1,116 @@
+#include <algorithm>
+
+#include "word_lz.h"
+
+constexpr size_t min_match = 3;
+constexpr size_t max_match = min_match + 0x7FFF;
+constexpr size_t max_literals = 0x8000;
+constexpr size_t window_size = 0x10000;
+constexpr size_t hash_bits = 16;
+constexpr std::uint32_t no_position = 0xFFFFFFFF;
+
+static std::uint32_t HashAt(const std::uint16_t* words) {
+    const std::uint32_t key = words[0] ^ (static_cast<std::uint32_t>(words[1]) << 5) ^ (static_cast<std::uint32_t>(words[2]) << 10);
+    return (key * 2654435761u) >> (32 - hash_bits);
+}
+
+static void FlushLiterals(const std::uint16_t* words, size_t begin, size_t end, std::vector<std::uint16_t>& out) {
+    while (begin < end) {
+        const size_t count = std::min(max_literals, end - begin);
+        out.push_back(static_cast<std::uint16_t>(count - 1));
+        out.insert(out.end(), words + begin, words + begin + count);
+        begin += count;
+    }
+}
+
+std::vector<std::uint16_t> LzCompress(const std::uint16_t* words, size_t word_count) {
+    std::vector<std::uint16_t> out;
+    out.reserve(2 + word_count + word_count / max_literals + 1);
+    out.push_back(static_cast<std::uint16_t>(word_count));
+    out.push_back(static_cast<std::uint16_t>(word_count >> 16));
+
+    // Most recent position of each hash. A single candidate, as in LZ4: searching older ones
+    // barely improves the ratio on program images and halves the speed.
+    std::vector<std::uint32_t> head(size_t{1} << hash_bits, no_position);
+    const auto insert = [&](size_t position) {
+        head[HashAt(words + position)] = static_cast<std::uint32_t>(position);
+    };
+
+    size_t literal_start = 0;
+    size_t position = 0;
+    while (position + min_match <= word_count) {
+        const std::uint32_t candidate = head[HashAt(words + position)];
+        size_t length = 0;
+        size_t distance = 0;
+        if (candidate != no_position && position - candidate <= window_size) {
+            const size_t limit = std::min(max_match, word_count - position);
+            while (length < limit && words[candidate + length] == words[position + length]) {
+                length++;
+            }
+            distance = position - candidate;
+        }
+
+        if (length < min_match) {
+            insert(position);
+            position++;
+            continue;
+        }
+
+        FlushLiterals(words, literal_start, position, out);
+        out.push_back(static_cast<std::uint16_t>(0x8000 | (length - min_match)));
+        out.push_back(static_cast<std::uint16_t>(distance - 1));
+
+        const size_t end = position + length;
+        for (; position < end; position++) {
+            if (position + min_match <= word_count) {
+                insert(position);
+            }
+        }
+        literal_start = position;
+    }
+
+    FlushLiterals(words, literal_start, word_count, out);
+    return out;
+}
+
+std::optional<std::vector<std::uint16_t>> LzDecompress(const std::uint16_t* words, size_t word_count) {
+    if (word_count < 2)
+        return std::nullopt;
+
+    // The size may come off the network, so it is only believed as far as the tokens could
+    // produce it: no more than a copy's max_match words per two words of stream.
+    const size_t size = words[0] | (static_cast<size_t>(words[1]) << 16);
+    if (size > (word_count - 2) / 2 * max_match)
+        return std::nullopt;
+    std::vector<std::uint16_t> out;
+    out.reserve(size);
+
+    size_t i = 2;
+    while (i < word_count) {
+        const std::uint16_t token = words[i++];
+        if (!(token & 0x8000)) {
+            const size_t count = size_t{token} + 1;
+            if (count > word_count - i || count > size - out.size())
+                return std::nullopt;
+            out.insert(out.end(), words + i, words + i + count);
+            i += count;
+            continue;
+        }
+
+        if (i == word_count)
+            return std::nullopt;
+        const size_t length = (token & 0x7FFF) + min_match;
+        const size_t distance = size_t{words[i++]} + 1;
+        if (distance > out.size() || length > size - out.size())
+            return std::nullopt;
+        // Word by word, since the copy may overlap the words it produces.
+        const size_t from = out.size() - distance;
+        for (size_t j = 0; j < length; j++) {
+            out.push_back(out[from + j]);
+        }
+    }
+
+    if (out.size() != size)
+        return std::nullopt;
+    return out;
+}
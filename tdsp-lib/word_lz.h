@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// LZ77 over 16-bit words, for program images: long runs of nop padding, zeroed tables and
+// repeated instruction sequences compress well, and matching whole words keeps it fast.
+//
+// [uncompressed words:2] then tokens, each one word:
+//   0x0000-0x7FFF  literal run of (token + 1) words, which follow
+//   0x8000-0xFFFF  copy of ((token & 0x7FFF) + 3) words from (next word + 1) words back
+// A copy may overlap its own output, so a distance of 1 repeats a single word.
+std::vector<std::uint16_t> LzCompress(const std::uint16_t* words, size_t word_count);
+
+// Returns std::nullopt if the stream is malformed.
+std::optional<std::vector<std::uint16_t>> LzDecompress(const std::uint16_t* words, size_t word_count);
@@ -0,0 +1,93 @@
+#include "receiver_service.h"
+
+using boost::asio::ip::udp;
+
+ReceiverService::ReceiverService(const udp::endpoint& bind_endpoint, double loss_rate, unsigned seed,
+                                 bool record_packets, double capacity)
+    : socket(io_service, bind_endpoint), loss(loss_rate), rng(seed), receiver(record_packets) {
+    if (capacity > 0) {
+        this->capacity.emplace(capacity, 32.0);
+    }
+    socket.set_option(boost::asio::socket_base::receive_buffer_size{1 << 22});
+    StartReceive();
+    thread = std::thread([this] { io_service.run(); });
+}
+
+ReceiverService::~ReceiverService() {
+    io_service.stop();
+    thread.join();
+}
+
+udp::endpoint ReceiverService::Endpoint() const {
+    return socket.local_endpoint();
+}
+
+std::optional<std::vector<std::uint16_t>> ReceiverService::WaitForImage(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock{mutex};
+    if (!cv.wait_for(lock, timeout, [this] { return receiver.Upload().Complete(); }))
+        return std::nullopt;
+    return receiver.Upload().Image();
+}
+
+bool ReceiverService::WaitForPackets(size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock{mutex};
+    return cv.wait_for(lock, timeout, [&] { return receiver.PacketCount() >= count; });
+}
+
+ReceiverService::Counters ReceiverService::GetCounters() {
+    std::lock_guard<std::mutex> lock{mutex};
+    Counters counters;
+    counters.packets = receiver.PacketCount();
+    counters.invalid = receiver.InvalidCount();
+    counters.instructions = receiver.InstructionCount();
+    counters.payload_words = receiver.PayloadWordCount();
+    counters.dropped = dropped;
+    counters.overruns = overruns;
+    return counters;
+}
+
+DspReceiver ReceiverService::Snapshot() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return receiver;
+}
+
+bool ReceiverService::ShouldDrop() {
+    if (!loss(rng))
+        return false;
+    dropped++;
+    return true;
+}
+
+bool ReceiverService::Overrun() {
+    if (!capacity)
+        return false;
+    const auto now = TransferClock::now();
+    if (capacity->Ready(now)) {
+        capacity->Consume(now);
+        return false;
+    }
+    overruns++;
+    return true;
+}
+
+void ReceiverService::StartReceive() {
+    socket.async_receive_from(boost::asio::buffer(receive_buffer), remote, [this](const boost::system::error_code& ec, size_t bytes) {
+        if (ec == boost::asio::error::operation_aborted)
+            return;
+
+        if (!ec && !Overrun() && !ShouldDrop()) {
+            const auto arrival = TransferClock::now();
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                receiver.HandleDatagram(receive_buffer.data(), bytes / sizeof(std::uint16_t), arrival, reply);
+            }
+            cv.notify_all();
+            if (!reply.empty() && !ShouldDrop()) {
+                boost::system::error_code send_ec;
+                socket.send_to(boost::asio::buffer(reply), remote, 0, send_ec);
+            }
+        }
+
+        StartReceive();
+    });
+}
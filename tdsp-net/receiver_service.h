@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "dsp_protocol.h"
+#include "dsp_receiver.h"
+#include "pacing.h"
+
+// Stand-in for the DSP stub: listens on a UDP socket on its own thread, feeds every datagram
+// to a DspReceiver and sends back any acks. Datagrams in both directions are dropped at
+// random with probability `loss_rate` to emulate a lossy link. With a non-zero `capacity`,
+// incoming datagrams beyond that many per second (after a short burst) are dropped as well, to
+// emulate a device that cannot keep up.
+class ReceiverService {
+public:
+    struct Counters {
+        size_t packets = 0;
+        size_t invalid = 0;
+        size_t instructions = 0;
+        size_t payload_words = 0;
+        size_t dropped = 0;
+        size_t overruns = 0;
+    };
+
+    explicit ReceiverService(const boost::asio::ip::udp::endpoint& bind_endpoint, double loss_rate = 0.0,
+                             unsigned seed = 1, bool record_packets = false, double capacity = 0);
+    ~ReceiverService();
+
+    boost::asio::ip::udp::endpoint Endpoint() const;
+
+    // Waits until an upload has been completely received.
+    std::optional<std::vector<std::uint16_t>> WaitForImage(std::chrono::milliseconds timeout);
+    // Waits until at least `count` valid packets have arrived.
+    bool WaitForPackets(size_t count, std::chrono::milliseconds timeout);
+
+    Counters GetCounters();
+    // Copy of the receiver state, including the packet log if recording.
+    DspReceiver Snapshot();
+
+private:
+    void StartReceive();
+    bool ShouldDrop();
+    bool Overrun();
+
+    boost::asio::io_service io_service;
+    boost::asio::ip::udp::socket socket;
+    std::array<std::uint16_t, max_datagram_size / sizeof(std::uint16_t)> receive_buffer;
+    boost::asio::ip::udp::endpoint remote;
+    std::vector<std::uint16_t> reply;
+
+    std::bernoulli_distribution loss;
+    std::mt19937 rng;
+    std::atomic<size_t> dropped{0};
+    std::optional<TokenBucket> capacity;
+    std::atomic<size_t> overruns{0};
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    DspReceiver receiver;
+
+    std::thread thread;
+};
@@ -0,0 +1,336 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "delta_upload.h"
+#include "pacing.h"
+#include "reliable_upload.h"
+#include "transfer.h"
+
+using boost::asio::ip::udp;
+
+constexpr auto give_up_after = std::chrono::seconds{5};
+constexpr auto manifest_retry_interval = std::chrono::milliseconds{100};
+
+// What every target shares: the socket and the image, whose chunk headers are encoded once.
+struct SharedUpload {
+    udp::socket& socket;
+    const std::uint16_t* image;
+    size_t word_count;
+    const ReliableUploadOptions& options;
+    std::vector<std::array<std::uint16_t, chunk_header_words>> headers;
+    size_t active_targets = 0;
+    // Called once every target has finished.
+    std::function<void()> on_finished;
+    // A full manifest of the image, hashed once for every target given no manifest.
+    std::optional<Manifest> full_manifest;
+};
+
+// A send completion handler that records how long the send took, if timing.
+static auto SendCompletion(StageTimings* timings) {
+    const auto submitted = timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    return [timings, submitted](const boost::system::error_code&, size_t) {
+        if (timings) {
+            timings->Record(SenderStage::Socket, std::chrono::steady_clock::now() - submitted);
+        }
+    };
+}
+
+class TargetUpload {
+public:
+    TargetUpload(boost::asio::io_service& io_service, SharedUpload& shared, std::uint32_t index, const UploadTarget& target)
+        : shared(shared), index(index), endpoint(target.endpoint), timer(io_service) {
+        // Without a manifest the receiver would take a new image of the same size for
+        // retransmissions of the last one, so a full upload gets one too.
+        pending_manifest = target.manifest ? *target.manifest : *shared.full_manifest;
+    }
+
+    void Start() {
+        start = last_progress = TransferClock::now();
+
+        const ReliableUploadOptions& options = shared.options;
+        if (options.rate > 0 || options.adaptive) {
+            const double rate = options.rate > 0 ? options.rate : default_adaptive_start_rate;
+            if (options.adaptive) {
+                rate_control.emplace(rate);
+            }
+            pacer.emplace(rate_control ? rate_control->Rate() : rate, static_cast<double>(options.burst));
+        }
+        Pump();
+    }
+
+    bool Finished() const { return finished; }
+
+    void PrintProgress() const {
+        const TransferStats& stats = sender ? sender->Stats() : TransferStats{};
+        std::printf("%s:%u: %zu/%zu chunks acked",
+                    endpoint.address().to_string().c_str(), endpoint.port(), sender ? sender->AckedCount() : 0,
+                    ChunkCountFor(shared.word_count));
+        if (pacer) {
+            std::printf(", %.0f datagrams/s", pacer->Rate());
+        }
+        std::printf(", %zu retransmitted (%.1f%%)\n",
+                    stats.retransmissions, stats.chunks_sent ? 100.0 * stats.retransmissions / stats.chunks_sent : 0.0);
+    }
+
+    void OnAck(const AckInfo& ack) {
+        if (finished)
+            return;
+
+        const auto now = TransferClock::now();
+        if (sender) {
+            const size_t acked_before = sender->AckedCount();
+            sender->OnAck(ack, now);
+            const size_t acked = sender->AckedCount() - acked_before;
+            if (acked != 0) {
+                last_progress = now;
+            }
+            if (rate_control && sender->SmoothedRtt()) {
+                rate_control->OnAcked(acked, *sender->SmoothedRtt(), rate_limited);
+                pacer->SetRate(rate_control->Rate());
+                rate_limited = false;
+            }
+        } else if (ack.flags & ack_flag_rejected) {
+            if (!(pending_manifest.flags & manifest_flag_delta))
+                return;
+            pending_manifest.flags &= ~manifest_flag_delta;
+            pending_manifest.changed.clear();
+            last_progress = now;
+        } else {
+            sender.emplace(shared.image, shared.word_count, shared.options.window_size, pending_manifest.changed);
+            last_progress = now;
+        }
+        Pump();
+    }
+
+    UploadStats Stats() const {
+        UploadStats stats;
+        stats.chunks = ChunkCountFor(shared.word_count);
+        stats.words = shared.word_count;
+        if (pending_manifest.flags & manifest_flag_delta) {
+            stats.words = 0;
+            for (std::uint32_t i = 0; i < stats.chunks; i++) {
+                if (pending_manifest.changed[i]) {
+                    stats.words += ImageChunkWords(shared.word_count, i);
+                } else {
+                    stats.chunks_skipped++;
+                }
+            }
+        }
+        if (sender) {
+            stats.datagrams = sender->Stats().chunks_sent;
+            stats.retransmissions = sender->Stats().retransmissions;
+            stats.fast_retransmissions = sender->Stats().fast_retransmissions;
+            stats.timeouts = sender->Stats().timeouts;
+        }
+        if (pacer) {
+            stats.rate = pacer->Rate();
+            stats.peak_rate = rate_control ? rate_control->PeakRate() : pacer->Rate();
+        }
+        stats.complete = sender && sender->Done();
+        stats.elapsed = end - start;
+        return stats;
+    }
+
+private:
+    void Pump() {
+        const auto now = TransferClock::now();
+        if (!sender) {
+            // Owned by the send handler, as a rejected delta replaces the manifest while the
+            // previous one may still be queued.
+            auto message = std::make_shared<std::vector<std::uint16_t>>();
+            EncodeManifest(pending_manifest, *message);
+            if (shared.options.capture) {
+                shared.options.capture->Record(now, index, message->data(), message->size() * sizeof(std::uint16_t));
+            }
+            const auto completion = SendCompletion(shared.options.timings);
+            shared.socket.async_send_to(boost::asio::buffer(*message), endpoint,
+                                        [message, completion](const boost::system::error_code& ec, size_t bytes) {
+                                            completion(ec, bytes);
+                                        });
+            WaitUntil(now + manifest_retry_interval);
+            return;
+        }
+
+        const size_t retransmissions_before = sender->Stats().retransmissions;
+        std::optional<TransferClock::time_point> paced_until;
+        while (auto sequence = sender->NextToSend(now)) {
+            if (pacer && !pacer->Ready(now)) {
+                paced_until = pacer->ReadyAt(now);
+                rate_limited = true;
+                break;
+            }
+            if (pacer) {
+                pacer->Consume(now);
+            }
+            sender->MarkSent(*sequence, now);
+            const std::array<boost::asio::const_buffer, 2> buffers{
+                boost::asio::buffer(shared.headers[*sequence]),
+                boost::asio::buffer(shared.image + *sequence * max_chunk_payload_words,
+                                    ImageChunkWords(shared.word_count, *sequence) * sizeof(std::uint16_t)),
+            };
+            if (shared.options.capture) {
+                shared.options.capture->Record(now, index, buffers[0].data(), buffers[0].size(), buffers[1].data(),
+                                               buffers[1].size());
+            }
+            shared.socket.async_send_to(buffers, endpoint, SendCompletion(shared.options.timings));
+        }
+
+        if (rate_control && sender->Stats().retransmissions != retransmissions_before) {
+            rate_control->OnLoss(now, sender->SmoothedRtt().value_or(sender->RetransmitTimeout()));
+            pacer->SetRate(rate_control->Rate());
+        }
+
+        if (sender->Done()) {
+            Finish();
+            return;
+        }
+
+        auto timeout = sender->NextTimeout();
+        if (paced_until && (!timeout || *paced_until < *timeout)) {
+            timeout = paced_until;
+        }
+        if (timeout) {
+            WaitUntil(*timeout);
+        }
+    }
+
+    void WaitUntil(TransferClock::time_point timeout) {
+        timer.expires_at(timeout);
+        timer.async_wait([this](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted || finished)
+                return;
+            if (TransferClock::now() - last_progress > give_up_after) {
+                Finish();
+                return;
+            }
+            Pump();
+        });
+    }
+
+    void Finish() {
+        finished = true;
+        end = TransferClock::now();
+        timer.cancel();
+        if (--shared.active_targets == 0) {
+            shared.on_finished();
+        }
+    }
+
+    SharedUpload& shared;
+    std::uint32_t index;
+    udp::endpoint endpoint;
+    // Not constructed until the manifest has been acknowledged.
+    std::optional<WindowedSender> sender;
+    Manifest pending_manifest;
+    std::optional<TokenBucket> pacer;
+    std::optional<RateController> rate_control;
+    // Whether the pacer held back a datagram since the last ack.
+    bool rate_limited = false;
+    boost::asio::steady_timer timer;
+    TransferClock::time_point start;
+    TransferClock::time_point end;
+    TransferClock::time_point last_progress;
+    bool finished = false;
+};
+
+UploadStats ReliableUpload(boost::asio::io_service& io_service, udp::socket& socket, const udp::endpoint& endpoint,
+                           const std::uint16_t* image, size_t word_count, const ReliableUploadOptions& options,
+                           const std::optional<Manifest>& manifest) {
+    return ReliableUpload(io_service, socket, std::vector<UploadTarget>{{endpoint, manifest}}, image, word_count,
+                          options).front();
+}
+
+std::vector<UploadStats> ReliableUpload(boost::asio::io_service& io_service, udp::socket& socket,
+                                        const std::vector<UploadTarget>& targets, const std::uint16_t* image,
+                                        size_t word_count, const ReliableUploadOptions& options) {
+    if (targets.empty())
+        return {};
+
+    // Every target keeps a window of chunks queued in the kernel at once.
+    boost::system::error_code ec;
+    socket.set_option(boost::asio::socket_base::send_buffer_size{1 << 20}, ec);
+
+    boost::asio::steady_timer stats_timer{io_service};
+    SharedUpload shared{socket, image, word_count, options, {}, targets.size(), [&] {
+        socket.cancel();
+        stats_timer.cancel();
+    }};
+    shared.headers.resize(ChunkCountFor(word_count));
+    for (std::uint32_t i = 0; i < shared.headers.size(); i++) {
+        StageTimer timer{options.timings, SenderStage::Encode};
+        EncodeChunkHeader(ImageChunkHeader(word_count, i, options.chunk_flags), shared.headers[i].data());
+    }
+    if (std::any_of(targets.begin(), targets.end(), [](const UploadTarget& target) { return !target.manifest; })) {
+        shared.full_manifest = PlanUpload(MakeUploadRecord(image, word_count), std::nullopt);
+    }
+
+    std::vector<std::unique_ptr<TargetUpload>> uploads;
+    std::map<udp::endpoint, TargetUpload*> by_endpoint;
+    for (std::uint32_t i = 0; i < targets.size(); i++) {
+        uploads.push_back(std::make_unique<TargetUpload>(io_service, shared, i, targets[i]));
+        const bool inserted = by_endpoint.emplace(targets[i].endpoint, uploads.back().get()).second;
+        assert(inserted);
+        (void)inserted;
+    }
+
+    std::array<std::uint16_t, max_datagram_size / sizeof(std::uint16_t)> receive_buffer;
+    udp::endpoint receive_endpoint;
+    std::function<void()> start_receive;
+
+    const auto on_receive = [&](const boost::system::error_code& ec, size_t bytes) {
+        if (ec == boost::asio::error::operation_aborted)
+            return;
+        const auto upload = by_endpoint.find(receive_endpoint);
+        if (!ec && upload != by_endpoint.end()) {
+            if (auto ack = DecodeAck(receive_buffer.data(), bytes / sizeof(std::uint16_t))) {
+                upload->second->OnAck(*ack);
+            }
+        }
+        if (shared.active_targets != 0) {
+            start_receive();
+        }
+    };
+    start_receive = [&] {
+        socket.async_receive_from(boost::asio::buffer(receive_buffer), receive_endpoint, on_receive);
+    };
+
+    std::function<void()> start_stats_timer;
+
+    start_stats_timer = [&] {
+        stats_timer.expires_from_now(options.stats_interval);
+        stats_timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted)
+                return;
+            for (const auto& upload : uploads) {
+                if (!upload->Finished()) {
+                    upload->PrintProgress();
+                }
+            }
+            start_stats_timer();
+        });
+    };
+
+    // Receive first: if every target finishes, the socket is cancelled, which must find the
+    // receive pending.
+    start_receive();
+    if (options.stats_interval.count() > 0) {
+        start_stats_timer();
+    }
+    for (const auto& upload : uploads) {
+        upload->Start();
+    }
+    io_service.run();
+    io_service.reset();
+
+    std::vector<UploadStats> stats;
+    for (const auto& upload : uploads) {
+        stats.push_back(upload->Stats());
+    }
+    return stats;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "capture_log.h"
+#include "dsp_protocol.h"
+#include "stage_timing.h"
+#include "upload.h"
+
+struct ReliableUploadOptions {
+    size_t window_size = 64;
+    // Datagrams per second per target; zero sends as fast as the window allows. With
+    // `adaptive` this is the starting rate, default_adaptive_start_rate if zero.
+    double rate = 0;
+    // Datagrams a target may be sent back to back after an idle period.
+    size_t burst = 16;
+    // Adjust the rate from acks and losses (see RateController).
+    bool adaptive = false;
+    // Print a line with each unfinished target's progress, rate and loss this often; zero
+    // disables it.
+    std::chrono::milliseconds stats_interval{0};
+    // Flags for every chunk, e.g. chunk_flag_compressed if the image is an LzCompress stream.
+    std::uint16_t chunk_flags = 0;
+    // Records every datagram sent, numbering targets by their position in the target list.
+    CaptureWriter* capture = nullptr;
+    // Times each send from submission to completion.
+    StageTimings* timings = nullptr;
+};
+
+struct UploadTarget {
+    boost::asio::ip::udp::endpoint endpoint;
+    std::optional<Manifest> manifest;
+};
+
+// Uploads the image with the windowed, acknowledged chunk protocol. Gives up on a target if it
+// stops acknowledging for a few seconds.
+//
+// A manifest is sent first and retransmitted until acknowledged; without one given, a full
+// manifest of the image, so the receiver always knows a new upload has started. A delta
+// manifest then limits the transfer to the changed chunks; if the receiver rejects it because
+// it no longer holds the base image, the upload falls back to sending every chunk. For a
+// compressed upload the image is the stream, and a given manifest must not be a delta.
+UploadStats ReliableUpload(boost::asio::io_service& io_service, boost::asio::ip::udp::socket& socket,
+                           const boost::asio::ip::udp::endpoint& endpoint, const std::uint16_t* image,
+                           size_t word_count, const ReliableUploadOptions& options,
+                           const std::optional<Manifest>& manifest = std::nullopt);
+
+// Uploads the same image to every target at once from one socket. Chunks are encoded once and
+// sent asynchronously; each target has its own window, retransmit timers and deadline, so a
+// slow or dead target does not hold back the others. Targets must have distinct endpoints.
+// Returns the stats of each target in order.
+std::vector<UploadStats> ReliableUpload(boost::asio::io_service& io_service, boost::asio::ip::udp::socket& socket,
+                                        const std::vector<UploadTarget>& targets, const std::uint16_t* image,
+                                        size_t word_count, const ReliableUploadOptions& options);
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <thread>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+#include "replay.h"
+
+using boost::asio::ip::udp;
+
+constexpr size_t max_replay_batch = 64;
+
+// Sends log datagrams [first, last) and returns how many the socket accepted.
+static size_t SendBatch(udp::socket& socket, const CaptureLog& log, size_t first, size_t last,
+                        const std::vector<udp::endpoint>& endpoints, ReplayStats& stats) {
+    size_t accepted = 0;
+#if defined(__linux__)
+    std::array<mmsghdr, max_replay_batch> messages{};
+    std::array<iovec, max_replay_batch> vectors{};
+    while (first < last) {
+        const size_t count = std::min(last - first, max_replay_batch);
+        for (size_t i = 0; i < count; i++) {
+            const CaptureLog::Datagram& datagram = log.datagrams[first + i];
+            const udp::endpoint& endpoint = endpoints[datagram.target % endpoints.size()];
+            vectors[i].iov_base = const_cast<unsigned char*>(log.Bytes(datagram));
+            vectors[i].iov_len = datagram.size;
+            messages[i].msg_hdr = {};
+            messages[i].msg_hdr.msg_name = const_cast<sockaddr*>(endpoint.data());
+            messages[i].msg_hdr.msg_namelen = static_cast<socklen_t>(endpoint.size());
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int sent = sendmmsg(socket.native_handle(), messages.data(), static_cast<unsigned>(count), 0);
+        stats.send_calls++;
+        if (sent <= 0) {
+            // Skip the datagram the kernel choked on rather than spinning on it.
+            stats.errors++;
+            first++;
+            continue;
+        }
+        for (int i = 0; i < sent; i++) {
+            stats.bytes += messages[i].msg_len;
+        }
+        accepted += static_cast<size_t>(sent);
+        first += static_cast<size_t>(sent);
+    }
+#else
+    for (; first < last; first++) {
+        const CaptureLog::Datagram& datagram = log.datagrams[first];
+        boost::system::error_code ec;
+        stats.send_calls++;
+        const size_t bytes = socket.send_to(boost::asio::buffer(log.Bytes(datagram), datagram.size),
+                                            endpoints[datagram.target % endpoints.size()], 0, ec);
+        if (ec) {
+            stats.errors++;
+            continue;
+        }
+        stats.bytes += bytes;
+        accepted++;
+    }
+#endif
+    return accepted;
+}
+
+ReplayStats Replay(udp::socket& socket, const CaptureLog& log, const std::vector<udp::endpoint>& endpoints, bool fast) {
+    ReplayStats stats;
+    if (endpoints.empty())
+        return stats;
+
+    // Blocking sends: a full send buffer should slow the replay down, not drop datagrams.
+    boost::system::error_code ec;
+    socket.set_option(boost::asio::socket_base::send_buffer_size{1 << 20}, ec);
+    socket.non_blocking(false, ec);
+
+    const auto start = std::chrono::steady_clock::now();
+    size_t next = 0;
+    while (next < log.datagrams.size()) {
+        size_t last = log.datagrams.size();
+        if (!fast) {
+            const auto due = start + log.datagrams[next].time;
+            std::this_thread::sleep_until(due);
+            // Everything that has fallen due while sleeping goes out together.
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            last = next + 1;
+            while (last < log.datagrams.size() && log.datagrams[last].time <= elapsed) {
+                last++;
+            }
+        }
+        stats.datagrams += SendBatch(socket, log, next, last, endpoints, stats);
+        next = last;
+    }
+    stats.elapsed = std::chrono::steady_clock::now() - start;
+    return stats;
+}
+
+void PrintReplayStats(const ReplayStats& stats) {
+    const double seconds = std::chrono::duration<double>(stats.elapsed).count();
+    std::printf("Replayed %zu datagrams (%zu bytes) in %.3f ms with %zu send calls",
+                stats.datagrams, stats.bytes, seconds * 1000.0, stats.send_calls);
+    if (seconds > 0) {
+        std::printf(", %.0f datagrams/s", stats.datagrams / seconds);
+    }
+    std::printf("\n");
+    if (stats.errors != 0) {
+        std::printf("%zu datagrams could not be sent\n", stats.errors);
+    }
+}
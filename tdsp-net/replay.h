@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "capture_log.h"
+
+struct ReplayStats {
+    size_t datagrams = 0;
+    size_t bytes = 0;
+    // Datagrams the socket refused; they are skipped, not retried.
+    size_t errors = 0;
+    // System calls used to send; fewer than datagrams when batched.
+    size_t send_calls = 0;
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+// Resends a captured session. Target i of the log goes to endpoints[i % endpoints.size()].
+//
+// With `fast`, datagrams go out back to back, ignoring the recorded timing; otherwise each one
+// is sent when it is due relative to the start of the replay. On Linux, datagrams that are due
+// together are handed to the kernel in one sendmmsg call.
+ReplayStats Replay(boost::asio::ip::udp::socket& socket, const CaptureLog& log,
+                   const std::vector<boost::asio::ip::udp::endpoint>& endpoints, bool fast);
+
+void PrintReplayStats(const ReplayStats& stats);
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <array>
+#include <random>
+
+#include "sample_image.h"
+
+std::vector<std::uint16_t> MakeNoiseImage(size_t word_count) {
+    std::vector<std::uint16_t> image(word_count);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = static_cast<std::uint16_t>(i * 0x9E37);
+    }
+    return image;
+}
+
+std::vector<std::uint16_t> MakeProgramImage(size_t word_count, unsigned seed) {
+    // Opcode bases from the instruction table, with the bits their operands occupy.
+    constexpr std::array<std::pair<std::uint16_t, std::uint16_t>, 12> opcodes{{
+        {0x86C0, 0x0100}, // add Imm16, Ax (followed by the immediate)
+        {0xC600, 0x01FF}, // add Imm8u, Ax
+        {0x4600, 0x017F}, // add MemR7Imm7s, Ax
+        {0x8680, 0x011F}, // add MemRn, Ax
+        {0xA600, 0x01FF}, // add MemImm8, Ax
+        {0x5DF0, 0x0003}, // add Bx, Ax
+        {0xB200, 0x01FF}, // addh MemImm8, Ax
+        {0x92A0, 0x011F}, // addh Register, Ax
+        {0x5C00, 0x00FF}, // bkrep Imm8u (followed by the address)
+        {0x9280, 0x011F}, // addh MemRn, Ax
+        {0xD38B, 0x0010}, // add r6, Ax
+        {0x5DC0, 0x0004}, // add p0, p1, Ab
+    }};
+
+    std::mt19937 rng{seed};
+    std::geometric_distribution<size_t> routine_length{1.0 / 120};
+    std::geometric_distribution<size_t> table_length{1.0 / 200};
+    std::discrete_distribution<size_t> opcode{{20, 14, 10, 10, 8, 6, 5, 5, 2, 4, 3, 3}};
+
+    std::vector<std::uint16_t> image;
+    image.reserve(word_count);
+    while (image.size() < word_count) {
+        const size_t code_end = image.size() + routine_length(rng);
+        while (image.size() < code_end) {
+            const auto [base, operand_bits] = opcodes[opcode(rng)];
+            image.push_back(static_cast<std::uint16_t>(base | (rng() & operand_bits)));
+            if (base == 0x86C0 || base == 0x5C00) {
+                image.push_back(static_cast<std::uint16_t>(rng() & 0x0FFF));
+            }
+        }
+        while (image.size() % 16 != 0) {
+            image.push_back(0x0000);
+        }
+
+        switch (rng() % 4) {
+        case 0:
+            image.insert(image.end(), table_length(rng), 0x0000);
+            break;
+        case 1:
+            image.insert(image.end(), table_length(rng), static_cast<std::uint16_t>(rng()));
+            break;
+        default:
+            break;
+        }
+    }
+
+    image.resize(word_count);
+    return image;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Images for self-tests and benchmarks.
+
+// Distinct words with no repeats within 64K words, which no compressor can shrink.
+std::vector<std::uint16_t> MakeNoiseImage(size_t word_count);
+
+// Shaped like a DSP program: runs of instructions from a small opcode mix with varying
+// operands, each routine padded with nops to a 16-word boundary, interleaved with zeroed and
+// constant data tables. Deterministic for a given seed.
+std::vector<std::uint16_t> MakeProgramImage(size_t word_count, unsigned seed = 1);
@@ -0,0 +1,170 @@
+#include <cassert>
+#include <memory>
+
+#include "send_pipeline.h"
+
+SendPipeline::SendPipeline(boost::asio::io_service& io_service, boost::asio::ip::udp::socket& socket,
+                           boost::asio::ip::udp::endpoint endpoint, bool batch,
+                           std::chrono::milliseconds flush_interval, size_t max_in_flight, double rate,
+                           CaptureWriter* capture, StageTimings* timings)
+    : io_service(io_service), socket(socket), endpoint(endpoint), batch(batch), flush_interval(flush_interval),
+      max_in_flight(max_in_flight), capture(capture), timings(timings), flush_timer(io_service), pace_timer(io_service),
+      work(std::make_unique<boost::asio::io_service::work>(io_service)) {
+    if (rate > 0) {
+        pacer.emplace(rate, static_cast<double>(max_in_flight));
+    }
+    network_thread = std::thread([this] { this->io_service.run(); });
+}
+
+SendPipeline::~SendPipeline() {
+    Finish();
+}
+
+void SendPipeline::Send(std::vector<std::uint16_t> instruction) {
+    Push({Item::Instruction, std::move(instruction), {}});
+}
+
+void SendPipeline::Flush() {
+    Push({Item::Flush, {}, {}});
+}
+
+void SendPipeline::Finish() {
+    if (!network_thread.joinable())
+        return;
+
+    Push({Item::End, {}, {}});
+    network_thread.join();
+    io_service.reset();
+}
+
+void SendPipeline::Push(Item item) {
+    if (timings) {
+        item.queued = std::chrono::steady_clock::now();
+    }
+    while (!queue.TryPush(std::move(item))) {
+        std::this_thread::yield();
+    }
+
+    // Wake the network thread unless a drain is already pending.
+    if (!drain_scheduled.exchange(true)) {
+        io_service.post([this] { Drain(); });
+    }
+}
+
+void SendPipeline::Drain() {
+    while (in_flight < max_in_flight) {
+        // Not every item sends a datagram, so this only keeps the pacer from running into debt
+        // by more than one batch at a time.
+        const auto now = std::chrono::steady_clock::now();
+        if (pacer && !pacer->Ready(now)) {
+            // Whatever woke us, the timer resumes draining once a datagram may be sent.
+            pace_timer.expires_at(pacer->ReadyAt(now));
+            pace_timer.async_wait([this](const boost::system::error_code& ec) {
+                if (ec != boost::asio::error::operation_aborted) {
+                    Drain();
+                }
+            });
+            return;
+        }
+
+        if (flush_due) {
+            FlushBatch();
+            continue;
+        }
+        auto item = queue.TryPop();
+        if (!item) {
+            drain_scheduled = false;
+            // The producer may have pushed between our failed pop and clearing the flag.
+            if (queue.Empty() || drain_scheduled.exchange(true))
+                break;
+            continue;
+        }
+        if (timings) {
+            timings->Record(SenderStage::Queue, std::chrono::steady_clock::now() - item->queued);
+        }
+
+        switch (item->kind) {
+        case Item::Instruction:
+            if (!batch) {
+                std::vector<std::uint16_t> message;
+                {
+                    StageTimer timer{timings, SenderStage::Encode};
+                    message = EncodeSingle(item->words);
+                }
+                StartSend(std::move(message));
+                instructions_sent++;
+                break;
+            }
+            if (!AppendToBatch(item->words)) {
+                FlushBatch();
+                const bool appended = AppendToBatch(item->words);
+                assert(appended);
+                (void)appended;
+            }
+            if (encoder.InstructionCount() == 1) {
+                flush_timer.expires_from_now(flush_interval);
+                // The flush waits its turn in Drain like any other send.
+                flush_timer.async_wait([this](const boost::system::error_code& ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        flush_due = true;
+                        Drain();
+                    }
+                });
+            }
+            break;
+        case Item::Flush:
+            FlushBatch();
+            break;
+        case Item::End:
+            FlushBatch();
+            ending = true;
+            break;
+        }
+    }
+
+    if (ending && in_flight == 0) {
+        work.reset();
+    }
+}
+
+void SendPipeline::FlushBatch() {
+    flush_timer.cancel();
+    flush_due = false;
+    if (encoder.Empty())
+        return;
+
+    instructions_sent += encoder.InstructionCount();
+    std::vector<std::uint16_t> message;
+    {
+        StageTimer timer{timings, SenderStage::Encode};
+        message = encoder.Message();
+    }
+    StartSend(std::move(message));
+    encoder.Clear();
+}
+
+bool SendPipeline::AppendToBatch(const std::vector<std::uint16_t>& instruction) {
+    StageTimer timer{timings, SenderStage::Encode};
+    return encoder.TryAppend(instruction);
+}
+
+void SendPipeline::StartSend(std::vector<std::uint16_t> message) {
+    if (pacer) {
+        pacer->Consume(std::chrono::steady_clock::now());
+    }
+    in_flight++;
+    datagrams_sent++;
+
+    auto buffer = std::make_shared<std::vector<std::uint16_t>>(std::move(message));
+    if (capture) {
+        capture->Record(std::chrono::steady_clock::now(), 0, buffer->data(), buffer->size() * sizeof(std::uint16_t));
+    }
+    const auto submitted = timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    socket.async_send_to(boost::asio::buffer(*buffer), endpoint, [this, buffer, submitted](const boost::system::error_code&, size_t) {
+        if (timings) {
+            timings->Record(SenderStage::Socket, std::chrono::steady_clock::now() - submitted);
+        }
+        in_flight--;
+        Drain();
+    });
+}
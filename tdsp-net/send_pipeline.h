@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "capture_log.h"
+#include "dsp_protocol.h"
+#include "pacing.h"
+#include "spsc_queue.h"
+#include "stage_timing.h"
+
+// Decouples assembly from network I/O. The reader thread hands assembled instructions over
+// through a lock-free queue; a network thread running the socket's io_service encodes them
+// (optionally coalescing them into batch messages) and keeps several async sends in flight.
+//
+// A pending batch is sent when it is full, on Flush(), or when its oldest instruction has
+// waited for `flush_interval`. With a non-zero `rate`, datagrams are paced to at most that many
+// per second, after an initial burst of `max_in_flight`; instructions queue up meanwhile.
+// Every datagram is recorded to `capture` if given, and the queue, encode and socket stages are
+// timed into `timings` if given.
+class SendPipeline {
+public:
+    SendPipeline(boost::asio::io_service& io_service, boost::asio::ip::udp::socket& socket,
+                 boost::asio::ip::udp::endpoint endpoint, bool batch, std::chrono::milliseconds flush_interval,
+                 size_t max_in_flight = 8, double rate = 0, CaptureWriter* capture = nullptr,
+                 StageTimings* timings = nullptr);
+    ~SendPipeline();
+
+    // Producer side; call from a single thread only.
+    void Send(std::vector<std::uint16_t> instruction);
+    void Flush();
+
+    // Sends everything still queued, waits for the sends to complete and stops the network thread.
+    void Finish();
+
+    // Only meaningful after Finish().
+    size_t InstructionsSent() const { return instructions_sent; }
+    size_t DatagramsSent() const { return datagrams_sent; }
+
+private:
+    struct Item {
+        enum { Instruction, Flush, End } kind = Instruction;
+        std::vector<std::uint16_t> words;
+        // Only set when timing.
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    void Push(Item item);
+
+    // Network thread only.
+    void Drain();
+    void FlushBatch();
+    bool AppendToBatch(const std::vector<std::uint16_t>& instruction);
+    void StartSend(std::vector<std::uint16_t> message);
+
+    boost::asio::io_service& io_service;
+    boost::asio::ip::udp::socket& socket;
+    boost::asio::ip::udp::endpoint endpoint;
+    const bool batch;
+    const std::chrono::milliseconds flush_interval;
+    const size_t max_in_flight;
+    CaptureWriter* const capture;
+    StageTimings* const timings;
+
+    SpscQueue<Item> queue{1024};
+    std::atomic<bool> drain_scheduled{false};
+
+    BatchEncoder encoder;
+    boost::asio::steady_timer flush_timer;
+    // The flush timer fired, but the batch goes out from Drain, within max_in_flight and the pacer.
+    bool flush_due = false;
+    std::optional<TokenBucket> pacer;
+    boost::asio::steady_timer pace_timer;
+    size_t in_flight = 0;
+    bool ending = false;
+    size_t instructions_sent = 0;
+    size_t datagrams_sent = 0;
+
+    std::unique_ptr<boost::asio::io_service::work> work;
+    std::thread network_thread;
+};
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "dsp_protocol.h"
+#include "pacing.h"
+#include "upload.h"
+
+UploadStats StreamImage(boost::asio::ip::udp::socket& socket, const boost::asio::ip::udp::endpoint& endpoint,
+                        const std::uint16_t* image, size_t word_count, double rate, std::uint16_t chunk_flags,
+                        CaptureWriter* capture, StageTimings* timings) {
+    // A deep send buffer lets the kernel absorb bursts instead of blocking us per datagram.
+    boost::system::error_code ec;
+    socket.set_option(boost::asio::socket_base::send_buffer_size{1 << 20}, ec);
+
+    UploadStats stats;
+    std::vector<std::uint16_t> message;
+    message.reserve(max_datagram_size / sizeof(std::uint16_t));
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Without acks there is nothing to adapt to, and nothing else to do while waiting.
+    std::optional<TokenBucket> pacer;
+    if (rate > 0) {
+        pacer.emplace(rate, 1.0);
+        stats.rate = stats.peak_rate = rate;
+    }
+
+    ChunkHeader header;
+    header.flags = chunk_flags;
+    header.total_words = static_cast<std::uint32_t>(word_count);
+
+    // An empty image still sends one chunk so the receiver learns the upload happened.
+    const size_t chunk_count = std::max<size_t>(1, (word_count + max_chunk_payload_words - 1) / max_chunk_payload_words);
+    for (size_t i = 0; i < chunk_count; i++) {
+        const size_t offset = i * max_chunk_payload_words;
+        const size_t payload_words = std::min(max_chunk_payload_words, word_count - offset);
+        header.sequence = static_cast<std::uint32_t>(i);
+        header.offset = static_cast<std::uint32_t>(offset);
+        {
+            StageTimer timer{timings, SenderStage::Encode};
+            EncodeChunk(header, image + offset, payload_words, message);
+        }
+        if (pacer) {
+            std::this_thread::sleep_until(pacer->ReadyAt(std::chrono::steady_clock::now()));
+            pacer->Consume(std::chrono::steady_clock::now());
+        }
+        if (capture) {
+            capture->Record(std::chrono::steady_clock::now(), 0, message.data(), message.size() * sizeof(std::uint16_t));
+        }
+        {
+            StageTimer timer{timings, SenderStage::Socket};
+            socket.send_to(boost::asio::buffer(message), endpoint);
+        }
+
+        stats.datagrams++;
+        stats.chunks++;
+        stats.words += payload_words;
+    }
+
+    stats.elapsed = std::chrono::steady_clock::now() - start;
+    return stats;
+}
+
+void PrintUploadStats(const UploadStats& stats) {
+    const double seconds = std::chrono::duration<double>(stats.elapsed).count();
+    const double bytes = static_cast<double>(stats.words * sizeof(std::uint16_t));
+    std::printf("Uploaded %zu words in %zu datagrams in %.3f ms", stats.words, stats.datagrams, seconds * 1000.0);
+    if (seconds > 0) {
+        std::printf(" (%.2f MB/s, %.0f datagrams/s)", bytes / seconds / 1e6, stats.datagrams / seconds);
+    }
+    std::printf("\n");
+    if (stats.chunks_skipped != 0) {
+        std::printf("Delta upload: sent %zu of %zu chunks, the rest were unchanged.\n",
+                    stats.chunks - stats.chunks_skipped, stats.chunks);
+    }
+    if (stats.rate > 0) {
+        std::printf("Paced at %.0f datagrams/s at the end, %.0f at most.\n", stats.rate, stats.peak_rate);
+    }
+    if (stats.retransmissions != 0) {
+        std::printf("%zu datagrams were retransmissions (%.1f%%): %zu fast, %zu after a timeout.\n",
+                    stats.retransmissions, 100.0 * stats.retransmissions / stats.datagrams, stats.fast_retransmissions,
+                    stats.timeouts);
+    }
+    if (!stats.complete) {
+        std::printf("Upload did not complete: receiver stopped acknowledging.\n");
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/asio.hpp>
+
+#include "capture_log.h"
+#include "stage_timing.h"
+
+struct UploadStats {
+    // Payload words actually sent; for a delta upload only those of the changed chunks.
+    size_t words = 0;
+    size_t chunks = 0;
+    // Chunks a delta upload left out because the receiver already had them.
+    size_t chunks_skipped = 0;
+    size_t datagrams = 0;
+    size_t retransmissions = 0;
+    size_t fast_retransmissions = 0;
+    size_t timeouts = 0;
+    // Pacing rate at the end of the upload and the highest it reached, in datagrams per
+    // second; zero if unpaced.
+    double rate = 0;
+    double peak_rate = 0;
+    bool complete = true;
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+// Splits the image into MTU-sized chunk messages and sends them back to back, or at most
+// `rate` datagrams per second if non-zero. `chunk_flags` are set on every chunk. Every datagram
+// is recorded to `capture` if given, and encoding and sending are timed into `timings`.
+UploadStats StreamImage(boost::asio::ip::udp::socket& socket, const boost::asio::ip::udp::endpoint& endpoint,
+                        const std::uint16_t* image, size_t word_count, double rate = 0, std::uint16_t chunk_flags = 0,
+                        CaptureWriter* capture = nullptr, StageTimings* timings = nullptr);
+
+void PrintUploadStats(const UploadStats& stats);
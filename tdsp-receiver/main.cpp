@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include "dsp_receiver.h"
+#include "receiver_service.h"
+#include "sha256.h"
+
+using boost::asio::ip::udp;
+
+struct Options {
+    double loss_rate = 0.0;
+    std::string bind_address = "0.0.0.0";
+    unsigned short port = 0;
+};
+
+static std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options options;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            options.loss_rate = std::strtod(argv[++i], nullptr) / 100.0;
+        } else if (std::strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            options.bind_address = argv[++i];
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (argc - i != 1)
+        return std::nullopt;
+    options.port = static_cast<unsigned short>(std::strtoul(argv[i], nullptr, 10));
+    return options;
+}
+
+static void PrintSummary(const DspReceiver& receiver, size_t dropped) {
+    printf("%zu packets (%zu invalid, %zu dropped by --loss), %zu instructions, %zu payload words\n",
+           receiver.PacketCount(), receiver.InvalidCount(), dropped, receiver.InstructionCount(), receiver.PayloadWordCount());
+
+    if (receiver.PacketCount() >= 2) {
+        const double seconds = std::chrono::duration<double>(receiver.LastArrival() - receiver.FirstArrival()).count();
+        if (seconds > 0) {
+            printf("First to last packet: %.3f ms, %.0f packets/s, %.0f words/s\n",
+                   seconds * 1000.0, (receiver.PacketCount() - 1) / seconds, receiver.PayloadWordCount() / seconds);
+        }
+    }
+
+    const WindowedReceiver& upload = receiver.Upload();
+    if (upload.Started()) {
+        printf("Upload of %zu words %s", upload.Image().size(), upload.Complete() ? "complete" : "incomplete");
+        if (upload.Complete()) {
+            printf(", sha256 ");
+            for (unsigned char byte : Sha256(upload.Image())) {
+                printf("%02x", byte);
+            }
+            if (auto verified = upload.Verified()) {
+                printf(", %s the manifest", *verified ? "matches" : "DOES NOT match");
+            }
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto options = ParseOptions(argc, argv);
+    if (!options) {
+        printf("Usage: program [--loss <percent>] [--bind <address>] <port>\n");
+        printf("Receives 0xD590-family messages like the DSP stub would, acknowledges reliable uploads\n");
+        printf("and prints statistics once a second and on exit.\n");
+        return 1;
+    }
+
+    ReceiverService receiver{udp::endpoint(boost::asio::ip::address::from_string(options->bind_address), options->port),
+                             options->loss_rate};
+    printf("Listening on %s:%u\n", receiver.Endpoint().address().to_string().c_str(), receiver.Endpoint().port());
+
+    boost::asio::io_service io_service;
+    boost::asio::signal_set signals{io_service, SIGINT, SIGTERM};
+    boost::asio::steady_timer timer{io_service};
+
+    size_t last_packets = 0;
+    std::function<void()> tick = [&] {
+        timer.expires_from_now(std::chrono::seconds{1});
+        timer.async_wait([&](const boost::system::error_code& ec) {
+            if (ec)
+                return;
+            const auto counters = receiver.GetCounters();
+            if (counters.packets != last_packets) {
+                printf("%zu packets/s, %zu packets total, %zu invalid\n",
+                       counters.packets - last_packets, counters.packets, counters.invalid);
+                last_packets = counters.packets;
+            }
+            tick();
+        });
+    };
+    tick();
+
+    signals.async_wait([&](const boost::system::error_code&, int) {
+        timer.cancel();
+    });
+
+    io_service.run();
+
+    PrintSummary(receiver.Snapshot(), receiver.GetCounters().dropped);
+    return 0;
+}
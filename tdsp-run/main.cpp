@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "assembler.h"
+#include "emu_batch.h"
+
+struct Options {
+    std::string manifest;
+    std::string output;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::uint64_t cycles = 1000000;
+    DispatchMode mode = DispatchMode::Jit;
+    std::string profile;
+    std::uint64_t period = 100;
+};
+
+static void PrintUsage() {
+    printf("Usage: tdsp-run [options] <manifest>\n");
+    printf("  Runs every job of the manifest from reset, one line each:\n");
+    printf("    <name> <program> [cycles=<n>] [in=<address>:<file>]... [out=<address>:<words>]\n");
+    printf("  Programs are assembly source, or raw little-endian words if named *.bin; inputs are\n");
+    printf("  raw words copied to data memory. Paths are relative to the manifest, and lines\n");
+    printf("  starting with # are skipped.\n");
+    printf("  --output <file>     write the results of all jobs to a columnar file\n");
+    printf("  --threads <n>       workers to run jobs on (default: one per core)\n");
+    printf("  --cycles <n>        cycle limit of jobs that set none (default 1000000)\n");
+    printf("  --mode <mode>       switch, block or jit (default jit)\n");
+    printf("  --profile <prefix>  sample every job, writing folded stacks for flamegraph.pl to\n");
+    printf("                      <prefix>.folded and per-instruction counts to <prefix>.lines\n");
+    printf("  --period <n>        cycles between samples (default 100)\n");
+    printf("\n");
+}
+
+static std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options options;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            options.cycles = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            options.profile = argv[++i];
+        } else if (std::strcmp(argv[i], "--period") == 0 && i + 1 < argc) {
+            options.period = std::max<std::uint64_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if (mode == "switch") {
+                options.mode = DispatchMode::Switch;
+            } else if (mode == "block") {
+                options.mode = DispatchMode::Block;
+            } else if (mode == "jit") {
+                options.mode = DispatchMode::Jit;
+            } else {
+                return std::nullopt;
+            }
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (i + 1 != argc)
+        return std::nullopt;
+    options.manifest = argv[i];
+    return options;
+}
+
+static std::optional<std::vector<unsigned char>> ReadFile(const std::filesystem::path& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+        return std::nullopt;
+    return std::vector<unsigned char>{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static std::optional<std::vector<std::uint16_t>> ReadWords(const std::filesystem::path& path) {
+    const auto bytes = ReadFile(path);
+    if (!bytes)
+        return std::nullopt;
+    std::vector<std::uint16_t> words(bytes->size() / 2);
+    for (size_t i = 0; i < words.size(); i++) {
+        words[i] = static_cast<std::uint16_t>((*bytes)[2 * i] | (*bytes)[2 * i + 1] << 8);
+    }
+    return words;
+}
+
+using SharedWords = std::shared_ptr<const std::vector<std::uint16_t>>;
+using SharedSymbols = std::shared_ptr<const std::vector<AsmSymbol>>;
+
+// Loads every program and input once, however many jobs name it.
+class FileCache {
+public:
+    SharedWords Program(const std::filesystem::path& path) {
+        SharedWords& words = programs[path.string()];
+        if (words)
+            return words;
+        if (path.extension() == ".bin") {
+            words = Input(path);
+            return words;
+        }
+
+        std::ifstream source{path};
+        if (!source) {
+            printf("Could not read %s.\n", path.string().c_str());
+            return nullptr;
+        }
+        if (table.empty()) {
+            table = BuildParserTable();
+        }
+        AssembledProgram program = AssembleProgram(table, source);
+        for (const AssemblyError& error : program.errors) {
+            printf("%s:%zu: %s\n", path.string().c_str(), error.line, error.message.c_str());
+        }
+        if (!program.errors.empty())
+            return nullptr;
+        words = std::make_shared<const std::vector<std::uint16_t>>(std::move(program.words));
+        symbols[path.string()] = std::make_shared<const std::vector<AsmSymbol>>(std::move(program.symbols));
+        return words;
+    }
+
+    // The labels of a program Program assembled; nullptr for raw words.
+    SharedSymbols Symbols(const std::filesystem::path& path) const {
+        const auto found = symbols.find(path.string());
+        return found == symbols.end() ? nullptr : found->second;
+    }
+
+    SharedWords Input(const std::filesystem::path& path) {
+        SharedWords& words = inputs[path.string()];
+        if (!words) {
+            auto loaded = ReadWords(path);
+            if (!loaded) {
+                printf("Could not read %s.\n", path.string().c_str());
+                return nullptr;
+            }
+            words = std::make_shared<const std::vector<std::uint16_t>>(std::move(*loaded));
+        }
+        return words;
+    }
+
+private:
+    std::vector<InstructionParser> table;
+    std::map<std::string, SharedWords> programs;
+    std::map<std::string, SharedWords> inputs;
+    std::map<std::string, SharedSymbols> symbols;
+};
+
+// "<address>:<rest>", with the address in any base strtoul takes.
+static std::optional<std::pair<std::uint16_t, std::string>> SplitAddress(const std::string& value) {
+    const size_t colon = value.find(':');
+    if (colon == std::string::npos || colon == 0)
+        return std::nullopt;
+    char* end = nullptr;
+    const unsigned long address = std::strtoul(value.c_str(), &end, 0);
+    if (end != value.c_str() + colon || address > 0xFFFF)
+        return std::nullopt;
+    return std::pair{static_cast<std::uint16_t>(address), value.substr(colon + 1)};
+}
+
+static std::optional<std::vector<BatchJob>> LoadManifest(const Options& options) {
+    std::ifstream manifest{options.manifest};
+    if (!manifest) {
+        printf("Could not read %s.\n", options.manifest.c_str());
+        return std::nullopt;
+    }
+    const std::filesystem::path directory = std::filesystem::path{options.manifest}.parent_path();
+
+    FileCache files;
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (size_t line_number = 1; std::getline(manifest, line); line_number++) {
+        std::istringstream fields{line};
+        std::string name;
+        std::string program;
+        if (!(fields >> name) || name[0] == '#')
+            continue;
+        const auto fail = [&](const char* message) {
+            printf("%s:%zu: %s\n", options.manifest.c_str(), line_number, message);
+            return std::nullopt;
+        };
+        if (!(fields >> program))
+            return fail("expected a program after the job name");
+
+        BatchJob job;
+        job.name = name;
+        job.max_cycles = options.cycles;
+        job.program = files.Program(directory / program);
+        if (!job.program)
+            return std::nullopt;
+        if (!options.profile.empty()) {
+            job.profile_period = options.period;
+            job.symbols = files.Symbols(directory / program);
+        }
+        for (std::string field; fields >> field;) {
+            if (field.rfind("cycles=", 0) == 0) {
+                job.max_cycles = std::strtoull(field.c_str() + 7, nullptr, 0);
+            } else if (field.rfind("in=", 0) == 0) {
+                const auto input = SplitAddress(field.substr(3));
+                if (!input)
+                    return fail("expected in=<address>:<file>");
+                BatchInput batch_input{input->first, files.Input(directory / input->second)};
+                if (!batch_input.words)
+                    return std::nullopt;
+                job.inputs.push_back(std::move(batch_input));
+            } else if (field.rfind("out=", 0) == 0) {
+                const auto output = SplitAddress(field.substr(4));
+                if (!output)
+                    return fail("expected out=<address>:<words>");
+                job.output_address = output->first;
+                const unsigned long words = std::strtoul(output->second.c_str(), nullptr, 0);
+                job.output_words = static_cast<std::uint16_t>(std::min(0xFFFFul, words));
+            } else {
+                return fail("unknown field");
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+// Each job's stacks under a root frame named after it, and its instructions, a line each:
+// <job> <pc> <symbol> <hits> <cycles>.
+static bool WriteProfiles(const std::string& prefix, const std::vector<BatchResult>& results) {
+    std::ofstream folded{prefix + ".folded", std::ios::trunc};
+    std::ofstream lines{prefix + ".lines", std::ios::trunc};
+    for (const BatchResult& result : results) {
+        std::istringstream stacks{result.folded_stacks};
+        for (std::string stack; std::getline(stacks, stack);) {
+            folded << result.name << ';' << stack << '\n';
+        }
+        for (const InstructionProfile& instruction : result.profile) {
+            char pc[16];
+            std::snprintf(pc, sizeof(pc), "0x%05x", instruction.pc);
+            lines << result.name << ' ' << pc << ' ' << instruction.symbol << ' ' << instruction.hits << ' '
+                  << instruction.cycles << '\n';
+        }
+    }
+    if (!folded || !lines) {
+        printf("Could not write the profile to %s.*.\n", prefix.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const auto options = ParseOptions(argc, argv);
+    if (!options) {
+        PrintUsage();
+        return 1;
+    }
+    const auto jobs = LoadManifest(*options);
+    if (!jobs)
+        return 1;
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<BatchResult> results = RunBatch(*jobs, options->threads, options->mode);
+    const double seconds = std::max(1e-9, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::uint64_t cycles = 0;
+    size_t unfinished = 0;
+    for (const BatchResult& result : results) {
+        cycles += result.cycles;
+        // Jobs end with a trap or by running off their program.
+        if (result.reason != StopReason::Trap && result.reason != StopReason::EndOfProgram) {
+            printf("%s: %s at 0x%05x\n", result.name.c_str(), StopReasonName(result.reason), result.pc);
+            unfinished++;
+        }
+    }
+    printf("%zu jobs on %zu threads: %llu cycles in %.3f s (%.1f M/s), %zu did not finish\n",
+           results.size(), std::min(options->threads, std::max<size_t>(1, results.size())),
+           static_cast<unsigned long long>(cycles), seconds, cycles / seconds / 1e6, unfinished);
+
+    if (!options->output.empty()) {
+        const std::vector<unsigned char> bytes = EncodeBatchResults(results);
+        std::ofstream file{options->output, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!file) {
+            printf("Could not write %s.\n", options->output.c_str());
+            return 1;
+        }
+    }
+    if (!options->profile.empty() && !WriteProfiles(options->profile, results))
+        return 1;
+    return unfinished ? 2 : 0;
+}
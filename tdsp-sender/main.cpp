@@ -1,34 +1,420 @@
+#include <algorithm>
 #include <cassert>
+#include <csignal>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
 #include <variant>
+#include <vector>
 
 #include <boost/asio.hpp>
 
 #include "asm_lexer.h"
 #include "asm_parse.h"
+#include "assembler.h"
+#include "capture_log.h"
+#include "delta_upload.h"
+#include "dsp_protocol.h"
 #include "instruction_table_lexer.h"
+#include "mapped_file.h"
+#include "pacing.h"
+#include "receiver_service.h"
+#include "reliable_upload.h"
+#include "replay.h"
+#include "sample_image.h"
+#include "send_pipeline.h"
+#include "stage_timing.h"
+#include "upload.h"
+#include "word_lz.h"
 
 using boost::asio::ip::udp;
 
-int main(int argc, char** argv) {
-    if (argc != 3) {
-        printf("Usage: program <host> <port>");
+struct Options {
+    bool batch = false;
+    std::chrono::milliseconds flush_interval{20};
+    std::string upload_image;
+    std::string upload_source;
+    bool reliable = false;
+    bool delta = false;
+    bool compress = false;
+    std::string cache_dir;
+    std::string record_path;
+    std::string replay_path;
+    bool replay_fast = false;
+    bool timings = false;
+    // ParseOptions sets progress lines to once a second.
+    ReliableUploadOptions transfer;
+    std::optional<double> selftest_loss;
+    size_t selftest_words = 1 << 20;
+    size_t selftest_targets = 1;
+    double selftest_capacity = 0;
+    // Host and port of each device.
+    std::vector<std::pair<std::string, std::string>> targets;
+};
+
+static std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options options;
+    options.transfer.stats_interval = std::chrono::seconds{1};
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            options.batch = true;
+        } else if (std::strcmp(argv[i], "--flush-ms") == 0 && i + 1 < argc) {
+            options.flush_interval = std::chrono::milliseconds{std::strtol(argv[++i], nullptr, 10)};
+        } else if (std::strcmp(argv[i], "--upload") == 0 && i + 1 < argc) {
+            options.upload_image = argv[++i];
+        } else if (std::strcmp(argv[i], "--upload-source") == 0 && i + 1 < argc) {
+            options.upload_source = argv[++i];
+        } else if (std::strcmp(argv[i], "--reliable") == 0) {
+            options.reliable = true;
+        } else if (std::strcmp(argv[i], "--delta") == 0) {
+            options.delta = true;
+            options.reliable = true;
+        } else if (std::strcmp(argv[i], "--compress") == 0) {
+            options.compress = true;
+        } else if (std::strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            options.transfer.window_size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            options.transfer.rate = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+            options.transfer.burst = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--adaptive") == 0) {
+            options.transfer.adaptive = true;
+            options.reliable = true;
+        } else if (std::strcmp(argv[i], "--stats-ms") == 0 && i + 1 < argc) {
+            options.transfer.stats_interval = std::chrono::milliseconds{std::strtol(argv[++i], nullptr, 10)};
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            options.record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options.replay_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay-fast") == 0) {
+            options.replay_fast = true;
+        } else if (std::strcmp(argv[i], "--timings") == 0) {
+            options.timings = true;
+        } else if (std::strcmp(argv[i], "--selftest-loss") == 0 && i + 1 < argc) {
+            options.selftest_loss = std::strtod(argv[++i], nullptr) / 100.0;
+        } else if (std::strcmp(argv[i], "--selftest-words") == 0 && i + 1 < argc) {
+            options.selftest_words = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--selftest-targets") == 0 && i + 1 < argc) {
+            options.selftest_targets = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--selftest-capacity") == 0 && i + 1 < argc) {
+            options.selftest_capacity = std::strtod(argv[++i], nullptr);
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (!options.upload_image.empty() && !options.upload_source.empty())
+        return std::nullopt;
+    if (options.delta && options.compress)
+        return std::nullopt;
+    if (!options.replay_path.empty() &&
+        (!options.record_path.empty() || !options.upload_image.empty() || !options.upload_source.empty()))
+        return std::nullopt;
+    if (options.cache_dir.empty()) {
+        if (const char* cache_home = std::getenv("XDG_CACHE_HOME")) {
+            options.cache_dir = std::string{cache_home} + "/tdsp-sender";
+        } else if (const char* home = std::getenv("HOME")) {
+            options.cache_dir = std::string{home} + "/.cache/tdsp-sender";
+        } else {
+            options.cache_dir = ".tdsp-sender-cache";
+        }
+    }
+    if (options.selftest_loss && argc - i == 0)
+        return options;
+    if (argc - i == 0 || (argc - i) % 2 != 0)
+        return std::nullopt;
+    for (; i < argc; i += 2) {
+        options.targets.emplace_back(argv[i], argv[i + 1]);
+    }
+    return options;
+}
+
+static void PrintUsage() {
+    printf("Usage: program [options] <host> <port> [<host> <port>...]\n");
+    printf("  Several targets are only supported for uploads, which are then reliable and\n");
+    printf("  run concurrently.\n");
+    printf("  --batch                 pack several instructions into each datagram; a blank\n");
+    printf("                          line or .flush sends the pending batch immediately\n");
+    printf("  --flush-ms <ms>         send a pending batch after this long (default 20)\n");
+    printf("  --upload <image>        stream a raw image of little-endian 16-bit words\n");
+    printf("  --upload-source <file>  assemble a source file and stream the result\n");
+    printf("  --reliable              upload with acknowledgements and retransmission\n");
+    printf("  --window <chunks>       chunks in flight for --reliable (default 64)\n");
+    printf("  --rate <datagrams/s>    pace datagrams to each target; for --adaptive, the\n");
+    printf("                          starting rate (default %.0f)\n", default_adaptive_start_rate);
+    printf("  --burst <datagrams>     datagrams sent back to back when paced (default 16)\n");
+    printf("  --adaptive              upload reliably, finding the highest rate each target\n");
+    printf("                          sustains from acks and losses\n");
+    printf("  --stats-ms <ms>         print progress, rate and loss during reliable uploads\n");
+    printf("                          this often; 0 disables (default 1000)\n");
+    printf("  --delta                 upload reliably, sending only the chunks that changed\n");
+    printf("                          since the last upload to the same endpoint\n");
+    printf("  --cache-dir <dir>       where --delta remembers past uploads\n");
+    printf("                          (default $XDG_CACHE_HOME/tdsp-sender)\n");
+    printf("  --compress              LZ-compress the image before uploading; not with --delta\n");
+    printf("  --record <file>         log every datagram sent, with its time, to a file\n");
+    printf("  --replay <file>         resend a --record log with its original timing; the\n");
+    printf("                          n-th target of the log goes to the n-th given target\n");
+    printf("  --replay-fast           with --replay, send as fast as possible instead\n");
+    printf("  --timings               time lexing, table lookup, queueing, encoding and sending,\n");
+    printf("                          and print percentiles of each on exit and on SIGUSR1;\n");
+    printf("                          interactively, lexing includes waiting for input\n");
+    printf("\n");
+    printf("       program --selftest-loss <percent> [--selftest-words <n>] [--selftest-targets <n>]\n");
+    printf("               [--selftest-capacity <datagrams/s>] [upload options]\n");
+    printf("  Uploads reliably to local receiver stand-ins that drop datagrams, and also any beyond\n");
+    printf("  their capacity if given, and reports goodput.\n");
+    printf("  With --delta, then edits the image and uploads it again as a delta. With --compress,\n");
+    printf("  the generated image is shaped like a program rather than incompressible.\n");
+}
+
+static bool IsFlushDirective(const TokenList& line) {
+    if (line.size() != 1)
+        return false;
+    if (auto meta = std::get_if<AsmToken::MetaStatement>(&line.front()))
+        return meta->value == "flush";
+    return false;
+}
+
+struct Image {
+    std::unique_ptr<MappedFile> file;
+    std::vector<std::uint16_t> words;
+
+    const std::uint16_t* Data() const { return file ? reinterpret_cast<const std::uint16_t*>(file->Data()) : words.data(); }
+    size_t Size() const { return file ? file->Size() / sizeof(std::uint16_t) : words.size(); }
+};
+
+static std::optional<Image> LoadImage(const Options& options) {
+    Image image;
+
+    if (!options.upload_image.empty()) {
+        image.file = MappedFile::Open(options.upload_image);
+        if (!image.file) {
+            printf("Could not open %s.\n", options.upload_image.c_str());
+            return std::nullopt;
+        }
+        if (image.file->Size() % sizeof(std::uint16_t) != 0) {
+            printf("%s is not a whole number of 16-bit words.\n", options.upload_image.c_str());
+            return std::nullopt;
+        }
+        if (image.Size() > max_image_words) {
+            printf("%s is larger than the %zu words a receiver accepts.\n", options.upload_image.c_str(), max_image_words);
+            return std::nullopt;
+        }
+        return image;
+    }
+
+    std::ifstream source{options.upload_source};
+    if (!source) {
+        printf("Could not open %s.\n", options.upload_source.c_str());
+        return std::nullopt;
+    }
+
+    auto program = AssembleProgram(BuildParserTable(), source, options.transfer.timings);
+    for (const AssemblyError& error : program.errors) {
+        printf("%s:%zu: %s\n", options.upload_source.c_str(), error.line, error.message.c_str());
+    }
+    if (!program.errors.empty())
+        return std::nullopt;
+    if (program.words.size() > max_image_words) {
+        printf("%s assembles to more than the %zu words a receiver accepts.\n", options.upload_source.c_str(), max_image_words);
+        return std::nullopt;
+    }
+
+    image.words = std::move(program.words);
+    return image;
+}
+
+// The LzCompress stream of the image, if it is smaller.
+static std::optional<std::vector<std::uint16_t>> CompressImage(const Image& image) {
+    const auto start = std::chrono::steady_clock::now();
+    auto stream = LzCompress(image.Data(), image.Size());
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (stream.size() >= image.Size()) {
+        printf("Compression does not shrink the image; uploading it uncompressed.\n");
+        return std::nullopt;
+    }
+    printf("Compressed %zu words to %zu (%.1f%%) in %.3f ms.\n",
+           image.Size(), stream.size(), 100.0 * stream.size() / std::max<size_t>(1, image.Size()), ms);
+    return stream;
+}
+
+static std::string UploadRecordPath(const Options& options, const udp::endpoint& endpoint) {
+    return options.cache_dir + "/" + endpoint.address().to_string() + "_" + std::to_string(endpoint.port());
+}
+
+// Uploads to every endpoint at once. With --delta, each target gets a manifest that, if it was
+// uploaded to before, lists only the changed chunks, and the image is remembered for each
+// target that completed.
+static std::vector<UploadStats> UploadToAll(const Options& options, boost::asio::io_service& io_service,
+                                            udp::socket& socket, const std::vector<udp::endpoint>& endpoints,
+                                            const Image& image) {
+    std::optional<UploadRecord> record;
+    std::vector<UploadTarget> targets;
+    for (const udp::endpoint& endpoint : endpoints) {
+        UploadTarget target{endpoint, std::nullopt};
+        if (options.delta) {
+            if (!record) {
+                record = MakeUploadRecord(image.Data(), image.Size());
+            }
+            target.manifest = PlanUpload(*record, LoadUploadRecord(UploadRecordPath(options, endpoint)));
+        }
+        targets.push_back(std::move(target));
+    }
+
+    std::optional<std::vector<std::uint16_t>> stream;
+    ReliableUploadOptions transfer = options.transfer;
+    if (options.compress && (stream = CompressImage(image))) {
+        transfer.chunk_flags |= chunk_flag_compressed;
+    }
+
+    const std::uint16_t* words = stream ? stream->data() : image.Data();
+    const size_t word_count = stream ? stream->size() : image.Size();
+    const auto stats = ReliableUpload(io_service, socket, targets, words, word_count, transfer);
+
+    for (size_t i = 0; i < endpoints.size() && record; i++) {
+        if (!stats[i].complete)
+            continue;
+        const std::string path = UploadRecordPath(options, endpoints[i]);
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path{path}.parent_path(), ec);
+        if (!SaveUploadRecord(path, *record)) {
+            printf("Could not save %s; the next upload will not be a delta.\n", path.c_str());
+        }
+    }
+    return stats;
+}
+
+// Prints the stats of each target, then a summary if there are several. Returns whether every
+// upload completed.
+static bool PrintAllUploadStats(const std::vector<udp::endpoint>& endpoints, const std::vector<UploadStats>& stats) {
+    if (stats.size() == 1) {
+        PrintUploadStats(stats.front());
+        return stats.front().complete;
+    }
+
+    size_t complete = 0;
+    std::chrono::steady_clock::duration elapsed{};
+    for (size_t i = 0; i < stats.size(); i++) {
+        printf("%s:%u: ", endpoints[i].address().to_string().c_str(), endpoints[i].port());
+        PrintUploadStats(stats[i]);
+        complete += stats[i].complete;
+        elapsed = std::max(elapsed, stats[i].elapsed);
+    }
+    printf("%zu of %zu targets complete in %.3f ms.\n",
+           complete, stats.size(), std::chrono::duration<double, std::milli>(elapsed).count());
+    return complete == stats.size();
+}
+
+static int RunUpload(const Options& options, boost::asio::io_service& io_service, udp::socket& socket,
+                     const std::vector<udp::endpoint>& endpoints) {
+    const auto image = LoadImage(options);
+    if (!image)
+        return 1;
+
+    if (!options.reliable && endpoints.size() == 1) {
+        const auto stream = options.compress ? CompressImage(*image) : std::nullopt;
+        const std::uint16_t* words = stream ? stream->data() : image->Data();
+        const size_t word_count = stream ? stream->size() : image->Size();
+        const std::uint16_t flags = stream ? chunk_flag_compressed : 0;
+        const auto stats = StreamImage(socket, endpoints.front(), words, word_count, options.transfer.rate, flags,
+                                       options.transfer.capture, options.transfer.timings);
+        PrintUploadStats(stats);
+        return stats.complete ? 0 : 1;
+    }
+
+    const auto stats = UploadToAll(options, io_service, socket, endpoints, *image);
+    return PrintAllUploadStats(endpoints, stats) ? 0 : 1;
+}
+
+static int RunReplay(const Options& options, udp::socket& socket, const std::vector<udp::endpoint>& endpoints) {
+    const auto log = LoadCaptureLog(options.replay_path);
+    if (!log) {
+        printf("Could not read capture log %s.\n", options.replay_path.c_str());
+        return 1;
+    }
+    if (log->target_count > endpoints.size()) {
+        printf("The log has %u targets but %zu were given; some will receive several.\n", log->target_count, endpoints.size());
+    }
+    const auto stats = Replay(socket, *log, endpoints, options.replay_fast);
+    PrintReplayStats(stats);
+    return stats.errors == 0 ? 0 : 1;
+}
+
+static int RunSelfTest(const Options& options) {
+    std::optional<Image> image;
+    if (!options.upload_image.empty() || !options.upload_source.empty()) {
+        image = LoadImage(options);
+        if (!image)
+            return 1;
+    } else if (options.selftest_words > max_image_words) {
+        printf("--selftest-words is larger than the %zu words a receiver accepts.\n", max_image_words);
+        return 1;
+    } else {
+        image.emplace();
+        image->words = options.compress ? MakeProgramImage(options.selftest_words) : MakeNoiseImage(options.selftest_words);
+    }
+
+    std::vector<std::unique_ptr<ReceiverService>> receivers;
+    std::vector<udp::endpoint> endpoints;
+    for (size_t i = 0; i < options.selftest_targets; i++) {
+        receivers.push_back(std::make_unique<ReceiverService>(udp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+                                                              *options.selftest_loss, static_cast<unsigned>(i + 1),
+                                                              false, options.selftest_capacity));
+        endpoints.push_back(receivers.back()->Endpoint());
     }
 
     boost::asio::io_service io_service;
     udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
 
-    udp::endpoint endpoint = [&] {
-        const std::string host = argv[1];
-        const std::string port = argv[2];
+    // With --delta, a stand-in's port is new every run, but a stale record from a previous run
+    // would only make the receiver reject the delta.
+    const auto upload = [&](const Image& image) {
+        bool ok = PrintAllUploadStats(endpoints, UploadToAll(options, io_service, socket, endpoints, image));
+        for (const auto& receiver : receivers) {
+            const auto received = receiver->WaitForImage(std::chrono::seconds{1});
+            const bool match = received && std::equal(received->begin(), received->end(), image.Data(),
+                                                      image.Data() + image.Size());
+            const auto counters = receiver->GetCounters();
+            printf("Loss %.1f%%: receiver dropped %zu datagrams and %zu overruns, image %s.\n",
+                   *options.selftest_loss * 100.0, counters.dropped, counters.overruns, match ? "intact" : "CORRUPT");
+            ok = ok && match;
+        }
+        return ok;
+    };
 
-        udp::resolver resolver(io_service);
-        udp::resolver::query query(udp::v4(), host, port);
-        udp::resolver::iterator iter = resolver.resolve(query);
-        return *iter;
-    }();
+    if (!upload(*image))
+        return 1;
+    if (!options.delta)
+        return 0;
+
+    // Edit a few words in the middle and append some, as after a small change to a program.
+    Image edited;
+    edited.words.assign(image->Data(), image->Data() + image->Size());
+    for (size_t i = edited.words.size() / 2; i < edited.words.size() / 2 + 16 && i < edited.words.size(); i++) {
+        edited.words[i] ^= 0xFFFF;
+    }
+    edited.words.insert(edited.words.end(), 100, 0x1234);
+    return upload(edited) ? 0 : 1;
+}
+
+static int RunInteractive(const Options& options, boost::asio::io_service& io_service, udp::socket& socket,
+                          const udp::endpoint& endpoint) {
+    SendPipeline pipeline{io_service, socket, endpoint, options.batch, options.flush_interval, 8, options.transfer.rate,
+                          options.transfer.capture, options.transfer.timings};
 
     auto table = BuildParserTable();
 
@@ -36,49 +422,155 @@ int main(int argc, char** argv) {
 
     while (true) {
         printf("> ");
-        auto line = GetLine(lexer);
+        std::optional<TokenList> line;
+        {
+            StageTimer timer{options.transfer.timings, SenderStage::Lex};
+            line = GetLine(lexer);
+        }
 
         if (!line) {
             printf("Error during lex.\n\n");
 
+            bool end_of_file = false;
             while (true) {
                 auto token = lexer.NextToken();
-                if (std::holds_alternative<AsmToken::EndOfFile>(token))
-                    return 0;
+                if (std::holds_alternative<AsmToken::EndOfFile>(token)) {
+                    end_of_file = true;
+                    break;
+                }
                 if (std::holds_alternative<AsmToken::EndOfLine>(token))
                     break;
             }
 
+            if (end_of_file)
+                break;
             continue;
         }
 
         if (line->empty() && std::holds_alternative<AsmToken::EndOfFile>(lexer.PeekToken())) {
-            return 0;
+            break;
         }
 
-        bool parse_success = false;
-        for (auto& parser : table) {
-            if (auto result = parser.TryParse(*line)) {
-                parse_success = true;
+        if (line->empty() || IsFlushDirective(*line)) {
+            pipeline.Flush();
+            continue;
+        }
 
-                printf("\nHex:\n");
-                for (std::uint16_t v : *result) {
-                    printf("%04x\n", v);
-                }
-                printf("\n");
+        std::optional<std::vector<std::uint16_t>> result;
+        {
+            StageTimer timer{options.transfer.timings, SenderStage::Lookup};
+            result = AssembleLine(table, *line);
+        }
+        if (result) {
+            printf("\nHex:\n");
+            for (std::uint16_t v : *result) {
+                printf("%04x\n", v);
+            }
+            printf("\n");
 
-                std::vector<std::uint16_t> message = *result;
-                message.insert(message.begin(), 0xD590);
+            pipeline.Send(std::move(*result));
+        } else {
+            printf("Failed to parse previous input.\n\n");
+        }
+    }
 
-                socket.send_to(boost::asio::buffer(message), endpoint);
+    pipeline.Finish();
+    if (options.batch) {
+        printf("Sent %zu instructions in %zu datagrams.\n", pipeline.InstructionsSent(), pipeline.DatagramsSent());
+    }
 
-                break;
-            }
+    return 0;
+}
+
+// Runs the mode the options select.
+static int Run(const Options& options) {
+    if (options.selftest_loss) {
+        return RunSelfTest(options);
+    }
+
+    boost::asio::io_service io_service;
+    udp::socket socket(io_service, udp::endpoint(udp::v4(), 0));
+
+    std::vector<udp::endpoint> endpoints;
+    udp::resolver resolver(io_service);
+    for (const auto& [host, port] : options.targets) {
+        udp::resolver::query query(udp::v4(), host, port);
+        udp::resolver::iterator iter = resolver.resolve(query);
+        if (std::find(endpoints.begin(), endpoints.end(), *iter) == endpoints.end()) {
+            endpoints.push_back(*iter);
         }
-        if (!parse_success) {
-            printf("Failed to parse previous input.\n\n");
+    }
+
+    if (!options.replay_path.empty()) {
+        return RunReplay(options, socket, endpoints);
+    }
+
+    if (!options.upload_image.empty() || !options.upload_source.empty()) {
+        return RunUpload(options, io_service, socket, endpoints);
+    }
+
+    if (endpoints.size() != 1) {
+        PrintUsage();
+        return 1;
+    }
+    return RunInteractive(options, io_service, socket, endpoints.front());
+}
+
+int main(int argc, char** argv) {
+    auto options = ParseOptions(argc, argv);
+    if (!options) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::unique_ptr<CaptureWriter> capture;
+    if (!options->record_path.empty()) {
+        capture = CaptureWriter::Create(options->record_path);
+        if (!capture) {
+            printf("Could not create %s.\n", options->record_path.c_str());
+            return 1;
         }
+        options->transfer.capture = capture.get();
     }
 
-    return 0;
+    // SIGUSR1 is waited for on a thread of its own, so that it is answered in every mode,
+    // including while blocked reading stdin.
+    StageTimings timings;
+    boost::asio::io_service signal_service;
+    boost::asio::signal_set signals{signal_service};
+    std::function<void()> wait_for_signal;
+    std::thread signal_thread;
+    if (options->timings) {
+        options->transfer.timings = &timings;
+#if defined(SIGUSR1)
+        signals.add(SIGUSR1);
+        wait_for_signal = [&] {
+            signals.async_wait([&](const boost::system::error_code& ec, int) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                timings.Print();
+                wait_for_signal();
+            });
+        };
+        wait_for_signal();
+        signal_thread = std::thread([&] { signal_service.run(); });
+#endif
+    }
+
+    const int result = Run(*options);
+    if (signal_thread.joinable()) {
+        signals.cancel();
+        signal_thread.join();
+    }
+    if (options->timings) {
+        timings.Print();
+    }
+    if (capture) {
+        if (!capture->Flush()) {
+            printf("Could not write %s.\n", options->record_path.c_str());
+            return 1;
+        }
+        printf("Recorded %zu datagrams to %s.\n", capture->DatagramCount(), options->record_path.c_str());
+    }
+    return result;
 }
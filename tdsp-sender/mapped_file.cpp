@@ -0,0 +1,58 @@
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TDSP_HAVE_MMAP
+#endif
+
+#include "mapped_file.h"
+
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+    std::unique_ptr<MappedFile> file{new MappedFile};
+
+#ifdef TDSP_HAVE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    file->size = static_cast<size_t>(st.st_size);
+    if (file->size != 0) {
+        void* p = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, file->size, MADV_SEQUENTIAL);
+            file->data = static_cast<const unsigned char*>(p);
+            file->mapped = true;
+        }
+    }
+    close(fd);
+
+    if (file->mapped || file->size == 0)
+        return file;
+#endif
+
+    std::ifstream stream{path, std::ios::binary};
+    if (!stream)
+        return nullptr;
+    file->contents.assign(std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{});
+    file->data = file->contents.data();
+    file->size = file->contents.size();
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef TDSP_HAVE_MMAP
+    if (mapped) {
+        munmap(const_cast<unsigned char*>(data), size);
+    }
+#endif
+}
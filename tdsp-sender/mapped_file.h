@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Uses mmap where available and falls back to reading the
+// file into memory elsewhere.
+class MappedFile {
+public:
+    // Returns nullptr if the file cannot be opened.
+    static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    MappedFile() = default;
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<unsigned char> contents;
+};
@@ -0,0 +1,32 @@
+#include <sstream>
+
+#include <catch.hpp>
+
+#include "assembler.h"
+
+TEST_CASE("assembler: Program With Error", "[assembler]") {
+    std::istringstream source{"nop\n\nadd 0x1234, a0\nbogus x\nnop"};
+
+    const auto program = AssembleProgram(BuildParserTable(), source);
+
+    REQUIRE(program.words == std::vector<std::uint16_t>{0x0000, 0x86C0, 0x1234, 0x0000});
+    REQUIRE(program.errors.size() == 1);
+    REQUIRE(program.errors[0].line == 4);
+}
+
+TEST_CASE("assembler: Labels", "[assembler]") {
+    std::istringstream source{"start:\nadd 0x1234, a0\nloop: nop\nstart: nop\nend:"};
+
+    const auto program = AssembleProgram(BuildParserTable(), source);
+
+    REQUIRE(program.words == std::vector<std::uint16_t>{0x86C0, 0x1234, 0x0000, 0x0000});
+    REQUIRE(program.symbols.size() == 3);
+    REQUIRE(program.symbols[0].name == "start");
+    REQUIRE(program.symbols[0].address == 0);
+    REQUIRE(program.symbols[1].name == "loop");
+    REQUIRE(program.symbols[1].address == 2);
+    REQUIRE(program.symbols[2].name == "end");
+    REQUIRE(program.symbols[2].address == 4);
+    REQUIRE(program.errors.size() == 1);
+    REQUIRE(program.errors[0].line == 4);
+}
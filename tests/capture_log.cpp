@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "capture_log.h"
+
+TEST_CASE("capture_log: Round Trip", "[capture_log]") {
+    const std::string path = "capture_log_test.cap";
+    const std::vector<std::uint16_t> header{0xD592, 1, 2};
+    const std::vector<std::uint16_t> payload(700, 0xABCD);
+    const auto start = CaptureClock::now();
+
+    auto writer = CaptureWriter::Create(path);
+    REQUIRE(writer);
+    writer->Record(start, 0, header.data(), header.size() * sizeof(std::uint16_t));
+    writer->Record(start + std::chrono::microseconds{250}, 3, header.data(), header.size() * sizeof(std::uint16_t),
+                   payload.data(), payload.size() * sizeof(std::uint16_t));
+    // Out of order times, as from several threads, are recorded as simultaneous.
+    writer->Record(start + std::chrono::microseconds{100}, 1, payload.data(), 0);
+    REQUIRE(writer->Flush());
+    REQUIRE(writer->DatagramCount() == 3);
+
+    const auto log = LoadCaptureLog(path);
+    REQUIRE(log);
+    REQUIRE(log->target_count == 4);
+    REQUIRE(log->datagrams.size() == 3);
+
+    REQUIRE(log->datagrams[0].time.count() == 0);
+    REQUIRE(log->datagrams[0].target == 0);
+    REQUIRE(log->datagrams[0].size == 6);
+    REQUIRE(std::equal(header.begin(), header.end(), reinterpret_cast<const std::uint16_t*>(log->Bytes(log->datagrams[0]))));
+
+    REQUIRE(log->datagrams[1].time == std::chrono::microseconds{250});
+    REQUIRE(log->datagrams[1].target == 3);
+    REQUIRE(log->datagrams[1].size == 6 + 1400);
+    const auto* words = reinterpret_cast<const std::uint16_t*>(log->Bytes(log->datagrams[1]));
+    REQUIRE(std::equal(header.begin(), header.end(), words));
+    REQUIRE(std::equal(payload.begin(), payload.end(), words + header.size()));
+
+    REQUIRE(log->datagrams[2].time == std::chrono::microseconds{250});
+    REQUIRE(log->datagrams[2].size == 0);
+
+    writer.reset();
+    std::remove(path.c_str());
+}
+
+TEST_CASE("capture_log: Rejects Damaged Files", "[capture_log]") {
+    const std::string path = "capture_log_test.cap";
+    REQUIRE(!LoadCaptureLog(path));
+
+    {
+        std::ofstream file{path, std::ios::binary};
+        file << "NOTACAP!";
+    }
+    REQUIRE(!LoadCaptureLog(path));
+
+    auto writer = CaptureWriter::Create(path);
+    const std::uint16_t words[4] = {1, 2, 3, 4};
+    writer->Record(CaptureClock::now(), 0, words, sizeof(words));
+    REQUIRE(writer->Flush());
+    writer.reset();
+    REQUIRE(LoadCaptureLog(path));
+
+    // Cut off in the middle of the datagram.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    REQUIRE(!LoadCaptureLog(path));
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,49 @@
+#include <cstdio>
+
+#include <catch.hpp>
+
+#include "delta_upload.h"
+#include "test_util.h"
+
+TEST_CASE("delta_upload: Plan Without Record", "[delta_upload]") {
+    const auto image = MakeImage(10000);
+    const auto manifest = PlanUpload(MakeUploadRecord(image.data(), image.size()), std::nullopt);
+
+    REQUIRE(manifest.flags == 0);
+    REQUIRE(manifest.total_words == image.size());
+    REQUIRE(manifest.changed.empty());
+}
+
+TEST_CASE("delta_upload: Plan Changed Chunks", "[delta_upload]") {
+    auto image = MakeImage(10 * max_chunk_payload_words);
+    const auto previous = MakeUploadRecord(image.data(), image.size());
+
+    image[3 * max_chunk_payload_words + 5] ^= 1;
+    image.push_back(0x1234);
+    const auto next = MakeUploadRecord(image.data(), image.size());
+    const auto manifest = PlanUpload(next, previous);
+
+    REQUIRE(manifest.flags == manifest_flag_delta);
+    REQUIRE(manifest.root == next.root);
+    REQUIRE(manifest.base_root == previous.root);
+    REQUIRE(manifest.changed.size() == 11);
+    for (size_t i = 0; i < manifest.changed.size(); i++) {
+        REQUIRE(manifest.changed[i] == (i == 3 || i == 10));
+    }
+}
+
+TEST_CASE("delta_upload: Record Round Trip", "[delta_upload]") {
+    const auto image = MakeImage(5000);
+    const auto record = MakeUploadRecord(image.data(), image.size());
+    const std::string path = "delta_upload_test.record";
+
+    REQUIRE(SaveUploadRecord(path, record));
+    const auto loaded = LoadUploadRecord(path);
+    REQUIRE(loaded);
+    REQUIRE(loaded->total_words == record.total_words);
+    REQUIRE(loaded->root == record.root);
+    REQUIRE(loaded->chunk_hashes == record.chunk_hashes);
+
+    std::remove(path.c_str());
+    REQUIRE(!LoadUploadRecord(path));
+}
@@ -0,0 +1,117 @@
+#include <catch.hpp>
+
+#include "dsp_protocol.h"
+
+TEST_CASE("dsp_protocol: Single Message", "[dsp_protocol]") {
+    const auto message = EncodeSingle({0x86C0, 0x1234});
+    REQUIRE(message == std::vector<std::uint16_t>{0xD590, 0x86C0, 0x1234});
+
+    const auto decoded = DecodeInstructions(message.data(), message.size());
+    REQUIRE(decoded);
+    REQUIRE(*decoded == std::vector<std::vector<std::uint16_t>>{{0x86C0, 0x1234}});
+}
+
+TEST_CASE("dsp_protocol: Batch Round Trip", "[dsp_protocol]") {
+    BatchEncoder encoder;
+    REQUIRE(encoder.TryAppend({0x0000}));
+    REQUIRE(encoder.TryAppend({0x86C0, 0x1234}));
+    REQUIRE(encoder.InstructionCount() == 2);
+
+    const auto& message = encoder.Message();
+    REQUIRE(message == std::vector<std::uint16_t>{0xD591, 2, 1, 0x0000, 2, 0x86C0, 0x1234});
+
+    const auto decoded = DecodeInstructions(message.data(), message.size());
+    REQUIRE(decoded);
+    REQUIRE(*decoded == std::vector<std::vector<std::uint16_t>>{{0x0000}, {0x86C0, 0x1234}});
+
+    encoder.Clear();
+    REQUIRE(encoder.Empty());
+}
+
+TEST_CASE("dsp_protocol: Batch Respects Datagram Size", "[dsp_protocol]") {
+    BatchEncoder encoder;
+    size_t appended = 0;
+    while (encoder.TryAppend({0x0000, 0x0000})) {
+        appended++;
+    }
+
+    REQUIRE(encoder.Message().size() * 2 <= max_datagram_size);
+    REQUIRE((encoder.Message().size() + 3) * 2 > max_datagram_size);
+    REQUIRE(appended == encoder.InstructionCount());
+}
+
+TEST_CASE("dsp_protocol: Malformed Batch", "[dsp_protocol]") {
+    const std::vector<std::uint16_t> truncated{0xD591, 2, 1, 0x0000, 2, 0x86C0};
+    REQUIRE(!DecodeInstructions(truncated.data(), truncated.size()));
+
+    const std::vector<std::uint16_t> unknown{0x1234, 0x0000};
+    REQUIRE(!DecodeInstructions(unknown.data(), unknown.size()));
+}
+
+TEST_CASE("dsp_protocol: Chunk Round Trip", "[dsp_protocol]") {
+    const std::vector<std::uint16_t> payload{0x1111, 0x2222, 0x3333};
+
+    ChunkHeader header;
+    header.sequence = 0x12345;
+    header.offset = 0x10002;
+    header.total_words = 0x10005;
+
+    std::vector<std::uint16_t> message;
+    EncodeChunk(header, payload.data(), payload.size(), message);
+    REQUIRE(message.size() == chunk_header_words + payload.size());
+
+    const auto decoded = DecodeChunkHeader(message.data(), message.size());
+    REQUIRE(decoded);
+    REQUIRE(decoded->sequence == 0x12345);
+    REQUIRE(decoded->offset == 0x10002);
+    REQUIRE(decoded->total_words == 0x10005);
+    REQUIRE(std::vector<std::uint16_t>(message.begin() + chunk_header_words, message.end()) == payload);
+
+    header.total_words = 0x10004;
+    EncodeChunk(header, payload.data(), payload.size(), message);
+    REQUIRE(!DecodeChunkHeader(message.data(), message.size()));
+}
+
+TEST_CASE("dsp_protocol: Manifest Round Trip", "[dsp_protocol]") {
+    Manifest manifest;
+    manifest.total_words = static_cast<std::uint32_t>(20 * max_chunk_payload_words + 1);
+    manifest.root[0] = 0xAB;
+    manifest.root[31] = 0xCD;
+
+    std::vector<std::uint16_t> message;
+    REQUIRE(EncodeManifest(manifest, message));
+    REQUIRE(message.size() == manifest_header_words);
+
+    auto decoded = DecodeManifest(message.data(), message.size());
+    REQUIRE(decoded);
+    REQUIRE(decoded->flags == 0);
+    REQUIRE(decoded->total_words == manifest.total_words);
+    REQUIRE(decoded->root == manifest.root);
+    REQUIRE(decoded->changed.empty());
+
+    manifest.flags = manifest_flag_delta;
+    manifest.base_root[5] = 0x55;
+    manifest.changed.assign(ChunkCountFor(manifest.total_words), false);
+    manifest.changed[0] = true;
+    manifest.changed[17] = true;
+    manifest.changed[20] = true;
+    REQUIRE(EncodeManifest(manifest, message));
+
+    decoded = DecodeManifest(message.data(), message.size());
+    REQUIRE(decoded);
+    REQUIRE(decoded->flags == manifest_flag_delta);
+    REQUIRE(decoded->base_root == manifest.base_root);
+    REQUIRE(decoded->changed == manifest.changed);
+
+    message.pop_back();
+    REQUIRE(!DecodeManifest(message.data(), message.size()));
+
+    manifest.changed.assign(max_manifest_bitmap_bits + 1, false);
+    REQUIRE(!EncodeManifest(manifest, message));
+
+    // Larger than any receiver takes.
+    Manifest huge;
+    huge.total_words = static_cast<std::uint32_t>(max_image_words + 1);
+    REQUIRE(EncodeManifest(huge, message));
+    REQUIRE(!DecodeManifest(message.data(), message.size()));
+}
@@ -0,0 +1,101 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_batch.h"
+#include "test_util.h"
+
+static std::shared_ptr<const std::vector<std::uint16_t>> AssembleShared(const std::string& source) {
+    return std::make_shared<const std::vector<std::uint16_t>>(Assemble(source));
+}
+
+// Jobs of very different lengths: each sums the words after its count to 0x200, and every fifth never
+// stops.
+static std::vector<BatchJob> MakeJobs() {
+    const auto sum = AssembleShared("mov 0x100, r0\nmov 0x200, r1\nclr 0, a0, true\nmov [r0], r2 || r0+1\nbkrep r2, 9\n"
+                                    "mov [r0], b1 || r0+1\nadd b1, a0\nmov a0l, [r1] || r1+0\ntrap");
+    const auto spin = AssembleShared("inc 1, a1, true\nbrr -2, true");
+    std::vector<BatchJob> jobs;
+    for (std::uint16_t i = 0; i < 60; i++) {
+        BatchJob job;
+        job.name = "job" + std::to_string(i);
+        std::vector<std::uint16_t> input{static_cast<std::uint16_t>(i * 7 % 50)};
+        for (std::uint16_t k = 0; k <= input[0]; k++) {
+            input.push_back(static_cast<std::uint16_t>(i + k));
+        }
+        job.program = i % 5 == 4 ? spin : sum;
+        job.inputs.push_back(BatchInput{0x100, std::make_shared<const std::vector<std::uint16_t>>(std::move(input))});
+        job.max_cycles = 2000;
+        job.output_address = 0x200;
+        job.output_words = 1;
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+TEST_CASE("emu_batch: Runs Jobs On Reused Emulators", "[emu_batch]") {
+    const std::vector<BatchJob> jobs = MakeJobs();
+    const std::vector<BatchResult> reference = RunBatch(jobs, 1, DispatchMode::Switch);
+    REQUIRE(reference.size() == jobs.size());
+    for (std::uint16_t i = 0; i < jobs.size(); i++) {
+        const BatchResult& result = reference[i];
+        REQUIRE(result.name == jobs[i].name);
+        if (i % 5 == 4) {
+            REQUIRE(result.reason == StopReason::CycleLimit);
+            REQUIRE(result.cycles == 2000);
+            // Nothing of the jobs before is left in memory.
+            REQUIRE(result.output[0] == 0);
+            continue;
+        }
+        const std::uint16_t n = i * 7 % 50;
+        std::int64_t expected = 0;
+        for (std::uint16_t k = 0; k <= n; k++) {
+            expected += i + k;
+        }
+        REQUIRE(result.reason == StopReason::Trap);
+        REQUIRE(result.acc[0] == expected);
+        REQUIRE(result.output[0] == expected);
+    }
+
+    // Any number of workers and any mode, with workers stealing the tail of each other's jobs.
+    for (const DispatchMode mode : {DispatchMode::Block, DispatchMode::Jit}) {
+        for (const size_t threads : {2, 3, 8}) {
+            const std::vector<BatchResult> results = RunBatch(jobs, threads, mode);
+            REQUIRE(results.size() == reference.size());
+            for (size_t i = 0; i < results.size(); i++) {
+                REQUIRE(results[i].reason == reference[i].reason);
+                REQUIRE(results[i].cycles == reference[i].cycles);
+                REQUIRE(results[i].acc == reference[i].acc);
+                REQUIRE(results[i].output == reference[i].output);
+            }
+        }
+    }
+    REQUIRE(RunBatch({}, 4, DispatchMode::Jit).empty());
+}
+
+TEST_CASE("emu_batch: Results Round Trip", "[emu_batch]") {
+    const std::vector<BatchResult> results = RunBatch(MakeJobs(), 2, DispatchMode::Block);
+    std::vector<BatchResult> edited = results;
+    edited[0].acc = {-1, std::int64_t{1} << 39, -(std::int64_t{1} << 39), 0};
+    edited[1].output = {0xFFFF, 0, 0x8000};
+
+    const std::vector<unsigned char> bytes = EncodeBatchResults(edited);
+    const auto decoded = DecodeBatchResults(bytes.data(), bytes.size());
+    REQUIRE(decoded);
+    REQUIRE(decoded->size() == edited.size());
+    for (size_t i = 0; i < edited.size(); i++) {
+        REQUIRE((*decoded)[i].name == edited[i].name);
+        REQUIRE((*decoded)[i].reason == edited[i].reason);
+        REQUIRE((*decoded)[i].cycles == edited[i].cycles);
+        REQUIRE((*decoded)[i].pc == edited[i].pc);
+        REQUIRE((*decoded)[i].acc == edited[i].acc);
+        REQUIRE((*decoded)[i].output == edited[i].output);
+    }
+
+    REQUIRE(!DecodeBatchResults(bytes.data(), bytes.size() - 1));
+    REQUIRE(!DecodeBatchResults(bytes.data(), 4));
+}
@@ -0,0 +1,542 @@
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_core.h"
+#include "test_util.h"
+
+static void Load(DspEmulator& emulator, const std::string& source) {
+    const std::vector<std::uint16_t> words = Assemble(source);
+    emulator.LoadProgram(words.data(), words.size());
+}
+
+TEST_CASE("emu_core: Decoder Covers The Table", "[emu_core]") {
+    const DecodeTable& table = GetDecodeTable();
+    REQUIRE(table.Forms().size() == BuildParserTable().size());
+
+    const std::vector<std::pair<std::string, EmuOp>> lines{
+        {"nop", EmuOp::Nop},
+        {"add [r0], a0 || r0+1", EmuOp::AluMemRn},
+        {"add 0x1234, a0", EmuOp::AluImm},
+        {"mov [page:1], a0", EmuOp::MovMemImm8Reg},
+        {"mov a0l, [r1] || r1+1", EmuOp::MovRegMemRn},
+        {"brr 2, neq", EmuOp::Br},
+        {"bkrep 5, 0x20", EmuOp::Bkrep},
+        {"mac y0, [r0], a0 || r0+1", EmuOp::MulMemRn},
+        {"push r0", EmuOp::Push},
+        {"max a0h, a1h || max a0l, a1l || vtrshr", EmuOp::Unimplemented},
+    };
+    for (const auto& [line, op] : lines) {
+        std::istringstream stream{line};
+        const auto program = AssembleProgram(BuildParserTable(), stream);
+        REQUIRE(program.errors.empty());
+        const InstructionForm* form = table.FormOf(program.words[0]);
+        REQUIRE(form);
+        REQUIRE(form->mnemonic == line.substr(0, line.find(' ')));
+        REQUIRE(form->length == program.words.size());
+        REQUIRE(table.Decode(program.words[0], program.words.size() > 1 ? program.words[1] : 0, 0).op == op);
+    }
+}
+
+TEST_CASE("emu_core: Arithmetic", "[emu_core]") {
+    DspEmulator emulator;
+    Load(emulator, "mov 0x12, a0\nadd 0x30, a0\nsub 3, a0\ninc 1, a0, true\nmov -5, a1h\ntrap\nnop");
+
+    const RunResult result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::Trap);
+    REQUIRE(result.cycles == 6);
+    REQUIRE(emulator.State().acc[0] == 0x40);
+    REQUIRE(emulator.State().acc[1] == -5 * 0x10000);
+    REQUIRE(emulator.State().flags.m);
+    REQUIRE(emulator.ReadRegister(DspReg::A1H) == 0xFFFB);
+
+    // Trap leaves the pc past it, so running again resumes.
+    REQUIRE(emulator.Run(100).reason == StopReason::EndOfProgram);
+}
+
+TEST_CASE("emu_core: Repeat And Block Repeat", "[emu_core]") {
+    DspEmulator emulator;
+    for (std::uint16_t i = 0; i < 8; i++) {
+        emulator.WriteData(0x100 + i, i + 1);
+    }
+
+    Load(emulator, "mov 0x100, r0\nclr 0, a0, true\nrep 3\nadd [r0], a0 || r0+1\ntrap");
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 1 + 2 + 3 + 4);
+    REQUIRE(emulator.State().r[0] == 0x104);
+
+    // The body of the block repeat is addresses 5 and 6.
+    emulator.Reset();
+    Load(emulator, "mov 0x100, r0\nclr 0, a0, true\nbkrep 2, 6\nmov [r0], b0 || r0+1\nadd b0, a0\ntrap");
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 1 + 2 + 3);
+    REQUIRE(emulator.State().loop_depth == 0);
+
+    // bkrepsto drops the repeat it saves, which bkreprst brings back before the body ends.
+    emulator.Reset();
+    Load(emulator, "mov 0x300, r4\nbkrep 2, 6\nbkrepsto [r4]\ninc 1, a1, true\nbkreprst [r4]\ntrap");
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[1] == 3);
+    REQUIRE(emulator.State().r[4] == 0x300);
+    REQUIRE(emulator.State().loop_depth == 0);
+}
+
+TEST_CASE("emu_core: Call And Return", "[emu_core]") {
+    DspEmulator emulator;
+    Load(emulator, "call 4, true\ninc 1, a0, true\ntrap\nnop\nmov 5, a1\nret true");
+    emulator.State().sp = 0x800;
+
+    const RunResult result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::Trap);
+    REQUIRE(result.pc == 4);
+    REQUIRE(emulator.State().acc[0] == 1);
+    REQUIRE(emulator.State().acc[1] == 5);
+    REQUIRE(emulator.State().sp == 0x800);
+}
+
+TEST_CASE("emu_core: Multiply Accumulate", "[emu_core]") {
+    DspEmulator emulator;
+    emulator.WriteData(0x200, 4);
+    emulator.WriteData(0x201, 0xFFFE);
+    Load(emulator, "mov 0x200, r0\nmov 3, y0\nclr 0, a0, true\nmpy y0, [r0] || r0+1\nmac y0, [r0], a0 || r0+1\nadd p0, a0\ntrap");
+
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 3 * 4 - 3 * 2);
+    REQUIRE(emulator.State().x[0] == 0xFFFE);
+}
+
+TEST_CASE("emu_core: Context Switch", "[emu_core]") {
+    DspEmulator emulator;
+    // cntx s keeps st2 and swaps a1 with b1; cntx r puts both back.
+    Load(emulator, "mov 0x41, st2\nmov 7, a1\nmov 9, b1\ncntx s\nmov 0, st2\ninc 1, a1, true\ncntx r\ntrap");
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().st2 == 0x41);
+    REQUIRE(emulator.State().acc[1] == 7);
+    REQUIRE(emulator.State().acc[3] == 10);
+
+    // So does a return from an interrupt with context.
+    emulator.Reset();
+    Load(emulator, "mov 7, a1\ncntx s\nmov 0x10, st2\ncall 8, true\ntrap\nreti true, context");
+    emulator.State().sp = 0x800;
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().st2 == 0);
+    REQUIRE(emulator.State().acc[1] == 7);
+    REQUIRE(emulator.State().ie);
+}
+
+TEST_CASE("emu_core: Modulo Addressing", "[emu_core]") {
+    DspEmulator emulator;
+    for (std::uint16_t i = 0; i < 8; i++) {
+        emulator.WriteData(0x100 + i, i + 1);
+    }
+    // r0 goes round 0x100 to 0x104; r6 ignores st2.
+    Load(emulator, "mov 0x200, cfgi\nmov 0x41, st2\nmov 0x103, r0\nmov 0x104, r6\nclr 0, a0, true\nrep 5\n"
+                   "add [r0], a0 || r0+1\nmov [r0], b0 || r0+1\nmodr [r0]-1\nmodr [r6]+1\nmov r0, r1\nmodr [r0]+1, dmod\ntrap");
+
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 4 + 5 + 1 + 2 + 3 + 4);
+    REQUIRE(emulator.State().acc[2] == 5);
+    REQUIRE(emulator.State().r[1] == 0x104);
+    REQUIRE(emulator.State().r[0] == 0x105);
+    REQUIRE(emulator.State().r[6] == 0x105);
+}
+
+TEST_CASE("emu_core: Conditional Branch", "[emu_core]") {
+    DspEmulator emulator;
+    Load(emulator, "mov 5, a0\nclr 0, a1, true\ninc 1, a1, true\ndec 1, a0, true\nbrr -3, neq\ntrap");
+
+    const RunResult result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::Trap);
+    REQUIRE(result.cycles == 2 + 5 * 3 + 1);
+    REQUIRE(emulator.State().acc[0] == 0);
+    REQUIRE(emulator.State().acc[1] == 5);
+    REQUIRE(emulator.State().flags.z);
+}
+
+TEST_CASE("emu_core: Flags Of Earlier Operations Are Kept", "[emu_core]") {
+    // The overflow of the first add stays in l, and the carry of the third survives the mov.
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block}) {
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        Load(emulator, "add 1, a0\nadd 1, a0\nadd 1, a1\nmov 0x12, a1\nmov st0, r0\ntrap");
+        emulator.State().acc[0] = 0x7FFFFFFFFF;
+        emulator.State().acc[1] = -1;
+
+        REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+        REQUIRE(emulator.State().r[0] == 0x00A0);
+        const DspFlags& f = emulator.State().flags;
+        REQUIRE(f.l);
+        REQUIRE(f.c);
+        REQUIRE(!f.v);
+        REQUIRE(!f.z);
+    }
+}
+
+TEST_CASE("emu_core: Stops", "[emu_core]") {
+    DspEmulator emulator;
+    const std::vector<std::uint16_t> words{0x0000, 0x5E21};
+    emulator.LoadProgram(words.data(), words.size());
+    RunResult result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::Unimplemented);
+    REQUIRE(result.pc == 1);
+    REQUIRE(result.opcode == 0x5E21);
+    REQUIRE(result.cycles == 1);
+    REQUIRE(emulator.State().pc == 1);
+
+    Load(emulator, "brr -1, true");
+    emulator.Reset();
+    result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::CycleLimit);
+    REQUIRE(result.cycles == 100);
+    REQUIRE(emulator.Cycles() == 100);
+}
+
+struct IoLog {
+    std::vector<std::uint16_t> reads;
+    std::vector<std::pair<std::uint16_t, std::uint16_t>> writes;
+};
+
+TEST_CASE("emu_core: Mapped IO", "[emu_core]") {
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit}) {
+        IoLog log;
+        MmioHandler handler;
+        handler.read = [](void* context, std::uint16_t address) -> std::uint16_t {
+            static_cast<IoLog*>(context)->reads.push_back(address);
+            return address & 0xFF;
+        };
+        handler.write = [](void* context, std::uint16_t address, std::uint16_t value) {
+            static_cast<IoLog*>(context)->writes.emplace_back(address, value);
+        };
+        handler.context = &log;
+
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        emulator.SetJitThreshold(0);
+        emulator.MapMmio(0x80, 1, handler);
+        emulator.WriteData(0x8010, 0x1234);
+        emulator.WriteData(0x8110, 0x55);
+        // cmpv only reads.
+        Load(emulator, "mov 0x8010, r0\nmov 0x8110, r1\nmov [r0], a0 || r0+1\nmov a0l, [r0] || r0+0\n"
+                       "mov [r1], a1 || r1+0\ncmpv 0x5, [r0] || r0+0\ntrap");
+
+        REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+        REQUIRE(log.reads == std::vector<std::uint16_t>{0x8010, 0x8011});
+        REQUIRE(log.writes == std::vector<std::pair<std::uint16_t, std::uint16_t>>{{0x8011, 0x10}});
+        REQUIRE(emulator.State().acc[0] == 0x10);
+        REQUIRE(emulator.State().acc[1] == 0x55);
+        REQUIRE(emulator.ReadData(0x8010) == 0x1234);
+        REQUIRE(emulator.ReadData(0x8011) == 0);
+
+        // Unmapped, the page is memory again, including for code compiled while it was mapped.
+        emulator.UnmapMmio(0x80, 1);
+        emulator.Reset();
+        REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+        REQUIRE(emulator.State().acc[0] == 0x1234);
+        REQUIRE(emulator.ReadData(0x8011) == 0x1234);
+        REQUIRE(log.reads.size() == 2);
+    }
+}
+
+TEST_CASE("emu_core: Program Writes Are Decoded", "[emu_core]") {
+    DspEmulator emulator;
+    Load(emulator, "nop\nnop\ntrap");
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 0);
+
+    emulator.Reset();
+    emulator.WriteProgram(1, 0x67D0); // inc 1, a0, true
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 1);
+}
+
+TEST_CASE("emu_core: Program Writes From IO", "[emu_core]") {
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit}) {
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        emulator.SetJitThreshold(0);
+        // Turns the nop after the store into inc 1, a0, and loads code past the end, which grows
+        // the block tables under the block running.
+        MmioHandler handler;
+        handler.write = [](void* context, std::uint16_t, std::uint16_t) {
+            DspEmulator& emulator = *static_cast<DspEmulator*>(context);
+            emulator.WriteProgram(5, 0x67D0);
+            const std::vector<std::uint16_t> far(0x100, 0x67D0);
+            emulator.LoadProgram(far.data(), far.size(), 0x1000);
+        };
+        handler.context = &emulator;
+        emulator.MapMmio(0x80, 1, handler);
+        Load(emulator, "mov 0x8000, r0\nbkrep 3, 6\nmov a1l, [r0] || r0+0\nnop\nnop\ntrap");
+
+        REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+        REQUIRE(emulator.Program()[5] == 0x67D0);
+        REQUIRE(emulator.ProgramSize() == 0x1100);
+        // The Switch mode runs the new instruction straight after the store; the others once the
+        // block that made it ends.
+        REQUIRE(emulator.State().acc[0] == (mode == DispatchMode::Switch ? 4 : 3));
+    }
+}
+
+static void RequireSameState(const DspEmulator& a, const DspEmulator& b) {
+    REQUIRE(a.State().acc == b.State().acc);
+    REQUIRE(a.State().r == b.State().r);
+    REQUIRE(a.State().x == b.State().x);
+    REQUIRE(a.State().y == b.State().y);
+    REQUIRE(a.State().p == b.State().p);
+    REQUIRE(a.State().pc == b.State().pc);
+    REQUIRE(a.State().sp == b.State().sp);
+    REQUIRE(a.State().loop_depth == b.State().loop_depth);
+    REQUIRE(a.ReadRegister(DspReg::St0) == b.ReadRegister(DspReg::St0));
+    REQUIRE(a.Cycles() == b.Cycles());
+}
+
+// Runs a program in slices of `budget` cycles in the Switch mode and in `mode`, which compiles
+// blocks from their first run, comparing the two after each slice.
+static void RequireSameRuns(DispatchMode mode, const std::string& source, std::uint64_t budget) {
+    DspEmulator reference;
+    DspEmulator emulator;
+    reference.SetDispatchMode(DispatchMode::Switch);
+    emulator.SetDispatchMode(mode);
+    emulator.SetJitThreshold(0);
+    for (DspEmulator* each : {&reference, &emulator}) {
+        for (std::uint16_t i = 0; i < 8; i++) {
+            each->WriteData(0x100 + i, i + 1);
+        }
+        each->State().sp = 0x800;
+        Load(*each, source);
+    }
+    while (true) {
+        const RunResult expected = reference.Run(budget);
+        const RunResult result = emulator.Run(budget);
+        REQUIRE(result.reason == expected.reason);
+        REQUIRE(result.cycles == expected.cycles);
+        REQUIRE(result.pc == expected.pc);
+        RequireSameState(reference, emulator);
+        if (result.reason != StopReason::CycleLimit)
+            break;
+    }
+    for (std::uint16_t i = 0; i < 8; i++) {
+        REQUIRE(emulator.ReadData(0x200 + i) == reference.ReadData(0x200 + i));
+    }
+}
+
+static const std::vector<std::string> dispatch_programs{
+    "mov 5, a0\nclr 0, a1, true\ninc 1, a1, true\ndec 1, a0, true\nbrr -3, neq\ntrap",
+    "mov 0x100, r0\nclr 0, a0, true\nrep 3\nadd [r0], a0 || r0+1\ntrap",
+    "mov 0x100, r0\nclr 0, a0, true\nbkrep 2, 6\nmov [r0], b0 || r0+1\nadd b0, a0\ntrap",
+    "call 4, true\ninc 1, a0, true\ntrap\nnop\nmov 5, a1\nret true",
+    // The body of the inner repeat ends in the middle of straight-line code.
+    "mov 0x200, r1\nbkrep 3, 10\ninc 1, a0, true\nbkrep 4, 9\nadd 2, a1\nmov a1l, [r1] || r1+1\n"
+    "add a1, b0\nsub a0, b1\nsub 1, a0\ntrap",
+    "mov 0x100, r0\nmov 0x200, r1\nmov 3, y0\nbkrep 5, 8\nmac y0, [r0], a0 || r0+1\nmov a0l, [r1] || r1+1\n"
+    "mov a0h, [r1] || r1+1\ntrap",
+    "mov 0x100, r0\nmov 0x200, r1\nmov 3, y0\nbkrep 3, 11\nclr 0, a0, true\nrep 4\nmac y0, [r0], a0 || r0+1\n"
+    "mov a0l, [r1] || r1+1\ntrap",
+    // A rep that ends a repeat body leaves its instruction to after the repeat.
+    "bkrep 2, 3\ninc 1, a0, true\nrep 2\nadd 1, a1\ntrap",
+    // Repeats saved and restored inside their own bodies, through r4 and the stack.
+    "mov 0x100, r0\nmov 0x200, r1\nmov 0x300, r4\nbkrep 5, 10\nmov [r0], b0 || r0+1\nadd b0, a0\nmov a0l, [r1] || r1+1\n"
+    "bkrep 2, 15\nbkrepsto [r4]\ninc 1, a1, true\nbkreprst [r4]\nbkrep 1, 19\nbkrepsto [sp]\nbkreprst [sp]\ntrap",
+    // Circular buffers in r0 and r4, stepping by one and by stepj; the modulo changes midway.
+    "mov 0x100, r0\nmov 0x205, r1\nmov 0x102, r4\nmov 0x0182, cfgi\nmov 0x017E, cfgj\nmov 0x11, st2\nmov 3, y0\n"
+    "bkrep 6, 20\nmac y0, [r0], a0 || r0+1\nmov a0l, [r1] || r1-1\nadd [r4], a1 || r4+s\nmov 0x0102, cfgi\n"
+    "rep 3\nsub [r0], a1 || r0-1\ntrap",
+};
+
+TEST_CASE("emu_core: Block Dispatch Matches Switch", "[emu_core]") {
+    for (const std::string& source : dispatch_programs) {
+        // Running in slices ends some runs in the middle of a block.
+        for (const std::uint64_t budget : {1, 2, 3, 7, 20, 1000}) {
+            RequireSameRuns(DispatchMode::Block, source, budget);
+        }
+    }
+}
+
+TEST_CASE("emu_core: Jit Matches Switch", "[emu_core]") {
+    for (const std::string& source : dispatch_programs) {
+        for (const std::uint64_t budget : {1, 3, 20, 1000}) {
+            RequireSameRuns(DispatchMode::Jit, source, budget);
+        }
+    }
+}
+
+TEST_CASE("emu_core: Jit Matches Switch On Random Blocks", "[emu_core]") {
+    // Code the JIT has native code for, plus a few it hands back; the branches skip a word.
+    const std::vector<std::string> pool{
+        "add 0x1234, a1", "sub 0x12, a0", "and 0x8001, a0", "or 0x8001, a1", "xor 0x55, a1", "cmp 0x55, a0",
+        "add [r0], a0 || r0+1", "sub [r4], a1 || r4+s", "and [r5], a1 || r5+0", "or [r2], a0 || r2-1",
+        "cmp [r1], a1 || r1+1", "xor [r3], a0 || r3+s", "add r2, a0", "sub y0, a1", "addh r1, a0",
+        "addl r2, a1", "cmpu r3, a0", "subh r4, a1", "subl y0, a0", "add b1, a1", "add a1, b0", "cmp b0, a1",
+        "inc 1, a0, true", "dec 1, a1, true", "clr 0, a1, true", "clrr 0x8000, a0, true", "rnd 0x8000, a1, true",
+        "copy a1, a0, true", "neg a1, true", "not a0, true", "inc 1, a0, eq",
+        "mov 0x1234, r3", "mov 0x1234, y0", "mov 0x1234, a0", "mov 0x1234, b1", "mov 0x12, a1l", "mov -3, a0h",
+        "mov r1, y0", "mov a0h, r4", "mov b1l, r2", "mov r2, a1", "mov a0, b1", "mov [r6], a0l || r6+s",
+        "mov [r1], b1 || r1+1", "mov [r1], y0 || r1+1", "mov r3, [r0] || r0+1", "mov b0h, [r5] || r5-1",
+        "mov a1l, [r5] || r5+s", "mov [page:0x12], y0", "mov y0, [page:0x40]", "mov a1l, [page:0x40]",
+        "mac y0, [r2], a0 || r2+1", "mpy y0, [r4] || r4+s", "msu y0, [r1], a1 || r1-1", "maa y0, [r0], a1 || r0+1",
+        "mpysu y0, [r3] || r3+1", "macus y0, [r0], a0 || r0+1", "macuu y0, [r0], a1 || r0+1", "sqr [r0] || r0+1",
+        "sqra [r1], a0 || r1+1", "mpy y0, r3", "mac y0, r3, a0", "mpyi p0, y0, 0x12", "clrp p0", "clrp p1",
+        "modr [r2]", "modr [r3]-1", "modr [r4]+s, dmod", "push r3", "pop r4", "mov 0x1234, sv",
+        "brr 1, eq", "brr 1, neq", "brr 1, gt", "brr 1, ge", "brr 1, lt", "brr 1, le", "brr 1, nn", "brr 1, c", "brr 1, v",
+        "brr 1, e", "brr 1, l", "brr 1, nr",
+    };
+    // Values around the flag boundaries, besides random ones.
+    const std::vector<std::int64_t> edges{0, 1, -1, 0x3FFFFFFF, 0x40000000, 0x7FFFFFFF, -0x80000000LL, 0x7FFFFFFFFFLL,
+                                          -0x8000000000LL};
+
+    std::mt19937_64 random{40};
+    const auto pick = [&](size_t count) { return static_cast<size_t>(random() % count); };
+    const auto accumulator = [&] {
+        if (pick(2))
+            return edges[pick(edges.size())];
+        return static_cast<std::int64_t>(random() << 24) >> 24;
+    };
+
+    std::uint64_t native = 0;
+    for (int trial = 0; trial < 300; trial++) {
+        std::string source;
+        for (size_t i = 0, length = 1 + pick(12); i < length; i++) {
+            source += pool[pick(pool.size())] + "\n";
+        }
+        source += "trap";
+
+        DspState start;
+        for (std::int64_t& acc : start.acc) {
+            acc = accumulator();
+        }
+        for (std::uint16_t& r : start.r) {
+            r = static_cast<std::uint16_t>(0x100 + pick(0x200));
+        }
+        start.x = {static_cast<std::uint16_t>(random()), static_cast<std::uint16_t>(random())};
+        start.y = {static_cast<std::uint16_t>(random()), static_cast<std::uint16_t>(random())};
+        start.p = {static_cast<std::int32_t>(random()), static_cast<std::int32_t>(random())};
+        start.ps = static_cast<std::uint8_t>(pick(4));
+        start.page = static_cast<std::uint8_t>(pick(4));
+        start.cfgi = static_cast<std::uint16_t>(random());
+        start.cfgj = static_cast<std::uint16_t>(random());
+        start.st2 = static_cast<std::uint16_t>(pick(0x40));
+        start.sp = 0x380;
+        start.flags = DspFlags{pick(2) != 0, pick(2) != 0, pick(2) != 0, pick(2) != 0, pick(2) != 0, pick(2) != 0,
+                               pick(2) != 0, pick(2) != 0};
+
+        std::vector<std::uint16_t> memory(0x400);
+        for (std::uint16_t& word : memory) {
+            word = static_cast<std::uint16_t>(random());
+        }
+
+        DspEmulator reference;
+        DspEmulator jit;
+        reference.SetDispatchMode(DispatchMode::Switch);
+        jit.SetDispatchMode(DispatchMode::Jit);
+        jit.SetJitThreshold(0);
+        for (DspEmulator* emulator : {&reference, &jit}) {
+            Load(*emulator, source);
+            emulator->State() = start;
+            for (std::uint16_t i = 0; i < memory.size(); i++) {
+                emulator->WriteData(i, memory[i]);
+            }
+        }
+
+        // A branch may land in the middle of a two-word instruction, so the run need not reach
+        // the trap.
+        INFO(source);
+        const RunResult expected = reference.Run(100);
+        const RunResult result = jit.Run(100);
+        REQUIRE(result.reason == expected.reason);
+        REQUIRE(result.pc == expected.pc);
+        RequireSameState(reference, jit);
+        for (std::uint16_t i = 0; i < memory.size(); i++) {
+            REQUIRE(jit.ReadData(i) == reference.ReadData(i));
+        }
+        native += jit.JitNativeCount();
+    }
+    REQUIRE((native > 0) == JitCompiler::Available());
+}
+
+struct Timer {
+    DspEmulator* emulator;
+    std::uint64_t period;
+    int fired;
+};
+
+// Raises line 0 and comes round again a period later.
+static void TimerTick(void* context, std::uint64_t cycle) {
+    auto* timer = static_cast<Timer*>(context);
+    timer->fired++;
+    timer->emulator->RaiseInterrupt(0);
+    timer->emulator->ScheduleEvent(cycle + timer->period, &TimerTick, timer);
+}
+
+TEST_CASE("emu_core: Timer Interrupts", "[emu_core]") {
+    // The handler at line 0's vector counts in a0. The main loop is a block the timer lands in
+    // the middle of, and a repeated add, which the interrupt waits for.
+    const std::string source = "br 8, true\nnop\nnop\nnop\nnop\ninc 1, a0, true\nreti true\nmov 0x4, st0\neint\n"
+                               "inc 1, a1, true\ninc 1, a1, true\ninc 1, a1, true\ninc 1, a1, true\ninc 1, a1, true\n"
+                               "rep 3\nadd 1, a1\nbrr -9, true";
+    DspEmulator reference;
+    Timer reference_timer{&reference, 37, 0};
+    reference.SetDispatchMode(DispatchMode::Switch);
+    Load(reference, source);
+    reference.ScheduleEvent(37, &TimerTick, &reference_timer);
+    REQUIRE(reference.Run(1000).reason == StopReason::CycleLimit);
+    // The last tick comes during the rep, so its interrupt still waits.
+    REQUIRE(reference_timer.fired == 27);
+    REQUIRE(reference.State().acc[0] == 26);
+    REQUIRE(reference.State().ip == 1);
+    REQUIRE(reference.State().sp == 0);
+
+    for (const DispatchMode mode : {DispatchMode::Block, DispatchMode::Jit}) {
+        DspEmulator emulator;
+        Timer timer{&emulator, 37, 0};
+        emulator.SetDispatchMode(mode);
+        emulator.SetJitThreshold(0);
+        Load(emulator, source);
+        emulator.ScheduleEvent(37, &TimerTick, &timer);
+        for (int slice = 0; slice < 10; slice++) {
+            REQUIRE(emulator.Run(100).reason == StopReason::CycleLimit);
+        }
+        REQUIRE(timer.fired == 27);
+        RequireSameState(reference, emulator);
+    }
+
+    // Line 1 is masked, so it stays pending.
+    reference.RaiseInterrupt(1);
+    reference.Run(100);
+    REQUIRE(reference.State().ip == 2);
+    REQUIRE(reference.State().acc[0] == 29);
+}
+
+TEST_CASE("emu_core: Program Writes Invalidate Blocks", "[emu_core]") {
+    const auto assemble = [](const std::string& line) {
+        std::istringstream stream{line};
+        const auto program = AssembleProgram(BuildParserTable(), stream);
+        REQUIRE(program.errors.empty());
+        return program.words;
+    };
+
+    DspEmulator emulator;
+    Load(emulator, "nop\nnop\ninc 1, a0, true\ninc 1, a0, true\ninc 1, a0, true\ntrap");
+    emulator.State().pc = 2;
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 3);
+
+    // Patch the middle of the cached block.
+    emulator.Reset();
+    emulator.State().pc = 2;
+    emulator.WriteProgram(3, assemble("dec 1, a0, true")[0]);
+    REQUIRE(emulator.Run(100).reason == StopReason::Trap);
+    REQUIRE(emulator.State().acc[0] == 1);
+
+    // A repeat body that ends inside the cached block splits it: 2 and 3 run twice.
+    emulator.Reset();
+    emulator.WriteProgram(3, assemble("inc 1, a0, true")[0]);
+    const auto bkrep = assemble("bkrep 1, 3");
+    emulator.LoadProgram(bkrep.data(), bkrep.size(), 0);
+    const RunResult result = emulator.Run(100);
+    REQUIRE(result.reason == StopReason::Trap);
+    REQUIRE(result.cycles == 1 + 2 * 2 + 2);
+    REQUIRE(emulator.State().acc[0] == 5);
+}
@@ -0,0 +1,63 @@
+#include <cstdint>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_events.h"
+
+struct EventLog {
+    EventQueue* queue;
+    std::vector<std::uint64_t> cycles;
+    std::vector<int> order;
+};
+
+template <int tag>
+static void Record(void* context, std::uint64_t cycle) {
+    auto* log = static_cast<EventLog*>(context);
+    log->cycles.push_back(cycle);
+    log->order.push_back(tag);
+}
+
+// Schedules a tag-3 event for the cycle it runs at.
+static void Chain(void* context, std::uint64_t cycle) {
+    auto* log = static_cast<EventLog*>(context);
+    log->order.push_back(2);
+    log->queue->Schedule(cycle, &Record<3>, log);
+}
+
+TEST_CASE("emu_events: Due In Cycle Order", "[emu_events]") {
+    EventQueue queue;
+    EventLog log{&queue, {}, {}};
+    REQUIRE(queue.NextCycle() == EventQueue::never);
+
+    queue.Schedule(30, &Record<0>, &log);
+    queue.Schedule(10, &Record<0>, &log);
+    queue.Schedule(20, &Record<0>, &log);
+    REQUIRE(queue.NextCycle() == 10);
+
+    queue.RunDue(9);
+    REQUIRE(log.cycles.empty());
+    queue.RunDue(25);
+    REQUIRE(log.cycles == std::vector<std::uint64_t>{10, 20});
+    REQUIRE(queue.NextCycle() == 30);
+    queue.RunDue(100);
+    REQUIRE(log.cycles == std::vector<std::uint64_t>{10, 20, 30});
+    REQUIRE(queue.Size() == 0);
+}
+
+TEST_CASE("emu_events: Same Cycle In Schedule Order", "[emu_events]") {
+    EventQueue queue;
+    EventLog log{&queue, {}, {}};
+    queue.Schedule(5, &Record<0>, &log);
+    queue.Schedule(5, &Record<1>, &log);
+    queue.Schedule(5, &Chain, &log);
+    queue.Schedule(4, &Record<4>, &log);
+    const std::uint64_t cancelled = queue.Schedule(5, &Record<5>, &log);
+
+    REQUIRE(queue.Cancel(cancelled));
+    REQUIRE(!queue.Cancel(cancelled));
+    queue.RunDue(5);
+    // The event Chain schedules for now runs too.
+    REQUIRE(log.order == std::vector<int>{4, 0, 1, 2, 3});
+    REQUIRE(queue.NextCycle() == EventQueue::never);
+}
@@ -0,0 +1,141 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_core.h"
+#include "emu_lockstep.h"
+#include "test_util.h"
+
+// Runs every instance of `lockstep` again on an emulator of its own, from the same memory, and
+// requires the same results in `slices` runs of `budget` cycles.
+static void RequireSameAsEmulators(DspLockstep& lockstep, const std::vector<std::uint16_t>& program,
+                                   std::uint64_t budget, int slices, std::uint16_t memory_words) {
+    std::vector<DspEmulator> emulators(lockstep.Instances());
+    for (size_t i = 0; i < emulators.size(); i++) {
+        emulators[i].SetDispatchMode(DispatchMode::Switch);
+        emulators[i].LoadProgram(program.data(), program.size());
+        for (std::uint16_t address = 0; address < memory_words; address++) {
+            emulators[i].WriteData(address, lockstep.ReadData(i, address));
+        }
+    }
+    for (int slice = 0; slice < slices; slice++) {
+        const std::vector<RunResult> results = lockstep.Run(budget);
+        REQUIRE(results.size() == emulators.size());
+        for (size_t i = 0; i < emulators.size(); i++) {
+            INFO("instance " << i << ", slice " << slice);
+            const RunResult expected = emulators[i].Run(budget);
+            REQUIRE(results[i].reason == expected.reason);
+            REQUIRE(results[i].cycles == expected.cycles);
+            REQUIRE(results[i].pc == expected.pc);
+            REQUIRE(lockstep.Cycles(i) == emulators[i].Cycles());
+
+            const DspState state = lockstep.State(i);
+            const DspState& reference = emulators[i].State();
+            REQUIRE(state.acc == reference.acc);
+            REQUIRE(state.r == reference.r);
+            REQUIRE(state.x == reference.x);
+            REQUIRE(state.y == reference.y);
+            REQUIRE(state.p == reference.p);
+            REQUIRE(state.flags.z == reference.flags.z);
+            REQUIRE(state.flags.m == reference.flags.m);
+            REQUIRE(state.flags.n == reference.flags.n);
+            REQUIRE(state.flags.v == reference.flags.v);
+            REQUIRE(state.flags.c == reference.flags.c);
+            REQUIRE(state.flags.e == reference.flags.e);
+            REQUIRE(state.flags.l == reference.flags.l);
+            REQUIRE(state.flags.r == reference.flags.r);
+            REQUIRE(state.sv == reference.sv);
+            REQUIRE(state.sp == reference.sp);
+            for (std::uint16_t address = 0; address < memory_words; address++) {
+                REQUIRE(lockstep.ReadData(i, address) == emulators[i].ReadData(address));
+            }
+        }
+    }
+}
+
+TEST_CASE("emu_lockstep: Filter Runs In Lockstep", "[emu_lockstep]") {
+    const auto program = Assemble("mov 0x100, r0\nmov 0x200, r1\nmov [r0], y0 || r0+1\nbkrep 20, 9\nmac y0, [r0], a0 || r0+1\n"
+                                  "mov a0l, [r1] || r1+1\nmov a0h, [r1] || r1+1\ntrap");
+    DspLockstep lockstep{16};
+    lockstep.LoadProgram(program.data(), program.size());
+    std::mt19937 random{49};
+    for (size_t i = 0; i < lockstep.Instances(); i++) {
+        for (std::uint16_t address = 0x100; address < 0x120; address++) {
+            lockstep.WriteData(i, address, static_cast<std::uint16_t>(random()));
+        }
+    }
+    RequireSameAsEmulators(lockstep, program, 30, 3, 0x300);
+    // Nothing branched, so no instance dropped out.
+    for (size_t i = 0; i < lockstep.Instances(); i++) {
+        REQUIRE(lockstep.InLockstep(i));
+    }
+}
+
+TEST_CASE("emu_lockstep: Diverging Instances Drop Out", "[emu_lockstep]") {
+    // Counts a0 down from the instance's input, and in r2 the odd values it passes.
+    const auto program = Assemble("mov 0x100, r0\nmov [r0], a0 || r0+0\nmov 0, r2\nmov a0l, a1\nand 1, a1\nbrr 1, eq\n"
+                                  "modr [r2]+1\ndec 1, a0, true\nbrr -7, gt\nmov r2, [r0] || r0+1\ntrap");
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit}) {
+        DspLockstep lockstep{8};
+        lockstep.SetDispatchMode(mode);
+        lockstep.LoadProgram(program.data(), program.size());
+        for (size_t i = 0; i < lockstep.Instances(); i++) {
+            // Instances 0 and 1 count the same, so stay together.
+            lockstep.WriteData(i, 0x100, static_cast<std::uint16_t>(i < 2 ? 9 : i));
+        }
+        RequireSameAsEmulators(lockstep, program, 25, 4, 0x200);
+        REQUIRE(lockstep.InLockstep(0));
+        REQUIRE(lockstep.InLockstep(1));
+        REQUIRE(!lockstep.InLockstep(3));
+        REQUIRE(lockstep.ReadData(0, 0x100) == 5);
+    }
+}
+
+TEST_CASE("emu_lockstep: Matches Emulators On Random Code", "[emu_lockstep]") {
+    // Covered code and some that drops every instance out; the branches skip a word.
+    const std::vector<std::string> pool{
+        "add 0x1234, a1", "sub 0x12, a0", "and 0x8001, a0", "or 0x8001, a1", "xor 0x55, a1", "cmp 0x55, a0",
+        "add [r0], a0 || r0+1", "sub [r4], a1 || r4+s", "and [r5], a1 || r5+0", "or [r2], a0 || r2-1",
+        "cmp [r1], a1 || r1+1", "xor [r3], a0 || r3+s", "add r2, a0", "sub y0, a1", "addh r1, a0",
+        "addl r2, a1", "cmpu r3, a0", "subh r4, a1", "subl y0, a0", "add b1, a1", "add a1, b0", "cmp b0, a1",
+        "add p0, a1", "inc 1, a0, true", "dec 1, a1, true", "clr 0, a1, true", "clrr 0x8000, a0, true",
+        "rnd 0x8000, a1, true", "copy a1, a0, true", "neg a1, true", "not a0, true", "inc 1, a0, eq",
+        "dec 1, a1, lt", "neg a0, gt", "mov 0x1234, y0", "mov 0x12, a1l", "mov -3, a0h", "mov r1, y0",
+        "mov a0h, r4", "mov b1l, r2", "mov r2, a1", "mov a0, b1", "mov [r6], a0l || r6+s", "mov [r1], b1 || r1+1",
+        "mov [r1], y0 || r1+1", "mov r3, [r0] || r0+1", "mov b0h, [r5] || r5-1", "mov a1l, [r5] || r5+s",
+        "mov [page:0x12], y0", "mov y0, [page:0x40]", "mov a1l, [page:0x40]", "mac y0, [r2], a0 || r2+1",
+        "mpy y0, [r4] || r4+s", "msu y0, [r1], a1 || r1-1", "maa y0, [r0], a1 || r0+1", "mpysu y0, [r3] || r3+1",
+        "macus y0, [r0], a0 || r0+1", "macuu y0, [r0], a1 || r0+1", "sqr [r0] || r0+1", "sqra [r1], a0 || r1+1",
+        "mpy y0, r3", "mac y0, r3, a0", "mpyi p0, y0, 0x12", "clrp p0", "modr [r2]", "modr [r3]-1",
+        "modr [r4]+s, dmod", "mov 0x1234, sv", "mov 0x0182, cfgi", "mov 0x11, st2", "load 2, ps", "rep 2\nadd [r0], a1 || r0+1",
+        "brr 1, eq", "brr 1, neq", "brr 1, gt", "brr 1, ge", "brr 1, lt", "brr 1, le", "brr 1, nn", "brr 1, c",
+        "brr 1, v", "brr 1, e", "brr 1, l", "brr 1, nr", "brr 1, true",
+        "push r3", "pop r4", "shl 1, a0, true",
+    };
+    std::mt19937_64 random{49};
+    const auto pick = [&](size_t count) { return static_cast<size_t>(random() % count); };
+    for (int trial = 0; trial < 60; trial++) {
+        // Every instance starts from its own memory, with its registers loaded from it.
+        std::string source = "mov 0x80, r7\nmov [r7], a0 || r7+1\nmov [r7], a1h || r7+1\nmov [r7], b0 || r7+1\n"
+                             "mov [r7], b1l || r7+1\nmov [r7], y0 || r7+1\nmov 0x100, r0\nmov 0x140, r1\nmov 0x180, r2\n"
+                             "mov 0x1C0, r3\nmov 0x200, r4\nmov 0x240, r5\nmov 0x280, r6\nmov 0x380, sp\n";
+        for (size_t i = 0, length = 1 + pick(16); i < length; i++) {
+            source += pool[pick(pool.size())] + "\n";
+        }
+        source += "trap";
+        const auto program = Assemble(source);
+
+        DspLockstep lockstep{1 + pick(16)};
+        lockstep.LoadProgram(program.data(), program.size());
+        for (size_t i = 0; i < lockstep.Instances(); i++) {
+            for (std::uint16_t address = 0x80; address < 0x400; address++) {
+                lockstep.WriteData(i, address, static_cast<std::uint16_t>(random()));
+            }
+        }
+        INFO(source);
+        RequireSameAsEmulators(lockstep, program, 1 + pick(40), 2, 0x400);
+    }
+}
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_core.h"
+#include "emu_profiler.h"
+#include "test_util.h"
+
+TEST_CASE("emu_profiler: Samples Call Stacks", "[emu_profiler]") {
+    // Calls work three times from loop.
+    const AssembledProgram program = AssembleChecked("main: mov 3, r1\nloop: call 0x8, true\nmodr [r1]-1\nbrr -4, nr\n"
+                                              "done: trap\nnop\nwork: nop\nnop\nret true");
+    REQUIRE(program.symbols.size() == 4);
+    REQUIRE(program.symbols[2].address == 6);
+    REQUIRE(program.symbols[3].address == 8);
+
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit}) {
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        emulator.SetJitThreshold(0);
+        emulator.LoadProgram(program.words.data(), program.words.size());
+        DspProfiler profiler{emulator, 1, program.symbols};
+        REQUIRE(emulator.Run(1000).reason == StopReason::Trap);
+
+        // A sample before each instruction but the first.
+        REQUIRE(profiler.Samples() == 19);
+        REQUIRE(profiler.FoldedStacks() == "loop 9\nloop;work 9\ndone 1\n");
+
+        const std::vector<InstructionProfile> instructions = profiler.Instructions();
+        REQUIRE(instructions.size() == 7);
+        // The call, with the cycles of work under it.
+        REQUIRE(instructions[0].pc == 2);
+        REQUIRE(instructions[0].symbol == "loop");
+        REQUIRE(instructions[0].hits == 3);
+        REQUIRE(instructions[0].cycles == 12);
+        for (size_t i = 1; i < instructions.size(); i++) {
+            REQUIRE(instructions[i].hits == (instructions[i].pc == 6 ? 1 : 3));
+            REQUIRE(instructions[i].cycles == instructions[i].hits);
+        }
+    }
+}
+
+TEST_CASE("emu_profiler: Recursion And Period", "[emu_profiler]") {
+    // down calls itself until r1 reaches zero.
+    const AssembledProgram program = AssembleChecked("mov 3, r1\ncall 0x5, true\ntrap\ndown: modr [r1]-1\nbrr 1, nr\n"
+                                              "ret true\ncall 0x5, true\nret true");
+    DspEmulator emulator;
+    emulator.LoadProgram(program.words.data(), program.words.size());
+    DspProfiler profiler{emulator, 2, program.symbols};
+    REQUIRE(emulator.Run(1000).reason == StopReason::Trap);
+    // 14 cycles: samples at the even ones.
+    REQUIRE(emulator.Cycles() == 14);
+    REQUIRE(profiler.Samples() == 6);
+    REQUIRE(profiler.Symbolize(1) == "0x00001");
+    REQUIRE(profiler.Symbolize(7) == "down+0x2");
+    REQUIRE(profiler.FoldedStacks() == "0x00002;down 3\n0x00002;down;down 1\n0x00002;down;down;down 2\n");
+
+    // However deep the recursion, the inner call counts each sample once.
+    const std::vector<InstructionProfile> instructions = profiler.Instructions();
+    const auto call = std::find_if(instructions.begin(), instructions.end(),
+                                   [](const InstructionProfile& instruction) { return instruction.pc == 8; });
+    REQUIRE(call != instructions.end());
+    REQUIRE(call->hits == 1);
+    REQUIRE(call->cycles == 8);
+}
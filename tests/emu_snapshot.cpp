@@ -0,0 +1,131 @@
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "emu_core.h"
+#include "emu_snapshot.h"
+#include "test_util.h"
+
+// Filters 0x100 into 0x200 onwards, a repeat at a time.
+static const std::string filter = "mov 0x100, r0\nmov 0x200, r1\nmov 3, y0\nbkrep 20, 8\nmac y0, [r0], a0 || r0+1\n"
+                                  "mov a0l, [r1] || r1+1\nmov a0h, [r1] || r1+1\ntrap";
+
+struct Outcome {
+    RunResult result;
+    std::int64_t a0;
+    std::uint64_t cycles;
+    std::vector<std::uint16_t> output;
+};
+
+static Outcome RunToEnd(DspEmulator& emulator) {
+    const RunResult result = emulator.Run(10000);
+    std::vector<std::uint16_t> output;
+    for (std::uint16_t i = 0; i < 0x30; i++) {
+        output.push_back(emulator.ReadData(0x200 + i));
+    }
+    return Outcome{result, emulator.State().acc[0], emulator.Cycles(), output};
+}
+
+static void RequireSameOutcome(const Outcome& a, const Outcome& b) {
+    REQUIRE(a.result.reason == b.result.reason);
+    REQUIRE(a.result.pc == b.result.pc);
+    REQUIRE(a.a0 == b.a0);
+    REQUIRE(a.cycles == b.cycles);
+    REQUIRE(a.output == b.output);
+}
+
+TEST_CASE("emu_snapshot: Restore Reruns From The Snapshot", "[emu_snapshot]") {
+    for (const DispatchMode mode : {DispatchMode::Switch, DispatchMode::Block, DispatchMode::Jit}) {
+        DspEmulator emulator;
+        emulator.SetDispatchMode(mode);
+        emulator.SetJitThreshold(0);
+        for (std::uint16_t i = 0; i < 0x20; i++) {
+            emulator.WriteData(0x100 + i, i + 1);
+            emulator.WriteData(0x200 + i, 0xAAAA);
+        }
+        const std::vector<std::uint16_t> words = Assemble(filter);
+        emulator.LoadProgram(words.data(), words.size());
+        emulator.State().sp = 0x800;
+        REQUIRE(emulator.Run(5).reason == StopReason::CycleLimit);
+
+        const DspSnapshot snapshot = emulator.Snapshot();
+        const Outcome first = RunToEnd(emulator);
+        REQUIRE(first.result.reason == StopReason::Trap);
+        REQUIRE(first.output[0] != 0xAAAA);
+
+        // Again from the same point, copying back only what the run wrote, and in another
+        // emulator, which takes the whole snapshot.
+        for (int rerun = 0; rerun < 2; rerun++) {
+            emulator.Restore(snapshot);
+            REQUIRE(emulator.Cycles() == 5);
+            REQUIRE(emulator.ReadData(0x200) == 0xAAAA);
+            RequireSameOutcome(RunToEnd(emulator), first);
+        }
+        DspEmulator other;
+        other.SetDispatchMode(mode);
+        other.Restore(snapshot);
+        REQUIRE(other.ProgramSize() == words.size());
+        RequireSameOutcome(RunToEnd(other), first);
+    }
+}
+
+TEST_CASE("emu_snapshot: Restore Brings Back The Program", "[emu_snapshot]") {
+    DspEmulator emulator;
+    const std::vector<std::uint16_t> words = Assemble(filter);
+    emulator.LoadProgram(words.data(), words.size());
+    const DspSnapshot snapshot = emulator.Snapshot();
+    const Outcome first = RunToEnd(emulator);
+
+    // A write into the loop and code loaded past the end.
+    const std::vector<std::uint16_t> patch = Assemble("inc 1, a1, true");
+    emulator.WriteProgram(8, patch[0]);
+    emulator.LoadProgram(patch.data(), patch.size(), 0x500);
+    REQUIRE(emulator.ProgramSize() == 0x501);
+
+    emulator.Restore(snapshot);
+    REQUIRE(emulator.ProgramSize() == words.size());
+    REQUIRE(emulator.Program()[0x500] == 0);
+    RequireSameOutcome(RunToEnd(emulator), first);
+}
+
+TEST_CASE("emu_snapshot: Serialize", "[emu_snapshot]") {
+    DspEmulator emulator;
+    for (std::uint16_t i = 0; i < 0x20; i++) {
+        emulator.WriteData(0x100 + i, i * 7);
+    }
+    const std::vector<std::uint16_t> words = Assemble(filter);
+    emulator.LoadProgram(words.data(), words.size());
+    REQUIRE(emulator.Run(12).reason == StopReason::CycleLimit);
+    const DspSnapshot snapshot = emulator.Snapshot();
+    const Outcome first = RunToEnd(emulator);
+
+    const std::vector<unsigned char> bytes = SerializeSnapshot(snapshot);
+    // Mostly zeroed memory compresses to little.
+    REQUIRE(bytes.size() < 2048);
+    const auto loaded = DeserializeSnapshot(bytes.data(), bytes.size());
+    REQUIRE(loaded);
+    REQUIRE(loaded->cycles == 12);
+    REQUIRE(*loaded->program == words);
+
+    DspEmulator other;
+    other.Restore(*loaded);
+    RequireSameOutcome(RunToEnd(other), first);
+
+    REQUIRE(!DeserializeSnapshot(bytes.data(), bytes.size() - 1));
+    std::vector<unsigned char> other_magic = bytes;
+    other_magic[0] = 'X';
+    REQUIRE(!DeserializeSnapshot(other_magic.data(), other_magic.size()));
+
+    // Interrupt lines past the vectors, and bools other than 0 and 1. The state follows the
+    // magic and its size.
+    const size_t state_at = 8 + (sizeof(DspState) < 0x80 ? 1 : 2);
+    for (const size_t offset : {offsetof(DspState, ip), offsetof(DspState, im), offsetof(DspState, flags) + 3,
+                                offsetof(DspState, ie)}) {
+        std::vector<unsigned char> corrupt = bytes;
+        corrupt[state_at + offset] = 8;
+        REQUIRE(!DeserializeSnapshot(corrupt.data(), corrupt.size()));
+    }
+}
@@ -0,0 +1,121 @@
+#include <deque>
+
+#include <catch.hpp>
+
+#include "pacing.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("pacing: Token Bucket", "[pacing]") {
+    const TransferClock::time_point start{};
+    TokenBucket bucket{1000.0, 4.0};
+
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(bucket.Ready(start));
+        bucket.Consume(start);
+    }
+    REQUIRE(!bucket.Ready(start));
+    REQUIRE(bucket.ReadyAt(start) == start + 1ms);
+    REQUIRE(!bucket.Ready(start + 500us));
+    REQUIRE(bucket.Ready(start + 1ms));
+
+    // Never holds more than the burst, however long it idles.
+    bucket.Consume(start + 1ms);
+    size_t sent = 0;
+    while (bucket.Ready(start + 10s)) {
+        bucket.Consume(start + 10s);
+        sent++;
+    }
+    REQUIRE(sent == 4);
+}
+
+TEST_CASE("pacing: Token Bucket Debt", "[pacing]") {
+    const TransferClock::time_point start{};
+    TokenBucket bucket{1000.0, 1.0};
+
+    bucket.Consume(start);
+    bucket.Consume(start);
+    bucket.Consume(start);
+    REQUIRE(bucket.ReadyAt(start) == start + 3ms);
+}
+
+TEST_CASE("pacing: Rate Controller", "[pacing]") {
+    const TransferClock::time_point start{};
+    RateController control{1000.0};
+
+    // Slow start doubles the rate per round trip.
+    control.OnAcked(10, 10ms, true);
+    REQUIRE(control.Rate() == Approx(2000.0));
+
+    // Nothing is learned while something other than the pacer limits sending.
+    control.OnAcked(10, 10ms, false);
+    REQUIRE(control.Rate() == Approx(2000.0));
+
+    control.OnLoss(start, 10ms);
+    REQUIRE(control.Rate() == Approx(1400.0));
+    control.OnLoss(start + 5ms, 10ms);
+    REQUIRE(control.Rate() == Approx(1400.0));
+    REQUIRE(control.DecreaseCount() == 1);
+
+    // Additive increase: one round trip's worth of acks adds one datagram per round trip.
+    control.OnAcked(14, 10ms, true);
+    REQUIRE(control.Rate() == Approx(1500.0).epsilon(0.01));
+    REQUIRE(control.PeakRate() == Approx(2000.0));
+
+    for (int i = 0; i < 100; i++) {
+        control.OnLoss(start + 1s + i * 20ms, 10ms);
+    }
+    REQUIRE(control.Rate() == min_adaptive_rate);
+}
+
+// A sender paced by a RateController against a device that takes `capacity` datagrams per
+// second and drops the rest once its queue of 32 is full. Loss is noticed a round trip later.
+TEST_CASE("pacing: Converges Below Capacity", "[pacing]") {
+    const double capacity = 10000.0;
+    const auto rtt = 2ms;
+    const auto step = 10us;
+
+    RateController control{500.0};
+    TokenBucket pacer{control.Rate(), 4.0};
+    TokenBucket device{capacity, 32.0};
+
+    struct Feedback {
+        TransferClock::time_point at;
+        bool lost;
+    };
+    std::deque<Feedback> feedback;
+    size_t late_sent = 0;
+    size_t late_lost = 0;
+
+    TransferClock::time_point now{};
+    const TransferClock::time_point end = now + 10s;
+    for (; now < end; now += step) {
+        while (pacer.Ready(now)) {
+            pacer.Consume(now);
+            const bool dropped = !device.Ready(now);
+            if (!dropped) {
+                device.Consume(now);
+            }
+            feedback.push_back({now + rtt, dropped});
+            if (now > end - 5s) {
+                late_sent++;
+                late_lost += dropped;
+            }
+        }
+
+        while (!feedback.empty() && feedback.front().at <= now) {
+            if (feedback.front().lost) {
+                control.OnLoss(now, rtt);
+            } else {
+                control.OnAcked(1, rtt, true);
+            }
+            pacer.SetRate(control.Rate());
+            feedback.pop_front();
+        }
+    }
+
+    const double late_rate = (late_sent - late_lost) / 5.0;
+    REQUIRE(late_rate > 0.6 * capacity);
+    REQUIRE(late_rate <= 1.01 * capacity);
+    REQUIRE(late_lost < late_sent / 50);
+}
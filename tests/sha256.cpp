@@ -40,3 +40,39 @@ TEST_CASE("sha256: 112-Byte Input", "[sha256]") {
 
     REQUIRE(hash == expected);
 }
+
+TEST_CASE("sha256: 60-Byte Input", "[sha256]") {
+    auto hash = Sha256("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijk");
+
+    const std::array<unsigned char, 32> expected = {
+        0xb0, 0xd5, 0x82, 0xb3, 0x20, 0x31, 0xce, 0xaa,
+        0x28, 0x60, 0x6f, 0x8d, 0x86, 0xa8, 0x7e, 0xbf,
+        0x27, 0x14, 0x12, 0x17, 0x2f, 0x52, 0x3b, 0x05,
+        0xb2, 0xe7, 0x92, 0x26, 0x6d, 0xa7, 0xc8, 0x95,
+    };
+
+    REQUIRE(hash == expected);
+}
+
+TEST_CASE("sha256: Many Inputs Match Single Hashes", "[sha256]") {
+    std::vector<std::vector<unsigned char>> messages;
+    for (size_t size = 0; size < 300; size += 7) {
+        std::vector<unsigned char> message(size);
+        for (size_t i = 0; i < size; i++) {
+            message[i] = static_cast<unsigned char>(i * 7 + size);
+        }
+        messages.emplace_back(message);
+    }
+    messages.emplace_back(std::vector<unsigned char>(5000, 0xAB));
+
+    auto hashes = Sha256Many(messages);
+
+    REQUIRE(hashes.size() == messages.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        REQUIRE(hashes[i] == Sha256(messages[i]));
+    }
+}
+
+TEST_CASE("sha256: Many With No Inputs", "[sha256]") {
+    REQUIRE(Sha256Many(std::vector<Sha256Input>{}).empty());
+}
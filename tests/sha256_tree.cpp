@@ -0,0 +1,69 @@
+#include <catch.hpp>
+
+#include "sha256.h"
+#include "sha256_tree.h"
+
+static std::vector<unsigned char> MakeImage(size_t size) {
+    std::vector<unsigned char> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = static_cast<unsigned char>(i * 31 + (i >> 8));
+    }
+    return image;
+}
+
+TEST_CASE("sha256_tree: Two Leaves", "[sha256_tree]") {
+    const std::vector<unsigned char> image = MakeImage(6);
+
+    Sha256Tree tree{4};
+    tree.Build(image.data(), image.size());
+
+    const auto leaf0 = Sha256(std::vector<unsigned char>{0x00, image[0], image[1], image[2], image[3]});
+    const auto leaf1 = Sha256(std::vector<unsigned char>{0x00, image[4], image[5]});
+    std::vector<unsigned char> node{0x01};
+    node.insert(node.end(), leaf0.begin(), leaf0.end());
+    node.insert(node.end(), leaf1.begin(), leaf1.end());
+
+    REQUIRE(tree.LeafCount() == 2);
+    REQUIRE(tree.Root() == Sha256(node));
+}
+
+TEST_CASE("sha256_tree: Update Matches Rebuild", "[sha256_tree]") {
+    std::vector<unsigned char> image = MakeImage(100000);
+
+    Sha256Tree tree{256};
+    tree.Build(image.data(), image.size());
+    const auto original_root = tree.Root();
+
+    image[12345] ^= 0xFF;
+    image[12346] ^= 0xFF;
+    tree.Update(image.data(), image.size(), 12345, 2);
+
+    Sha256Tree rebuilt{256};
+    rebuilt.Build(image.data(), image.size());
+
+    REQUIRE(tree.Root() != original_root);
+    REQUIRE(tree.Root() == rebuilt.Root());
+    REQUIRE(tree.LeafHashes() == rebuilt.LeafHashes());
+}
+
+TEST_CASE("sha256_tree: Update With Size Change", "[sha256_tree]") {
+    std::vector<unsigned char> image = MakeImage(5000);
+
+    Sha256Tree tree{64};
+    tree.Build(image.data(), image.size());
+
+    image.resize(7001, 0x42);
+    tree.Update(image.data(), image.size(), 5000, 2001);
+
+    Sha256Tree grown{64};
+    grown.Build(image.data(), image.size());
+    REQUIRE(tree.Root() == grown.Root());
+
+    image.resize(130);
+    tree.Update(image.data(), image.size(), 130, 0);
+
+    Sha256Tree shrunk{64};
+    shrunk.Build(image.data(), image.size());
+    REQUIRE(tree.LeafCount() == 3);
+    REQUIRE(tree.Root() == shrunk.Root());
+}
@@ -0,0 +1,46 @@
+#include <thread>
+
+#include <catch.hpp>
+
+#include "spsc_queue.h"
+
+TEST_CASE("spsc_queue: Full And Empty", "[spsc_queue]") {
+    SpscQueue<int> queue{4};
+
+    REQUIRE(!queue.TryPop());
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(queue.TryPush(int{i}));
+    }
+    REQUIRE(!queue.TryPush(4));
+
+    REQUIRE(queue.TryPop() == 0);
+    REQUIRE(queue.TryPush(4));
+    for (int i = 1; i <= 4; i++) {
+        REQUIRE(queue.TryPop() == i);
+    }
+    REQUIRE(queue.Empty());
+}
+
+TEST_CASE("spsc_queue: Two Threads Preserve Order", "[spsc_queue]") {
+    constexpr size_t count = 1000000;
+    SpscQueue<size_t> queue{256};
+
+    std::thread producer{[&] {
+        for (size_t i = 0; i < count; i++) {
+            while (!queue.TryPush(size_t{i})) {
+                std::this_thread::yield();
+            }
+        }
+    }};
+
+    bool in_order = true;
+    for (size_t expected = 0; expected < count;) {
+        if (auto value = queue.TryPop()) {
+            in_order = in_order && *value == expected;
+            expected++;
+        }
+    }
+    producer.join();
+
+    REQUIRE(in_order);
+}
@@ -0,0 +1,57 @@
+#include <catch.hpp>
+
+#include "stage_timing.h"
+
+TEST_CASE("stage_timing: Buckets", "[stage_timing]") {
+    for (std::uint64_t value = 0; value < 32; value++) {
+        REQUIRE(LatencyHistogram::BucketLimit(LatencyHistogram::BucketOf(value)) == value);
+    }
+
+    size_t previous = 0;
+    for (std::uint64_t value = 1; value < (std::uint64_t{1} << 40); value = value * 5 / 4 + 1) {
+        const size_t bucket = LatencyHistogram::BucketOf(value);
+        REQUIRE(bucket >= previous);
+        REQUIRE(bucket < LatencyHistogram::bucket_count);
+        const std::uint64_t limit = LatencyHistogram::BucketLimit(bucket);
+        REQUIRE(limit >= value);
+        REQUIRE(limit - value <= value / 16);
+        REQUIRE(LatencyHistogram::BucketOf(limit) == bucket);
+        REQUIRE(LatencyHistogram::BucketOf(limit + 1) == bucket + 1);
+        previous = bucket;
+    }
+
+    REQUIRE(LatencyHistogram::BucketOf(~std::uint64_t{0}) == LatencyHistogram::bucket_count - 1);
+}
+
+TEST_CASE("stage_timing: Percentiles", "[stage_timing]") {
+    LatencyHistogram histogram;
+    REQUIRE(histogram.Count() == 0);
+    REQUIRE(histogram.Percentile(0.5).count() == 0);
+
+    for (int i = 1; i <= 1000; i++) {
+        histogram.Record(std::chrono::microseconds{i});
+    }
+    REQUIRE(histogram.Count() == 1000);
+    REQUIRE(histogram.Max() == std::chrono::microseconds{1000});
+    REQUIRE(histogram.Total() == std::chrono::microseconds{500500});
+
+    const auto near = [](std::chrono::nanoseconds value, std::chrono::nanoseconds expected) {
+        return value >= expected && value <= expected + expected / 16;
+    };
+    REQUIRE(near(histogram.Percentile(0.50), std::chrono::microseconds{500}));
+    REQUIRE(near(histogram.Percentile(0.90), std::chrono::microseconds{900}));
+    REQUIRE(near(histogram.Percentile(0.99), std::chrono::microseconds{990}));
+    REQUIRE(histogram.Percentile(1.0) == histogram.Max());
+}
+
+TEST_CASE("stage_timing: Timer", "[stage_timing]") {
+    StageTimings timings;
+    {
+        StageTimer timer{&timings, SenderStage::Encode};
+    }
+    {
+        StageTimer timer{nullptr, SenderStage::Encode};
+    }
+    REQUIRE(timings.Stage(SenderStage::Encode).Count() == 1);
+    REQUIRE(timings.Stage(SenderStage::Lex).Count() == 0);
+}
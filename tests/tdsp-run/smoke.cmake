@@ -0,0 +1,25 @@
+# Runs tdsp-run on the manifests here and checks its exit codes and --output file.
+# Takes TDSP_RUN, the executable, and OUTPUT, the results file to write.
+
+function(run_manifest manifest expected)
+    execute_process(COMMAND ${TDSP_RUN} --cycles 2 --output ${OUTPUT} ${CMAKE_CURRENT_LIST_DIR}/${manifest}
+                    RESULT_VARIABLE result)
+    if (NOT result EQUAL expected)
+        message(FATAL_ERROR "${manifest}: tdsp-run exited with ${result}, expected ${expected}")
+    endif()
+endfunction()
+
+run_manifest(bad.txt 1)
+run_manifest(unfinished.txt 2)
+file(REMOVE ${OUTPUT})
+run_manifest(jobs.txt 0)
+
+# "TDSPRUN1", one job "sum" that trapped after 15 cycles at 0x11 with a0 = 10, and out = 1 3 6 10.
+file(READ ${OUTPUT} results HEX)
+set(expected "5444535052554e3101037375"
+             "6d020f111400080004010306"
+             "0a")
+string(CONCAT expected ${expected})
+if (NOT results STREQUAL expected)
+    message(FATAL_ERROR "jobs.txt: wrote ${results}, expected ${expected}")
+endif()
@@ -0,0 +1 @@
+br 0, true
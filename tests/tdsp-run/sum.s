@@ -0,0 +1,15 @@
+mov 0x100, r0
+mov 0x200, r1
+mov [r0], b0 || r0+1
+add b0, a0
+mov a0l, [r1] || r1+1
+mov [r0], b0 || r0+1
+add b0, a0
+mov a0l, [r1] || r1+1
+mov [r0], b0 || r0+1
+add b0, a0
+mov a0l, [r1] || r1+1
+mov [r0], b0 || r0+1
+add b0, a0
+mov a0l, [r1] || r1+1
+trap
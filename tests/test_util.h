@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch.hpp>
+
+#include "assembler.h"
+
+// Assembles `source`, which the test requires to have no errors.
+inline AssembledProgram AssembleChecked(const std::string& source) {
+    std::istringstream stream{source};
+    AssembledProgram program = AssembleProgram(BuildParserTable(), stream);
+    REQUIRE(program.errors.empty());
+    return program;
+}
+
+inline std::vector<std::uint16_t> Assemble(const std::string& source) {
+    return AssembleChecked(source).words;
+}
+
+// An image of `size` words with no two chunks alike.
+inline std::vector<std::uint16_t> MakeImage(size_t size) {
+    std::vector<std::uint16_t> image(size);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = static_cast<std::uint16_t>(i * 0x9E37);
+    }
+    return image;
+}
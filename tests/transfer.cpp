@@ -0,0 +1,243 @@
+#include <deque>
+
+#include <catch.hpp>
+
+#include "delta_upload.h"
+#include "test_util.h"
+#include "transfer.h"
+#include "word_lz.h"
+
+struct Datagram {
+    TransferClock::time_point arrival;
+    std::vector<std::uint16_t> words;
+};
+
+// Runs a whole transfer over a simulated link with a fixed one-way delay, dropping every
+// `drop_every`-th datagram in each direction.
+static void Simulate(size_t drop_every, WindowedSender& sender, WindowedReceiver& receiver) {
+    const auto delay = std::chrono::microseconds{500};
+    TransferClock::time_point now{};
+    std::deque<Datagram> to_receiver;
+    std::deque<Datagram> to_sender;
+    size_t datagram_count = 0;
+
+    const auto drop = [&] { return drop_every != 0 && ++datagram_count % drop_every == 0; };
+
+    while (!sender.Done()) {
+        REQUIRE(now < TransferClock::time_point{} + std::chrono::seconds{60});
+
+        while (auto sequence = sender.NextToSend(now)) {
+            std::vector<std::uint16_t> message;
+            sender.EncodeForSend(*sequence, now, message);
+            if (!drop())
+                to_receiver.push_back({now + delay, message});
+        }
+
+        while (!to_receiver.empty() && to_receiver.front().arrival <= now) {
+            const auto& words = to_receiver.front().words;
+            const auto header = DecodeChunkHeader(words.data(), words.size());
+            REQUIRE(header);
+            REQUIRE(receiver.OnChunk(*header, words.data() + chunk_header_words, words.size() - chunk_header_words));
+            std::vector<std::uint16_t> ack;
+            EncodeAck(receiver.Ack(), ack);
+            if (!drop())
+                to_sender.push_back({now + delay, ack});
+            to_receiver.pop_front();
+        }
+
+        while (!to_sender.empty() && to_sender.front().arrival <= now) {
+            const auto& words = to_sender.front().words;
+            const auto ack = DecodeAck(words.data(), words.size());
+            REQUIRE(ack);
+            sender.OnAck(*ack, now);
+            to_sender.pop_front();
+        }
+
+        now += std::chrono::microseconds{100};
+    }
+}
+
+TEST_CASE("transfer: Lossless", "[transfer]") {
+    const auto image = MakeImage(100000);
+    WindowedSender sender{image.data(), image.size(), 32};
+    WindowedReceiver receiver;
+
+    Simulate(0, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Image() == image);
+    REQUIRE(sender.Stats().retransmissions == 0);
+    REQUIRE(sender.Stats().chunks_sent == ChunkCountFor(image.size()));
+}
+
+TEST_CASE("transfer: Lossy", "[transfer]") {
+    const auto image = MakeImage(100000);
+    WindowedSender sender{image.data(), image.size(), 32};
+    WindowedReceiver receiver;
+
+    Simulate(7, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Image() == image);
+    REQUIRE(sender.Stats().retransmissions > 0);
+    REQUIRE(sender.Stats().fast_retransmissions > 0);
+}
+
+TEST_CASE("transfer: Empty Image", "[transfer]") {
+    const std::vector<std::uint16_t> image;
+    WindowedSender sender{image.data(), image.size()};
+    WindowedReceiver receiver;
+
+    Simulate(0, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Image().empty());
+}
+
+TEST_CASE("transfer: Compressed", "[transfer]") {
+    std::vector<std::uint16_t> image = MakeImage(20000);
+    image.insert(image.begin() + 5000, 50000, 0x0000);
+    const auto stream = LzCompress(image.data(), image.size());
+
+    WindowedSender sender{stream.data(), stream.size(), 32};
+    sender.SetChunkFlags(chunk_flag_compressed);
+    WindowedReceiver receiver;
+    Simulate(5, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(!receiver.DecompressionFailed());
+    REQUIRE(receiver.Image() == image);
+}
+
+TEST_CASE("transfer: Same Size Uploads", "[transfer]") {
+    // Each opens with a full manifest, as ReliableUpload sends, so the second is not taken for
+    // retransmissions of the first.
+    std::vector<std::vector<std::uint16_t>> images{MakeImage(10000), MakeImage(10000)};
+    for (std::uint16_t& word : images[1]) {
+        word ^= 0x5A5A;
+    }
+    WindowedReceiver receiver;
+    for (const auto& image : images) {
+        REQUIRE(receiver.Begin(PlanUpload(MakeUploadRecord(image.data(), image.size()), std::nullopt)));
+        WindowedSender sender{image.data(), image.size(), 32};
+        Simulate(3, sender, receiver);
+
+        REQUIRE(receiver.Complete());
+        REQUIRE(receiver.Image() == image);
+        REQUIRE(receiver.Verified() == true);
+    }
+}
+
+TEST_CASE("transfer: Compressed With Manifest", "[transfer]") {
+    std::vector<std::uint16_t> image = MakeImage(5000);
+    image.insert(image.begin() + 1000, 20000, 0x0000);
+    const auto stream = LzCompress(image.data(), image.size());
+
+    WindowedReceiver receiver;
+    // The manifest describes the stream.
+    REQUIRE(receiver.Begin(PlanUpload(MakeUploadRecord(stream.data(), stream.size()), std::nullopt)));
+    WindowedSender sender{stream.data(), stream.size(), 32};
+    sender.SetChunkFlags(chunk_flag_compressed);
+    Simulate(5, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Image() == image);
+    REQUIRE(receiver.Verified() == true);
+}
+
+TEST_CASE("transfer: Ack Bitmap", "[transfer]") {
+    WindowedReceiver receiver;
+    const std::vector<std::uint16_t> payload(max_chunk_payload_words);
+
+    ChunkHeader header;
+    header.total_words = static_cast<std::uint32_t>(10 * max_chunk_payload_words);
+    for (std::uint32_t sequence : {0, 2, 3, 7}) {
+        header.sequence = sequence;
+        header.offset = static_cast<std::uint32_t>(sequence * max_chunk_payload_words);
+        REQUIRE(receiver.OnChunk(header, payload.data(), payload.size()));
+    }
+
+    const AckInfo ack = receiver.Ack();
+    REQUIRE(ack.cumulative == 1);
+    REQUIRE(ack.Selected(2));
+    REQUIRE(ack.Selected(3));
+    REQUIRE(!ack.Selected(4));
+    REQUIRE(ack.Selected(7));
+    REQUIRE(!receiver.Complete());
+}
+
+TEST_CASE("transfer: Malformed Chunks", "[transfer]") {
+    WindowedReceiver receiver;
+    const std::vector<std::uint16_t> payload(max_chunk_payload_words);
+    ChunkHeader header;
+    header.total_words = static_cast<std::uint32_t>(10 * max_chunk_payload_words);
+    REQUIRE(receiver.OnChunk(header, payload.data(), payload.size()));
+
+    // A huge total, a chunk past the end, one at the wrong offset and one cut short are all
+    // dropped without touching the upload in progress.
+    ChunkHeader huge;
+    huge.total_words = 0xFFFFFFFF;
+    ChunkHeader past = header;
+    past.total_words = static_cast<std::uint32_t>(2 * max_chunk_payload_words);
+    past.sequence = 2;
+    past.offset = static_cast<std::uint32_t>(2 * max_chunk_payload_words);
+    ChunkHeader misplaced = header;
+    misplaced.total_words = static_cast<std::uint32_t>(4 * max_chunk_payload_words);
+    misplaced.sequence = 1;
+    misplaced.offset = 1;
+    for (const ChunkHeader& bad : {huge, past, misplaced}) {
+        REQUIRE(!receiver.OnChunk(bad, payload.data(), payload.size()));
+    }
+    header.sequence = 1;
+    header.offset = static_cast<std::uint32_t>(max_chunk_payload_words);
+    REQUIRE(!receiver.OnChunk(header, payload.data(), payload.size() - 1));
+
+    REQUIRE(receiver.Ack().cumulative == 1);
+    REQUIRE(receiver.OnChunk(header, payload.data(), payload.size()));
+    REQUIRE(receiver.Ack().cumulative == 2);
+}
+
+TEST_CASE("transfer: Delta Upload", "[transfer]") {
+    auto image = MakeImage(100000);
+    WindowedSender first_sender{image.data(), image.size(), 32};
+    WindowedReceiver receiver;
+    Simulate(0, first_sender, receiver);
+    const auto previous = MakeUploadRecord(image.data(), image.size());
+
+    image[50000] ^= 0xFFFF;
+    image.resize(image.size() + 1000, 0x1234);
+    const auto manifest = PlanUpload(MakeUploadRecord(image.data(), image.size()), previous);
+    REQUIRE(manifest.flags == manifest_flag_delta);
+    REQUIRE(receiver.Begin(manifest));
+    REQUIRE(receiver.Begin(manifest));
+
+    WindowedSender sender{image.data(), image.size(), 32, manifest.changed};
+    Simulate(5, sender, receiver);
+
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Image() == image);
+    REQUIRE(receiver.Verified() == true);
+    REQUIRE(sender.Stats().chunks_sent - sender.Stats().retransmissions == 3);
+}
+
+TEST_CASE("transfer: Delta Against Wrong Image", "[transfer]") {
+    const auto image = MakeImage(10000);
+    WindowedReceiver receiver;
+
+    Manifest manifest = PlanUpload(MakeUploadRecord(image.data(), image.size()),
+                                   MakeUploadRecord(image.data(), image.size() - 1));
+    REQUIRE(!receiver.Begin(manifest));
+
+    WindowedSender sender{image.data(), image.size()};
+    Simulate(0, sender, receiver);
+    REQUIRE(!receiver.Begin(manifest));
+    Manifest huge;
+    huge.total_words = static_cast<std::uint32_t>(max_image_words + 1);
+    REQUIRE(!receiver.Begin(huge));
+    REQUIRE(receiver.Image() == image);
+
+    manifest = PlanUpload(MakeUploadRecord(image.data(), image.size()), MakeUploadRecord(image.data(), image.size()));
+    REQUIRE(receiver.Begin(manifest));
+    REQUIRE(receiver.Complete());
+    REQUIRE(receiver.Verified() == true);
+}
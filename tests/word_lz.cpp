@@ -0,0 +1,81 @@
+#include <random>
+
+#include <catch.hpp>
+
+#include "word_lz.h"
+
+static void RequireRoundTrip(const std::vector<std::uint16_t>& words) {
+    const auto stream = LzCompress(words.data(), words.size());
+    const auto decompressed = LzDecompress(stream.data(), stream.size());
+    REQUIRE(decompressed);
+    REQUIRE(*decompressed == words);
+}
+
+TEST_CASE("word_lz: Round Trip", "[word_lz]") {
+    RequireRoundTrip({});
+    RequireRoundTrip({0x1234});
+    RequireRoundTrip({0x0000, 0x0000});
+    RequireRoundTrip({1, 2, 3, 1, 2, 3, 1, 2});
+
+    std::mt19937 rng{7};
+    std::vector<std::uint16_t> noise(100000);
+    for (auto& word : noise) {
+        word = static_cast<std::uint16_t>(rng());
+    }
+    RequireRoundTrip(noise);
+
+    // Runs longer than one copy token, literal runs longer than one literal token, and repeats
+    // at the edge of the window.
+    std::vector<std::uint16_t> mixed(70000, 0x0000);
+    mixed.insert(mixed.end(), noise.begin(), noise.begin() + 40000);
+    mixed.insert(mixed.end(), noise.begin() + 5000, noise.begin() + 6000);
+    mixed.insert(mixed.end(), 5, 0xFFFF);
+    RequireRoundTrip(mixed);
+}
+
+TEST_CASE("word_lz: Compresses Runs", "[word_lz]") {
+    std::vector<std::uint16_t> program;
+    for (int routine = 0; routine < 100; routine++) {
+        for (std::uint16_t i = 0; i < 40; i++) {
+            program.push_back(static_cast<std::uint16_t>(0x86C0 + routine * 3 + i));
+        }
+        program.insert(program.end(), 24, 0x0000);
+    }
+
+    const auto stream = LzCompress(program.data(), program.size());
+    REQUIRE(stream.size() < program.size() * 3 / 4);
+
+    const std::vector<std::uint16_t> zeros(100000, 0);
+    REQUIRE(LzCompress(zeros.data(), zeros.size()).size() < 16);
+}
+
+TEST_CASE("word_lz: Malformed", "[word_lz]") {
+    const std::vector<std::uint16_t> words{1, 2, 3, 4, 5, 6, 7, 8};
+    auto stream = LzCompress(words.data(), words.size());
+
+    REQUIRE(!LzDecompress(stream.data(), 1));
+    REQUIRE(!LzDecompress(stream.data(), stream.size() - 1));
+
+    // Declared size too large.
+    stream[0]++;
+    REQUIRE(!LzDecompress(stream.data(), stream.size()));
+
+    // A copy from before the start.
+    const std::vector<std::uint16_t> bad_distance{4, 0, 0x0000, 0x1111, 0x8000, 0x0001};
+    REQUIRE(!LzDecompress(bad_distance.data(), bad_distance.size()));
+
+    // A copy with no distance word.
+    const std::vector<std::uint16_t> truncated{4, 0, 0x0000, 0x1111, 0x8000};
+    REQUIRE(!LzDecompress(truncated.data(), truncated.size()));
+
+    // A size far beyond what the tokens could produce is rejected before anything is allocated.
+    const std::vector<std::uint16_t> huge{0xFFFF, 0xFFFF, 0x0000, 0x1111};
+    REQUIRE(!LzDecompress(huge.data(), huge.size()));
+
+    // The longest copy, from a word before it.
+    constexpr std::uint16_t max_copy = 0x7FFF + 3;
+    const std::vector<std::uint16_t> longest{1 + max_copy, 0, 0x0000, 0x1111, 0xFFFF, 0x0000};
+    const auto expanded = LzDecompress(longest.data(), longest.size());
+    REQUIRE(expanded);
+    REQUIRE(*expanded == std::vector<std::uint16_t>(1 + max_copy, 0x1111));
+}